@@ -46,6 +46,7 @@
 
 int		 main(int, char *[]);
 int		 show(struct imsg *, struct parse_result *);
+void		 show_rib_bulk(u_char *, size_t, struct parse_result *);
 void		 send_filterset(struct imsgbuf *, struct filter_set_head *);
 void		 show_mrt_dump_neighbors(struct mrt_rib *, struct mrt_peer *,
 		    void *);
@@ -53,6 +54,8 @@ void		 show_mrt_dump(struct mrt_rib *, struct mrt_peer *, void *);
 void		 network_mrt_dump(struct mrt_rib *, struct mrt_peer *, void *);
 void		 show_mrt_state(struct mrt_bgp_state *, void *);
 void		 show_mrt_msg(struct mrt_bgp_msg *, void *);
+void		 show_mrt_stats(int);
+void		 stats_mrt_dump(struct mrt_rib *, struct mrt_peer *, void *);
 const char	*msg_type(u_int8_t);
 void		 network_bulk(struct parse_result *);
 int		 match_aspath(void *, u_int16_t, struct filter_as *);
@@ -60,16 +63,18 @@ int		 match_aspath(void *, u_int16_t, struct filter_as *);
 struct imsgbuf	*ibuf;
 struct mrt_parser show_mrt = { show_mrt_dump, show_mrt_state, show_mrt_msg };
 struct mrt_parser net_mrt = { network_mrt_dump, NULL, NULL };
+struct mrt_parser stats_mrt = { stats_mrt_dump, NULL, NULL };
 const struct output	*output = &show_output;
 int tableid;
 int nodescr;
+int ndjson;
 
 __dead void
 usage(void)
 {
 	extern char	*__progname;
 
-	fprintf(stderr, "usage: %s [-jn] [-s socket] command [argument ...]\n",
+	fprintf(stderr, "usage: %s [-Jjn] [-s socket] command [argument ...]\n",
 	    __progname);
 	exit(1);
 }
@@ -78,13 +83,14 @@ int
 main(int argc, char *argv[])
 {
 	struct sockaddr_un	 sun;
-	int			 fd, n, done, ch, verbose = 0;
+	int			 fd, idxfd, n, done, numdone, ch, verbose = 0;
 	struct imsg		 imsg;
 	struct network_config	 net;
 	struct parse_result	*res;
 	struct ctl_neighbor	 neighbor;
 	struct ctl_show_rib_request	ribreq;
-	char			*sockname;
+	struct trace_header	 th;
+	char			*sockname, *idxname;
 	enum imsg_type		 type;
 
 	if (pledge("stdio rpath wpath cpath unix inet dns", NULL) == -1)
@@ -94,8 +100,12 @@ main(int argc, char *argv[])
 	if (asprintf(&sockname, "%s.%d", SOCKET_NAME, tableid) == -1)
 		err(1, "asprintf");
 
-	while ((ch = getopt(argc, argv, "jns:")) != -1) {
+	while ((ch = getopt(argc, argv, "Jjns:")) != -1) {
 		switch (ch) {
+		case 'J':
+			ndjson = 1;
+			output = &json_output;
+			break;
 		case 'n':
 			if (++nodescr > 1)
 				usage();
@@ -124,9 +134,30 @@ main(int argc, char *argv[])
 
 	switch (res->action) {
 	case SHOW_MRT:
+		idxfd = -1;
+		if (res->mrtfile != NULL && (res->flags & F_CTL_INDEX ||
+		    res->addr.aid)) {
+			if (asprintf(&idxname, "%s.idx", res->mrtfile) == -1)
+				err(1, NULL);
+			if (res->flags & F_CTL_INDEX) {
+				if ((idxfd = open(idxname,
+				    O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
+					err(1, "open %s", idxname);
+			} else if ((idxfd = open(idxname, O_RDONLY)) == -1 &&
+			    errno != ENOENT)
+				warn("open %s", idxname);
+			free(idxname);
+		}
 		if (pledge("stdio", NULL) == -1)
 			err(1, "pledge");
 
+		if (res->flags & F_CTL_INDEX) {
+			if (idxfd == -1)
+				errx(1, "index requires a dump file");
+			mrt_index(res->mrtfd, idxfd, 1);
+			exit(0);
+		}
+
 		bzero(&ribreq, sizeof(ribreq));
 		if (res->as.type != AS_UNDEF)
 			ribreq.as = res->as;
@@ -140,11 +171,18 @@ main(int argc, char *argv[])
 		ribreq.flags = res->flags;
 		ribreq.validation_state = res->validation_state;
 		show_mrt.arg = &ribreq;
+		if (res->flags & F_CTL_STATS) {
+			show_mrt_stats(res->mrtfd);
+			exit(0);
+		}
 		if (res->flags & F_CTL_NEIGHBORS)
 			show_mrt.dump = show_mrt_dump_neighbors;
 		else
 			output->head(res);
-		mrt_parse(res->mrtfd, &show_mrt, 1);
+		if (idxfd == -1 || mrt_parse_indexed(res->mrtfd, idxfd,
+		    &show_mrt, &ribreq.prefix, ribreq.prefixlen, ribreq.flags,
+		    1) == -1)
+			mrt_parse(res->mrtfd, &show_mrt, 1);
 		exit(0);
 	default:
 		break;
@@ -171,6 +209,7 @@ main(int argc, char *argv[])
 		err(1, NULL);
 	imsg_init(ibuf, fd);
 	done = 0;
+	numdone = 1;
 
 	switch (res->action) {
 	case NONE:
@@ -213,9 +252,13 @@ main(int argc, char *argv[])
 	case SHOW_INTERFACE:
 		imsg_compose(ibuf, IMSG_CTL_SHOW_INTERFACE, 0, 0, -1, NULL, 0);
 		break;
+	case SHOW_RTR:
+		imsg_compose(ibuf, IMSG_CTL_SHOW_RTR, 0, 0, -1, NULL, 0);
+		break;
 	case SHOW_NEIGHBOR:
 	case SHOW_NEIGHBOR_TIMERS:
 	case SHOW_NEIGHBOR_TERSE:
+	case SHOW_NEIGHBOR_LATENCY:
 		neighbor.show_timers = (res->action == SHOW_NEIGHBOR_TIMERS);
 		if (res->peeraddr.aid || res->peerdesc[0])
 			imsg_compose(ibuf, IMSG_CTL_SHOW_NEIGHBOR, 0, 0, -1,
@@ -245,6 +288,17 @@ main(int argc, char *argv[])
 	case SHOW_RIB_MEM:
 		imsg_compose(ibuf, IMSG_CTL_SHOW_RIB_MEM, 0, 0, -1, NULL, 0);
 		break;
+	case SHOW_RIB_SUMMARY:
+		imsg_compose(ibuf, IMSG_CTL_SHOW_RIB_STATS, 0, 0, -1, NULL, 0);
+		break;
+	case SHOW_METRICS:
+		/* three requests, each terminated by its own IMSG_CTL_END */
+		output = &ometric_output;
+		numdone = 3;
+		imsg_compose(ibuf, IMSG_CTL_SHOW_NEIGHBOR, 0, 0, -1, NULL, 0);
+		imsg_compose(ibuf, IMSG_CTL_SHOW_RIB_MEM, 0, 0, -1, NULL, 0);
+		imsg_compose(ibuf, IMSG_CTL_SHOW_RIB_STATS, 0, 0, -1, NULL, 0);
+		break;
 	case RELOAD:
 		imsg_compose(ibuf, IMSG_CTL_RELOAD, 0, 0, -1,
 		    res->reason, sizeof(res->reason));
@@ -353,13 +407,33 @@ main(int argc, char *argv[])
 		printf("logging request sent.\n");
 		done = 1;
 		break;
+	case LOG_TRACE:
+		imsg_compose(ibuf, IMSG_CTL_TRACE, 0, 0, -1,
+		    &res->trace, sizeof(res->trace));
+		printf("trace request sent.\n");
+		done = 1;
+		break;
+	case LOG_TRACE_DUMP:
+		if (isatty(STDOUT_FILENO))
+			errx(1, "refusing to write binary trace to a terminal");
+		/* no head and tail output */
+		res->flags |= F_CTL_BINARY;
+		bzero(&th, sizeof(th));
+		memcpy(th.magic, TRACE_MAGIC, sizeof(th.magic));
+		th.version = TRACE_VERSION;
+		th.evsize = sizeof(struct trace_event);
+		if (fwrite(&th, sizeof(th), 1, stdout) != 1)
+			err(1, "fwrite");
+		imsg_compose(ibuf, IMSG_CTL_TRACE_DUMP, 0, 0, -1, NULL, 0);
+		break;
 	}
 
 	while (ibuf->w.queued)
 		if (msgbuf_write(&ibuf->w) <= 0 && errno != EAGAIN)
 			err(1, "write error");
 
-	output->head(res);
+	if (!(res->flags & F_CTL_BINARY))
+		output->head(res);
 
 	while (!done) {
 		if ((n = imsg_read(ibuf)) == -1 && errno != EAGAIN)
@@ -373,12 +447,14 @@ main(int argc, char *argv[])
 			if (n == 0)
 				break;
 
-			done = show(&imsg, res);
+			if (show(&imsg, res) && --numdone == 0)
+				done = 1;
 			imsg_free(&imsg);
 		}
 	}
 
-	output->tail();
+	if (!(res->flags & F_CTL_BINARY))
+		output->tail();
 
 	close(fd);
 	free(ibuf);
@@ -393,12 +469,15 @@ show(struct imsg *imsg, struct parse_result *res)
 	struct ctl_timer	*t;
 	struct ctl_show_interface	*iface;
 	struct ctl_show_nexthop	*nh;
+	struct ctl_show_rtr	*rtr;
 	struct kroute_full	*kf;
 	struct ktable		*kt;
 	struct ctl_show_rib	 rib;
 	u_char			*asdata;
 	struct rde_memstats	stats;
 	struct rde_hashstats	hash;
+	struct ctl_show_rib_stats	ribstats;
+	struct ctl_show_rib_peerstats	peerstats;
 	u_int			rescode, ilen;
 	size_t			aslen;
 
@@ -420,6 +499,12 @@ show(struct imsg *imsg, struct parse_result *res)
 		nh = imsg->data;
 		output->nexthop(nh);
 		break;
+	case IMSG_CTL_SHOW_RTR:
+		if (imsg->hdr.len < IMSG_HEADER_SIZE + sizeof(*rtr))
+			errx(1, "wrong imsg len");
+		rtr = imsg->data;
+		output->rtr(rtr);
+		break;
 	case IMSG_CTL_KROUTE:
 	case IMSG_CTL_SHOW_NETWORK:
 		if (imsg->hdr.len < IMSG_HEADER_SIZE + sizeof(*kf))
@@ -436,13 +521,21 @@ show(struct imsg *imsg, struct parse_result *res)
 	case IMSG_CTL_SHOW_RIB:
 		if (imsg->hdr.len < IMSG_HEADER_SIZE + sizeof(rib))
 			errx(1, "wrong imsg len");
+		if (res->flags & F_CTL_BINARY)
+			errx(1, "rib entry too large for bulk transfer");
 		memcpy(&rib, imsg->data, sizeof(rib));
 		aslen = imsg->hdr.len - IMSG_HEADER_SIZE - sizeof(rib);
 		asdata = imsg->data;
 		asdata += sizeof(rib);
 		output->rib(&rib, asdata, aslen, res);
 		break;
+	case IMSG_CTL_SHOW_RIB_BULK:
+		show_rib_bulk(imsg->data, imsg->hdr.len - IMSG_HEADER_SIZE,
+		    res);
+		break;
 	case IMSG_CTL_SHOW_RIB_COMMUNITIES:
+		if (res->flags & F_CTL_BINARY)
+			break;
 		ilen = imsg->hdr.len - IMSG_HEADER_SIZE;
 		if (ilen % sizeof(struct community)) {
 			warnx("bad IMSG_CTL_SHOW_RIB_COMMUNITIES received");
@@ -451,6 +544,8 @@ show(struct imsg *imsg, struct parse_result *res)
 		output->communities(imsg->data, ilen, res);
 		break;
 	case IMSG_CTL_SHOW_RIB_ATTR:
+		if (res->flags & F_CTL_BINARY)
+			break;
 		ilen = imsg->hdr.len - IMSG_HEADER_SIZE;
 		if (ilen < 3) {
 			warnx("bad IMSG_CTL_SHOW_RIB_ATTR received");
@@ -466,6 +561,22 @@ show(struct imsg *imsg, struct parse_result *res)
 		memcpy(&hash, imsg->data, sizeof(hash));
 		output->rib_hash(&hash);
 		break;
+	case IMSG_CTL_SHOW_RIB_STATS:
+		if (imsg->hdr.len < IMSG_HEADER_SIZE + sizeof(ribstats)) {
+			warnx("bad IMSG_CTL_SHOW_RIB_STATS received");
+			break;
+		}
+		memcpy(&ribstats, imsg->data, sizeof(ribstats));
+		output->rib_stats(&ribstats);
+		break;
+	case IMSG_CTL_SHOW_RIB_PEERSTATS:
+		if (imsg->hdr.len < IMSG_HEADER_SIZE + sizeof(peerstats)) {
+			warnx("bad IMSG_CTL_SHOW_RIB_PEERSTATS received");
+			break;
+		}
+		memcpy(&peerstats, imsg->data, sizeof(peerstats));
+		output->rib_peerstats(&peerstats);
+		break;
 	case IMSG_CTL_RESULT:
 		if (imsg->hdr.len != IMSG_HEADER_SIZE + sizeof(rescode)) {
 			warnx("got IMSG_CTL_RESULT with wrong len");
@@ -474,6 +585,15 @@ show(struct imsg *imsg, struct parse_result *res)
 		memcpy(&rescode, imsg->data, sizeof(rescode));
 		output->result(rescode);
 		return (1);
+	case IMSG_CTL_TRACE_DUMP:
+		ilen = imsg->hdr.len - IMSG_HEADER_SIZE;
+		if (ilen % sizeof(struct trace_event)) {
+			warnx("bad IMSG_CTL_TRACE_DUMP received");
+			break;
+		}
+		if (ilen > 0 && fwrite(imsg->data, ilen, 1, stdout) != 1)
+			err(1, "fwrite");
+		break;
 	case IMSG_CTL_END:
 		return (1);
 	default:
@@ -484,6 +604,246 @@ show(struct imsg *imsg, struct parse_result *res)
 	return (0);
 }
 
+struct bulk_reader {
+	u_char	*p;
+	size_t	 len;
+};
+
+static int
+bulk_get(struct bulk_reader *r, void *v, size_t n)
+{
+	if (r->len < n)
+		return (-1);
+	if (v != NULL)
+		memcpy(v, r->p, n);
+	r->p += n;
+	r->len -= n;
+	return (0);
+}
+
+static int
+bulk_u16(struct bulk_reader *r, u_int16_t *v)
+{
+	if (bulk_get(r, v, sizeof(*v)) == -1)
+		return (-1);
+	*v = ntohs(*v);
+	return (0);
+}
+
+static int
+bulk_u32(struct bulk_reader *r, u_int32_t *v)
+{
+	if (bulk_get(r, v, sizeof(*v)) == -1)
+		return (-1);
+	*v = ntohl(*v);
+	return (0);
+}
+
+static int
+bulk_addr(struct bulk_reader *r, struct bgpd_addr *addr)
+{
+	u_int8_t	aid;
+
+	if (bulk_get(r, &aid, sizeof(aid)) == -1)
+		return (-1);
+	bzero(addr, sizeof(*addr));
+	switch (aid) {
+	case AID_UNSPEC:
+		break;
+	case AID_INET:
+		if (bulk_get(r, &addr->v4, sizeof(addr->v4)) == -1)
+			return (-1);
+		break;
+	case AID_INET6:
+		if (bulk_get(r, &addr->v6, sizeof(addr->v6)) == -1)
+			return (-1);
+		break;
+	default:
+		if (bulk_get(r, addr, sizeof(*addr)) == -1)
+			return (-1);
+		break;
+	}
+	addr->aid = aid;
+	return (0);
+}
+
+struct bulk_peer {
+	struct bgpd_addr	addr;
+	char			descr[PEER_DESCR_LEN];
+	u_int32_t		id;	/* peer id + 1 */
+	u_int32_t		bgpid;
+};
+
+struct bulk_attr {
+	u_char			*aspath;
+	struct community	*comm;
+	u_char			*others;
+	u_int32_t		 lpref;
+	u_int32_t		 med;
+	u_int32_t		 weight;
+	u_int16_t		 aslen;
+	u_int16_t		 ncomm;
+	u_int16_t		 olen;
+	u_int8_t		 origin;
+};
+
+/*
+ * Decode one IMSG_CTL_SHOW_RIB_BULK message. Peer and attribute records
+ * are only valid inside the message that carries them.
+ */
+void
+show_rib_bulk(u_char *data, size_t len, struct parse_result *res)
+{
+	static struct bulk_attr	*attrs;
+	static size_t		 attrsz;
+	struct bulk_peer	 peers[64], *peer;
+	struct bulk_attr	*a;
+	struct bulk_reader	 r = { data, len };
+	struct ctl_show_rib	 rib;
+	u_char			*op;
+	size_t			 nattrs = 0, i, alen;
+	u_int32_t		 id, n, flags;
+	u_int16_t		 ref, pen, cnt;
+	u_int8_t		 version, type, l;
+
+	if (res->flags & F_CTL_BINARY) {
+		n = htonl(len);
+		if (fwrite(&n, sizeof(n), 1, stdout) != 1 ||
+		    fwrite(data, len, 1, stdout) != 1)
+			err(1, "fwrite");
+		return;
+	}
+
+	bzero(peers, sizeof(peers));
+	if (bulk_get(&r, &version, sizeof(version)) == -1 ||
+	    version != CTL_BULK_VERSION)
+		goto bad;
+
+	while (r.len > 0) {
+		if (bulk_get(&r, &type, sizeof(type)) == -1)
+			goto bad;
+		switch (type) {
+		case CTL_BULK_PEER:
+			if (bulk_u32(&r, &id) == -1)
+				goto bad;
+			peer = &peers[id % 64];
+			bzero(peer, sizeof(*peer));
+			peer->id = id + 1;
+			if (bulk_u32(&r, &peer->bgpid) == -1 ||
+			    bulk_addr(&r, &peer->addr) == -1 ||
+			    bulk_get(&r, &l, sizeof(l)) == -1 ||
+			    l >= sizeof(peer->descr) ||
+			    bulk_get(&r, peer->descr, l) == -1)
+				goto bad;
+			break;
+		case CTL_BULK_ATTR:
+			if (bulk_u16(&r, &ref) == -1 || ref != nattrs)
+				goto bad;
+			if (nattrs >= attrsz) {
+				a = reallocarray(attrs, attrsz + 256,
+				    sizeof(*attrs));
+				if (a == NULL)
+					err(1, NULL);
+				for (i = attrsz; i < attrsz + 256; i++)
+					a[i].comm = NULL;
+				attrs = a;
+				attrsz += 256;
+			}
+			a = &attrs[nattrs++];
+			if (bulk_get(&r, &a->origin, sizeof(a->origin)) == -1 ||
+			    bulk_u32(&r, &a->lpref) == -1 ||
+			    bulk_u32(&r, &a->med) == -1 ||
+			    bulk_u32(&r, &a->weight) == -1 ||
+			    bulk_u16(&r, &a->aslen) == -1)
+				goto bad;
+			a->aspath = r.p;
+			if (bulk_get(&r, NULL, a->aslen) == -1 ||
+			    bulk_u16(&r, &a->ncomm) == -1)
+				goto bad;
+			if ((a->comm = reallocarray(a->comm, a->ncomm + 1,
+			    sizeof(*a->comm))) == NULL)
+				err(1, NULL);
+			for (cnt = 0; cnt < a->ncomm; cnt++) {
+				if (bulk_u32(&r, &a->comm[cnt].flags) == -1 ||
+				    bulk_u32(&r, &a->comm[cnt].data1) == -1 ||
+				    bulk_u32(&r, &a->comm[cnt].data2) == -1 ||
+				    bulk_u32(&r, &a->comm[cnt].data3) == -1)
+					goto bad;
+			}
+			if (bulk_u16(&r, &a->olen) == -1)
+				goto bad;
+			a->others = r.p;
+			if (bulk_get(&r, NULL, a->olen) == -1)
+				goto bad;
+			break;
+		case CTL_BULK_PREFIX:
+			bzero(&rib, sizeof(rib));
+			if (bulk_u32(&r, &id) == -1 ||
+			    bulk_u16(&r, &ref) == -1 ||
+			    bulk_u32(&r, &flags) == -1 ||
+			    bulk_get(&r, &rib.validation_state,
+			    sizeof(rib.validation_state)) == -1 ||
+			    bulk_u32(&r, &n) == -1 ||
+			    bulk_addr(&r, &rib.prefix) == -1 ||
+			    bulk_get(&r, &rib.prefixlen,
+			    sizeof(rib.prefixlen)) == -1 ||
+			    bulk_addr(&r, &rib.exit_nexthop) == -1 ||
+			    bulk_addr(&r, &rib.true_nexthop) == -1)
+				goto bad;
+			rib.flags = flags;
+			rib.age = n;
+			if (rib.flags & F_PREF_DAMPED) {
+				if (bulk_u32(&r, &rib.damp_reuse) == -1 ||
+				    bulk_u16(&r, &pen) == -1)
+					goto bad;
+				rib.damp_penalty = pen;
+			}
+			peer = &peers[id % 64];
+			if (peer->id != id + 1 || ref >= nattrs)
+				goto bad;
+			a = &attrs[ref];
+			rib.remote_addr = peer->addr;
+			rib.remote_id = peer->bgpid;
+			strlcpy(rib.descr, peer->descr, sizeof(rib.descr));
+			rib.local_pref = a->lpref;
+			rib.med = a->med;
+			rib.weight = a->weight;
+			rib.origin = a->origin;
+
+			output->rib(&rib, a->aspath, a->aslen, res);
+			if (!(res->flags & F_CTL_DETAIL))
+				break;
+			if (a->ncomm > 0)
+				output->communities((u_char *)a->comm,
+				    a->ncomm * sizeof(*a->comm), res);
+			for (op = a->others; op < a->others + a->olen;
+			    op += alen) {
+				alen = a->others + a->olen - op;
+				if (alen < 3)
+					goto bad;
+				if (op[0] & ATTR_EXTLEN) {
+					if (alen < 4)
+						goto bad;
+					memcpy(&pen, op + 2, sizeof(pen));
+					n = 4 + ntohs(pen);
+				} else
+					n = 3 + op[2];
+				if (n > alen)
+					goto bad;
+				alen = n;
+				output->attr(op, alen, res);
+			}
+			break;
+		default:
+			goto bad;
+		}
+	}
+	return;
+
+bad:
+	warnx("bad IMSG_CTL_SHOW_RIB_BULK received");
+}
+
 char *
 fmt_peer(const char *descr, const struct bgpd_addr *remote_addr,
     int masklen)
@@ -642,7 +1002,7 @@ const char *
 fmt_flags(u_int8_t flags, int sum)
 {
 	static char buf[80];
-	char	 flagstr[5];
+	char	 flagstr[8];
 	char	*p = flagstr;
 
 	if (sum) {
@@ -654,6 +1014,8 @@ fmt_flags(u_int8_t flags, int sum)
 			*p++ = 'I';
 		if (flags & F_PREF_STALE)
 			*p++ = 'S';
+		if (flags & F_PREF_DAMPED)
+			*p++ = 'D';
 		if (flags & F_PREF_ELIGIBLE)
 			*p++ = '*';
 		if (flags & F_PREF_ACTIVE)
@@ -668,6 +1030,8 @@ fmt_flags(u_int8_t flags, int sum)
 
 		if (flags & F_PREF_STALE)
 			strlcat(buf, ", stale", sizeof(buf));
+		if (flags & F_PREF_DAMPED)
+			strlcat(buf, ", dampened", sizeof(buf));
 		if (flags & F_PREF_ELIGIBLE)
 			strlcat(buf, ", valid", sizeof(buf));
 		if (flags & F_PREF_ACTIVE)
@@ -1066,6 +1430,45 @@ show_mrt_dump_neighbors(struct mrt_rib *mr, struct mrt_peer *mp, void *arg)
 	exit(0);
 }
 
+struct mrt_stats {
+	unsigned long long	prefixes;
+	unsigned long long	entries;
+};
+
+void
+stats_mrt_dump(struct mrt_rib *mr, struct mrt_peer *mp, void *arg)
+{
+	struct mrt_stats	*st = arg;
+
+	st->prefixes++;
+	st->entries += mr->nentries;
+}
+
+/* decode the whole file without output and report the throughput */
+void
+show_mrt_stats(int fd)
+{
+	struct mrt_stats	st;
+	struct timespec		start, end;
+	double			elapsed;
+
+	bzero(&st, sizeof(st));
+	stats_mrt.arg = &st;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	mrt_parse(fd, &stats_mrt, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespecsub(&end, &start, &end);
+	elapsed = end.tv_sec + end.tv_nsec / 1000000000.0;
+	if (elapsed <= 0)
+		elapsed = 1e-9;
+
+	printf("%llu records, %llu bytes, %llu prefixes, %llu rib entries\n",
+	    stats_mrt.records, stats_mrt.bytes, st.prefixes, st.entries);
+	printf("%.3f seconds, %.0f records/s, %.3f GB/s\n", elapsed,
+	    stats_mrt.records / elapsed, stats_mrt.bytes / elapsed / 1e9);
+}
+
 void
 show_mrt_dump(struct mrt_rib *mr, struct mrt_peer *mp, void *arg)
 {
@@ -30,11 +30,15 @@ struct output {
 		    struct parse_result *);
 	void	(*rib_hash)(struct rde_hashstats *);
 	void	(*rib_mem)(struct rde_memstats *);
+	void	(*rib_stats)(struct ctl_show_rib_stats *);
+	void	(*rib_peerstats)(struct ctl_show_rib_peerstats *);
+	void	(*rtr)(struct ctl_show_rtr *);
 	void	(*result)(u_int);
 	void	(*tail)(void);
 };
 
-extern const struct output show_output, json_output;
+extern const struct output show_output, json_output, ometric_output;
+extern int ndjson;
 extern const size_t pt_sizes[];
 
 #define EOL0(flag)	((flag & F_CTL_SSV) ? ';' : '\n')
@@ -14,15 +14,22 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
 #include <err.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "json.h"
 
 #define JSON_MAX_STACK	16
+#define JSON_BUFSIZE	(64 * 1024)
 
 enum json_type {
 	NONE,
@@ -39,13 +46,121 @@ struct json_stack {
 
 char indent[JSON_MAX_STACK + 1];
 int level;
+int stream;
+int wrapped;
+
+static char	outbuf[JSON_BUFSIZE];
+static size_t	outlen;
+
+static void
+do_flush(void)
+{
+	if (outlen > 0 && fwrite(outbuf, outlen, 1, stdout) != 1)
+		err(1, "write");
+	outlen = 0;
+}
+
+static void
+do_write(const char *s, size_t len)
+{
+	if (len > sizeof(outbuf) - outlen) {
+		do_flush();
+		if (len > sizeof(outbuf)) {
+			if (fwrite(s, len, 1, stdout) != 1)
+				err(1, "write");
+			return;
+		}
+	}
+	memcpy(outbuf + outlen, s, len);
+	outlen += len;
+}
+
+static void
+do_putc(char c)
+{
+	if (outlen == sizeof(outbuf))
+		do_flush();
+	outbuf[outlen++] = c;
+}
+
+static void
+do_puts(const char *s)
+{
+	do_write(s, strlen(s));
+}
+
+static void
+do_uint(unsigned long long v)
+{
+	char	buf[20], *p = buf + sizeof(buf);
+
+	do {
+		*--p = '0' + v % 10;
+	} while ((v /= 10) != 0);
+	do_write(p, buf + sizeof(buf) - p);
+}
+
+static void
+do_escape(const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char	*start = s, *end = s + len;
+	unsigned char	 c;
+
+	for (; s < end; s++) {
+		c = *s;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		do_write(start, s - start);
+		start = s + 1;
+		do_putc('\\');
+		switch (c) {
+		case '"':
+		case '\\':
+			do_putc(c);
+			break;
+		case '\n':
+			do_putc('n');
+			break;
+		case '\t':
+			do_putc('t');
+			break;
+		default:
+			do_puts("u00");
+			do_putc(hex[c >> 4]);
+			do_putc(hex[c & 0xf]);
+			break;
+		}
+	}
+	do_write(start, s - start);
+}
+
+static int
+do_toplevel_array(void)
+{
+	return (stream && level == 1 && stack[level].type == ARRAY);
+}
 
 static void
 do_comma_indent(void)
 {
+	if (stream) {
+		/* top-level members other than arrays share one line */
+		if (level == 0 && !wrapped) {
+			do_putc('{');
+			stack[0].count = 0;
+			wrapped = 1;
+		}
+		/* elements of top-level arrays are separate lines */
+		if (!do_toplevel_array() && stack[level].count > 0)
+			do_putc(',');
+		stack[level].count++;
+		return;
+	}
 	if (stack[level].count++ > 0)
-		printf(",\n");
-	printf("\t%.*s", level, indent);
+		do_write(",\n", 2);
+	do_putc('\t');
+	do_write(indent, level);
 }
 
 static void
@@ -53,7 +168,28 @@ do_name(const char *name)
 {
 	if (stack[level].type == ARRAY)
 		return;
-	printf("\"%s\": ", name);
+	do_putc('"');
+	do_puts(name);
+	if (stream)
+		do_write("\":", 2);
+	else
+		do_write("\": ", 3);
+}
+
+static void
+do_unwrap(void)
+{
+	if (wrapped) {
+		do_write("}\n", 2);
+		wrapped = 0;
+	}
+}
+
+static void
+do_value_done(void)
+{
+	if (do_toplevel_array())
+		do_putc('\n');
 }
 
 static int
@@ -70,15 +206,23 @@ do_find(enum json_type type, const char *name)
 	return -1;
 }
 
+/*
+ * In stream mode the output is newline delimited JSON: every element of
+ * a top-level array is printed as a line of its own and everything else
+ * on the top level is collected into one object per line.
+ */
 void
-json_do_start(void)
+json_do_start(int ndjson)
 {
 	memset(indent, '\t', JSON_MAX_STACK);
 	memset(stack, 0, sizeof(stack));
 	level = 0;
 	stack[level].type = START;
+	stream = ndjson;
+	wrapped = 0;
 
-	printf("{\n");
+	if (!stream)
+		do_write("{\n", 2);
 }
 
 void
@@ -86,7 +230,11 @@ json_do_finish(void)
 {
 	while (level > 0)
 		json_do_end();
-	printf("\n}\n");
+	if (stream)
+		do_unwrap();
+	else
+		do_write("\n}\n", 3);
+	do_flush();
 }
 
 void
@@ -104,13 +252,20 @@ json_do_array(const char *name)
 	if (stack[level].type == ARRAY)
 		json_do_end();
 
-	do_comma_indent();
-	do_name(name);
-	printf("[\n");
+	if (stream && level == 0)
+		do_unwrap();
+	else {
+		do_comma_indent();
+		do_name(name);
+		if (stream)
+			do_putc('[');
+		else
+			do_write("[\n", 2);
+	}
 
 	if (++level >= JSON_MAX_STACK)
 		errx(1, "json stack too deep");
-	
+
 	stack[level].name = name;
 	stack[level].type = ARRAY;
 	stack[level].count = 0;
@@ -129,11 +284,14 @@ json_do_object(const char *name)
 
 	do_comma_indent();
 	do_name(name);
-	printf("{\n");
+	if (stream)
+		do_putc('{');
+	else
+		do_write("{\n", 2);
 
 	if (++level >= JSON_MAX_STACK)
 		errx(1, "json stack too deep");
-	
+
 	stack[level].name = name;
 	stack[level].type = OBJECT;
 	stack[level].count = 0;
@@ -142,13 +300,16 @@ json_do_object(const char *name)
 void
 json_do_end(void)
 {
-	if (stack[level].type == ARRAY)
-		printf("\n%.*s]", level, indent);
-	else if (stack[level].type == OBJECT)
-		printf("\n%.*s}", level, indent);
-	else
+	if (stack[level].type != ARRAY && stack[level].type != OBJECT)
 		errx(1, "json bad stack state");
 
+	if (!stream) {
+		do_putc('\n');
+		do_write(indent, level);
+	}
+	if (!do_toplevel_array())
+		do_putc(stack[level].type == ARRAY ? ']' : '}');
+
 	stack[level].name = NULL;
 	stack[level].type = NONE;
 	stack[level].count = 0;
@@ -157,35 +318,121 @@ json_do_end(void)
 		errx(1, "json stack underflow");
 
 	stack[level].count++;
+	if (do_toplevel_array()) {
+		/* one complete line, hand it out */
+		do_putc('\n');
+		if (outlen > sizeof(outbuf) / 2)
+			do_flush();
+	}
 }
 
 void
 json_do_printf(const char *name, const char *fmt, ...)
 {
+	char	*buf;
 	va_list ap;
+	int	len;
+
+	va_start(ap, fmt);
+	len = vasprintf(&buf, fmt, ap);
+	va_end(ap);
+	if (len == -1)
+		err(1, "json_do_printf");
+
+	do_comma_indent();
+	do_name(name);
+	do_putc('"');
+	do_escape(buf, len);
+	do_putc('"');
+	do_value_done();
+	free(buf);
+}
 
+void
+json_do_string(const char *name, const char *v)
+{
 	do_comma_indent();
+	do_name(name);
+	do_putc('"');
+	do_escape(v, strlen(v));
+	do_putc('"');
+	do_value_done();
+}
 
+/*
+ * Build a string value in place. Between json_do_string_begin() and
+ * json_do_string_end() only the json_str_*() functions may be called.
+ */
+void
+json_do_string_begin(const char *name)
+{
+	do_comma_indent();
 	do_name(name);
-	printf("\"");
-	va_start(ap, fmt);
-	vprintf(fmt, ap);
-	va_end(ap);
-	printf("\"");
+	do_putc('"');
+}
+
+void
+json_do_string_end(void)
+{
+	do_putc('"');
+	do_value_done();
+}
+
+void
+json_str_cat(const char *s)
+{
+	do_escape(s, strlen(s));
+}
+
+void
+json_str_char(char c)
+{
+	do_escape(&c, 1);
+}
+
+void
+json_str_uint(unsigned long long v)
+{
+	do_uint(v);
+}
+
+void
+json_str_inet(int af, const void *addr)
+{
+	const uint8_t	*a = addr;
+	char		 buf[INET6_ADDRSTRLEN];
+	int		 i;
+
+	if (af == AF_INET) {
+		for (i = 0; i < 4; i++) {
+			if (i > 0)
+				do_putc('.');
+			do_uint(a[i]);
+		}
+		return;
+	}
+	if (inet_ntop(af, addr, buf, sizeof(buf)) == NULL)
+		do_putc('?');
+	else
+		do_puts(buf);
 }
 
 void
 json_do_hexdump(const char *name, void *buf, size_t len)
 {
+	static const char hex[] = "0123456789abcdef";
 	uint8_t *data = buf;
 	size_t i;
 
 	do_comma_indent();
 	do_name(name);
-	printf("\"");
-	for (i=0; i < len; i++)
-		printf("%02x", *(data+i));
-	printf("\"");
+	do_putc('"');
+	for (i = 0; i < len; i++) {
+		do_putc(hex[data[i] >> 4]);
+		do_putc(hex[data[i] & 0xf]);
+	}
+	do_putc('"');
+	do_value_done();
 }
 
 void
@@ -194,9 +441,10 @@ json_do_bool(const char *name, int v)
 	do_comma_indent();
 	do_name(name);
 	if (v)
-		printf("true");
+		do_write("true", 4);
 	else
-		printf("false");
+		do_write("false", 5);
+	do_value_done();
 }
 
 void
@@ -204,7 +452,8 @@ json_do_uint(const char *name, unsigned long long v)
 {
 	do_comma_indent();
 	do_name(name);
-	printf("%llu", v);
+	do_uint(v);
+	do_value_done();
 }
 
 void
@@ -212,13 +461,25 @@ json_do_int(const char *name, long long v)
 {
 	do_comma_indent();
 	do_name(name);
-	printf("%lld", v);
+	if (v < 0) {
+		do_putc('-');
+		do_uint(-(unsigned long long)v);
+	} else
+		do_uint(v);
+	do_value_done();
 }
 
 void
 json_do_double(const char *name, double v)
 {
+	char	buf[64];
+	int	len;
+
 	do_comma_indent();
 	do_name(name);
-	printf("%f", v);
+	len = snprintf(buf, sizeof(buf), "%f", v);
+	if (len < 0 || (size_t)len >= sizeof(buf))
+		err(1, "json_do_double");
+	do_write(buf, len);
+	do_value_done();
 }
@@ -17,13 +17,20 @@
 #include <stdarg.h>
 #include <sys/cdefs.h>
 
-void json_do_start(void);
+void json_do_start(int);
 void json_do_finish(void);
 void json_do_array(const char *);
 void json_do_object(const char *);
 void json_do_end(void);
 void json_do_printf(const char *, const char *, ...)
 	__attribute__((__format__ (printf, 2, 3)));
+void json_do_string(const char *, const char *);
+void json_do_string_begin(const char *);
+void json_do_string_end(void);
+void json_str_cat(const char *);
+void json_str_char(char);
+void json_str_uint(unsigned long long);
+void json_str_inet(int, const void *);
 void json_do_hexdump(const char *, void *, size_t);
 void json_do_bool(const char *, int);
 void json_do_uint(const char *, unsigned long long);
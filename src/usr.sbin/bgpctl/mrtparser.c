@@ -15,11 +15,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <err.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -29,7 +32,17 @@
 #include "mrt.h"
 #include "mrtparser.h"
 
-void	*mrt_read_msg(int, struct mrt_hdr *);
+struct mrt_input {
+	u_char	*map;		/* mapped file or NULL */
+	size_t	 size;
+	size_t	 off;
+	void	*buf;		/* record buffer if not mapped */
+	size_t	 bufsize;
+	struct timespec	 mtime;
+	int	 fd;
+};
+
+void	*mrt_read_msg(struct mrt_input *, struct mrt_hdr *);
 size_t	 mrt_read_buf(int, void *, size_t);
 
 struct mrt_peer	*mrt_parse_v2_peer(struct mrt_hdr *, void *);
@@ -40,13 +53,15 @@ int	mrt_parse_dump_mp(struct mrt_hdr *, void *, struct mrt_peer **,
 	    struct mrt_rib **, int);
 int	mrt_extract_attr(struct mrt_rib_entry *, u_char *, int, u_int8_t,
 	    int);
+static struct mrt_rib		*mrt_rib_get(void);
+static struct mrt_rib_entry	*mrt_rib_entries(struct mrt_rib *, u_int16_t);
 
 void	mrt_free_peers(struct mrt_peer *);
-void	mrt_free_rib(struct mrt_rib *);
+void	mrt_free_rib(void);
 void	mrt_free_bgp_state(struct mrt_bgp_state *);
 void	mrt_free_bgp_msg(struct mrt_bgp_msg *);
 
-u_char *mrt_aspath_inflate(void *, u_int16_t, u_int16_t *);
+int	mrt_aspath_inflate(struct mrt_rib_entry *, void *, u_int16_t);
 int	mrt_extract_addr(void *, u_int, struct bgpd_addr *, u_int8_t);
 int	mrt_extract_prefix(void *, u_int, u_int8_t, struct bgpd_addr *,
 	    u_int8_t *, int);
@@ -54,23 +69,43 @@ int	mrt_extract_prefix(void *, u_int, u_int8_t, struct bgpd_addr *,
 struct mrt_bgp_state	*mrt_parse_state(struct mrt_hdr *, void *, int);
 struct mrt_bgp_msg	*mrt_parse_msg(struct mrt_hdr *, void *, int);
 
+/*
+ * Return the next record. The record is only valid until the next call,
+ * it either points into the mapped file or into a reused buffer.
+ */
 void *
-mrt_read_msg(int fd, struct mrt_hdr *hdr)
+mrt_read_msg(struct mrt_input *in, struct mrt_hdr *hdr)
 {
-	void *buf;
+	void	*buf;
+	size_t	 len;
 
 	bzero(hdr, sizeof(*hdr));
-	if (mrt_read_buf(fd, hdr, sizeof(*hdr)) != sizeof(*hdr))
+	if (in->map != NULL) {
+		if (in->off > in->size || in->size - in->off < sizeof(*hdr))
+			return (NULL);
+		memcpy(hdr, in->map + in->off, sizeof(*hdr));
+		len = ntohl(hdr->length);
+		if (in->size - in->off - sizeof(*hdr) < len)
+			return (NULL);
+		buf = in->map + in->off + sizeof(*hdr);
+		in->off += sizeof(*hdr) + len;
+		return (buf);
+	}
+
+	if (mrt_read_buf(in->fd, hdr, sizeof(*hdr)) != sizeof(*hdr))
 		return (NULL);
 
-	if ((buf = malloc(ntohl(hdr->length))) == NULL)
-		err(1, "malloc(%d)", hdr->length);
+	len = ntohl(hdr->length);
+	if (in->buf == NULL || len > in->bufsize) {
+		if ((buf = realloc(in->buf, len > 4096 ? len : 4096)) == NULL)
+			err(1, "realloc(%zu)", len);
+		in->buf = buf;
+		in->bufsize = len > 4096 ? len : 4096;
+	}
 
-	if (mrt_read_buf(fd, buf, ntohl(hdr->length)) != ntohl(hdr->length)) {
-		free(buf);
+	if (mrt_read_buf(in->fd, in->buf, len) != len)
 		return (NULL);
-	}
-	return (buf);
+	return (in->buf);
 }
 
 size_t
@@ -94,139 +129,173 @@ mrt_read_buf(int fd, void *buf, size_t len)
 	return (b - (char *)buf);
 }
 
-void
-mrt_parse(int fd, struct mrt_parser *p, int verbose)
+static int
+mrt_input_map(struct mrt_input *in, int fd)
+{
+	struct stat	st;
+
+	bzero(in, sizeof(*in));
+	in->fd = fd;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+	    (uintmax_t)st.st_size > SIZE_MAX)
+		return (-1);
+	in->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (in->map == MAP_FAILED) {
+		in->map = NULL;
+		return (-1);
+	}
+	in->size = st.st_size;
+	in->mtime = st.st_mtim;
+	return (0);
+}
+
+static void
+mrt_input_unmap(struct mrt_input *in)
+{
+	if (in->map != NULL)
+		munmap(in->map, in->size);
+	free(in->buf);
+}
+
+static void
+mrt_dispatch(struct mrt_hdr *h, void *msg, struct mrt_peer **pctx,
+    struct mrt_parser *p, int verbose)
 {
-	struct mrt_hdr		h;
-	struct mrt_peer		*pctx = NULL;
 	struct mrt_rib		*r;
 	struct mrt_bgp_state	*s;
 	struct mrt_bgp_msg	*m;
-	void			*msg;
 
-	while ((msg = mrt_read_msg(fd, &h))) {
-		switch (ntohs(h.type)) {
-		case MSG_NULL:
-		case MSG_START:
-		case MSG_DIE:
-		case MSG_I_AM_DEAD:
-		case MSG_PEER_DOWN:
-		case MSG_PROTOCOL_BGP:
-		case MSG_PROTOCOL_IDRP:
-		case MSG_PROTOCOL_BGP4PLUS:
-		case MSG_PROTOCOL_BGP4PLUS1:
-			if (verbose)
-				printf("deprecated MRT type %d\n",
-				    ntohs(h.type));
+	p->records++;
+	p->bytes += sizeof(*h) + ntohl(h->length);
+	switch (ntohs(h->type)) {
+	case MSG_NULL:
+	case MSG_START:
+	case MSG_DIE:
+	case MSG_I_AM_DEAD:
+	case MSG_PEER_DOWN:
+	case MSG_PROTOCOL_BGP:
+	case MSG_PROTOCOL_IDRP:
+	case MSG_PROTOCOL_BGP4PLUS:
+	case MSG_PROTOCOL_BGP4PLUS1:
+		if (verbose)
+			printf("deprecated MRT type %d\n",
+			    ntohs(h->type));
+		break;
+	case MSG_PROTOCOL_RIP:
+	case MSG_PROTOCOL_RIPNG:
+	case MSG_PROTOCOL_OSPF:
+	case MSG_PROTOCOL_ISIS_ET:
+	case MSG_PROTOCOL_ISIS:
+	case MSG_PROTOCOL_OSPFV3_ET:
+	case MSG_PROTOCOL_OSPFV3:
+		if (verbose)
+			printf("unsuported MRT type %d\n",
+			    ntohs(h->type));
+		break;
+	case MSG_TABLE_DUMP:
+		switch (ntohs(h->subtype)) {
+		case MRT_DUMP_AFI_IP:
+		case MRT_DUMP_AFI_IPv6:
+			if (p->dump == NULL)
+				break;
+			if (mrt_parse_dump(h, msg, pctx, &r) == 0 && p->dump)
+				p->dump(r, *pctx, p->arg);
 			break;
-		case MSG_PROTOCOL_RIP:
-		case MSG_PROTOCOL_RIPNG:
-		case MSG_PROTOCOL_OSPF:
-		case MSG_PROTOCOL_ISIS_ET:
-		case MSG_PROTOCOL_ISIS:
-		case MSG_PROTOCOL_OSPFV3_ET:
-		case MSG_PROTOCOL_OSPFV3:
+		default:
 			if (verbose)
-				printf("unsuported MRT type %d\n",
-				    ntohs(h.type));
+				printf("unknown AFI %d in table dump\n",
+				    ntohs(h->subtype));
 			break;
-		case MSG_TABLE_DUMP:
-			switch (ntohs(h.subtype)) {
-			case MRT_DUMP_AFI_IP:
-			case MRT_DUMP_AFI_IPv6:
-				if (p->dump == NULL)
-					break;
-				if (mrt_parse_dump(&h, msg, &pctx, &r) == 0) {
-					if (p->dump)
-						p->dump(r, pctx, p->arg);
-					mrt_free_rib(r);
-				}
+		}
+		break;
+	case MSG_TABLE_DUMP_V2:
+		switch (ntohs(h->subtype)) {
+		case MRT_DUMP_V2_PEER_INDEX_TABLE:
+			if (p->dump == NULL)
 				break;
-			default:
-				if (verbose)
-					printf("unknown AFI %d in table dump\n",
-					    ntohs(h.subtype));
+			if (*pctx)
+				mrt_free_peers(*pctx);
+			*pctx = mrt_parse_v2_peer(h, msg);
+			break;
+		case MRT_DUMP_V2_RIB_IPV4_UNICAST:
+		case MRT_DUMP_V2_RIB_IPV4_MULTICAST:
+		case MRT_DUMP_V2_RIB_IPV6_UNICAST:
+		case MRT_DUMP_V2_RIB_IPV6_MULTICAST:
+		case MRT_DUMP_V2_RIB_GENERIC:
+			if (p->dump == NULL)
 				break;
+			r = mrt_parse_v2_rib(h, msg, verbose);
+			if (r && p->dump)
+				p->dump(r, *pctx, p->arg);
+			break;
+		default:
+			if (verbose)
+				printf("unhandled DUMP_V2 subtype %d\n",
+				    ntohs(h->subtype));
+			break;
+		}
+		break;
+	case MSG_PROTOCOL_BGP4MP_ET:
+	case MSG_PROTOCOL_BGP4MP:
+		switch (ntohs(h->subtype)) {
+		case BGP4MP_STATE_CHANGE:
+		case BGP4MP_STATE_CHANGE_AS4:
+			if ((s = mrt_parse_state(h, msg, verbose))) {
+				if (p->state)
+					p->state(s, p->arg);
+				free(s);
 			}
 			break;
-		case MSG_TABLE_DUMP_V2:
-			switch (ntohs(h.subtype)) {
-			case MRT_DUMP_V2_PEER_INDEX_TABLE:
-				if (p->dump == NULL)
-					break;
-				if (pctx)
-					mrt_free_peers(pctx);
-				pctx = mrt_parse_v2_peer(&h, msg);
-				break;
-			case MRT_DUMP_V2_RIB_IPV4_UNICAST:
-			case MRT_DUMP_V2_RIB_IPV4_MULTICAST:
-			case MRT_DUMP_V2_RIB_IPV6_UNICAST:
-			case MRT_DUMP_V2_RIB_IPV6_MULTICAST:
-			case MRT_DUMP_V2_RIB_GENERIC:
-				if (p->dump == NULL)
-					break;
-				r = mrt_parse_v2_rib(&h, msg, verbose);
-				if (r) {
-					if (p->dump)
-						p->dump(r, pctx, p->arg);
-					mrt_free_rib(r);
-				}
-				break;
-			default:
-				if (verbose)
-					printf("unhandled DUMP_V2 subtype %d\n",
-					    ntohs(h.subtype));
-				break;
+		case BGP4MP_MESSAGE:
+		case BGP4MP_MESSAGE_AS4:
+		case BGP4MP_MESSAGE_LOCAL:
+		case BGP4MP_MESSAGE_AS4_LOCAL:
+			if ((m = mrt_parse_msg(h, msg, verbose))) {
+				if (p->message)
+					p->message(m, p->arg);
+				free(m->msg);
+				free(m);
 			}
 			break;
-		case MSG_PROTOCOL_BGP4MP_ET:
-		case MSG_PROTOCOL_BGP4MP:
-			switch (ntohs(h.subtype)) {
-			case BGP4MP_STATE_CHANGE:
-			case BGP4MP_STATE_CHANGE_AS4:
-				if ((s = mrt_parse_state(&h, msg, verbose))) {
-					if (p->state)
-						p->state(s, p->arg);
-					free(s);
-				}
-				break;
-			case BGP4MP_MESSAGE:
-			case BGP4MP_MESSAGE_AS4:
-			case BGP4MP_MESSAGE_LOCAL:
-			case BGP4MP_MESSAGE_AS4_LOCAL:
-				if ((m = mrt_parse_msg(&h, msg, verbose))) {
-					if (p->message)
-						p->message(m, p->arg);
-					free(m->msg);
-					free(m);
-				}
-				break;
-			case BGP4MP_ENTRY:
-				if (p->dump == NULL)
-					break;
-				if (mrt_parse_dump_mp(&h, msg, &pctx, &r,
-				    verbose) == 0) {
-					if (p->dump)
-						p->dump(r, pctx, p->arg);
-					mrt_free_rib(r);
-				}
+		case BGP4MP_ENTRY:
+			if (p->dump == NULL)
 				break;
-			default:
-				if (verbose)
-					printf("unhandled BGP4MP subtype %d\n",
-					    ntohs(h.subtype));
-				break;
-			}
+			if (mrt_parse_dump_mp(h, msg, pctx, &r,
+			    verbose) == 0 && p->dump)
+				p->dump(r, *pctx, p->arg);
 			break;
 		default:
 			if (verbose)
-				printf("unknown MRT type %d\n", ntohs(h.type));
+				printf("unhandled BGP4MP subtype %d\n",
+				    ntohs(h->subtype));
 			break;
 		}
-		free(msg);
+		break;
+	default:
+		if (verbose)
+			printf("unknown MRT type %d\n", ntohs(h->type));
+		break;
 	}
+}
+
+void
+mrt_parse(int fd, struct mrt_parser *p, int verbose)
+{
+	struct mrt_hdr		 h;
+	struct mrt_peer		*pctx = NULL;
+	struct mrt_input	 in;
+	void			*msg;
+
+	/* map regular files and decode the records in place */
+	if (mrt_input_map(&in, fd) == 0)
+		madvise(in.map, in.size, MADV_SEQUENTIAL);
+
+	while ((msg = mrt_read_msg(&in, &h)))
+		mrt_dispatch(&h, msg, &pctx, p, verbose);
 	if (pctx)
 		mrt_free_peers(pctx);
+	mrt_free_rib();
+	mrt_input_unmap(&in);
 }
 
 static int
@@ -358,7 +427,7 @@ fail:
 struct mrt_rib *
 mrt_parse_v2_rib(struct mrt_hdr *hdr, void *msg, int verbose)
 {
-	struct mrt_rib_entry *entries = NULL;
+	struct mrt_rib_entry *entries;
 	struct mrt_rib	*r;
 	u_int8_t	*b = msg;
 	u_int		len = ntohl(hdr->length);
@@ -370,9 +439,7 @@ mrt_parse_v2_rib(struct mrt_hdr *hdr, void *msg, int verbose)
 	if (len < sizeof(snum) + 1)
 		return NULL;
 
-	r = calloc(1, sizeof(struct mrt_rib));
-	if (r == NULL)
-		err(1, "calloc");
+	r = mrt_rib_get();
 
 	/* seq_num */
 	memcpy(&snum, b, sizeof(snum));
@@ -431,11 +498,9 @@ mrt_parse_v2_rib(struct mrt_hdr *hdr, void *msg, int verbose)
 	b += sizeof(cnt);
 	len -= sizeof(cnt);
 	cnt = ntohs(cnt);
-	r->nentries = cnt;
 
 	/* entries */
-	if ((entries = calloc(cnt, sizeof(struct mrt_rib_entry))) == NULL)
-		err(1, "calloc");
+	entries = mrt_rib_entries(r, cnt);
 	for (i = 0; i < cnt; i++) {
 		u_int32_t	otm;
 		u_int16_t	pix, alen;
@@ -468,11 +533,8 @@ mrt_parse_v2_rib(struct mrt_hdr *hdr, void *msg, int verbose)
 		b += alen;
 		len -= alen;
 	}
-	r->entries = entries;
 	return (r);
 fail:
-	mrt_free_rib(r);
-	free(entries);
 	return (NULL);
 }
 
@@ -498,14 +560,8 @@ mrt_parse_dump(struct mrt_hdr *hdr, void *msg, struct mrt_peer **pp,
 	}
 	p = *pp;
 
-	*rp = r = calloc(1, sizeof(struct mrt_rib));
-	if (r == NULL)
-		err(1, "calloc");
-	re = calloc(1, sizeof(struct mrt_rib_entry));
-	if (re == NULL)
-		err(1, "calloc");
-	r->nentries = 1;
-	r->entries = re;
+	*rp = r = mrt_rib_get();
+	re = mrt_rib_entries(r, 1);
 
 	if (len < 2 * sizeof(u_int16_t))
 		goto fail;
@@ -579,7 +635,6 @@ mrt_parse_dump(struct mrt_hdr *hdr, void *msg, struct mrt_peer **pp,
 
 	return (0);
 fail:
-	mrt_free_rib(r);
 	return (-1);
 }
 
@@ -613,14 +668,8 @@ mrt_parse_dump_mp(struct mrt_hdr *hdr, void *msg, struct mrt_peer **pp,
 	}
 	p = *pp;
 
-	*rp = r = calloc(1, sizeof(struct mrt_rib));
-	if (r == NULL)
-		err(1, "calloc");
-	re = calloc(1, sizeof(struct mrt_rib_entry));
-	if (re == NULL)
-		err(1, "calloc");
-	r->nentries = 1;
-	r->entries = re;
+	*rp = r = mrt_rib_get();
+	re = mrt_rib_entries(r, 1);
 
 	if (len < 4 * sizeof(u_int16_t))
 		goto fail;
@@ -728,7 +777,6 @@ mrt_parse_dump_mp(struct mrt_hdr *hdr, void *msg, struct mrt_peer **pp,
 
 	return (0);
 fail:
-	mrt_free_rib(r);
 	return (-1);
 }
 
@@ -737,6 +785,7 @@ mrt_extract_attr(struct mrt_rib_entry *re, u_char *a, int alen, u_int8_t aid,
     int as4)
 {
 	struct mrt_attr	*ap;
+	size_t		n;
 	u_int32_t	tmp;
 	u_int16_t	attr_len;
 	u_int8_t	type, flags, *attr;
@@ -769,16 +818,11 @@ mrt_extract_attr(struct mrt_rib_entry *re, u_char *a, int alen, u_int8_t aid,
 			break;
 		case MRT_ATTR_ASPATH:
 			if (as4) {
+				/* points into the record like the attrs */
 				re->aspath_len = attr_len;
-				if ((re->aspath = malloc(attr_len)) == NULL)
-					err(1, "malloc");
-				memcpy(re->aspath, a, attr_len);
-			} else {
-				re->aspath = mrt_aspath_inflate(a, attr_len,
-				    &re->aspath_len);
-				if (re->aspath == NULL)
-					return (-1);
-			}
+				re->aspath = a;
+			} else if (mrt_aspath_inflate(re, a, attr_len) == -1)
+				return (-1);
 			break;
 		case MRT_ATTR_NEXTHOP:
 			if (attr_len != 4)
@@ -848,28 +892,27 @@ mrt_extract_attr(struct mrt_rib_entry *re, u_char *a, int alen, u_int8_t aid,
 			break;
 		case MRT_ATTR_AS4PATH:
 			if (!as4) {
-				free(re->aspath);
 				re->aspath_len = attr_len;
-				if ((re->aspath = malloc(attr_len)) == NULL)
-					err(1, "malloc");
-				memcpy(re->aspath, a, attr_len);
+				re->aspath = a;
 				break;
 			}
 			/* FALLTHROUGH */
 		default:
-			re->nattrs++;
-			if (re->nattrs >= UCHAR_MAX)
+			if (re->nattrs + 1 >= UCHAR_MAX)
 				err(1, "too many attributes");
-			ap = reallocarray(re->attrs,
-			    re->nattrs, sizeof(struct mrt_attr));
-			if (ap == NULL)
-				err(1, "realloc");
-			re->attrs = ap;
-			ap = re->attrs + re->nattrs - 1;
+			if (re->nattrs == re->attrs_size) {
+				n = re->attrs_size ? re->attrs_size * 2 : 8;
+				ap = reallocarray(re->attrs, n,
+				    sizeof(struct mrt_attr));
+				if (ap == NULL)
+					err(1, "realloc");
+				re->attrs = ap;
+				re->attrs_size = n;
+			}
+			ap = re->attrs + re->nattrs++;
+			/* points into the record, valid during the callback */
 			ap->attr_len = a + attr_len - attr;
-			if ((ap->attr = malloc(ap->attr_len)) == NULL)
-				err(1, "malloc");
-			memcpy(ap->attr, attr, ap->attr_len);
+			ap->attr = attr;
 			break;
 		}
 		a += attr_len;
@@ -887,20 +930,62 @@ mrt_free_peers(struct mrt_peer *p)
 	free(p);
 }
 
-void
-mrt_free_rib(struct mrt_rib *r)
+/*
+ * The rib records are decoded into the same buffers over and over, the
+ * result is only valid until the next record is parsed.
+ */
+static struct mrt_rib		 mrt_rib_buf;
+static struct mrt_rib_entry	*mrt_entries;
+static u_int16_t		 mrt_entries_max;
+
+static struct mrt_rib *
+mrt_rib_get(void)
 {
-	u_int16_t	i, j;
+	memset(&mrt_rib_buf, 0, sizeof(mrt_rib_buf));
+	mrt_rib_buf.entries = mrt_entries;
+	return (&mrt_rib_buf);
+}
 
-	for (i = 0; i < r->nentries && r->entries; i++) {
-		for (j = 0; j < r->entries[i].nattrs; j++)
-			 free(r->entries[i].attrs[j].attr);
-		free(r->entries[i].attrs);
-		free(r->entries[i].aspath);
+static struct mrt_rib_entry *
+mrt_rib_entries(struct mrt_rib *r, u_int16_t cnt)
+{
+	struct mrt_rib_entry	*re, keep;
+	u_int16_t		 i;
+
+	if (cnt > mrt_entries_max) {
+		if ((re = reallocarray(mrt_entries, cnt, sizeof(*re))) == NULL)
+			err(1, "realloc");
+		memset(re + mrt_entries_max, 0,
+		    (cnt - mrt_entries_max) * sizeof(*re));
+		mrt_entries = re;
+		mrt_entries_max = cnt;
 	}
+	for (i = 0; i < cnt; i++) {
+		re = &mrt_entries[i];
+		keep = *re;
+		memset(re, 0, sizeof(*re));
+		re->attrs = keep.attrs;
+		re->attrs_size = keep.attrs_size;
+		re->aspath_buf = keep.aspath_buf;
+		re->aspath_size = keep.aspath_size;
+	}
+	r->entries = mrt_entries;
+	r->nentries = cnt;
+	return (mrt_entries);
+}
+
+void
+mrt_free_rib(void)
+{
+	u_int16_t	i;
 
-	free(r->entries);
-	free(r);
+	for (i = 0; i < mrt_entries_max; i++) {
+		free(mrt_entries[i].attrs);
+		free(mrt_entries[i].aspath_buf);
+	}
+	free(mrt_entries);
+	mrt_entries = NULL;
+	mrt_entries_max = 0;
 }
 
 void
@@ -916,8 +1001,9 @@ mrt_free_bgp_msg(struct mrt_bgp_msg *m)
 	free(m);
 }
 
-u_char *
-mrt_aspath_inflate(void *data, u_int16_t len, u_int16_t *newlen)
+/* convert a 2-byte AS path into the aspath buffer of re */
+int
+mrt_aspath_inflate(struct mrt_rib_entry *re, void *data, u_int16_t len)
 {
 	u_int8_t	*seg, *nseg, *ndata;
 	u_int16_t	 seg_size, olen, nlen;
@@ -932,12 +1018,18 @@ mrt_aspath_inflate(void *data, u_int16_t len, u_int16_t *newlen)
 		nlen += 2 + sizeof(u_int32_t) * seg_len;
 
 		if (seg_size > olen)
-			return NULL;
+			return (-1);
 	}
 
-	*newlen = nlen;
-	if ((ndata = malloc(nlen)) == NULL)
-		err(1, "malloc");
+	if (nlen > re->aspath_size) {
+		if ((ndata = realloc(re->aspath_buf, nlen)) == NULL)
+			err(1, "realloc");
+		re->aspath_buf = ndata;
+		re->aspath_size = nlen;
+	}
+	ndata = re->aspath_buf;
+	re->aspath = ndata;
+	re->aspath_len = nlen;
 
 	/* then copy the aspath */
 	seg = data;
@@ -952,7 +1044,7 @@ mrt_aspath_inflate(void *data, u_int16_t len, u_int16_t *newlen)
 		}
 	}
 
-	return (ndata);
+	return (0);
 }
 
 int
@@ -1238,3 +1330,293 @@ fail:
 	free(m);
 	return (NULL);
 }
+
+static void
+mrt_index_key(struct mrt_index_entry *e, struct bgpd_addr *prefix,
+    u_int8_t prefixlen)
+{
+	struct in_addr	ina;
+	struct in6_addr	in6;
+
+	e->aid = prefix->aid;
+	e->prefixlen = prefixlen;
+	memset(e->addr, 0, sizeof(e->addr));
+	switch (prefix->aid) {
+	case AID_INET:
+		inet4applymask(&ina, &prefix->v4, prefixlen);
+		memcpy(e->addr, &ina, sizeof(ina));
+		break;
+	case AID_INET6:
+		inet6applymask(&in6, &prefix->v6, prefixlen);
+		memcpy(e->addr, &in6, sizeof(in6));
+		break;
+	default:
+		/* other families are not indexed */
+		e->aid = AID_UNSPEC;
+		e->prefixlen = 0;
+		break;
+	}
+}
+
+static int
+mrt_index_keycmp(const struct mrt_index_entry *a,
+    const struct mrt_index_entry *b)
+{
+	int	r;
+
+	if (a->aid != b->aid)
+		return (a->aid < b->aid ? -1 : 1);
+	if ((r = memcmp(a->addr, b->addr, sizeof(a->addr))) != 0)
+		return (r);
+	if (a->prefixlen != b->prefixlen)
+		return (a->prefixlen < b->prefixlen ? -1 : 1);
+	return (0);
+}
+
+static int
+mrt_index_cmp(const void *va, const void *vb)
+{
+	const struct mrt_index_entry	*a = va, *b = vb;
+	int				 r;
+
+	if ((r = mrt_index_keycmp(a, b)) != 0)
+		return (r);
+	if (a->offset != b->offset)
+		return (a->offset < b->offset ? -1 : 1);
+	return (0);
+}
+
+static int
+mrt_offset_cmp(const void *va, const void *vb)
+{
+	const struct mrt_index_entry	*a = *(struct mrt_index_entry **)va;
+	const struct mrt_index_entry	*b = *(struct mrt_index_entry **)vb;
+
+	if (a->offset != b->offset)
+		return (a->offset < b->offset ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Build the sidecar index for the dump in fd and write it to idxfd.
+ * Records that are not table dump entries of an IP family are stored
+ * without a key so that lookups always replay them.
+ */
+void
+mrt_index(int fd, int idxfd, int verbose)
+{
+	struct mrt_index_hdr	 ih;
+	struct mrt_index_entry	*ie = NULL, *e;
+	struct mrt_input	 in;
+	struct mrt_hdr		 h;
+	struct mrt_peer		*pctx = NULL;
+	struct mrt_rib		*r;
+	u_int64_t		 off, peeroff = MRT_INDEX_NOPEER;
+	size_t			 cnt = 0, max = 0;
+	void			*msg, *newp;
+
+	if (mrt_input_map(&in, fd) == -1)
+		errx(1, "mrt index: dump is not a regular file");
+	madvise(in.map, in.size, MADV_SEQUENTIAL);
+
+	for (off = in.off; (msg = mrt_read_msg(&in, &h)) != NULL;
+	    off = in.off) {
+		r = NULL;
+		switch (ntohs(h.type)) {
+		case MSG_TABLE_DUMP:
+			if (mrt_parse_dump(&h, msg, &pctx, &r) == -1)
+				r = NULL;
+			break;
+		case MSG_TABLE_DUMP_V2:
+			switch (ntohs(h.subtype)) {
+			case MRT_DUMP_V2_PEER_INDEX_TABLE:
+				/* replayed on demand via peeroff */
+				peeroff = off;
+				continue;
+			case MRT_DUMP_V2_RIB_IPV4_UNICAST:
+			case MRT_DUMP_V2_RIB_IPV4_MULTICAST:
+			case MRT_DUMP_V2_RIB_IPV6_UNICAST:
+			case MRT_DUMP_V2_RIB_IPV6_MULTICAST:
+			case MRT_DUMP_V2_RIB_GENERIC:
+				r = mrt_parse_v2_rib(&h, msg, verbose);
+				break;
+			}
+			break;
+		case MSG_PROTOCOL_BGP4MP_ET:
+		case MSG_PROTOCOL_BGP4MP:
+			if (ntohs(h.subtype) == BGP4MP_ENTRY &&
+			    mrt_parse_dump_mp(&h, msg, &pctx, &r,
+			    verbose) == -1)
+				r = NULL;
+			break;
+		}
+
+		if (cnt >= max) {
+			max = max ? max * 2 : 1024;
+			if ((newp = reallocarray(ie, max, sizeof(*ie))) ==
+			    NULL)
+				err(1, "mrt index");
+			ie = newp;
+		}
+		e = &ie[cnt++];
+		bzero(e, sizeof(*e));
+		e->offset = off;
+		e->peeroff = peeroff;
+		e->timestamp = ntohl(h.timestamp);
+		if (r != NULL)
+			mrt_index_key(e, &r->prefix, r->prefixlen);
+	}
+	if (pctx)
+		mrt_free_peers(pctx);
+	mrt_free_rib();
+	if (cnt > UINT32_MAX)
+		errx(1, "mrt index: too many records");
+
+	qsort(ie, cnt, sizeof(*ie), mrt_index_cmp);
+
+	bzero(&ih, sizeof(ih));
+	memcpy(ih.magic, MRT_INDEX_MAGIC, sizeof(ih.magic));
+	ih.version = MRT_INDEX_VERSION;
+	ih.count = cnt;
+	ih.filesize = in.size;
+	ih.mtime_sec = in.mtime.tv_sec;
+	ih.mtime_nsec = in.mtime.tv_nsec;
+	if (write(idxfd, &ih, sizeof(ih)) != sizeof(ih) ||
+	    (cnt > 0 && write(idxfd, ie, cnt * sizeof(*ie)) !=
+	    (ssize_t)(cnt * sizeof(*ie))))
+		err(1, "mrt index: write");
+
+	if (verbose)
+		printf("indexed %zu records\n", cnt);
+	free(ie);
+	mrt_input_unmap(&in);
+}
+
+/* first entry with a key not less than k */
+static size_t
+mrt_index_lookup(struct mrt_index_entry *ie, size_t cnt,
+    struct mrt_index_entry *k)
+{
+	size_t	lo = 0, hi = cnt, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (mrt_index_keycmp(&ie[mid], k) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+static void
+mrt_index_addr(struct mrt_index_entry *e, struct bgpd_addr *a)
+{
+	bzero(a, sizeof(*a));
+	a->aid = e->aid;
+	if (e->aid == AID_INET)
+		memcpy(&a->v4, e->addr, sizeof(a->v4));
+	else
+		memcpy(&a->v6, e->addr, sizeof(a->v6));
+}
+
+/*
+ * Replay only the records matching prefix using the sidecar index in
+ * idxfd. The callbacks still do the final filtering. Returns -1 without
+ * calling any callback if the index can not be used.
+ */
+int
+mrt_parse_indexed(int fd, int idxfd, struct mrt_parser *p,
+    struct bgpd_addr *prefix, u_int8_t prefixlen, int flags, int verbose)
+{
+	struct mrt_index_hdr	 ih;
+	struct mrt_index_entry	*ie, **match, k;
+	struct mrt_input	 in;
+	struct mrt_hdr		 h;
+	struct mrt_peer		*pctx = NULL;
+	struct bgpd_addr	 a;
+	struct stat		 st;
+	u_int64_t		 peeroff = MRT_INDEX_NOPEER;
+	size_t			 cnt, i, n = 0;
+	void			*map, *msg;
+	int			 l;
+
+	if (prefix->aid != AID_INET && prefix->aid != AID_INET6)
+		return (-1);
+	if (fstat(idxfd, &st) == -1 || (size_t)st.st_size < sizeof(ih))
+		return (-1);
+	if (mrt_input_map(&in, fd) == -1)
+		return (-1);
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, idxfd, 0);
+	if (map == MAP_FAILED) {
+		mrt_input_unmap(&in);
+		return (-1);
+	}
+	memcpy(&ih, map, sizeof(ih));
+	if (memcmp(ih.magic, MRT_INDEX_MAGIC, sizeof(ih.magic)) != 0 ||
+	    ih.version != MRT_INDEX_VERSION || ih.filesize != in.size ||
+	    ih.mtime_sec != in.mtime.tv_sec ||
+	    ih.mtime_nsec != in.mtime.tv_nsec ||
+	    (size_t)st.st_size != sizeof(ih) +
+	    (size_t)ih.count * sizeof(*ie)) {
+		warnx("mrt index out of date, ignored");
+		munmap(map, st.st_size);
+		mrt_input_unmap(&in);
+		return (-1);
+	}
+	ie = (struct mrt_index_entry *)((char *)map + sizeof(ih));
+	cnt = ih.count;
+
+	if ((match = calloc(cnt ? cnt : 1, sizeof(*match))) == NULL)
+		err(1, NULL);
+
+	/* unkeyed records sort first and are always replayed */
+	for (i = 0; i < cnt && ie[i].aid == AID_UNSPEC; i++)
+		match[n++] = &ie[i];
+
+	if (flags & F_LONGER) {
+		/* all more specifics are stored right after the prefix */
+		mrt_index_key(&k, prefix, prefixlen);
+		for (i = mrt_index_lookup(ie, cnt, &k); i < cnt; i++) {
+			if (ie[i].aid != k.aid)
+				break;
+			mrt_index_addr(&ie[i], &a);
+			if (prefix_compare(prefix, &a, prefixlen) != 0)
+				break;
+			if (ie[i].prefixlen >= prefixlen)
+				match[n++] = &ie[i];
+		}
+	} else {
+		/* exact match or, with F_SHORTER, all covering prefixes */
+		for (l = (flags & F_SHORTER) ? 0 : prefixlen; l <= prefixlen;
+		    l++) {
+			mrt_index_key(&k, prefix, l);
+			for (i = mrt_index_lookup(ie, cnt, &k);
+			    i < cnt && mrt_index_keycmp(&ie[i], &k) == 0; i++)
+				match[n++] = &ie[i];
+		}
+	}
+
+	/* replay in file order, loading the right peer table first */
+	qsort(match, n, sizeof(*match), mrt_offset_cmp);
+	for (i = 0; i < n; i++) {
+		if (match[i]->peeroff != peeroff &&
+		    match[i]->peeroff != MRT_INDEX_NOPEER) {
+			peeroff = match[i]->peeroff;
+			in.off = peeroff;
+			if ((msg = mrt_read_msg(&in, &h)) != NULL)
+				mrt_dispatch(&h, msg, &pctx, p, verbose);
+		}
+		in.off = match[i]->offset;
+		if ((msg = mrt_read_msg(&in, &h)) != NULL)
+			mrt_dispatch(&h, msg, &pctx, p, verbose);
+	}
+
+	if (pctx)
+		mrt_free_peers(pctx);
+	mrt_free_rib();
+	free(match);
+	munmap(map, st.st_size);
+	mrt_input_unmap(&in);
+	return (0);
+}
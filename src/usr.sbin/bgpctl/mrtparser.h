@@ -47,6 +47,10 @@ struct mrt_rib_entry {
 	u_int16_t	 aspath_len;
 	u_int16_t	 nattrs;
 	u_int8_t	 origin;
+	/* buffers kept for the next record */
+	void		*aspath_buf;
+	size_t		 aspath_size;
+	size_t		 attrs_size;
 };
 
 struct mrt_rib {
@@ -94,6 +98,39 @@ struct mrt_parser {
 	void	(*state)(struct mrt_bgp_state *, void *);
 	void	(*message)(struct mrt_bgp_msg *, void *);
 	void	*arg;
+	unsigned long long	records;	/* records read */
+	unsigned long long	bytes;		/* bytes read */
+};
+
+/*
+ * Sidecar index of table dump records, sorted by prefix. The index is
+ * stored in host byte order and is tied to the size and modification
+ * time of the dump file.
+ */
+#define MRT_INDEX_MAGIC		"BGPMRTIX"
+#define MRT_INDEX_VERSION	2
+#define MRT_INDEX_NOPEER	((u_int64_t)-1)
+
+struct mrt_index_hdr {
+	char		magic[8];
+	u_int32_t	version;
+	u_int32_t	count;
+	u_int64_t	filesize;
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+};
+
+struct mrt_index_entry {
+	u_int64_t	offset;		/* record offset in the dump */
+	u_int64_t	peeroff;	/* offset of the PEER_INDEX_TABLE */
+	u_int32_t	timestamp;
+	u_int8_t	aid;		/* AID_UNSPEC if not indexed */
+	u_int8_t	prefixlen;
+	u_int16_t	pad;
+	u_int8_t	addr[16];
 };
 
 void	mrt_parse(int, struct mrt_parser *, int);
+void	mrt_index(int, int, int);
+int	mrt_parse_indexed(int, int, struct mrt_parser *, struct bgpd_addr *,
+	    u_int8_t, int, int);
@@ -0,0 +1,268 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ometric.h"
+
+/*
+ * Minimal OpenMetrics text exposition. The samples of a metric family
+ * need to be printed together, since the data arrives one object at a
+ * time everything is collected first and printed by ometric_output_all().
+ */
+
+struct olabels {
+	char	*str;		/* rendered 'key="value",...' */
+};
+
+struct ometric_sample {
+	STAILQ_ENTRY(ometric_sample)	 entry;
+	const char			*suffix;
+	char				*labels;
+	union {
+		uint64_t	i;
+		double		f;
+	}				 value;
+	int				 isfloat;
+};
+
+struct ometric {
+	STAILQ_ENTRY(ometric)		 entry;
+	STAILQ_HEAD(, ometric_sample)	 samples;
+	const char			*name;
+	const char			*help;
+	enum ometric_type		 type;
+};
+
+static STAILQ_HEAD(, ometric) ometrics = STAILQ_HEAD_INITIALIZER(ometrics);
+
+static const char * const type_names[] = {
+	[OMT_UNKNOWN] = "unknown",
+	[OMT_GAUGE] = "gauge",
+	[OMT_COUNTER] = "counter",
+	[OMT_STATESET] = "stateset",
+	[OMT_HISTOGRAM] = "histogram",
+};
+
+struct ometric *
+ometric_new(enum ometric_type type, const char *name, const char *help)
+{
+	struct ometric	*om;
+
+	if ((om = calloc(1, sizeof(*om))) == NULL)
+		err(1, NULL);
+	om->name = name;
+	om->help = help;
+	om->type = type;
+	STAILQ_INIT(&om->samples);
+	STAILQ_INSERT_TAIL(&ometrics, om, entry);
+	return (om);
+}
+
+void
+ometric_free_all(void)
+{
+	struct ometric		*om;
+	struct ometric_sample	*os;
+
+	while ((om = STAILQ_FIRST(&ometrics)) != NULL) {
+		STAILQ_REMOVE_HEAD(&ometrics, entry);
+		while ((os = STAILQ_FIRST(&om->samples)) != NULL) {
+			STAILQ_REMOVE_HEAD(&om->samples, entry);
+			free(os->labels);
+			free(os);
+		}
+		free(om);
+	}
+}
+
+/* append key="value" to *s, escaping the value as required */
+static void
+olabel_cat(char **s, const char *key, const char *value)
+{
+	char	*n, *esc, *e;
+
+	if ((esc = malloc(strlen(value) * 2 + 1)) == NULL)
+		err(1, NULL);
+	for (e = esc; *value != '\0'; value++) {
+		switch (*value) {
+		case '\\':
+		case '"':
+			*e++ = '\\';
+			*e++ = *value;
+			break;
+		case '\n':
+			*e++ = '\\';
+			*e++ = 'n';
+			break;
+		default:
+			*e++ = *value;
+			break;
+		}
+	}
+	*e = '\0';
+
+	if (asprintf(&n, "%s%s%s=\"%s\"", *s ? *s : "", *s ? "," : "",
+	    key, esc) == -1)
+		err(1, NULL);
+	free(esc);
+	free(*s);
+	*s = n;
+}
+
+/* keys is a NULL terminated array, values needs the same number of entries */
+struct olabels *
+olabels_new(const char * const *keys, const char * const *values)
+{
+	struct olabels	*ol;
+
+	if ((ol = calloc(1, sizeof(*ol))) == NULL)
+		err(1, NULL);
+	for (; *keys != NULL; keys++, values++)
+		olabel_cat(&ol->str, *keys, *values != NULL ? *values : "");
+	return (ol);
+}
+
+void
+olabels_free(struct olabels *ol)
+{
+	if (ol == NULL)
+		return;
+	free(ol->str);
+	free(ol);
+}
+
+static struct ometric_sample *
+ometric_sample(struct ometric *om, const char *key, const char *value,
+    struct olabels *ol)
+{
+	struct ometric_sample	*os;
+
+	if ((os = calloc(1, sizeof(*os))) == NULL)
+		err(1, NULL);
+	if (ol != NULL && ol->str != NULL)
+		if ((os->labels = strdup(ol->str)) == NULL)
+			err(1, NULL);
+	if (key != NULL)
+		olabel_cat(&os->labels, key, value);
+	STAILQ_INSERT_TAIL(&om->samples, os, entry);
+	return (os);
+}
+
+void
+ometric_set_int(struct ometric *om, uint64_t val, struct olabels *ol)
+{
+	ometric_sample(om, NULL, NULL, ol)->value.i = val;
+}
+
+void
+ometric_set_float(struct ometric *om, double val, struct olabels *ol)
+{
+	struct ometric_sample	*os;
+
+	os = ometric_sample(om, NULL, NULL, ol);
+	os->value.f = val;
+	os->isfloat = 1;
+}
+
+void
+ometric_set_int_with_label(struct ometric *om, uint64_t val, const char *key,
+    const char *value, struct olabels *ol)
+{
+	ometric_sample(om, key, value, ol)->value.i = val;
+}
+
+/* set one sample per state, the current state is 1 all others 0 */
+void
+ometric_set_state(struct ometric *om, const char * const *states,
+    const char *state, struct olabels *ol)
+{
+	for (; *states != NULL; states++)
+		ometric_set_int_with_label(om, strcmp(*states, state) == 0,
+		    om->name, *states, ol);
+}
+
+/*
+ * Add a histogram from the per bucket counts in buckets, bounds holds the
+ * upper bound of all but the last bucket which is +Inf.
+ */
+void
+ometric_set_histogram(struct ometric *om, const uint64_t *buckets,
+    const double *bounds, size_t n, double sum, struct olabels *ol)
+{
+	struct ometric_sample	*os;
+	char			 le[32];
+	uint64_t		 cnt = 0;
+	size_t			 i;
+
+	for (i = 0; i < n; i++) {
+		cnt += buckets[i];
+		if (i == n - 1)
+			strlcpy(le, "+Inf", sizeof(le));
+		else
+			snprintf(le, sizeof(le), "%g", bounds[i]);
+		os = ometric_sample(om, "le", le, ol);
+		os->suffix = "_bucket";
+		os->value.i = cnt;
+	}
+	os = ometric_sample(om, NULL, NULL, ol);
+	os->suffix = "_count";
+	os->value.i = cnt;
+	os = ometric_sample(om, NULL, NULL, ol);
+	os->suffix = "_sum";
+	os->value.f = sum;
+	os->isfloat = 1;
+}
+
+int
+ometric_output_all(FILE *out)
+{
+	struct ometric		*om;
+	struct ometric_sample	*os;
+	const char		*suffix;
+
+	STAILQ_FOREACH(om, &ometrics, entry) {
+		if (STAILQ_EMPTY(&om->samples))
+			continue;
+		if (fprintf(out, "# HELP %s %s\n", om->name, om->help) < 0)
+			return (-1);
+		if (fprintf(out, "# TYPE %s %s\n", om->name,
+		    type_names[om->type]) < 0)
+			return (-1);
+		suffix = om->type == OMT_COUNTER ? "_total" : "";
+		STAILQ_FOREACH(os, &om->samples, entry) {
+			if (fprintf(out, "%s%s", om->name,
+			    os->suffix != NULL ? os->suffix : suffix) < 0)
+				return (-1);
+			if (os->labels != NULL &&
+			    fprintf(out, "{%s}", os->labels) < 0)
+				return (-1);
+			if (os->isfloat) {
+				if (fprintf(out, " %.6f\n", os->value.f) < 0)
+					return (-1);
+			} else if (fprintf(out, " %llu\n",
+			    (unsigned long long)os->value.i) < 0)
+				return (-1);
+		}
+	}
+	if (fprintf(out, "# EOF\n") < 0)
+		return (-1);
+	return (0);
+}
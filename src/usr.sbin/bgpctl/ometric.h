@@ -0,0 +1,45 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum ometric_type {
+	OMT_UNKNOWN,
+	OMT_GAUGE,
+	OMT_COUNTER,
+	OMT_STATESET,
+	OMT_HISTOGRAM,
+};
+
+struct ometric;
+struct olabels;
+
+struct ometric	*ometric_new(enum ometric_type, const char *, const char *);
+void		 ometric_free_all(void);
+struct olabels	*olabels_new(const char * const *, const char * const *);
+void		 olabels_free(struct olabels *);
+
+int	ometric_output_all(FILE *);
+
+void	ometric_set_int(struct ometric *, uint64_t, struct olabels *);
+void	ometric_set_float(struct ometric *, double, struct olabels *);
+void	ometric_set_int_with_label(struct ometric *, uint64_t, const char *,
+	    const char *, struct olabels *);
+void	ometric_set_state(struct ometric *, const char * const *,
+	    const char *, struct olabels *);
+void	ometric_set_histogram(struct ometric *, const uint64_t *,
+	    const double *, size_t, double, struct olabels *);
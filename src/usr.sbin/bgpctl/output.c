@@ -68,7 +68,7 @@ show_head(struct parse_result *res)
 			break;
 		printf("flags: "
 		    "* = Valid, > = Selected, I = via IBGP, A = Announced,\n"
-		    "       S = Stale, E = Error\n");
+		    "       S = Stale, E = Error, D = Dampened\n");
 		printf("origin validation state: "
 		    "N = not-found, V = valid, ! = invalid\n");
 		printf("origin: i = IGP, e = EGP, ? = Incomplete\n\n");
@@ -76,6 +76,11 @@ show_head(struct parse_result *res)
 		    "flags", "ovs", "destination", "gateway", "lpref", "med",
 		    "aspath origin");
 		break;
+	case SHOW_RIB_SUMMARY:
+		printf("%-16s %-14s %10s %10s %10s %9s %9s %9s\n", "RIB",
+		    "Family", "Prefixes", "Active", "Eligible", "Valid",
+		    "Invalid", "NotFound");
+		break;
 	case NETWORK_SHOW:
 		printf("flags: S = Static\n");
 		printf("flags prio destination          gateway\n");
@@ -195,8 +200,29 @@ show_neighbor_msgstats(struct peer *p)
 	    p->stats.prefix_sent_update, p->stats.prefix_rcvd_update);
 	printf("  %-15s %10llu %10llu\n", "Withdraws",
 	    p->stats.prefix_sent_withdraw, p->stats.prefix_rcvd_withdraw);
-	printf("  %-15s %10llu %10llu\n", "End-of-Rib",
+	printf("  %-15s %10llu %10llu\n\n", "End-of-Rib",
 	    p->stats.prefix_sent_eor, p->stats.prefix_rcvd_eor);
+	if (p->conf.mrai)
+		printf("  Outbound queue, advertisement interval %us:\n",
+		    p->conf.mrai);
+	else
+		printf("  Outbound queue:\n");
+	printf("  %-15s %10u\n", "Updates", p->stats.pending_update);
+	printf("  %-15s %10u\n", "Withdraws", p->stats.pending_withdraw);
+	printf("  %-15s %10u\n", "Credit used", p->stats.pending_credit);
+	printf("  %-15s %10llu\n", "Suppressed", p->stats.prefix_suppressed);
+	printf("  %-15s %10u\n", "Dampened", p->stats.prefix_damp_cnt);
+	printf("  %-15s %10llu\n", "Damp absorbed",
+	    p->stats.prefix_damp_absorbed);
+	printf("  %-15s %10u/s\n", "Drain rate", p->stats.drain_rate);
+	if (p->stats.pending_update + p->stats.pending_withdraw == 0)
+		printf("  %-15s %10u\n", "Time to drain", 0);
+	else if (p->stats.drain_rate == 0)
+		printf("  %-15s %10s\n", "Time to drain", "-");
+	else
+		printf("  %-15s %10us\n", "Time to drain",
+		    (p->stats.pending_update + p->stats.pending_withdraw) /
+		    p->stats.drain_rate);
 }
 
 static void
@@ -320,6 +346,70 @@ show_neighbor_full(struct peer *p, struct parse_result *res)
 	}
 }
 
+static const char *
+fmt_usec(u_int64_t us)
+{
+	static char	buf[16];
+
+	if (us < 1000)
+		snprintf(buf, sizeof(buf), "%lluus", (unsigned long long)us);
+	else if (us < 1000000)
+		snprintf(buf, sizeof(buf), "%.1fms", us / 1000.0);
+	else
+		snprintf(buf, sizeof(buf), "%.1fs", us / 1000000.0);
+	return (buf);
+}
+
+/* upper bound of the bucket holding the q quantile */
+static const char *
+fmt_latency_quantile(struct latency_hist *h, double q)
+{
+	static char	buf[16];
+	u_int64_t	cnt = 0;
+	int		i;
+
+	for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+		cnt += h->bucket[i];
+		if (cnt >= q * h->count)
+			break;
+	}
+	if (i == LATENCY_BUCKETS - 1)
+		snprintf(buf, sizeof(buf), ">%s", fmt_usec(8ULL << (i - 1)));
+	else
+		snprintf(buf, sizeof(buf), "<%s", fmt_usec(8ULL << i));
+	return (buf);
+}
+
+static void
+show_neighbor_latency(struct peer *p)
+{
+	struct latency_hist	*h;
+	char			*s;
+	int			 i;
+
+	s = fmt_peer(p->conf.descr, &p->conf.remote_addr,
+	    p->conf.remote_masklen);
+	printf("BGP neighbor %s, 1 in %d UPDATEs sampled\n", s,
+	    LATENCY_SAMPLE);
+	free(s);
+	printf("  %-10s %10s %10s %10s %10s %10s\n", "Stage", "Samples",
+	    "Avg", "p50", "p90", "p99");
+	for (i = 0; i < LAT_MAX; i++) {
+		h = &p->stats.latency[i];
+		printf("  %-10s %10llu ", latency_stages[i],
+		    (unsigned long long)h->count);
+		if (h->count == 0) {
+			printf("%10s %10s %10s %10s\n", "-", "-", "-", "-");
+			continue;
+		}
+		printf("%10s ", fmt_usec(h->sum / h->count));
+		printf("%10s ", fmt_latency_quantile(h, 0.5));
+		printf("%10s ", fmt_latency_quantile(h, 0.9));
+		printf("%10s\n", fmt_latency_quantile(h, 0.99));
+	}
+	printf("\n");
+}
+
 static void
 show_neighbor(struct peer *p, struct parse_result *res)
 {
@@ -341,6 +431,10 @@ show_neighbor(struct peer *p, struct parse_result *res)
 	case SHOW_NEIGHBOR_TIMERS:
 		show_neighbor_full(p, res);
 		break;
+	case SHOW_NEIGHBOR_LATENCY:
+		if (!p->conf.template)
+			show_neighbor_latency(p);
+		break;
 	case SHOW_NEIGHBOR_TERSE:
 		s = fmt_peer(NULL, &p->conf.remote_addr,
 		    p->conf.remote_masklen);
@@ -400,6 +494,29 @@ show_fib_table(struct ktable *kt)
 	    kt->fib_sync != kt->fib_conf ? "*" : "");
 }
 
+static void
+show_rtr(struct ctl_show_rtr *rtr)
+{
+	printf("RTR cache %s port %u", log_addr(&rtr->remote_addr),
+	    rtr->remote_port);
+	if (rtr->descr[0])
+		printf(" (%s)", rtr->descr);
+	printf("\n  State: %s, protocol version %u\n", rtr->state,
+	    rtr->version);
+	if (rtr->have_serial)
+		printf("  Session ID: %u, Serial: %u\n", rtr->session_id,
+		    rtr->serial);
+	printf("  VRPs: %u IPv4, %u IPv6\n", rtr->vrp_v4, rtr->vrp_v6);
+	if (rtr->last_update >= 0)
+		printf("  Last update: %s ago, took %u ms, %u updates\n",
+		    fmt_timeframe(rtr->last_update), rtr->update_ms,
+		    rtr->updates);
+	else
+		printf("  Last update: never\n");
+	printf("  Refresh: %us, Retry: %us, Expire: %us\n\n", rtr->refresh,
+	    rtr->retry, rtr->expire);
+}
+
 static void
 show_nexthop(struct ctl_show_nexthop *nh)
 {
@@ -872,6 +989,13 @@ show_rib_detail(struct ctl_show_rib *r, u_char *asdata, size_t aslen,
 
 	printf("%c    Last update: %s ago%c", EOL0(flag0),
 	    fmt_timeframe(r->age), EOL0(flag0));
+	if (r->damp_penalty) {
+		printf("    Damping penalty %u", r->damp_penalty);
+		if (r->flags & F_PREF_DAMPED)
+			printf(", reuse in %s",
+			    fmt_timeframe(r->damp_reuse));
+		printf("%c", EOL0(flag0));
+	}
 }
 
 static void
@@ -932,12 +1056,17 @@ show_rib_mem(struct rde_memstats *stats)
 	    fmt_mem(stats->aset_size));
 	printf("%10lld prefix-set elements using %s of memory\n",
 	    stats->pset_cnt, fmt_mem(stats->pset_size));
+	printf("%10lld flap damping entries using %s of memory\n",
+	    stats->damp_cnt, fmt_mem(stats->damp_size));
+	if (stats->index_cnt > 0)
+		printf("%10lld RIB index entries using %s of memory\n",
+		    stats->index_cnt, fmt_mem(stats->index_size));
 	printf("RIB using %s of memory\n", fmt_mem(pts +
 	    stats->prefix_cnt * sizeof(struct prefix) +
 	    stats->rib_cnt * sizeof(struct rib_entry) +
 	    stats->path_cnt * sizeof(struct rde_aspath) +
 	    stats->aspath_size + stats->attr_cnt * sizeof(struct attr) +
-	    stats->attr_data));
+	    stats->attr_data + stats->damp_size + stats->index_size));
 	printf("Sets using %s of memory\n", fmt_mem(stats->aset_size +
 	    stats->pset_size));
 	printf("\nRDE hash statistics\n");
@@ -956,6 +1085,39 @@ show_rib_hash(struct rde_hashstats *hash)
 	    hash->min, hash->max, avg, dev);
 }
 
+static void
+show_rib_stats(struct ctl_show_rib_stats *rs)
+{
+	printf("%-16s %-14s %10llu %10llu ", rs->rib, aid2str(rs->aid),
+	    (unsigned long long)rs->stats.prefix_cnt,
+	    (unsigned long long)rs->stats.active_cnt);
+	if (rs->flags & F_RIB_NOEVALUATE)
+		printf("%10s ", "-");
+	else
+		printf("%10llu ", (unsigned long long)rs->stats.eligible_cnt);
+	printf("%9llu %9llu %9llu\n",
+	    (unsigned long long)rs->stats.ovs_cnt[ROA_VALID],
+	    (unsigned long long)rs->stats.ovs_cnt[ROA_INVALID],
+	    (unsigned long long)rs->stats.ovs_cnt[ROA_NOTFOUND]);
+}
+
+static void
+show_rib_peerstats(struct ctl_show_rib_peerstats *ps)
+{
+	static int	 header;
+	char		*s;
+
+	if (!header) {
+		printf("\n%-20s %-16s %10s %10s\n", "Neighbor", "RIB",
+		    "Accepted", "Best");
+		header = 1;
+	}
+	s = fmt_peer(ps->descr, &ps->remote_addr, -1);
+	printf("%-20s %-16s %10u %10u\n", s, ps->rib, ps->prefix_cnt,
+	    ps->prefix_best_cnt);
+	free(s);
+}
+
 static void
 show_result(u_int rescode)
 {
@@ -987,6 +1149,9 @@ const struct output show_output = {
 	.rib = show_rib,
 	.rib_mem = show_rib_mem,
 	.rib_hash = show_rib_hash,
+	.rib_stats = show_rib_stats,
+	.rib_peerstats = show_rib_peerstats,
+	.rtr = show_rtr,
 	.result = show_result,
 	.tail = show_tail
 };
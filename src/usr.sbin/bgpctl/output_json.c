@@ -33,7 +33,82 @@
 static void
 json_head(struct parse_result *res)
 {
-	json_do_start();
+	json_do_start(ndjson);
+}
+
+static void
+json_do_addr(const char *name, const struct bgpd_addr *addr, int plen)
+{
+	switch (addr->aid) {
+	case AID_INET:
+	case AID_INET6:
+		json_do_string_begin(name);
+		json_str_inet(aid2af(addr->aid), &addr->ba);
+		if (plen >= 0) {
+			json_str_char('/');
+			json_str_uint(plen);
+		}
+		json_do_string_end();
+		break;
+	default:
+		if (plen >= 0)
+			json_do_printf(name, "%s/%u", log_addr(addr), plen);
+		else
+			json_do_string(name, log_addr(addr));
+		break;
+	}
+}
+
+static void
+json_do_aspath(const char *name, u_char *data, size_t len)
+{
+	u_char		*seg;
+	u_int16_t	 seg_size;
+	u_int8_t	 i, seg_type, seg_len;
+
+	json_do_string_begin(name);
+	for (seg = data; len > 0; len -= seg_size, seg += seg_size) {
+		seg_type = seg[0];
+		seg_len = seg[1];
+		seg_size = 2 + sizeof(u_int32_t) * seg_len;
+
+		if (seg != data)
+			json_str_char(' ');
+		json_str_cat(aspath_delim(seg_type, 0));
+		for (i = 0; i < seg_len; i++) {
+			if (i > 0)
+				json_str_char(' ');
+			json_str_uint(aspath_extract(seg, i));
+		}
+		json_str_cat(aspath_delim(seg_type, 1));
+	}
+	json_do_string_end();
+}
+
+static void
+json_do_community_value(u_int16_t a, u_int16_t v)
+{
+	if (a == COMMUNITY_WELLKNOWN) {
+		json_do_string("community", fmt_community(a, v));
+		return;
+	}
+	json_do_string_begin("community");
+	json_str_uint(a);
+	json_str_char(':');
+	json_str_uint(v);
+	json_do_string_end();
+}
+
+static void
+json_do_large_community_value(u_int32_t d1, u_int32_t d2, u_int32_t d3)
+{
+	json_do_string_begin("community");
+	json_str_uint(d1);
+	json_str_char(':');
+	json_str_uint(d2);
+	json_str_char(':');
+	json_str_uint(d3);
+	json_do_string_end();
 }
 
 static void
@@ -57,7 +132,7 @@ json_neighbor_capabilities(struct capabilities *capa)
 		json_do_array("multiprotocol");
 		for (i = 0; i < AID_MAX; i++)
 			if (capa->mp[i])
-				json_do_printf("mp", "%s", aid2str(i));
+				json_do_string("mp", aid2str(i));
 		json_do_end();
 	}
 	if (capa->grestart.restart) {
@@ -82,7 +157,7 @@ json_neighbor_capabilities(struct capabilities *capa)
 			for (i = 0; i < AID_MAX; i++)
 				if (capa->grestart.flags[i] & CAPA_GR_PRESENT) {
 					json_do_object("family");
-					json_do_printf("family", "%s",
+					json_do_string("family",
 					    aid2str(i));
 					json_do_bool("preserved",
 					    capa->grestart.flags[i] &
@@ -102,8 +177,8 @@ static void
 json_neighbor_stats(struct peer *p)
 {
 	json_do_object("stats");
-	json_do_printf("last_read", "%s", fmt_monotime(p->stats.last_read));
-	json_do_printf("last_write", "%s", fmt_monotime(p->stats.last_write));
+	json_do_string("last_read", fmt_monotime(p->stats.last_read));
+	json_do_string("last_write", fmt_monotime(p->stats.last_write));
 
 	json_do_object("prefixes");
 	json_do_uint("sent", p->stats.prefix_out_cnt);
@@ -154,6 +229,39 @@ json_neighbor_stats(struct peer *p)
 
 	json_do_end();
 
+	json_do_object("queue");
+	json_do_uint("updates", p->stats.pending_update);
+	json_do_uint("withdraws", p->stats.pending_withdraw);
+	json_do_uint("credit_used", p->stats.pending_credit);
+	json_do_uint("suppressed", p->stats.prefix_suppressed);
+	json_do_uint("dampened", p->stats.prefix_damp_cnt);
+	json_do_uint("damp_absorbed", p->stats.prefix_damp_absorbed);
+	json_do_uint("drain_rate", p->stats.drain_rate);
+	json_do_end();
+
+	json_do_end();
+}
+
+static void
+json_neighbor_latency(struct peer *p)
+{
+	struct latency_hist	*h;
+	int			 i, j;
+
+	json_do_object("latency");
+	json_do_uint("sample_rate", LATENCY_SAMPLE);
+	for (i = 0; i < LAT_MAX; i++) {
+		h = &p->stats.latency[i];
+		json_do_object(latency_stages[i]);
+		json_do_uint("samples", h->count);
+		json_do_uint("sum_us", h->sum);
+		/* bucket j counts samples up to 8 << j us, the last the rest */
+		json_do_array("buckets");
+		for (j = 0; j < LATENCY_BUCKETS; j++)
+			json_do_uint("bucket", h->bucket[j]);
+		json_do_end();
+		json_do_end();
+	}
 	json_do_end();
 }
 
@@ -184,11 +292,12 @@ json_neighbor_full(struct peer *p)
 			    p->conf.max_out_prefix_restart);
 	}
 	if (p->auth.method != AUTH_NONE)
-		json_do_printf("authentication", "%s",
+		json_do_string("authentication",
 		    fmt_auth_method(p->auth.method));
 	json_do_bool("ttl_security", p->conf.ttlsec);
 	json_do_uint("holdtime", p->conf.holdtime);
 	json_do_uint("min_holdtime", p->conf.min_holdtime);
+	json_do_uint("advertisement_interval", p->conf.mrai);
 
 	/* capabilities */
 	json_do_bool("announce_capabilities", p->conf.announce_capa);
@@ -202,19 +311,19 @@ json_neighbor_full(struct peer *p)
 
 	/* errors */
 	if (*(p->conf.reason))
-		json_do_printf("my_shutdown_reason", "%s",
+		json_do_string("my_shutdown_reason",
 		    log_reason(p->conf.reason));
 	if (*(p->stats.last_reason))
-		json_do_printf("last_shutdown_reason", "%s",
+		json_do_string("last_shutdown_reason",
 		    log_reason(p->stats.last_reason));
 	errstr = fmt_errstr(p->stats.last_sent_errcode,
 	    p->stats.last_sent_suberr);
 	if (errstr)
-		json_do_printf("last_error_sent", "%s", errstr);
+		json_do_string("last_error_sent", errstr);
 	errstr = fmt_errstr(p->stats.last_rcvd_errcode,
 	    p->stats.last_rcvd_suberr);
 	if (errstr)
-		json_do_printf("last_error_received", "%s", errstr);
+		json_do_string("last_error_received", errstr);
 
 	/* connection info */
 	if (p->state >= STATE_OPENSENT) {
@@ -223,13 +332,13 @@ json_neighbor_full(struct peer *p)
 		json_do_uint("keepalive", p->holdtime / 3);
 
 		json_do_object("local");
-		json_do_printf("address", "%s", log_addr(&p->local));
+		json_do_string("address", log_addr(&p->local));
 		json_do_uint("port", p->local_port);
 		json_neighbor_capabilities(&p->capa.ann);
 		json_do_end();
 
 		json_do_object("remote");
-		json_do_printf("address", "%s", log_addr(&p->remote));
+		json_do_string("address", log_addr(&p->remote));
 		json_do_uint("port", p->remote_port);
 		json_neighbor_capabilities(&p->capa.peer);
 		json_do_end();
@@ -248,13 +357,13 @@ json_neighbor(struct peer *p, struct parse_result *res)
 
 	json_do_object("neighbor");
 
-	json_do_printf("remote_as", "%s", log_as(p->conf.remote_as));
+	json_do_string("remote_as", log_as(p->conf.remote_as));
 	if (p->conf.descr[0])
-		json_do_printf("description", "%s", p->conf.descr);
+		json_do_string("description", p->conf.descr);
 	if (p->conf.group[0])
-		json_do_printf("group", "%s", p->conf.group);
+		json_do_string("group", p->conf.group);
 	if (!p->conf.template)
-		json_do_printf("remote_addr", "%s",
+		json_do_string("remote_addr",
 		    log_addr(&p->conf.remote_addr));
 	else
 		json_do_printf("remote_addr", "%s/%u",
@@ -262,10 +371,10 @@ json_neighbor(struct peer *p, struct parse_result *res)
 	if (p->state == STATE_ESTABLISHED) {
 		struct in_addr ina;
 		ina.s_addr = p->remote_bgpid;
-		json_do_printf("bgpid", "%s", inet_ntoa(ina));
+		json_do_string("bgpid", inet_ntoa(ina));
 	}
-	json_do_printf("state", "%s", statenames[p->state]);
-	json_do_printf("last_updown", "%s", fmt_monotime(p->stats.last_updown));
+	json_do_string("state", statenames[p->state]);
+	json_do_string("last_updown", fmt_monotime(p->stats.last_updown));
 
 	switch (res->action) {
 	case SHOW:
@@ -278,6 +387,9 @@ json_neighbor(struct peer *p, struct parse_result *res)
 	case SHOW_NEIGHBOR_TERSE:
 		json_neighbor_full(p);
 		break;
+	case SHOW_NEIGHBOR_LATENCY:
+		json_neighbor_latency(p);
+		break;
 	default:
 		break;
 	}
@@ -291,7 +403,7 @@ json_timer(struct ctl_timer *t)
 	json_do_array("timers");
 
 	json_do_object("timer");
-	json_do_printf("name", "%s", timernames[t->type]);
+	json_do_string("name", timernames[t->type]);
 	json_do_int("due", t->val);
 	json_do_end();
 }
@@ -318,7 +430,7 @@ json_fib(struct kroute_full *kf)
 		origin = "dynamic";
 	else
 		origin = "unknown";
-	json_do_printf("origin", "%s", origin);
+	json_do_string("origin", origin);
 	json_do_bool("used_by_nexthop", kf->flags & F_NEXTHOP);
 	json_do_bool("blackhole", kf->flags & F_BLACKHOLE);
 	json_do_bool("reject", kf->flags & F_REJECT);
@@ -326,7 +438,7 @@ json_fib(struct kroute_full *kf)
 	if (kf->flags & F_CONNECTED)
 		json_do_printf("nexthop", "link#%u", kf->ifindex);
 	else
-		json_do_printf("nexthop", "%s", log_addr(&kf->nexthop));
+		json_do_string("nexthop", log_addr(&kf->nexthop));
 
 	json_do_end();
 }
@@ -338,26 +450,57 @@ json_fib_table(struct ktable *kt)
 
 	json_do_object("fibtable");
 	json_do_uint("rtableid", kt->rtableid);
-	json_do_printf("description", "%s", kt->descr);
+	json_do_string("description", kt->descr);
 	json_do_bool("coupled", kt->fib_sync);
 	json_do_bool("admin_change", kt->fib_sync != kt->fib_conf);
 	json_do_end();
 }
 
+static void
+json_rtr(struct ctl_show_rtr *rtr)
+{
+	json_do_array("rtrs");
+
+	json_do_object("rtr");
+	json_do_addr("remote_addr", &rtr->remote_addr, -1);
+	json_do_uint("remote_port", rtr->remote_port);
+	if (rtr->descr[0])
+		json_do_string("descr", rtr->descr);
+	json_do_string("state", rtr->state);
+	json_do_uint("version", rtr->version);
+	if (rtr->have_serial) {
+		json_do_uint("session_id", rtr->session_id);
+		json_do_uint("serial", rtr->serial);
+	}
+	json_do_uint("vrp_ipv4", rtr->vrp_v4);
+	json_do_uint("vrp_ipv6", rtr->vrp_v6);
+	if (rtr->last_update >= 0) {
+		json_do_printf("last_update", "%s",
+		    fmt_timeframe(rtr->last_update));
+		json_do_uint("last_update_sec", rtr->last_update);
+		json_do_uint("update_ms", rtr->update_ms);
+	}
+	json_do_uint("updates", rtr->updates);
+	json_do_uint("refresh", rtr->refresh);
+	json_do_uint("retry", rtr->retry);
+	json_do_uint("expire", rtr->expire);
+	json_do_end();
+}
+
 static void
 json_do_interface(struct ctl_show_interface *iface)
 {
 	json_do_object("interface");
 
-	json_do_printf("name", "%s", iface->ifname);
+	json_do_string("name", iface->ifname);
 	json_do_uint("rdomain", iface->rdomain);
 	json_do_bool("is_up", iface->is_up);
 	json_do_bool("nh_reachable", iface->nh_reachable);
 
 	if (iface->media[0])
-		json_do_printf("media", "%s", iface->media);
+		json_do_string("media", iface->media);
 
-	json_do_printf("linkstate", "%s", iface->linkstate);
+	json_do_string("linkstate", iface->linkstate);
 	if (iface->baudrate > 0)
 		json_do_uint("baudrate", iface->baudrate);
 
@@ -374,7 +517,7 @@ json_nexthop(struct ctl_show_nexthop *nh)
 
 	json_do_object("nexthop");
 
-	json_do_printf("address", "%s", log_addr(&nh->addr));
+	json_do_string("address", log_addr(&nh->addr));
 	json_do_bool("valid", nh->valid);
 
 	if (!nh->krvalid)
@@ -387,7 +530,7 @@ json_nexthop(struct ctl_show_nexthop *nh)
 		    k->prefixlen);
 		json_do_uint("priority", k->priority);
 		json_do_bool("connected", k->flags & F_CONNECTED);
-		json_do_printf("nexthop", "%s", inet_ntoa(k->nexthop));
+		json_do_string("nexthop", inet_ntoa(k->nexthop));
 		break;
 	case AID_INET6:
 		k6 = &nh->kr.kr6;
@@ -395,7 +538,7 @@ json_nexthop(struct ctl_show_nexthop *nh)
 		    k6->prefixlen);
 		json_do_uint("priority", k6->priority);
 		json_do_bool("connected", k6->flags & F_CONNECTED);
-		json_do_printf("nexthop", "%s", log_in6addr(&k6->nexthop));
+		json_do_string("nexthop", log_in6addr(&k6->nexthop));
 		break;
 	default:
 		warnx("nexthop: unknown address family");
@@ -433,13 +576,12 @@ json_communities(u_char *data, size_t len, struct parse_result *res)
 		switch (c.flags) {
 		case COMMUNITY_TYPE_BASIC:
 			json_do_array("communities");
-			json_do_printf("community", "%s",
-			    fmt_community(c.data1, c.data2));
+			json_do_community_value(c.data1, c.data2);
 			break;
 		case COMMUNITY_TYPE_LARGE:
 			json_do_array("large_communities");
-			json_do_printf("community", "%s",
-			    fmt_large_community(c.data1, c.data2, c.data3));
+			json_do_large_community_value(c.data1, c.data2,
+			    c.data3);
 			break;
 		case COMMUNITY_TYPE_EXT:
 			ext = (uint64_t)c.data3 << 48;
@@ -460,7 +602,7 @@ json_communities(u_char *data, size_t len, struct parse_result *res)
 			ext = htobe64(ext);
 
 			json_do_array("extended_communities");
-			json_do_printf("community", "%s",
+			json_do_string("community",
 			    fmt_ext_community((void *)&ext));
 			break;
 		}
@@ -484,7 +626,7 @@ json_do_community(u_char *data, uint16_t len)
 		memcpy(&v, data + i + 2, sizeof(v));
 		a = ntohs(a);
 		v = ntohs(v);
-		json_do_printf("community", "%s", fmt_community(a, v));
+		json_do_community_value(a, v);
 	}
 
 	json_do_end();
@@ -511,8 +653,7 @@ json_do_large_community(u_char *data, uint16_t len)
 		l1 = ntohl(l1);
 		l2 = ntohl(l2);
 
-		json_do_printf("community", "%s",
-		    fmt_large_community(a, l1, l2));
+		json_do_large_community_value(a, l1, l2);
 	}
 
 	json_do_end();
@@ -531,7 +672,7 @@ json_do_ext_community(u_char *data, uint16_t len)
 	json_do_array("extended_communities");
 
 	for (i = 0; i < len; i += 8)
-		json_do_printf("community", "%s", fmt_ext_community(data + i));
+		json_do_string("community", fmt_ext_community(data + i));
 
 	json_do_end();
 }
@@ -579,7 +720,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 	json_do_array("attributes");
 
 	json_do_object("attribute");
-	json_do_printf("type", "%s", fmt_attr(type, -1));
+	json_do_string("type", fmt_attr(type, -1));
 	json_do_uint("length", alen);
 	json_do_object("flags");
 	json_do_bool("partial", flags & ATTR_PARTIAL);
@@ -590,7 +731,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 	switch (type) {
 	case ATTR_ORIGIN:
 		if (alen == 1)
-			json_do_printf("origin", "%s", fmt_origin(*data, 0));
+			json_do_string("origin", fmt_origin(*data, 0));
 		else
 			json_do_printf("error", "bad length");
 		break;
@@ -611,7 +752,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 		}
 		if (aspath_asprint(&aspath, path, alen) == -1)
 			err(1, NULL);
-		json_do_printf("aspath", "%s", aspath);
+		json_do_string("aspath", aspath);
 		free(aspath);
 		if (path != data)
 			free(path);
@@ -619,7 +760,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 	case ATTR_NEXTHOP:
 		if (alen == 4) {
 			memcpy(&id, data, sizeof(id));
-			json_do_printf("nexthop", "%s", inet_ntoa(id));
+			json_do_string("nexthop", inet_ntoa(id));
 		} else
 			json_do_printf("error", "bad length");
 		break;
@@ -647,7 +788,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 			break;
 		}
 		json_do_uint("AS", as);
-		json_do_printf("router_id", "%s", inet_ntoa(id));
+		json_do_string("router_id", inet_ntoa(id));
 		break;
 	case ATTR_COMMUNITIES:
 		json_do_community(data, alen);
@@ -655,7 +796,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 	case ATTR_ORIGINATOR_ID:
 		if (alen == 4) {
 			memcpy(&id, data, sizeof(id));
-			json_do_printf("originator", "%s", inet_ntoa(id));
+			json_do_string("originator", inet_ntoa(id));
 		} else
 			json_do_printf("error", "bad length");
 		break;
@@ -664,7 +805,7 @@ json_attr(u_char *data, size_t len, struct parse_result *res)
 		for (off = 0; off + sizeof(id) <= alen;
 		    off += sizeof(id)) {
 			memcpy(&id, data + off, sizeof(id));
-			json_do_printf("cluster_id", "%s", inet_ntoa(id));
+			json_do_string("cluster_id", inet_ntoa(id));
 		}
 		json_do_end();
 		break;
@@ -687,7 +828,7 @@ bad_len:
 			    afi, safi);
 			break;
 		}
-		json_do_printf("family", "%s", aid2str(aid));
+		json_do_string("family", aid2str(aid));
 
 		if (type == ATTR_MP_REACH_NLRI) {
 			struct bgpd_addr nexthop;
@@ -729,7 +870,7 @@ bad_len:
 			data += nhlen + 1;
 			alen -= nhlen + 1;
 
-			json_do_printf("nexthop", "%s", log_addr(&nexthop));
+			json_do_string("nexthop", log_addr(&nexthop));
 		}
 
 		json_do_array("NLRI");
@@ -782,28 +923,24 @@ json_rib(struct ctl_show_rib *r, u_char *asdata, size_t aslen,
     struct parse_result *res)
 {
 	struct in_addr id;
-	char *aspath;
 
 	json_do_array("rib");
 
 	json_do_object("rib_entry");
 
-	json_do_printf("prefix", "%s/%u", log_addr(&r->prefix), r->prefixlen);
-
-	if (aspath_asprint(&aspath, asdata, aslen) == -1)
-		err(1, NULL);
-	json_do_printf("aspath", "%s", aspath);
-	free(aspath);
-
-	json_do_printf("exit_nexthop", "%s", log_addr(&r->exit_nexthop));
-	json_do_printf("true_nexthop", "%s", log_addr(&r->true_nexthop));
+	json_do_addr("prefix", &r->prefix, r->prefixlen);
+	json_do_aspath("aspath", asdata, aslen);
+	json_do_addr("exit_nexthop", &r->exit_nexthop, -1);
+	json_do_addr("true_nexthop", &r->true_nexthop, -1);
 
 	json_do_object("neighbor");
 	if (r->descr[0])
-		json_do_printf("description", "%s", r->descr);
-	json_do_printf("remote_addr", "%s", log_addr(&r->remote_addr));
+		json_do_string("description", r->descr);
+	json_do_addr("remote_addr", &r->remote_addr, -1);
 	id.s_addr = htonl(r->remote_id);
-	json_do_printf("bgp_id", "%s", inet_ntoa(id));
+	json_do_string_begin("bgp_id");
+	json_str_inet(AF_INET, &id);
+	json_do_string_end();
 	json_do_end();
 
 	/* flags */
@@ -811,21 +948,29 @@ json_rib(struct ctl_show_rib *r, u_char *asdata, size_t aslen,
 	if (r->flags & F_PREF_ACTIVE)
 		json_do_bool("best", 1);
 	if (r->flags & F_PREF_INTERNAL)
-		json_do_printf("source", "%s", "internal");
+		json_do_string("source", "internal");
 	else
-		json_do_printf("source", "%s", "external");
+		json_do_string("source", "external");
 	if (r->flags & F_PREF_STALE)
 		json_do_bool("stale", 1);
 	if (r->flags & F_PREF_ANNOUNCE)
 		json_do_bool("announced", 1);
+	if (r->flags & F_PREF_DAMPED)
+		json_do_bool("dampened", 1);
+	if (r->damp_penalty) {
+		json_do_uint("damp_penalty", r->damp_penalty);
+		if (r->flags & F_PREF_DAMPED)
+			json_do_string("damp_reuse",
+			    fmt_timeframe(r->damp_reuse));
+	}
 
 	/* various attribibutes */
-	json_do_printf("ovs", "%s", fmt_ovs(r->validation_state, 0));
-	json_do_printf("origin", "%s", fmt_origin(r->origin, 0));
+	json_do_string("ovs", fmt_ovs(r->validation_state, 0));
+	json_do_string("origin", fmt_origin(r->origin, 0));
 	json_do_uint("metric", r->med);
 	json_do_uint("localpref", r->local_pref);
 	json_do_uint("weight", r->weight);
-	json_do_printf("last_update", "%s", fmt_timeframe(r->age));
+	json_do_string("last_update", fmt_timeframe(r->age));
 
 	/* keep the object open for communities and attribuites */
 }
@@ -875,12 +1020,17 @@ json_rib_mem(struct rde_memstats *stats)
 	    stats->attr_cnt * sizeof(struct attr), stats->attr_refs);
 	json_rib_mem_element("attributes", stats->attr_dcnt,
 	    stats->attr_data, UINT64_MAX);
+	json_rib_mem_element("damping", stats->damp_cnt,
+	    stats->damp_size, UINT64_MAX);
+	json_rib_mem_element("index", stats->index_cnt,
+	    stats->index_size, UINT64_MAX);
 	json_rib_mem_element("total", UINT64_MAX, 
 	    pts + stats->prefix_cnt * sizeof(struct prefix) +
 	    stats->rib_cnt * sizeof(struct rib_entry) +
 	    stats->path_cnt * sizeof(struct rde_aspath) +
 	    stats->aspath_size + stats->attr_cnt * sizeof(struct attr) +
-	    stats->attr_data, UINT64_MAX);
+	    stats->attr_data + stats->damp_size + stats->index_size,
+	    UINT64_MAX);
 	json_do_end();
 
 	json_do_object("sets");
@@ -907,7 +1057,7 @@ json_rib_hash(struct rde_hashstats *hash)
 
 	json_do_object("hashtable");
 
-	json_do_printf("name", "%s", hash->name);
+	json_do_string("name", hash->name);
 	json_do_uint("size", hash->num);
 	json_do_uint("entries", hash->sum);
 	json_do_uint("min", hash->min);
@@ -917,6 +1067,42 @@ json_rib_hash(struct rde_hashstats *hash)
 	json_do_end();
 }
 
+static void
+json_rib_stats(struct ctl_show_rib_stats *rs)
+{
+	json_do_array("ribs");
+	json_do_object("rib");
+	json_do_string("name", rs->rib);
+	json_do_string("family", aid2str(rs->aid));
+	json_do_uint("prefixes", rs->stats.prefix_cnt);
+	json_do_uint("active", rs->stats.active_cnt);
+	if ((rs->flags & F_RIB_NOEVALUATE) == 0) {
+		json_do_uint("eligible", rs->stats.eligible_cnt);
+		json_do_uint("ineligible",
+		    rs->stats.prefix_cnt - rs->stats.eligible_cnt);
+	}
+	json_do_object("ovs");
+	json_do_uint("valid", rs->stats.ovs_cnt[ROA_VALID]);
+	json_do_uint("invalid", rs->stats.ovs_cnt[ROA_INVALID]);
+	json_do_uint("not-found", rs->stats.ovs_cnt[ROA_NOTFOUND]);
+	json_do_end();
+	json_do_end();
+}
+
+static void
+json_rib_peerstats(struct ctl_show_rib_peerstats *ps)
+{
+	json_do_array("neighbors");
+	json_do_object("neighbor");
+	json_do_addr("remote_addr", &ps->remote_addr, -1);
+	if (ps->descr[0])
+		json_do_string("description", ps->descr);
+	json_do_string("rib", ps->rib);
+	json_do_uint("accepted", ps->prefix_cnt);
+	json_do_uint("best", ps->prefix_best_cnt);
+	json_do_end();
+}
+
 static void
 json_result(u_int rescode)
 {
@@ -928,7 +1114,7 @@ json_result(u_int rescode)
 		json_do_printf("error", "unknown error %d", rescode);
 	} else {
 		json_do_printf("status", "FAILED");
-		json_do_printf("error", "%s", ctl_res_strerror[rescode]);
+		json_do_string("error", ctl_res_strerror[rescode]);
 	}
 }
 
@@ -951,6 +1137,9 @@ const struct output json_output = {
 	.rib = json_rib,
 	.rib_mem = json_rib_mem,
 	.rib_hash = json_rib_hash,
+	.rib_stats = json_rib_stats,
+	.rib_peerstats = json_rib_peerstats,
+	.rtr = json_rtr,
 	.result = json_result,
 	.tail = json_tail
 };
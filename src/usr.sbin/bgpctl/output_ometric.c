@@ -0,0 +1,381 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bgpd.h"
+#include "session.h"
+#include "rde.h"
+
+#include "bgpctl.h"
+#include "parser.h"
+#include "ometric.h"
+
+static struct ometric *peer_info, *peer_state, *peer_last_change,
+		*peer_last_read, *peer_last_write,
+		*peer_prefixes_received, *peer_prefixes_sent,
+		*peer_prefixes_best, *peer_message_transmit,
+		*peer_message_receive, *peer_update_transmit,
+		*peer_update_receive, *peer_update_pending,
+		*peer_update_credit, *peer_drain_rate, *peer_output_queue,
+		*peer_latency;
+static struct ometric *rde_mem_objects, *rde_mem_bytes, *rde_mem_refs,
+		*rde_hash_size, *rde_hash_entries, *rde_hash_chain_max;
+static struct ometric *rib_prefixes, *rib_active, *rib_eligible, *rib_ovs;
+
+static const char * const peer_keys[] = {
+	"remote_addr", "description", NULL
+};
+
+static const char * const peer_states[] = {
+	"none", "idle", "connect", "active", "opensent", "openconfirm",
+	"established", NULL
+};
+
+static time_t	now;
+
+static void
+ometric_head(struct parse_result *res)
+{
+	struct timespec	ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+	now = ts.tv_sec;
+
+	peer_info = ometric_new(OMT_GAUGE, "bgpd_peer_info",
+	    "bgpd peer information, always 1");
+	peer_state = ometric_new(OMT_STATESET, "bgpd_peer_state",
+	    "state of the BGP session");
+	peer_last_change = ometric_new(OMT_GAUGE,
+	    "bgpd_peer_last_change_seconds",
+	    "time since the last session state change");
+	peer_last_read = ometric_new(OMT_GAUGE, "bgpd_peer_last_read_seconds",
+	    "time since the last message was received");
+	peer_last_write = ometric_new(OMT_GAUGE,
+	    "bgpd_peer_last_write_seconds",
+	    "time since the last message was sent");
+	peer_prefixes_received = ometric_new(OMT_GAUGE,
+	    "bgpd_peer_prefixes_received", "prefixes in the Adj-RIB-In");
+	peer_prefixes_sent = ometric_new(OMT_GAUGE, "bgpd_peer_prefixes_sent",
+	    "prefixes in the Adj-RIB-Out");
+	peer_prefixes_best = ometric_new(OMT_GAUGE, "bgpd_peer_prefixes_best",
+	    "prefixes selected as best path in the Loc-RIB");
+	peer_message_transmit = ometric_new(OMT_COUNTER,
+	    "bgpd_peer_message_transmit", "BGP messages sent");
+	peer_message_receive = ometric_new(OMT_COUNTER,
+	    "bgpd_peer_message_receive", "BGP messages received");
+	peer_update_transmit = ometric_new(OMT_COUNTER,
+	    "bgpd_peer_update_transmit", "prefix updates sent");
+	peer_update_receive = ometric_new(OMT_COUNTER,
+	    "bgpd_peer_update_receive", "prefix updates received");
+	peer_update_pending = ometric_new(OMT_GAUGE,
+	    "bgpd_peer_update_pending",
+	    "prefix updates queued in the RDE for this peer");
+	peer_update_credit = ometric_new(OMT_GAUGE,
+	    "bgpd_peer_update_credit_used",
+	    "UPDATE credits not yet returned by the SE");
+	peer_drain_rate = ometric_new(OMT_GAUGE, "bgpd_peer_drain_rate",
+	    "measured prefixes per second sent to the peer");
+	peer_output_queue = ometric_new(OMT_GAUGE, "bgpd_peer_output_queue",
+	    "messages queued on the session socket");
+	peer_latency = ometric_new(OMT_HISTOGRAM,
+	    "bgpd_peer_update_latency_seconds",
+	    "time from reading a sampled UPDATE until a pipeline stage");
+
+	rde_mem_objects = ometric_new(OMT_GAUGE, "bgpd_rde_memory_objects",
+	    "number of objects in the RDE");
+	rde_mem_bytes = ometric_new(OMT_GAUGE, "bgpd_rde_memory_bytes",
+	    "memory used by objects in the RDE");
+	rde_mem_refs = ometric_new(OMT_GAUGE, "bgpd_rde_memory_references",
+	    "references held by objects in the RDE");
+	rde_hash_size = ometric_new(OMT_GAUGE, "bgpd_rde_hash_size",
+	    "number of buckets of a RDE hash table");
+	rde_hash_entries = ometric_new(OMT_GAUGE, "bgpd_rde_hash_entries",
+	    "number of entries in a RDE hash table");
+	rde_hash_chain_max = ometric_new(OMT_GAUGE, "bgpd_rde_hash_chain_max",
+	    "longest bucket chain of a RDE hash table");
+
+	rib_prefixes = ometric_new(OMT_GAUGE, "bgpd_rib_prefixes",
+	    "prefixes in the RIB");
+	rib_active = ometric_new(OMT_GAUGE, "bgpd_rib_active_prefixes",
+	    "prefixes selected by the decision process");
+	rib_eligible = ometric_new(OMT_GAUGE, "bgpd_rib_eligible_prefixes",
+	    "prefixes eligible for the decision process");
+	rib_ovs = ometric_new(OMT_GAUGE, "bgpd_rib_ovs_prefixes",
+	    "prefixes per origin validation state");
+}
+
+static struct olabels *
+ometric_peer_labels(const char *descr, const struct bgpd_addr *addr)
+{
+	const char	*values[3];
+
+	values[0] = log_addr(addr);
+	values[1] = descr;
+	values[2] = NULL;
+	return (olabels_new(peer_keys, values));
+}
+
+static void
+ometric_since(struct ometric *om, time_t t, struct olabels *ol)
+{
+	if (t == 0)
+		return;
+	if (t > now)
+		t = now;
+	ometric_set_int(om, now - t, ol);
+}
+
+static void
+ometric_latency(struct peer *p)
+{
+	static const char * const keys[] = {
+		"remote_addr", "description", "stage", NULL
+	};
+	const char	*values[4];
+	double		 bounds[LATENCY_BUCKETS];
+	struct olabels	*ol;
+	int		 i, s;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		bounds[i] = (8ULL << i) / 1000000.0;
+
+	values[0] = log_addr(&p->conf.remote_addr);
+	values[1] = p->conf.descr;
+	values[3] = NULL;
+	for (s = 0; s < LAT_MAX; s++) {
+		if (p->stats.latency[s].count == 0)
+			continue;
+		values[2] = latency_stages[s];
+		ol = olabels_new(keys, values);
+		ometric_set_histogram(peer_latency, p->stats.latency[s].bucket,
+		    bounds, LATENCY_BUCKETS,
+		    p->stats.latency[s].sum / 1000000.0, ol);
+		olabels_free(ol);
+	}
+}
+
+static void
+ometric_neighbor(struct peer *p, struct parse_result *res)
+{
+	static const char * const info_keys[] = {
+		"remote_addr", "description", "remote_as", "group", NULL
+	};
+	const char	*values[5];
+	struct olabels	*ol;
+
+	if (p->conf.template)
+		return;
+
+	values[0] = log_addr(&p->conf.remote_addr);
+	values[1] = p->conf.descr;
+	values[2] = log_as(p->conf.remote_as);
+	values[3] = p->conf.group;
+	values[4] = NULL;
+	ol = olabels_new(info_keys, values);
+	ometric_set_int(peer_info, 1, ol);
+	olabels_free(ol);
+
+	ol = ometric_peer_labels(p->conf.descr, &p->conf.remote_addr);
+	if (p->state <= STATE_ESTABLISHED)
+		ometric_set_state(peer_state, peer_states,
+		    peer_states[p->state], ol);
+	ometric_since(peer_last_change, p->stats.last_updown, ol);
+	ometric_since(peer_last_read, p->stats.last_read, ol);
+	ometric_since(peer_last_write, p->stats.last_write, ol);
+	ometric_set_int(peer_prefixes_received, p->stats.prefix_cnt, ol);
+	ometric_set_int(peer_prefixes_sent, p->stats.prefix_out_cnt, ol);
+
+	ometric_set_int_with_label(peer_message_transmit,
+	    p->stats.msg_sent_open, "messages", "open", ol);
+	ometric_set_int_with_label(peer_message_transmit,
+	    p->stats.msg_sent_notification, "messages", "notification", ol);
+	ometric_set_int_with_label(peer_message_transmit,
+	    p->stats.msg_sent_update, "messages", "update", ol);
+	ometric_set_int_with_label(peer_message_transmit,
+	    p->stats.msg_sent_keepalive, "messages", "keepalive", ol);
+	ometric_set_int_with_label(peer_message_transmit,
+	    p->stats.msg_sent_rrefresh, "messages", "route_refresh", ol);
+	ometric_set_int_with_label(peer_message_receive,
+	    p->stats.msg_rcvd_open, "messages", "open", ol);
+	ometric_set_int_with_label(peer_message_receive,
+	    p->stats.msg_rcvd_notification, "messages", "notification", ol);
+	ometric_set_int_with_label(peer_message_receive,
+	    p->stats.msg_rcvd_update, "messages", "update", ol);
+	ometric_set_int_with_label(peer_message_receive,
+	    p->stats.msg_rcvd_keepalive, "messages", "keepalive", ol);
+	ometric_set_int_with_label(peer_message_receive,
+	    p->stats.msg_rcvd_rrefresh, "messages", "route_refresh", ol);
+
+	ometric_set_int_with_label(peer_update_transmit,
+	    p->stats.prefix_sent_update, "type", "update", ol);
+	ometric_set_int_with_label(peer_update_transmit,
+	    p->stats.prefix_sent_withdraw, "type", "withdraw", ol);
+	ometric_set_int_with_label(peer_update_transmit,
+	    p->stats.prefix_sent_eor, "type", "eor", ol);
+	ometric_set_int_with_label(peer_update_receive,
+	    p->stats.prefix_rcvd_update, "type", "update", ol);
+	ometric_set_int_with_label(peer_update_receive,
+	    p->stats.prefix_rcvd_withdraw, "type", "withdraw", ol);
+	ometric_set_int_with_label(peer_update_receive,
+	    p->stats.prefix_rcvd_eor, "type", "eor", ol);
+
+	ometric_set_int_with_label(peer_update_pending,
+	    p->stats.pending_update, "type", "update", ol);
+	ometric_set_int_with_label(peer_update_pending,
+	    p->stats.pending_withdraw, "type", "withdraw", ol);
+	ometric_set_int(peer_update_credit, p->stats.pending_credit, ol);
+	ometric_set_int(peer_drain_rate, p->stats.drain_rate, ol);
+	ometric_set_int(peer_output_queue, p->wbuf.queued, ol);
+	olabels_free(ol);
+
+	ometric_latency(p);
+}
+
+static void
+ometric_rib_mem_element(const char *type, uint64_t count, uint64_t size,
+    uint64_t refs)
+{
+	if (count != UINT64_MAX)
+		ometric_set_int_with_label(rde_mem_objects, count, "type",
+		    type, NULL);
+	if (size != UINT64_MAX)
+		ometric_set_int_with_label(rde_mem_bytes, size, "type",
+		    type, NULL);
+	if (refs != UINT64_MAX)
+		ometric_set_int_with_label(rde_mem_refs, refs, "type",
+		    type, NULL);
+}
+
+static void
+ometric_rib_mem(struct rde_memstats *stats)
+{
+	int	i;
+
+	for (i = 0; i < AID_MAX; i++) {
+		if (stats->pt_cnt[i] == 0)
+			continue;
+		ometric_rib_mem_element(aid_vals[i].name, stats->pt_cnt[i],
+		    stats->pt_cnt[i] * pt_sizes[i], UINT64_MAX);
+	}
+	ometric_rib_mem_element("rib", stats->rib_cnt,
+	    stats->rib_cnt * sizeof(struct rib_entry), UINT64_MAX);
+	ometric_rib_mem_element("prefix", stats->prefix_cnt,
+	    stats->prefix_cnt * sizeof(struct prefix), UINT64_MAX);
+	ometric_rib_mem_element("rde_aspath", stats->path_cnt,
+	    stats->path_cnt * sizeof(struct rde_aspath),
+	    stats->path_refs);
+	ometric_rib_mem_element("aspath", stats->aspath_cnt,
+	    stats->aspath_size, stats->aspath_refs);
+	ometric_rib_mem_element("community_entries", stats->comm_cnt,
+	    stats->comm_cnt * sizeof(struct rde_community), UINT64_MAX);
+	ometric_rib_mem_element("community", stats->comm_nmemb,
+	    stats->comm_size * sizeof(struct community), stats->comm_refs);
+	ometric_rib_mem_element("attributes_entries", stats->attr_cnt,
+	    stats->attr_cnt * sizeof(struct attr), stats->attr_refs);
+	ometric_rib_mem_element("attributes", stats->attr_dcnt,
+	    stats->attr_data, UINT64_MAX);
+	ometric_rib_mem_element("damping", stats->damp_cnt,
+	    stats->damp_size, UINT64_MAX);
+	ometric_rib_mem_element("index", stats->index_cnt,
+	    stats->index_size, UINT64_MAX);
+	ometric_rib_mem_element("as_set", stats->aset_nmemb,
+	    stats->aset_size, UINT64_MAX);
+	ometric_rib_mem_element("as_set_tables", stats->aset_cnt, UINT64_MAX,
+	    UINT64_MAX);
+	ometric_rib_mem_element("prefix_set", stats->pset_cnt,
+	    stats->pset_size, UINT64_MAX);
+}
+
+static void
+ometric_rib_hash(struct rde_hashstats *hash)
+{
+	ometric_set_int_with_label(rde_hash_size, hash->num, "table",
+	    hash->name, NULL);
+	ometric_set_int_with_label(rde_hash_entries, hash->sum, "table",
+	    hash->name, NULL);
+	ometric_set_int_with_label(rde_hash_chain_max, hash->max, "table",
+	    hash->name, NULL);
+}
+
+static void
+ometric_rib_stats(struct ctl_show_rib_stats *rs)
+{
+	static const char * const keys[] = { "rib", "family", NULL };
+	const char	*values[3];
+	struct olabels	*ol;
+
+	values[0] = rs->rib;
+	values[1] = aid2str(rs->aid);
+	values[2] = NULL;
+	ol = olabels_new(keys, values);
+	ometric_set_int(rib_prefixes, rs->stats.prefix_cnt, ol);
+	ometric_set_int(rib_active, rs->stats.active_cnt, ol);
+	if ((rs->flags & F_RIB_NOEVALUATE) == 0)
+		ometric_set_int(rib_eligible, rs->stats.eligible_cnt, ol);
+	ometric_set_int_with_label(rib_ovs, rs->stats.ovs_cnt[ROA_VALID],
+	    "state", "valid", ol);
+	ometric_set_int_with_label(rib_ovs, rs->stats.ovs_cnt[ROA_INVALID],
+	    "state", "invalid", ol);
+	ometric_set_int_with_label(rib_ovs, rs->stats.ovs_cnt[ROA_NOTFOUND],
+	    "state", "not-found", ol);
+	olabels_free(ol);
+}
+
+static void
+ometric_rib_peerstats(struct ctl_show_rib_peerstats *ps)
+{
+	struct olabels	*ol;
+
+	ol = ometric_peer_labels(ps->descr, &ps->remote_addr);
+	ometric_set_int(peer_prefixes_best, ps->prefix_best_cnt, ol);
+	olabels_free(ol);
+}
+
+static void
+ometric_result(u_int rescode)
+{
+	if (rescode == 0)
+		return;
+	if (rescode > sizeof(ctl_res_strerror)/sizeof(ctl_res_strerror[0]))
+		warnx("unknown result error code %u", rescode);
+	else
+		warnx("%s", ctl_res_strerror[rescode]);
+}
+
+static void
+ometric_tail(void)
+{
+	if (ometric_output_all(stdout) == -1)
+		err(1, "stdout");
+	ometric_free_all();
+}
+
+const struct output ometric_output = {
+	.head = ometric_head,
+	.neighbor = ometric_neighbor,
+	.rib_mem = ometric_rib_mem,
+	.rib_hash = ometric_rib_hash,
+	.rib_stats = ometric_rib_stats,
+	.rib_peerstats = ometric_rib_peerstats,
+	.result = ometric_result,
+	.tail = ometric_tail
+};
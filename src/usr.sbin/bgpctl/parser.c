@@ -61,7 +61,8 @@ enum token_type {
 	RD,
 	FAMILY,
 	RTABLE,
-	FILENAME
+	FILENAME,
+	TRACECLASS
 };
 
 struct token {
@@ -111,6 +112,8 @@ static const struct token t_prepnbr[];
 static const struct token t_prepself[];
 static const struct token t_weight[];
 static const struct token t_log[];
+static const struct token t_log_trace[];
+static const struct token t_log_traceclass[];
 static const struct token t_fib_table[];
 static const struct token t_show_fib_table[];
 static const struct token t_communication[];
@@ -129,10 +132,12 @@ static const struct token t_show[] = {
 	{ NOTOKEN,	"",		NONE,		NULL},
 	{ KEYWORD,	"fib",		SHOW_FIB,	t_show_fib},
 	{ KEYWORD,	"interfaces",	SHOW_INTERFACE,	NULL},
+	{ KEYWORD,	"metrics",	SHOW_METRICS,	NULL},
 	{ KEYWORD,	"neighbor",	SHOW_NEIGHBOR,	t_show_neighbor},
 	{ KEYWORD,	"network",	NETWORK_SHOW,	t_network_show},
 	{ KEYWORD,	"nexthop",	SHOW_NEXTHOP,	NULL},
 	{ KEYWORD,	"rib",		SHOW_RIB,	t_show_rib},
+	{ KEYWORD,	"rtr",		SHOW_RTR,	NULL},
 	{ KEYWORD,	"tables",	SHOW_FIB_TABLES, NULL},
 	{ KEYWORD,	"ip",		NONE,		t_show_ip},
 	{ KEYWORD,	"summary",	SHOW_SUMMARY,	t_show_summary},
@@ -172,12 +177,15 @@ static const struct token t_show_rib[] = {
 	{ FLAG,		"selected",	F_CTL_ACTIVE,	t_show_rib},
 	{ FLAG,		"detail",	F_CTL_DETAIL,	t_show_rib},
 	{ FLAG,		"error",	F_CTL_INVALID,	t_show_rib},
+	{ FLAG,		"dampened",	F_CTL_DAMPENED,	t_show_rib},
+	{ FLAG,		"bulk",		F_CTL_BULK,	t_show_rib},
+	{ FLAG,		"binary",	F_CTL_BULK|F_CTL_BINARY, t_show_rib},
 	{ FLAG,		"ssv"	,	F_CTL_SSV,	t_show_rib},
 	{ FLAG,		"in",		F_CTL_ADJ_IN,	t_show_rib},
 	{ FLAG,		"out",		F_CTL_ADJ_OUT,	t_show_rib},
 	{ KEYWORD,	"neighbor",	NONE,		t_show_rib_neigh},
 	{ KEYWORD,	"table",	NONE,		t_show_rib_rib},
-	{ KEYWORD,	"summary",	SHOW_SUMMARY,	t_show_summary},
+	{ KEYWORD,	"summary",	SHOW_RIB_SUMMARY, NULL},
 	{ KEYWORD,	"memory",	SHOW_RIB_MEM,	NULL},
 	{ KEYWORD,	"ovs",		NONE,		t_show_ovs},
 	{ FAMILY,	"",		NONE,		t_show_rib},
@@ -203,6 +211,8 @@ static const struct token t_show_mrt[] = {
 	{ FLAG,		"ssv",		F_CTL_SSV,	t_show_mrt},
 	{ KEYWORD,	"neighbor",	NONE,		t_show_mrt_neigh},
 	{ FLAG,		"peers",	F_CTL_NEIGHBORS,t_show_mrt},
+	{ FLAG,		"stats",	F_CTL_STATS,	t_show_mrt},
+	{ FLAG,		"index",	F_CTL_INDEX,	t_show_mrt},
 	{ KEYWORD,	"file",		NONE,		t_show_mrt_file},
 	{ FAMILY,	"",		NONE,		t_show_mrt},
 	{ PREFIX,	"",		NONE,		t_show_prefix},
@@ -241,6 +251,7 @@ static const struct token t_show_neighbor_modifiers[] = {
 	{ KEYWORD,	"timers",	SHOW_NEIGHBOR_TIMERS,	NULL},
 	{ KEYWORD,	"messages",	SHOW_NEIGHBOR,		NULL},
 	{ KEYWORD,	"terse",	SHOW_NEIGHBOR_TERSE,	NULL},
+	{ KEYWORD,	"latency",	SHOW_NEIGHBOR_LATENCY,	NULL},
 	{ ENDTOKEN,	"",		NONE,			NULL}
 };
 
@@ -464,6 +475,29 @@ static const struct token t_weight[] = {
 static const struct token t_log[] = {
 	{ KEYWORD,	"verbose",	LOG_VERBOSE,	NULL},
 	{ KEYWORD,	"brief",	LOG_BRIEF,	NULL},
+	{ KEYWORD,	"trace",	LOG_TRACE,	t_log_trace},
+	{ ENDTOKEN,	"",		NONE,		NULL}
+};
+
+static const struct token t_log_trace[] = {
+	{ KEYWORD,	"dump",		LOG_TRACE_DUMP,	NULL},
+	{ TRACECLASS,	"none",		0,		NULL},
+	{ TRACECLASS,	"all",		TRACE_ALL,	NULL},
+	{ TRACECLASS,	"update",	TRACE_UPDATE,	t_log_traceclass},
+	{ TRACECLASS,	"filter",	TRACE_FILTER,	t_log_traceclass},
+	{ TRACECLASS,	"decision",	TRACE_DECISION,	t_log_traceclass},
+	{ TRACECLASS,	"kroute",	TRACE_KROUTE,	t_log_traceclass},
+	{ TRACECLASS,	"imsg",		TRACE_IMSG,	t_log_traceclass},
+	{ ENDTOKEN,	"",		NONE,		NULL}
+};
+
+static const struct token t_log_traceclass[] = {
+	{ NOTOKEN,	"",		NONE,		NULL},
+	{ TRACECLASS,	"update",	TRACE_UPDATE,	t_log_traceclass},
+	{ TRACECLASS,	"filter",	TRACE_FILTER,	t_log_traceclass},
+	{ TRACECLASS,	"decision",	TRACE_DECISION,	t_log_traceclass},
+	{ TRACECLASS,	"kroute",	TRACE_KROUTE,	t_log_traceclass},
+	{ TRACECLASS,	"imsg",		TRACE_IMSG,	t_log_traceclass},
 	{ ENDTOKEN,	"",		NONE,		NULL}
 };
 
@@ -561,6 +595,14 @@ match_token(int *argc, char **argv[], const struct token table[])
 				res.flags |= t->value;
 			}
 			break;
+		case TRACECLASS:
+			if (word != NULL && strncmp(word, table[i].keyword,
+			    wordlen) == 0) {
+				match++;
+				t = &table[i];
+				res.trace |= t->value;
+			}
+			break;
 		case FAMILY:
 			if (word == NULL)
 				break;
@@ -786,6 +828,7 @@ match_token(int *argc, char **argv[], const struct token table[])
 						break;
 					err(1, "mrt open(%s)", word);
 				}
+				res.mrtfile = word;
 				match++;
 				t = &table[i];
 			}
@@ -820,6 +863,7 @@ show_valid_args(const struct token table[])
 			break;
 		case KEYWORD:
 		case FLAG:
+		case TRACECLASS:
 		case ASTYPE:
 		case EXTCOM_SUBTYPE:
 			fprintf(stderr, "  %s\n", table[i].keyword);
@@ -28,19 +28,25 @@ enum actions {
 	SHOW_NEIGHBOR,
 	SHOW_NEIGHBOR_TIMERS,
 	SHOW_NEIGHBOR_TERSE,
+	SHOW_NEIGHBOR_LATENCY,
 	SHOW_FIB,
 	SHOW_FIB_TABLES,
 	SHOW_RIB,
 	SHOW_MRT,
 	SHOW_RIB_MEM,
+	SHOW_RIB_SUMMARY,
+	SHOW_METRICS,
 	SHOW_NEXTHOP,
 	SHOW_INTERFACE,
+	SHOW_RTR,
 	RELOAD,
 	FIB,
 	FIB_COUPLE,
 	FIB_DECOUPLE,
 	LOG_VERBOSE,
 	LOG_BRIEF,
+	LOG_TRACE,
+	LOG_TRACE_DUMP,
 	NEIGHBOR,
 	NEIGHBOR_UP,
 	NEIGHBOR_DOWN,
@@ -68,6 +74,7 @@ struct parse_result {
 	const char		*ext_comm_subtype;
 	u_int64_t		 rd;
 	int			 flags;
+	u_int32_t		 trace;
 	int			 is_group;
 	u_int8_t		 validation_state;
 	u_int			 rtableid;
@@ -75,6 +82,7 @@ struct parse_result {
 	u_int8_t		 prefixlen;
 	u_int8_t		 aid;
 	int			 mrtfd;
+	const char		*mrtfile;
 };
 
 __dead void		 usage(void);
@@ -44,6 +44,9 @@ pid_t		start_child(enum bgpd_process, char *, int, int, int);
 int		send_filterset(struct imsgbuf *, struct filter_set_head *);
 int		reconfigure(char *, struct bgpd_config *);
 int		send_config(struct bgpd_config *);
+static int	send_set_item(int, void *, size_t);
+static int	send_set_flush(void);
+static int	send_roa_items(int, struct prefixset_item *);
 int		dispatch_imsg(struct imsgbuf *, int, struct bgpd_config *);
 int		control_setup(struct bgpd_config *);
 static void	getsockpair(int [2]);
@@ -53,6 +56,7 @@ int			 cflags;
 volatile sig_atomic_t	 mrtdump;
 volatile sig_atomic_t	 quit;
 volatile sig_atomic_t	 reconfig;
+volatile sig_atomic_t	 sigchld;
 pid_t			 reconfpid;
 int			 reconfpending;
 struct imsgbuf		*ibuf_se;
@@ -61,6 +65,17 @@ struct rib_names	 ribnames = SIMPLEQ_HEAD_INITIALIZER(ribnames);
 char			*cname;
 char			*rcname;
 
+/*
+ * Set items are sent to the RDE in batches filling a whole imsg instead
+ * of one imsg per item. With millions of items the per imsg overhead is
+ * what makes a reload slow.
+ */
+static struct {
+	u_char	buf[MAX_IMSGSIZE - IMSG_HEADER_SIZE];
+	size_t	len;
+	int	type;
+} setbulk;
+
 void
 sighdlr(int sig)
 {
@@ -76,6 +91,9 @@ sighdlr(int sig)
 	case SIGUSR1:
 		mrtdump = 1;
 		break;
+	case SIGCHLD:
+		sigchld = 1;
+		break;
 	}
 }
 
@@ -226,6 +244,7 @@ main(int argc, char *argv[])
 	signal(SIGHUP, sighdlr);
 	signal(SIGALRM, sighdlr);
 	signal(SIGUSR1, sighdlr);
+	signal(SIGCHLD, sighdlr);
 	signal(SIGPIPE, SIG_IGN);
 
 	if ((ibuf_se = malloc(sizeof(struct imsgbuf))) == NULL ||
@@ -267,7 +286,9 @@ BROKEN	if (pledge("stdio rpath wpath cpath fattr unix route recvfd sendfd",
 	if (pftable_clear_all() != 0)
 		quit = 1;
 
+	log_queue_init(NULL);
 	while (quit == 0) {
+		log_flush();
 		bzero(pfd, sizeof(pfd));
 
 		timeout = mrt_timeout(conf->mrt);
@@ -357,8 +378,30 @@ BROKEN	if (pledge("stdio rpath wpath cpath fattr unix route recvfd sendfd",
 			mrtdump = 0;
 			mrt_handler(conf->mrt);
 		}
+
+		if (sigchld) {
+			sigchld = 0;
+			/* reap mrt writers, a dying engine is fatal */
+			while ((pid = waitpid(WAIT_ANY, &status,
+			    WNOHANG)) > 0) {
+				if (pid == rde_pid || pid == se_pid) {
+					log_warnx("%s terminated",
+					    pid == rde_pid ?
+					    "route decision engine" :
+					    "session engine");
+					quit = 1;
+				} else if (WIFSIGNALED(status))
+					log_warnx("mrt writer terminated; "
+					    "signal %d", WTERMSIG(status));
+				else if (WIFEXITED(status) &&
+				    WEXITSTATUS(status) != 0)
+					log_warnx("mrt writer failed");
+			}
+		}
 	}
 
+	log_queue_done();
+
 	/* close pipes */
 	if (ibuf_se) {
 		msgbuf_clear(&ibuf_se->w);
@@ -503,6 +546,7 @@ send_config(struct bgpd_config *conf)
 	struct as_set		*aset;
 	struct prefixset	*ps;
 	struct prefixset_item	*psi, *npsi;
+	struct rtr_config	*rtr;
 
 	reconfpending = 2;	/* one per child */
 
@@ -554,10 +598,17 @@ send_config(struct bgpd_config *conf)
 				log_peer_warnx(&p->conf, "pfkey setup failed");
 	}
 
+	/* RTR caches are handled by the SE */
+	SIMPLEQ_FOREACH(rtr, &conf->rtrs, entry) {
+		if (imsg_compose(ibuf_se, IMSG_RECONF_RTR_CONFIG, 0, 0, -1,
+		    rtr, sizeof(*rtr)) == -1)
+			return (-1);
+	}
+
 	/* networks go via kroute to the RDE */
 	kr_net_reload(conf->default_tableid, 0, &conf->networks);
 
-	/* prefixsets for filters in the RDE */
+	/* prefixsets for filters in the RDE, items are sent sorted */
 	while ((ps = SIMPLEQ_FIRST(&conf->prefixsets)) != NULL) {
 		SIMPLEQ_REMOVE_HEAD(&conf->prefixsets, entry);
 		if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET, 0, 0, -1,
@@ -565,12 +616,17 @@ send_config(struct bgpd_config *conf)
 			return (-1);
 		RB_FOREACH_SAFE(psi, prefixset_tree, &ps->psitems, npsi) {
 			RB_REMOVE(prefixset_tree, &ps->psitems, psi);
-			if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_ITEM,
-			    0, 0, -1, psi, sizeof(*psi)) == -1)
+			if (send_set_item(IMSG_RECONF_PREFIX_SET_ITEMS,
+			    &psi->p, sizeof(psi->p)) == -1)
 				return (-1);
 			set_free(psi->set);
 			free(psi);
 		}
+		if (send_set_flush() == -1)
+			return (-1);
+		if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_DONE, 0, 0,
+		    -1, NULL, 0) == -1)
+			return (-1);
 		free(ps);
 	}
 
@@ -581,23 +637,17 @@ send_config(struct bgpd_config *conf)
 		    ps->name, sizeof(ps->name)) == -1)
 			return (-1);
 		RB_FOREACH_SAFE(psi, prefixset_tree, &ps->psitems, npsi) {
-			struct roa_set *rs;
-			size_t i, l, n;
 			RB_REMOVE(prefixset_tree, &ps->psitems, psi);
-			rs = set_get(psi->set, &n);
-			for (i = 0; i < n; i += l) {
-				l = (n - i > 1024 ? 1024 : n - i);
-				if (imsg_compose(ibuf_rde,
-				    IMSG_RECONF_ROA_SET_ITEMS,
-				    0, 0, -1, rs + i, l * sizeof(*rs)) == -1)
-					return -1;
-			}
-			if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_ITEM,
-			    0, 0, -1, psi, sizeof(*psi)) == -1)
+			if (send_roa_items(IMSG_RECONF_ROA_ITEMS, psi) == -1)
 				return (-1);
 			set_free(psi->set);
 			free(psi);
 		}
+		if (send_set_flush() == -1)
+			return (-1);
+		if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_DONE, 0, 0,
+		    -1, NULL, 0) == -1)
+			return (-1);
 		free(ps);
 	}
 
@@ -606,23 +656,17 @@ send_config(struct bgpd_config *conf)
 		    NULL, 0) == -1)
 			return (-1);
 		RB_FOREACH_SAFE(psi, prefixset_tree, &conf->roa, npsi) {
-			struct roa_set *rs;
-			size_t i, l, n;
 			RB_REMOVE(prefixset_tree, &conf->roa, psi);
-			rs = set_get(psi->set, &n);
-			for (i = 0; i < n; i += l) {
-				l = (n - i > 1024 ? 1024 : n - i);
-				if (imsg_compose(ibuf_rde,
-				    IMSG_RECONF_ROA_SET_ITEMS,
-				    0, 0, -1, rs + i, l * sizeof(*rs)) == -1)
-					return -1;
-			}
-			if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_ITEM,
-			    0, 0, -1, psi, sizeof(*psi)) == -1)
+			if (send_roa_items(IMSG_RECONF_ROA_ITEMS, psi) == -1)
 				return (-1);
 			set_free(psi->set);
 			free(psi);
 		}
+		if (send_set_flush() == -1)
+			return (-1);
+		if (imsg_compose(ibuf_rde, IMSG_RECONF_PREFIX_SET_DONE, 0, 0,
+		    -1, NULL, 0) == -1)
+			return (-1);
 	}
 
 	/* as-sets for filters in the RDE */
@@ -718,13 +762,61 @@ send_config(struct bgpd_config *conf)
 	return (0);
 }
 
+static int
+send_set_item(int type, void *data, size_t len)
+{
+	if (setbulk.len > 0 && (setbulk.type != type ||
+	    setbulk.len + len > sizeof(setbulk.buf)))
+		if (send_set_flush() == -1)
+			return (-1);
+	setbulk.type = type;
+	memcpy(setbulk.buf + setbulk.len, data, len);
+	setbulk.len += len;
+	return (0);
+}
+
+static int
+send_set_flush(void)
+{
+	if (setbulk.len == 0)
+		return (0);
+	if (imsg_compose(ibuf_rde, setbulk.type, 0, 0, -1, setbulk.buf,
+	    setbulk.len) == -1)
+		return (-1);
+	setbulk.len = 0;
+	return (0);
+}
+
+/* one struct roa per source-as of the ROA prefix */
+static int
+send_roa_items(int type, struct prefixset_item *psi)
+{
+	struct roa	 roa;
+	struct roa_set	*rs;
+	size_t		 i, n;
+
+	if (psi->set == NULL)
+		return (0);
+	memset(&roa, 0, sizeof(roa));
+	roa.prefix = psi->p.addr;
+	roa.prefixlen = psi->p.len;
+	rs = set_get(psi->set, &n);
+	for (i = 0; i < n; i++) {
+		roa.asnum = rs[i].as;
+		roa.maxlen = rs[i].maxlen;
+		if (send_set_item(type, &roa, sizeof(roa)) == -1)
+			return (-1);
+	}
+	return (0);
+}
+
 int
 dispatch_imsg(struct imsgbuf *ibuf, int idx, struct bgpd_config *conf)
 {
 	struct imsg		 imsg;
 	struct peer		*p;
 	ssize_t			 n;
-	int			 rv, verbose;
+	int			 rv, verbose, pri;
 
 	rv = 0;
 	while (ibuf) {
@@ -885,6 +977,16 @@ dispatch_imsg(struct imsgbuf *ibuf, int idx, struct bgpd_config *conf)
 			memcpy(&verbose, imsg.data, sizeof(verbose));
 			log_setverbose(verbose);
 			break;
+		case IMSG_LOG:
+			if (imsg.hdr.len <= IMSG_HEADER_SIZE + sizeof(pri) ||
+			    ((char *)imsg.data)[imsg.hdr.len -
+			    IMSG_HEADER_SIZE - 1] != '\0') {
+				log_warnx("wrong imsg len");
+				break;
+			}
+			memcpy(&pri, imsg.data, sizeof(pri));
+			log_emit(pri, (char *)imsg.data + sizeof(pri));
+			break;
 		case IMSG_RECONF_DONE:
 			if (reconfpending == 0) {
 				log_warnx("unexpected RECONF_DONE received");
@@ -35,6 +35,7 @@
 
 #define	BGP_VERSION			4
 #define	BGP_PORT			179
+#define	RTR_PORT			323
 #define	CONFFILE			"/etc/bgpd.conf"
 #define	BGPD_USER			"_bgpd"
 #define	PEER_DESCR_LEN			32
@@ -61,6 +62,8 @@
 #define	BGPD_FLAG_REFLECTOR		0x0004
 #define	BGPD_FLAG_NEXTHOP_BGP		0x0010
 #define	BGPD_FLAG_NEXTHOP_DEFAULT	0x0020
+#define	BGPD_FLAG_MRT_SNAPSHOT		0x0040
+#define	BGPD_FLAG_RIB_INDEX		0x0080
 #define	BGPD_FLAG_DECISION_MASK		0x0f00
 #define	BGPD_FLAG_DECISION_ROUTEAGE	0x0100
 #define	BGPD_FLAG_DECISION_TRANS_AS	0x0200
@@ -93,6 +96,11 @@
 #define	F_CTL_OVS_INVALID	0x100000
 #define	F_CTL_OVS_NOTFOUND	0x200000
 #define	F_CTL_NEIGHBORS		0x400000 /* only used by bgpctl */
+#define	F_CTL_DAMPENED		0x800000 /* only set on requests */
+#define	F_CTL_STATS		0x1000000 /* only used by bgpctl */
+#define	F_CTL_INDEX		0x2000000 /* only used by bgpctl */
+#define	F_CTL_BULK		0x4000000 /* only set on requests */
+#define	F_CTL_BINARY		0x8000000 /* only used by bgpctl */
 
 /*
  * Note that these numeric assignments differ from the numbers commonly
@@ -116,6 +124,43 @@
 #define CTL_MSG_HIGH_MARK	500
 #define CTL_MSG_LOW_MARK	100
 
+/*
+ * Outbound UPDATE generation in the RDE is credit based. Each peer may
+ * have at most RDE_PEER_CREDIT UPDATE messages sent to the SE without the
+ * credit returned. The SE hands credits back with IMSG_UPDATE_CREDIT in
+ * batches of RDE_PEER_CREDIT_BATCH once it took the messages off the
+ * pipe, independent of how far the peer socket drained. So up to
+ * RDE_PEER_CREDIT_BATCH - 1 of the used credits belong to messages
+ * already queued on the socket, which has its own limit with
+ * SESS_MSG_HIGH_MARK. Peers with credit left are served in deficit
+ * round-robin order, each round adds RDE_UPDATE_QUANTUM bytes to the
+ * peer deficit.
+ */
+#define RDE_PEER_CREDIT		64
+#define RDE_PEER_CREDIT_BATCH	16
+#define RDE_UPDATE_QUANTUM	MAX_PKTSIZE
+
+/*
+ * Every LATENCY_SAMPLE received UPDATE is timestamped by the SE and
+ * followed through the RDE. The time since it was read is recorded per
+ * pipeline stage in log2 histograms, bucket i counts samples up to
+ * 8 << i microseconds and the last one everything above.
+ */
+#define LATENCY_SAMPLE		64
+#define LATENCY_BUCKETS		24
+
+/*
+ * Binary trace ring, each process keeps the last TRACE_RING_SIZE events
+ * of the enabled trace classes. A dump is sent in TRACE_DUMP_CHUNK sized
+ * pieces to bgpctl which writes it to a file. At most TRACE_DUMP_QUEUED
+ * pieces are queued at a time, the rest follows as the queue drains.
+ */
+#define TRACE_RING_SIZE		32768
+#define TRACE_DUMP_CHUNK	256
+#define TRACE_DUMP_QUEUED	4
+#define TRACE_MAGIC		"BGPDTRC1"
+#define TRACE_VERSION		1
+
 enum bgpd_process {
 	PROC_MAIN,
 	PROC_SE,
@@ -231,6 +276,15 @@ struct listen_addr {
 };
 
 TAILQ_HEAD(listen_addrs, listen_addr);
+
+struct rtr_config {
+	SIMPLEQ_ENTRY(rtr_config)	entry;
+	char				descr[PEER_DESCR_LEN];
+	struct bgpd_addr		remote_addr;
+	u_int16_t			remote_port;
+};
+
+SIMPLEQ_HEAD(rtr_config_head, rtr_config);
 TAILQ_HEAD(filter_set_head, filter_set);
 
 struct peer;
@@ -249,13 +303,26 @@ RB_HEAD(prefixset_tree, prefixset_item);
 
 struct tentry_v4;
 struct tentry_v6;
+struct trie_multi;
+
 struct trie_head {
 	struct tentry_v4	*root_v4;
 	struct tentry_v6	*root_v6;
+	struct trie_multi	*multi_v4;	/* compiled lookup tables */
+	struct trie_multi	*multi_v6;
 	int			 match_default_v4;
 	int			 match_default_v6;
 };
 
+/* insert state of trie_bulk_add() and trie_bulk_roa_add() */
+struct trie_bulk {
+	struct trie_head	*th;
+	struct tentry_v4	*path_v4[33];
+	struct tentry_v6	*path_v6[129];
+	int			 depth_v4;
+	int			 depth_v6;
+};
+
 struct rde_prefixset {
 	char				name[SET_NAME_LEN];
 	struct trie_head		th;
@@ -285,6 +352,7 @@ struct bgpd_config {
 	struct rde_prefixset_head		 rde_originsets;
 	struct rde_prefixset			 rde_roa;
 	struct as_set_head			 as_sets;
+	struct rtr_config_head			 rtrs;
 	char					*csock;
 	char					*rcsock;
 	int					 flags;
@@ -293,10 +361,16 @@ struct bgpd_config {
 	u_int32_t				 bgpid;
 	u_int32_t				 clusterid;
 	u_int32_t				 as;
+	u_int32_t				 damp_halflife;
+	u_int32_t				 damp_maxsuppress;
 	u_int16_t				 short_as;
 	u_int16_t				 holdtime;
 	u_int16_t				 min_holdtime;
 	u_int16_t				 connectretry;
+	u_int16_t				 mrai_ebgp;
+	u_int16_t				 mrai_ibgp;
+	u_int16_t				 damp_reuse;
+	u_int16_t				 damp_suppress;
 	u_int8_t				 fib_priority;
 };
 
@@ -388,6 +462,7 @@ struct peer_config {
 	u_int16_t		 max_out_prefix_restart;
 	u_int16_t		 holdtime;
 	u_int16_t		 min_holdtime;
+	u_int16_t		 mrai;		/* advertisement interval */
 	u_int16_t		 local_short_as;
 	u_int8_t		 template;
 	u_int8_t		 remote_masklen;
@@ -409,6 +484,17 @@ struct peer_config {
 
 #define PEERFLAG_TRANS_AS	0x01
 #define PEERFLAG_LOG_UPDATES	0x02
+#define PEERFLAG_MRAI		0x04	/* mrai set for this peer */
+#define PEERFLAG_MRAI_WITHDRAW	0x08	/* pace withdraws as well */
+#define PEERFLAG_DAMPING	0x10	/* route flap damping */
+#define PEERFLAG_NO_ADJRIBIN	0x20	/* no Adj-RIB-In, refresh instead */
+
+/* route flap damping defaults, see RFC 7196 */
+#define	DAMP_HALFLIFE		900
+#define	DAMP_REUSE		750
+#define	DAMP_SUPPRESS		6000
+#define	DAMP_MAXSUPPRESS	3600
+#define	DAMP_PENALTY_MAX	0xffff
 
 enum network_type {
 	NETWORK_DEFAULT,	/* from network statements */
@@ -458,12 +544,18 @@ enum imsg_type {
 	IMSG_CTL_SHOW_RIB_PREFIX,
 	IMSG_CTL_SHOW_RIB_COMMUNITIES,
 	IMSG_CTL_SHOW_RIB_ATTR,
+	IMSG_CTL_SHOW_RIB_BULK,
 	IMSG_CTL_SHOW_NETWORK,
 	IMSG_CTL_SHOW_RIB_MEM,
 	IMSG_CTL_SHOW_RIB_HASH,
+	IMSG_CTL_SHOW_RIB_STATS,
+	IMSG_CTL_SHOW_RIB_PEERSTATS,
 	IMSG_CTL_SHOW_TERSE,
 	IMSG_CTL_SHOW_TIMER,
+	IMSG_CTL_SHOW_RTR,
 	IMSG_CTL_LOG_VERBOSE,
+	IMSG_CTL_TRACE,
+	IMSG_CTL_TRACE_DUMP,
 	IMSG_CTL_SHOW_FIB_TABLES,
 	IMSG_CTL_TERMINATE,
 	IMSG_NETWORK_ADD,
@@ -486,16 +578,19 @@ enum imsg_type {
 	IMSG_RECONF_VPN_IMPORT,
 	IMSG_RECONF_VPN_DONE,
 	IMSG_RECONF_PREFIX_SET,
-	IMSG_RECONF_PREFIX_SET_ITEM,
+	IMSG_RECONF_PREFIX_SET_ITEMS,
+	IMSG_RECONF_PREFIX_SET_DONE,
 	IMSG_RECONF_AS_SET,
 	IMSG_RECONF_AS_SET_ITEMS,
 	IMSG_RECONF_AS_SET_DONE,
 	IMSG_RECONF_ORIGIN_SET,
 	IMSG_RECONF_ROA_SET,
-	IMSG_RECONF_ROA_SET_ITEMS,
+	IMSG_RECONF_ROA_ITEMS,
+	IMSG_RECONF_RTR_CONFIG,
 	IMSG_RECONF_DRAIN,
 	IMSG_RECONF_DONE,
 	IMSG_UPDATE,
+	IMSG_UPDATE_SAMPLE,
 	IMSG_UPDATE_ERR,
 	IMSG_SESSION_ADD,
 	IMSG_SESSION_UP,
@@ -520,7 +615,12 @@ enum imsg_type {
 	IMSG_IFINFO,
 	IMSG_DEMOTE,
 	IMSG_XON,
-	IMSG_XOFF
+	IMSG_XOFF,
+	IMSG_UPDATE_CREDIT,
+	IMSG_LOG,
+	IMSG_RTR_ROA_ADD,
+	IMSG_RTR_ROA_DEL,
+	IMSG_RTR_ROA_COMMIT
 };
 
 struct demote_msg {
@@ -696,6 +796,25 @@ struct ctl_show_nexthop {
 	u_int8_t			krvalid;
 };
 
+struct ctl_show_rtr {
+	char			descr[PEER_DESCR_LEN];
+	char			state[16];
+	struct bgpd_addr	remote_addr;
+	time_t			last_update;	/* seconds ago, -1 never */
+	u_int32_t		serial;
+	u_int32_t		refresh;
+	u_int32_t		retry;
+	u_int32_t		expire;
+	u_int32_t		vrp_v4;
+	u_int32_t		vrp_v6;
+	u_int32_t		updates;
+	u_int32_t		update_ms;	/* duration of last update */
+	u_int16_t		session_id;
+	u_int16_t		remote_port;
+	u_int8_t		version;
+	u_int8_t		have_serial;
+};
+
 struct ctl_neighbor {
 	struct bgpd_addr	addr;
 	char			descr[PEER_DESCR_LEN];
@@ -710,6 +829,7 @@ struct ctl_neighbor {
 #define	F_PREF_ANNOUNCE	0x08
 #define	F_PREF_STALE	0x10
 #define	F_PREF_INVALID	0x20
+#define	F_PREF_DAMPED	0x40
 
 struct ctl_show_rib {
 	struct bgpd_addr	true_nexthop;
@@ -723,6 +843,8 @@ struct ctl_show_rib {
 	u_int32_t		med;
 	u_int32_t		weight;
 	u_int32_t		flags;
+	u_int32_t		damp_reuse;	/* seconds until reuse */
+	u_int16_t		damp_penalty;
 	u_int8_t		prefixlen;
 	u_int8_t		origin;
 	u_int8_t		validation_state;
@@ -779,6 +901,14 @@ struct filter_originset {
 	struct rde_prefixset	*ps;
 };
 
+#define	ASPATH_RE_LEN		128
+
+struct aspath_re;
+struct filter_aspath {
+	char			 re[ASPATH_RE_LEN];
+	struct aspath_re	*dfa;		/* compiled by the RDE */
+};
+
 struct filter_ovs {
 	u_int8_t		 validity;
 	u_int8_t		 is_set;
@@ -801,6 +931,28 @@ struct community {
 	u_int32_t	data3;
 };
 
+/*
+ * Bulk RIB dump, IMSG_CTL_SHOW_RIB_BULK. A message starts with the
+ * version byte followed by records, each starting with its type byte.
+ * Integers are in network byte order. An address is encoded as the aid
+ * byte followed by 4 bytes for IPv4, 16 bytes for IPv6, nothing for
+ * AID_UNSPEC and a struct bgpd_addr for any other family. Peers and
+ * attribute sets are defined before use and are only valid within the
+ * message defining them.
+ *
+ * PEER:   u32 id, u32 bgp id, addr remote, u8 len, descr
+ * ATTR:   u16 ref, u8 origin, u32 lpref, u32 med, u32 weight,
+ *         u16 len, aspath, u16 count, count * 4 * u32 community,
+ *         u16 len, optional attributes in wire format
+ * PREFIX: u32 peer id, u16 attr ref, u32 flags, u8 validation state,
+ *         u32 age, addr prefix, u8 prefixlen, addr exit nexthop,
+ *         addr true nexthop, if F_PREF_DAMPED u32 reuse, u16 penalty
+ */
+#define	CTL_BULK_VERSION	2
+#define	CTL_BULK_PEER		1
+#define	CTL_BULK_ATTR		2
+#define	CTL_BULK_PREFIX		3
+
 struct ctl_show_rib_request {
 	char			rib[PEER_DESCR_LEN];
 	struct ctl_neighbor	neighbor;
@@ -965,6 +1117,7 @@ struct filter_match {
 	struct filter_prefixset		prefixset;
 	struct filter_originset		originset;
 	struct filter_ovs		ovs;
+	struct filter_aspath		aspath;
 };
 
 struct filter_rule {
@@ -1031,6 +1184,14 @@ struct roa_set {
 	u_int32_t	maxlen;	/* change type for better struct layout */
 };
 
+/* single ROA, used for the bulk transfer of ROA sets and by RTR */
+struct roa {
+	struct bgpd_addr	prefix;
+	u_int32_t		asnum;
+	u_int8_t		prefixlen;
+	u_int8_t		maxlen;
+};
+
 struct prefixset_item {
 	struct filter_prefix		p;
 	RB_ENTRY(prefixset_item)	entry;
@@ -1108,6 +1269,10 @@ struct rde_memstats {
 	long long	aset_nmemb;
 	long long	pset_cnt;
 	long long	pset_size;
+	long long	damp_cnt;
+	long long	damp_size;
+	long long	index_cnt;
+	long long	index_size;
 };
 
 struct rde_hashstats {
@@ -1119,7 +1284,89 @@ struct rde_hashstats {
 	long long	sumq;
 };
 
+struct rib_stats {
+	u_int64_t	prefix_cnt;
+	u_int64_t	active_cnt;
+	u_int64_t	eligible_cnt;	/* not in F_RIB_NOEVALUATE RIBs */
+	u_int64_t	ovs_cnt[ROA_MASK + 1];
+};
+
+struct ctl_show_rib_stats {
+	char			rib[PEER_DESCR_LEN];
+	struct rib_stats	stats;
+	u_int16_t		flags;
+	u_int8_t		aid;
+};
+
+enum latency_stage {
+	LAT_QUEUE,		/* dequeued by the RDE */
+	LAT_DECISION,		/* decision process done */
+	LAT_ADJOUT,		/* queued in an Adj-RIB-Out */
+	LAT_FIB,		/* route sent to the parent for the FIB */
+	LAT_SEND,		/* UPDATE built for this peer */
+	LAT_MAX
+};
+
+struct latency_hist {
+	u_int64_t	bucket[LATENCY_BUCKETS];
+	u_int64_t	count;
+	u_int64_t	sum;		/* in microseconds */
+};
+
+/* trace classes */
+#define TRACE_UPDATE		0x01
+#define TRACE_FILTER		0x02
+#define TRACE_DECISION		0x04
+#define TRACE_KROUTE		0x08
+#define TRACE_IMSG		0x10
+#define TRACE_ALL		0x1f
+
+enum trace_type {
+	TRACE_EV_NONE,
+	TRACE_EV_UPDATE,	/* UPDATE received, value is the length */
+	TRACE_EV_FILTER,	/* input filter verdict, value is the action */
+	TRACE_EV_BEST,		/* best path changed, peerid of new best */
+	TRACE_EV_KROUTE,	/* route sent to the FIB, value is imsg type */
+	TRACE_EV_IMSG		/* data is the pipe, value is bytes queued */
+};
+
+/* events are 32 bytes and stored in host byte order */
+struct trace_event {
+	u_int64_t	time;		/* CLOCK_MONOTONIC in nanoseconds */
+	u_int64_t	data;		/* first 8 bytes of the prefix */
+	u_int32_t	peerid;
+	u_int32_t	value;
+	u_int16_t	type;
+	u_int8_t	proc;
+	u_int8_t	aid;
+	u_int8_t	prefixlen;
+	u_int8_t	pad[3];
+};
+
+/* header of the trace file written by bgpctl */
+struct trace_header {
+	char		magic[8];
+	u_int32_t	version;
+	u_int32_t	evsize;
+};
+
+/* position of a running trace dump */
+struct trace_cursor {
+	u_int32_t	start;
+	u_int32_t	cnt;
+};
+
+struct ctl_show_rib_peerstats {
+	struct bgpd_addr	remote_addr;
+	char			descr[PEER_DESCR_LEN];
+	char			rib[PEER_DESCR_LEN];
+	u_int32_t		prefix_cnt;
+	u_int32_t		prefix_best_cnt;
+};
+
 #define	MRT_FILE_LEN	512
+#define	MRT_MAX_QUEUED	65536	/* queued records before dropping */
+#define	MRT_WRITER_BUFSIZE	(64 * 1024)
 #define	MRT2MC(x)	((struct mrt_config *)(x))
 
 enum mrt_type {
@@ -1148,6 +1395,7 @@ struct mrt {
 	u_int32_t		group_id;
 	enum mrt_type		type;
 	enum mrt_state		state;
+	u_int32_t		dropped;
 	u_int16_t		seqnum;
 };
 
@@ -1176,6 +1424,7 @@ int	control_imsg_relay(struct imsg *);
 struct bgpd_config	*new_config(void);
 void		copy_config(struct bgpd_config *, struct bgpd_config *);
 void		free_l3vpns(struct l3vpn_head *);
+void		free_rtrs(struct rtr_config_head *);
 void		free_config(struct bgpd_config *);
 void		free_prefixsets(struct prefixset_head *);
 void		free_rde_prefixsets(struct rde_prefixset_head *);
@@ -1226,6 +1475,7 @@ void		 log_peer_warnx(const struct peer_config *, const char *, ...)
 void		 mrt_clear_seq(void);
 void		 mrt_write(struct mrt *);
 void		 mrt_clean(struct mrt *);
+void		 mrt_dropped(struct mrt *);
 void		 mrt_init(struct imsgbuf *, struct imsgbuf *);
 time_t		 mrt_timeout(struct mrt_head *);
 void		 mrt_reconfigure(struct mrt_head *);
@@ -1277,27 +1527,61 @@ int		 as_set_match(const struct as_set *, u_int32_t);
 struct set_table	*set_new(size_t, size_t);
 void			 set_free(struct set_table *);
 int			 set_add(struct set_table *, void *, size_t);
+int			 set_del(struct set_table *, u_int32_t);
 void			*set_get(struct set_table *, size_t *);
 void			 set_prep(struct set_table *);
 void			*set_match(const struct set_table *, u_int32_t);
 int			 set_equal(const struct set_table *,
 			    const struct set_table *);
 
+/* rde_regex.c */
+struct aspath_re	*aspath_re_compile(const char *, const char **);
+void			 aspath_re_free(struct aspath_re *);
+
 /* rde_trie.c */
 int	trie_add(struct trie_head *, struct bgpd_addr *, u_int8_t, u_int8_t,
 	    u_int8_t);
 int	trie_roa_add(struct trie_head *, struct bgpd_addr *, u_int8_t,
 	    struct set_table *);
+void	trie_bulk_init(struct trie_bulk *, struct trie_head *);
+int	trie_bulk_add(struct trie_bulk *, struct bgpd_addr *, u_int8_t,
+	    u_int8_t, u_int8_t);
+int	trie_bulk_roa_add(struct trie_bulk *, struct bgpd_addr *, u_int8_t,
+	    struct set_table *);
+int	trie_roa_update(struct trie_head *, struct bgpd_addr *, u_int8_t,
+	    struct roa_set *);
+int	trie_roa_delete(struct trie_head *, struct bgpd_addr *, u_int8_t,
+	    u_int32_t);
 void	trie_free(struct trie_head *);
+int	trie_compile(struct trie_head *);
 int	trie_match(struct trie_head *, struct bgpd_addr *, u_int8_t, int);
 int	trie_roa_check(struct trie_head *, struct bgpd_addr *, u_int8_t,
 	    u_int32_t);
 void	trie_dump(struct trie_head *);
 int	trie_equal(struct trie_head *, struct trie_head *);
+void	trie_diff(struct trie_head *, struct trie_head *,
+	    void (*)(struct bgpd_addr *, u_int8_t, void *), void *);
+void	trie_roa_diff(struct trie_head *, struct trie_head *,
+	    void (*)(struct bgpd_addr *, u_int8_t, void *), void *);
 
 /* timer.c */
 time_t			 getmonotime(void);
 
+/* trace.c */
+extern u_int32_t	 trace_mask;
+#define TRACE_ON(c)	(trace_mask & (c))
+#define TRACE_VALUE(c, t, id, d, v)					\
+	do {								\
+		if (TRACE_ON(c))					\
+			trace_value((t), (id), (d), (v));		\
+	} while (0)
+void	trace_set(u_int32_t, enum bgpd_process);
+void	trace_value(enum trace_type, u_int32_t, u_int64_t, u_int32_t);
+void	trace_prefix(enum trace_type, u_int32_t, struct bgpd_addr *,
+	    u_int8_t, u_int32_t);
+void	trace_dump_start(struct trace_cursor *);
+int	trace_dump(struct imsgbuf *, pid_t, struct trace_cursor *, u_int);
+
 /* util.c */
 const char	*log_addr(const struct bgpd_addr *);
 const char	*log_in6addr(const struct in6_addr *);
@@ -1306,6 +1590,7 @@ const char	*log_as(u_int32_t);
 const char	*log_rd(u_int64_t);
 const char	*log_ext_subtype(short, u_int8_t);
 const char	*log_reason(const char *);
+const char	*aspath_delim(u_int8_t, int);
 int		 aspath_snprint(char *, size_t, void *, u_int16_t);
 int		 aspath_asprint(char **, void *, u_int16_t);
 size_t		 aspath_strlen(void *, u_int16_t);
@@ -1461,6 +1746,14 @@ static const char * const ctl_res_strerror[] = {
 	"no such RIB"
 };
 
+static const char * const latency_stages[] = {
+	"queue",
+	"decision",
+	"adjout",
+	"fib",
+	"send"
+};
+
 static const char * const timernames[] = {
 	"None",
 	"ConnectRetryTimer",
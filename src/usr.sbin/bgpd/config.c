@@ -60,6 +60,7 @@ new_config(void)
 	SIMPLEQ_INIT(&conf->rde_originsets);
 	RB_INIT(&conf->roa);
 	SIMPLEQ_INIT(&conf->as_sets);
+	SIMPLEQ_INIT(&conf->rtrs);
 
 	TAILQ_INIT(conf->filters);
 	TAILQ_INIT(conf->listen_addrs);
@@ -81,6 +82,12 @@ copy_config(struct bgpd_config *to, struct bgpd_config *from)
 	to->holdtime = from->holdtime;
 	to->min_holdtime = from->min_holdtime;
 	to->connectretry = from->connectretry;
+	to->mrai_ebgp = from->mrai_ebgp;
+	to->mrai_ibgp = from->mrai_ibgp;
+	to->damp_halflife = from->damp_halflife;
+	to->damp_maxsuppress = from->damp_maxsuppress;
+	to->damp_reuse = from->damp_reuse;
+	to->damp_suppress = from->damp_suppress;
 	to->fib_priority = from->fib_priority;
 }
 
@@ -110,6 +117,17 @@ free_l3vpns(struct l3vpn_head *l3vpns)
 	}
 }
 
+void
+free_rtrs(struct rtr_config_head *rh)
+{
+	struct rtr_config	*r;
+
+	while ((r = SIMPLEQ_FIRST(rh)) != NULL) {
+		SIMPLEQ_REMOVE_HEAD(rh, entry);
+		free(r);
+	}
+}
+
 void
 free_prefixsets(struct prefixset_head *psh)
 {
@@ -167,6 +185,7 @@ free_config(struct bgpd_config *conf)
 	free_rde_prefixsets(&conf->rde_originsets);
 	as_sets_free(&conf->as_sets);
 	free_prefixtree(&conf->roa);
+	free_rtrs(&conf->rtrs);
 
 	while ((la = TAILQ_FIRST(conf->listen_addrs)) != NULL) {
 		TAILQ_REMOVE(conf->listen_addrs, la, entry);
@@ -255,6 +274,10 @@ merge_config(struct bgpd_config *xconf, struct bgpd_config *conf)
 	free_l3vpns(&xconf->l3vpns);
 	SIMPLEQ_CONCAT(&xconf->l3vpns, &conf->l3vpns);
 
+	/* switch the rtr configs, first remove the old ones */
+	free_rtrs(&xconf->rtrs);
+	SIMPLEQ_CONCAT(&xconf->rtrs, &conf->rtrs);
+
 	/*
 	 * merge new listeners:
 	 * -flag all existing ones as to be deleted
@@ -35,6 +35,7 @@ struct ctl_conn	*control_connbyfd(int);
 struct ctl_conn	*control_connbypid(pid_t);
 int		 control_close(int);
 void		 control_result(struct ctl_conn *, u_int);
+void		 control_trace_dump(struct ctl_conn *);
 ssize_t		 imsg_read_nofd(struct imsgbuf *);
 
 int
@@ -227,6 +228,7 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 	struct ctl_conn		*c;
 	ssize_t			 n;
 	int			 verbose, matched;
+	u_int32_t		 mask;
 	struct peer		*p;
 	struct ctl_neighbor	*neighbor;
 	struct ctl_show_rib_request	*ribreq;
@@ -245,6 +247,8 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 			if (imsg_ctl_rde(IMSG_XON, c->ibuf.pid, NULL, 0) != -1)
 				c->throttled = 0;
 		}
+		if (c->tracing)
+			control_trace_dump(c);
 	}
 
 	if (!(pfd->revents & POLLIN))
@@ -271,8 +275,10 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 			case IMSG_CTL_SHOW_NEXTHOP:
 			case IMSG_CTL_SHOW_INTERFACE:
 			case IMSG_CTL_SHOW_RIB_MEM:
+			case IMSG_CTL_SHOW_RIB_STATS:
 			case IMSG_CTL_SHOW_TERSE:
 			case IMSG_CTL_SHOW_TIMER:
+			case IMSG_CTL_SHOW_RTR:
 			case IMSG_CTL_SHOW_NETWORK:
 			case IMSG_CTL_SHOW_RIB:
 			case IMSG_CTL_SHOW_RIB_PREFIX:
@@ -300,6 +306,10 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 				    0, 0, -1, p, sizeof(struct peer));
 			imsg_compose(&c->ibuf, IMSG_CTL_END, 0, 0, -1, NULL, 0);
 			break;
+		case IMSG_CTL_SHOW_RTR:
+			rtr_show(&c->ibuf, 0);
+			imsg_compose(&c->ibuf, IMSG_CTL_END, 0, 0, -1, NULL, 0);
+			break;
 		case IMSG_CTL_SHOW_NEIGHBOR:
 			c->ibuf.pid = imsg.hdr.pid;
 
@@ -492,6 +502,7 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 			c->terminate = 1;
 			/* FALLTHROUGH */
 		case IMSG_CTL_SHOW_RIB_MEM:
+		case IMSG_CTL_SHOW_RIB_STATS:
 			c->ibuf.pid = imsg.hdr.pid;
 			imsg_ctl_rde(imsg.hdr.type, imsg.hdr.pid,
 			    imsg.data, imsg.hdr.len - IMSG_HEADER_SIZE);
@@ -520,6 +531,26 @@ control_dispatch_msg(struct pollfd *pfd, u_int *ctl_cnt,
 			memcpy(&verbose, imsg.data, sizeof(verbose));
 			log_setverbose(verbose);
 			break;
+		case IMSG_CTL_TRACE:
+			if (imsg.hdr.len != IMSG_HEADER_SIZE +
+			    sizeof(mask))
+				break;
+
+			/* the parent does not trace */
+			imsg_ctl_rde(imsg.hdr.type, 0,
+			    imsg.data, imsg.hdr.len - IMSG_HEADER_SIZE);
+
+			memcpy(&mask, imsg.data, sizeof(mask));
+			trace_set(mask, PROC_SE);
+			break;
+		case IMSG_CTL_TRACE_DUMP:
+			if (c->tracing)
+				break;
+			c->ibuf.pid = imsg.hdr.pid;
+			trace_dump_start(&c->trace);
+			c->tracing = 1;
+			control_trace_dump(c);
+			break;
 		default:
 			break;
 		}
@@ -550,6 +581,20 @@ control_imsg_relay(struct imsg *imsg)
 	    imsg->data, imsg->hdr.len - IMSG_HEADER_SIZE));
 }
 
+/* send the next part of the ring, the rest follows from the write path */
+void
+control_trace_dump(struct ctl_conn *c)
+{
+	if (c->ibuf.w.queued >= TRACE_DUMP_QUEUED)
+		return;
+	if (trace_dump(&c->ibuf, c->ibuf.pid, &c->trace,
+	    TRACE_DUMP_QUEUED - c->ibuf.w.queued))
+		return;
+	c->tracing = 0;
+	/* the RDE appends its ring and ends the reply */
+	imsg_ctl_rde(IMSG_CTL_TRACE_DUMP, c->ibuf.pid, NULL, 0);
+}
+
 void
 control_result(struct ctl_conn *c, u_int code)
 {
@@ -26,10 +26,50 @@
 
 #include "log.h"
 
+/*
+ * Once log_queue_init() was called messages are formatted into a ring
+ * and only written out by log_flush() from the main loop, either by the
+ * writer callback (which passes them to the parent) or to syslog.
+ * Each message class is rate limited by a token bucket, messages over
+ * the limit are counted and reported once the class has tokens again.
+ * Forked children must call log_queue_drop() since nobody flushes their
+ * copy of the ring.
+ */
+#define LOG_MSG_LEN	1024
+#define LOG_RATE	20	/* messages per second */
+#define LOG_BURST	200
+#define LOG_RING_SIZE	(3 * LOG_BURST)	/* a full burst of every class */
+
+struct log_msg {
+	int	pri;
+	char	msg[LOG_MSG_LEN];
+};
+
+struct log_rate {
+	time_t		last;
+	unsigned int	tokens;
+	unsigned int	suppressed;
+};
+
+static const char * const log_classnames[LOG_CLASS_MAX] = {
+	"general",
+	"neighbor",
+	"update"
+};
+
 static int		 debug;
 static int		 verbose;
 static const char	*log_procname;
 
+static struct log_msg	*log_ring;
+static unsigned int	 log_head, log_cnt, log_dropped;
+static int		(*log_writer)(int, const char *);
+static struct log_rate	 log_rates[LOG_CLASS_MAX];
+static int		 log_unlimited;
+
+static void	log_enqueue(int, const char *, ...)
+		    __attribute__((__format__ (printf, 2, 3)));
+
 void
 log_init(int n_debug, int facility)
 {
@@ -64,6 +104,174 @@ log_getverbose(void)
 	return (verbose);
 }
 
+void
+log_queue_init(int (*writer)(int, const char *))
+{
+	if (log_ring == NULL &&
+	    (log_ring = calloc(LOG_RING_SIZE, sizeof(*log_ring))) == NULL)
+		return;		/* stay synchronous */
+	log_writer = writer;
+}
+
+/* write out all pending messages and go back to synchronous logging */
+void
+log_queue_done(void)
+{
+	log_writer = NULL;
+	log_flush();
+	free(log_ring);
+	log_ring = NULL;
+}
+
+/*
+ * Called in a forked child. The inherited messages are still written by
+ * the parent, drop them without writing and log synchronously.
+ */
+void
+log_queue_drop(void)
+{
+	log_writer = NULL;
+	log_cnt = 0;
+	log_dropped = 0;
+	free(log_ring);
+	log_ring = NULL;
+}
+
+/* turn the rate limit off, e.g. while parsing the config */
+void
+log_nolimit(int on)
+{
+	log_unlimited = on;
+}
+
+void
+log_emit(int pri, const char *msg)
+{
+	if (debug) {
+		fprintf(stderr, "%s\n", msg);
+		fflush(stderr);
+	} else
+		syslog(pri, "%s", msg);
+}
+
+static time_t
+log_now(void)
+{
+	struct timespec	ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return (0);
+	return (ts.tv_sec);
+}
+
+/* refill the bucket and report suppressed messages, returns tokens */
+static unsigned int
+log_refill(int class, time_t now)
+{
+	struct log_rate	*lr = &log_rates[class];
+	unsigned int	 n;
+
+	if (now != lr->last) {
+		if (lr->last == 0 || now - lr->last >= LOG_BURST / LOG_RATE)
+			lr->tokens = LOG_BURST;
+		else {
+			lr->tokens += (now - lr->last) * LOG_RATE;
+			if (lr->tokens > LOG_BURST)
+				lr->tokens = LOG_BURST;
+		}
+		lr->last = now;
+	}
+	if (lr->suppressed != 0 && lr->tokens != 0) {
+		n = lr->suppressed;
+		lr->suppressed = 0;
+		lr->tokens--;
+		logit(LOG_WARNING, "%u %s messages suppressed", n,
+		    log_classnames[class]);
+	}
+	return (lr->tokens);
+}
+
+/*
+ * Returns 1 if a message of class should be dropped. Callers check
+ * this before formatting the message.
+ */
+int
+log_limit(int class)
+{
+	if (log_unlimited || class < 0 || class >= LOG_CLASS_MAX)
+		return (0);
+	if (log_refill(class, log_now()) == 0) {
+		log_rates[class].suppressed++;
+		return (1);
+	}
+	log_rates[class].tokens--;
+	return (0);
+}
+
+static void
+log_drain(void)
+{
+	struct log_msg	*lm;
+
+	while (log_cnt > 0) {
+		lm = &log_ring[(log_head - log_cnt) % LOG_RING_SIZE];
+		if (log_writer == NULL || log_writer(lm->pri, lm->msg) == -1)
+			log_emit(lm->pri, lm->msg);
+		log_cnt--;
+	}
+}
+
+void
+log_flush(void)
+{
+	unsigned int	 n;
+	int		 class;
+	time_t		 now;
+
+	if (log_ring == NULL)
+		return;
+
+	log_drain();
+
+	now = log_now();
+	for (class = 0; class < LOG_CLASS_MAX; class++)
+		if (log_rates[class].suppressed != 0)
+			log_refill(class, now);
+	if (log_dropped != 0) {
+		n = log_dropped;
+		log_dropped = 0;
+		log_enqueue(LOG_WARNING, "log queue full, %u messages lost",
+		    n);
+	}
+
+	log_drain();
+}
+
+static void
+log_venqueue(int pri, const char *fmt, va_list ap)
+{
+	struct log_msg	*lm;
+
+	if (log_cnt == LOG_RING_SIZE) {
+		log_dropped++;
+		return;
+	}
+	lm = &log_ring[log_head++ % LOG_RING_SIZE];
+	log_cnt++;
+	lm->pri = pri;
+	(void)vsnprintf(lm->msg, sizeof(lm->msg), fmt, ap);
+}
+
+static void
+log_enqueue(int pri, const char *fmt, ...)
+{
+	va_list	ap;
+
+	va_start(ap, fmt);
+	log_venqueue(pri, fmt, ap);
+	va_end(ap);
+}
+
 void
 logit(int pri, const char *fmt, ...)
 {
@@ -80,6 +288,12 @@ vlog(int pri, const char *fmt, va_list ap)
 	char	*nfmt;
 	int	 saved_errno = errno;
 
+	if (log_ring != NULL && pri != LOG_CRIT) {
+		log_venqueue(pri, fmt, ap);
+		errno = saved_errno;
+		return;
+	}
+
 	if (debug) {
 		/* best effort in out of mem situations */
 		if (asprintf(&nfmt, "%s\n", fmt) == -1) {
@@ -103,6 +317,9 @@ log_warn(const char *emsg, ...)
 	va_list		 ap;
 	int		 saved_errno = errno;
 
+	if (log_limit(LOG_CLASS_GENERAL))
+		return;
+
 	/* best effort to even work in out of memory situations */
 	if (emsg == NULL)
 		logit(LOG_ERR, "%s", strerror(saved_errno));
@@ -129,6 +346,8 @@ log_warnx(const char *emsg, ...)
 {
 	va_list	 ap;
 
+	if (log_limit(LOG_CLASS_GENERAL))
+		return;
 	va_start(ap, emsg);
 	vlog(LOG_ERR, emsg, ap);
 	va_end(ap);
@@ -139,6 +358,8 @@ log_info(const char *emsg, ...)
 {
 	va_list	 ap;
 
+	if (log_limit(LOG_CLASS_GENERAL))
+		return;
 	va_start(ap, emsg);
 	vlog(LOG_INFO, emsg, ap);
 	va_end(ap);
@@ -169,6 +390,7 @@ vfatalc(int code, const char *emsg, va_list ap)
 		s[0] = '\0';
 		sep = "";
 	}
+	log_queue_done();
 	if (code)
 		logit(LOG_CRIT, "fatal in %s: %s%s%s",
 		    log_procname, s, sep, strerror(code));
@@ -22,10 +22,24 @@
 #include <stdarg.h>
 #include <sys/cdefs.h>
 
+enum log_class {
+	LOG_CLASS_GENERAL,
+	LOG_CLASS_PEER,
+	LOG_CLASS_UPDATE,
+	LOG_CLASS_MAX
+};
+
 void	log_init(int, int);
 void	log_procinit(const char *);
 void	log_setverbose(int);
 int	log_getverbose(void);
+void	log_queue_init(int (*)(int, const char *));
+void	log_queue_done(void);
+void	log_queue_drop(void);
+void	log_nolimit(int);
+void	log_flush(void);
+void	log_emit(int, const char *);
+int	log_limit(int);
 void	log_warn(const char *, ...)
 	    __attribute__((__format__ (printf, 1, 2)));
 void	log_warnx(const char *, ...)
@@ -63,6 +63,8 @@ log_peer_info(const struct peer_config *peer, const char *emsg, ...)
 	char	*p, *nfmt;
 	va_list	 ap;
 
+	if (log_limit(LOG_CLASS_PEER))
+		return;
 	p = log_fmt_peer(peer);
 	if (asprintf(&nfmt, "%s: %s", p, emsg) == -1)
 		fatal(NULL);
@@ -79,6 +81,8 @@ log_peer_warn(const struct peer_config *peer, const char *emsg, ...)
 	char	*p, *nfmt;
 	va_list	 ap;
 
+	if (log_limit(LOG_CLASS_PEER))
+		return;
 	p = log_fmt_peer(peer);
 	if (emsg == NULL) {
 		if (asprintf(&nfmt, "%s: %s", p, strerror(errno)) == -1)
@@ -101,6 +105,8 @@ log_peer_warnx(const struct peer_config *peer, const char *emsg, ...)
 	char	*p, *nfmt;
 	va_list	 ap;
 
+	if (log_limit(LOG_CLASS_PEER))
+		return;
 	p = log_fmt_peer(peer);
 	if (asprintf(&nfmt, "%s: %s", p, emsg) == -1)
 		fatal(NULL);
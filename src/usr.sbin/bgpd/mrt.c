@@ -22,10 +22,12 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "bgpd.h"
 #include "rde.h"
@@ -45,6 +47,7 @@ int mrt_dump_hdr_se(struct ibuf **, struct peer *, u_int16_t, u_int16_t,
     u_int32_t, int);
 int mrt_dump_hdr_rde(struct ibuf **, u_int16_t type, u_int16_t, u_int32_t);
 int mrt_open(struct mrt *, time_t);
+static int mrt_writer(int);
 
 #define DUMP_BYTE(x, b)							\
 	do {								\
@@ -99,6 +102,12 @@ mrt_dump_bgp_msg(struct mrt *mrt, void *pkg, u_int16_t pkglen,
 	int		 incoming = 0;
 	u_int16_t	 subtype = BGP4MP_MESSAGE;
 
+	/* the writer does not keep up, drop instead of queueing forever */
+	if (mrt->wbuf.queued >= MRT_MAX_QUEUED) {
+		mrt->dropped++;
+		return;
+	}
+
 	if (peer->capa.neg.as4byte)
 		subtype = BGP4MP_MESSAGE_AS4;
 
@@ -126,6 +135,12 @@ mrt_dump_state(struct mrt *mrt, u_int16_t old_state, u_int16_t new_state,
 	struct ibuf	*buf;
 	u_int16_t	 subtype = BGP4MP_STATE_CHANGE;
 
+	/* the writer does not keep up, drop instead of queueing forever */
+	if (mrt->wbuf.queued >= MRT_MAX_QUEUED) {
+		mrt->dropped++;
+		return;
+	}
+
 	if (peer->capa.neg.as4byte)
 		subtype = BGP4MP_STATE_CHANGE_AS4;
 
@@ -882,6 +897,7 @@ mrt_clean(struct mrt *mrt)
 {
 	struct ibuf	*b;
 
+	mrt_dropped(mrt);
 	close(mrt->wbuf.fd);
 	while ((b = TAILQ_FIRST(&mrt->wbuf.bufs))) {
 		TAILQ_REMOVE(&mrt->wbuf.bufs, b, entry);
@@ -890,6 +906,16 @@ mrt_clean(struct mrt *mrt)
 	mrt->wbuf.queued = 0;
 }
 
+void
+mrt_dropped(struct mrt *mrt)
+{
+	if (mrt->dropped == 0)
+		return;
+	log_warnx("mrt dump: %u records dropped, writer too slow",
+	    mrt->dropped);
+	mrt->dropped = 0;
+}
+
 static struct imsgbuf	*mrt_imsgbuf[2];
 
 void
@@ -903,7 +929,8 @@ int
 mrt_open(struct mrt *mrt, time_t now)
 {
 	enum imsg_type	type;
-	int		fd;
+	size_t		len;
+	int		fd, wfd;
 
 	if (strftime(MRT2MC(mrt)->file, sizeof(MRT2MC(mrt)->file),
 	    MRT2MC(mrt)->name, localtime(&now)) == 0) {
@@ -918,6 +945,15 @@ mrt_open(struct mrt *mrt, time_t now)
 		return (1);
 	}
 
+	/* compressed dumps are passed through a writer process */
+	len = strlen(MRT2MC(mrt)->file);
+	if (len > 3 && strcmp(MRT2MC(mrt)->file + len - 3, ".gz") == 0) {
+		wfd = mrt_writer(fd);
+		close(fd);
+		if ((fd = wfd) == -1)
+			return (1);
+	}
+
 	if (mrt->state == MRT_STATE_OPEN)
 		type = IMSG_MRT_OPEN;
 	else
@@ -930,6 +966,84 @@ mrt_open(struct mrt *mrt, time_t now)
 	return (1);
 }
 
+/*
+ * Fork a process that reads the MRT stream from a pipe and writes it
+ * gzip compressed to fd with large writes. Returns the non-blocking write
+ * end of the pipe to be passed to the SE or RDE or -1 on error.
+ */
+static int
+mrt_writer(int fd)
+{
+	gzFile	 gz;
+	char	*buf;
+	ssize_t	 n;
+	int	 p[2];
+
+	if (pipe2(p, O_CLOEXEC) == -1) {
+		log_warn("mrt_writer: pipe");
+		return (-1);
+	}
+
+	switch (fork()) {
+	case -1:
+		log_warn("mrt_writer: fork");
+		close(p[0]);
+		close(p[1]);
+		return (-1);
+	case 0:
+		break;
+	default:
+		close(p[0]);
+		if (fcntl(p[1], F_SETFL, O_NONBLOCK) == -1) {
+			log_warn("mrt_writer: fcntl");
+			close(p[1]);
+			return (-1);
+		}
+		return (p[1]);
+	}
+
+	/* the parent writes its queued log messages itself */
+	log_queue_drop();
+
+	/* finish the file even if bgpd is shutting down */
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGINT, SIG_IGN);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGALRM, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGCHLD, SIG_DFL);
+
+	if (dup2(p[0], STDIN_FILENO) == -1 || dup2(fd, STDOUT_FILENO) == -1)
+		fatal("mrt_writer: dup2");
+	closefrom(STDERR_FILENO + 1);
+
+	setproctitle("mrt writer");
+	if (pledge("stdio", NULL) == -1)
+		fatal("pledge");
+
+	if ((buf = malloc(MRT_WRITER_BUFSIZE)) == NULL)
+		fatal("mrt_writer");
+	if ((gz = gzdopen(STDOUT_FILENO, "wb")) == NULL)
+		fatalx("mrt_writer: gzdopen failed");
+	if (gzbuffer(gz, 2 * MRT_WRITER_BUFSIZE) == -1)
+		fatalx("mrt_writer: gzbuffer failed");
+
+	for (;;) {
+		if ((n = read(STDIN_FILENO, buf, MRT_WRITER_BUFSIZE)) == -1) {
+			if (errno == EINTR)
+				continue;
+			fatal("mrt_writer: read");
+		}
+		if (n == 0)
+			break;
+		if (gzwrite(gz, buf, n) != n)
+			fatalx("mrt_writer: gzwrite failed");
+	}
+	if (gzclose(gz) != Z_OK)
+		fatalx("mrt_writer: gzclose failed");
+	_exit(0);
+}
+
 time_t
 mrt_timeout(struct mrt_head *mrt)
 {
@@ -195,6 +195,7 @@ typedef struct {
 %}
 
 %token	AS ROUTERID HOLDTIME YMIN LISTEN ON FIBUPDATE FIBPRIORITY RTABLE
+%token	ADVINTERVAL DAMPING SOFTRECONFIG
 %token	NONE UNICAST VPN RD EXPORT EXPORTTRGT IMPORTTRGT DEFAULTROUTE
 %token	RDE RIB EVALUATE IGNORE COMPARE
 %token	GROUP NEIGHBOR NETWORK
@@ -212,19 +213,21 @@ typedef struct {
 %token	COMMUNITY EXTCOMMUNITY LARGECOMMUNITY DELETE
 %token	PREFIX PREFIXLEN PREFIXSET
 %token	ROASET ORIGINSET OVS
-%token	ASSET SOURCEAS TRANSITAS PEERAS MAXASLEN MAXASSEQ
+%token	ASSET SOURCEAS TRANSITAS PEERAS MAXASLEN MAXASSEQ ASPATH
 %token	SET LOCALPREF MED METRIC NEXTHOP REJECT BLACKHOLE NOMODIFY SELF
 %token	PREPEND_SELF PREPEND_PEER PFTABLE WEIGHT RTLABEL ORIGIN PRIORITY
 %token	ERROR INCLUDE
 %token	IPSEC ESP AH SPI IKE
 %token	IPV4 IPV6
 %token	QUALIFY VIA
+%token	RTR PORT
 %token	NE LE GE XRANGE LONGER MAXLEN
 %token	<v.string>		STRING
 %token	<v.number>		NUMBER
 %type	<v.number>		asnumber as4number as4number_any optnumber
 %type	<v.number>		espah family safi restart origincode nettype
-%type	<v.number>		yesno inout restricted validity
+%type	<v.number>		yesno inout restricted validity rtrport
+%type	<v.string>		rtrdescr
 %type	<v.string>		string
 %type	<v.addr>		address
 %type	<v.prefix>		prefix addrspec
@@ -583,6 +586,44 @@ conf_main	: AS as4number		{
 			}
 			conf->min_holdtime = $3;
 		}
+		| ADVINTERVAL EBGP NUMBER	{
+			if ($3 < 0 || $3 > USHRT_MAX) {
+				yyerror("advertisement-interval must be "
+				    "between 0 and %u", USHRT_MAX);
+				YYERROR;
+			}
+			conf->mrai_ebgp = $3;
+		}
+		| ADVINTERVAL IBGP NUMBER	{
+			if ($3 < 0 || $3 > USHRT_MAX) {
+				yyerror("advertisement-interval must be "
+				    "between 0 and %u", USHRT_MAX);
+				YYERROR;
+			}
+			conf->mrai_ibgp = $3;
+		}
+		| DAMPING STRING NUMBER	{
+			if ($3 < 1 || $3 > USHRT_MAX) {
+				yyerror("damping %s must be between 1 and %u",
+				    $2, USHRT_MAX);
+				free($2);
+				YYERROR;
+			}
+			if (!strcmp($2, "half-life"))
+				conf->damp_halflife = $3;
+			else if (!strcmp($2, "reuse"))
+				conf->damp_reuse = $3;
+			else if (!strcmp($2, "suppress"))
+				conf->damp_suppress = $3;
+			else if (!strcmp($2, "max-suppress"))
+				conf->damp_maxsuppress = $3;
+			else {
+				yyerror("unknown damping option \"%s\"", $2);
+				free($2);
+				YYERROR;
+			}
+			free($2);
+		}
 		| LISTEN ON address	{
 			struct listen_addr	*la;
 			struct sockaddr		*sa;
@@ -597,6 +638,34 @@ conf_main	: AS as4number		{
 			memcpy(&la->sa, sa, la->sa_len);
 			TAILQ_INSERT_TAIL(conf->listen_addrs, la, entry);
 		}
+		| RTR address rtrport rtrdescr	{
+			struct rtr_config	*rtr;
+
+			SIMPLEQ_FOREACH(rtr, &conf->rtrs, entry)
+				if (memcmp(&rtr->remote_addr, &$2,
+				    sizeof($2)) == 0 && rtr->remote_port == $3)
+					break;
+			if (rtr != NULL) {
+				yyerror("rtr %s port %lld already configured",
+				    log_addr(&$2), $3);
+				free($4);
+				YYERROR;
+			}
+			if ((rtr = calloc(1, sizeof(*rtr))) == NULL)
+				fatal("parse conf_main rtr calloc");
+			rtr->remote_addr = $2;
+			rtr->remote_port = $3;
+			if ($4 != NULL && strlcpy(rtr->descr, $4,
+			    sizeof(rtr->descr)) >= sizeof(rtr->descr)) {
+				yyerror("descr \"%s\" too long: max %zu",
+				    $4, sizeof(rtr->descr) - 1);
+				free($4);
+				free(rtr);
+				YYERROR;
+			}
+			free($4);
+			SIMPLEQ_INSERT_TAIL(&conf->rtrs, rtr, entry);
+		}
 		| FIBPRIORITY NUMBER		{
 			if ($2 <= RTP_NONE || $2 > RTP_MAX) {
 				yyerror("invalid fib-priority");
@@ -712,6 +781,24 @@ conf_main	: AS as4number		{
 			}
 			free($2);
 		}
+		| RDE STRING yesno		{
+			int	flag;
+
+			if (!strcmp($2, "mrt-snapshot"))
+				flag = BGPD_FLAG_MRT_SNAPSHOT;
+			else if (!strcmp($2, "rib-index"))
+				flag = BGPD_FLAG_RIB_INDEX;
+			else {
+				yyerror("unknown rde option \"%s\"", $2);
+				free($2);
+				YYERROR;
+			}
+			if ($3)
+				conf->flags |= flag;
+			else
+				conf->flags &= ~flag;
+			free($2);
+		}
 		| RDE MED COMPARE STRING	{
 			if (!strcmp($4, "always"))
 				conf->flags |= BGPD_FLAG_DECISION_MED_ALWAYS;
@@ -966,6 +1053,21 @@ restricted	: RESTRICTED	{ $$ = 1; }
 		| /* nothing */	{ $$ = 0; }
 		;
 
+rtrport		: /* empty */	{ $$ = RTR_PORT; }
+		| PORT NUMBER	{
+			if ($2 < 1 || $2 > USHRT_MAX) {
+				yyerror("port must be between 1 and %u",
+				    USHRT_MAX);
+				YYERROR;
+			}
+			$$ = $2;
+		}
+		;
+
+rtrdescr	: /* empty */	{ $$ = NULL; }
+		| DESCR string	{ $$ = $2; }
+		;
+
 address		: STRING		{
 			u_int8_t	len;
 
@@ -1338,6 +1440,40 @@ peeropts	: REMOTEAS as4number	{
 			}
 			curpeer->conf.min_holdtime = $3;
 		}
+		| ADVINTERVAL NUMBER	{
+			if ($2 < 0 || $2 > USHRT_MAX) {
+				yyerror("advertisement-interval must be "
+				    "between 0 and %u", USHRT_MAX);
+				YYERROR;
+			}
+			curpeer->conf.mrai = $2;
+			curpeer->conf.flags |= PEERFLAG_MRAI;
+		}
+		| ADVINTERVAL STRING yesno	{
+			if (strcmp($2, "withdraw")) {
+				yyerror("unknown advertisement-interval "
+				    "option \"%s\"", $2);
+				free($2);
+				YYERROR;
+			}
+			free($2);
+			if ($3 == 1)
+				curpeer->conf.flags |= PEERFLAG_MRAI_WITHDRAW;
+			else
+				curpeer->conf.flags &= ~PEERFLAG_MRAI_WITHDRAW;
+		}
+		| DAMPING yesno		{
+			if ($2 == 1)
+				curpeer->conf.flags |= PEERFLAG_DAMPING;
+			else
+				curpeer->conf.flags &= ~PEERFLAG_DAMPING;
+		}
+		| SOFTRECONFIG IN yesno	{
+			if ($3 == 1)
+				curpeer->conf.flags &= ~PEERFLAG_NO_ADJRIBIN;
+			else
+				curpeer->conf.flags |= PEERFLAG_NO_ADJRIBIN;
+		}
 		| ANNOUNCE family safi {
 			u_int8_t	aid, safi;
 			u_int16_t	afi;
@@ -2108,6 +2244,30 @@ filter_elm	: filter_prefix_h	{
 			fmopts.m.aslen.type = ASLEN_SEQ;
 			fmopts.m.aslen.aslen = $2;
 		}
+		| ASPATH STRING		{
+			struct aspath_re	*re;
+			const char		*errstr;
+
+			if (fmopts.m.aspath.re[0] != '\0') {
+				yyerror("as-path filter already specified");
+				free($2);
+				YYERROR;
+			}
+			if ((re = aspath_re_compile($2, &errstr)) == NULL) {
+				yyerror("bad as-path \"%s\": %s", $2, errstr);
+				free($2);
+				YYERROR;
+			}
+			aspath_re_free(re);
+			if (strlcpy(fmopts.m.aspath.re, $2,
+			    sizeof(fmopts.m.aspath.re)) >=
+			    sizeof(fmopts.m.aspath.re)) {
+				yyerror("as-path expression too long");
+				free($2);
+				YYERROR;
+			}
+			free($2);
+		}
 		| community STRING	{
 			int i;
 			for (i = 0; i < MAX_COMM_MATCH; i++) {
@@ -2773,12 +2933,14 @@ lookup(char *s)
 		{ "AS",			AS},
 		{ "IPv4",		IPV4},
 		{ "IPv6",		IPV6},
+		{ "advertisement-interval", ADVINTERVAL},
 		{ "ah",			AH},
 		{ "allow",		ALLOW},
 		{ "announce",		ANNOUNCE},
 		{ "any",		ANY},
 		{ "as-4byte",		AS4BYTE },
 		{ "as-override",	ASOVERRIDE},
+		{ "as-path",		ASPATH},
 		{ "as-set",		ASSET },
 		{ "blackhole",		BLACKHOLE},
 		{ "capabilities",	CAPABILITIES},
@@ -2786,6 +2948,7 @@ lookup(char *s)
 		{ "compare",		COMPARE},
 		{ "connect-retry",	CONNECTRETRY},
 		{ "connected",		CONNECTED},
+		{ "damping",		DAMPING},
 		{ "default-route",	DEFAULTROUTE},
 		{ "delete",		DELETE},
 		{ "demote",		DEMOTE},
@@ -2848,6 +3011,7 @@ lookup(char *s)
 		{ "password",		PASSWORD},
 		{ "peer-as",		PEERAS},
 		{ "pftable",		PFTABLE},
+		{ "port",		PORT},
 		{ "prefix",		PREFIX},
 		{ "prefix-set",		PREFIXSET},
 		{ "prefixlen",		PREFIXLEN},
@@ -2869,9 +3033,11 @@ lookup(char *s)
 		{ "router-id",		ROUTERID},
 		{ "rtable",		RTABLE},
 		{ "rtlabel",		RTLABEL},
+		{ "rtr",		RTR},
 		{ "self",		SELF},
 		{ "set",		SET},
 		{ "socket",		SOCKET },
+		{ "softreconfig",	SOFTRECONFIG},
 		{ "source-as",		SOURCEAS},
 		{ "spi",		SPI},
 		{ "static",		STATIC},
@@ -3254,6 +3420,10 @@ init_config(struct bgpd_config *c)
 	c->min_holdtime = MIN_HOLDTIME;
 	c->holdtime = INTERVAL_HOLD;
 	c->connectretry = INTERVAL_CONNECTRETRY;
+	c->damp_halflife = DAMP_HALFLIFE;
+	c->damp_reuse = DAMP_REUSE;
+	c->damp_suppress = DAMP_SUPPRESS;
+	c->damp_maxsuppress = DAMP_MAXSUPPRESS;
 	c->bgpid = get_bgpid();
 	c->fib_priority = RTP_BGP;
 	c->default_tableid = getrtable();
@@ -3277,6 +3447,9 @@ parse_config(char *filename, struct peer_head *ph)
 	conf = new_config();
 	init_config(conf);
 
+	/* every config warning matters, do not rate limit them */
+	log_nolimit(1);
+
 	if ((filter_l = calloc(1, sizeof(struct filter_head))) == NULL)
 		fatal(NULL);
 	if ((peerfilter_l = calloc(1, sizeof(struct filter_head))) == NULL)
@@ -3337,6 +3510,21 @@ parse_config(char *filename, struct peer_head *ph)
 		errors++;
 	}
 
+	/*
+	 * the penalty ceiling must be reachable and fit in 16 bits,
+	 * reuse / 2 is the limit to forget an entry so it must not be 0
+	 */
+	if (conf->damp_reuse < 2 ||
+	    conf->damp_reuse >= conf->damp_suppress ||
+	    conf->damp_maxsuppress / conf->damp_halflife >= 16 ||
+	    (conf->damp_reuse << (conf->damp_maxsuppress /
+	    conf->damp_halflife)) > DAMP_PENALTY_MAX ||
+	    (conf->damp_reuse << (conf->damp_maxsuppress /
+	    conf->damp_halflife)) <= conf->damp_suppress) {
+		log_warnx("configuration error: bad damping parameters");
+		errors++;
+	}
+
 	/* clear the globals */
 	curpeer = NULL;
 	curgroup = NULL;
@@ -3356,6 +3544,7 @@ errors:
 		filterlist_free(groupfilter_l);
 
 		free_config(conf);
+		log_nolimit(0);
 		return (NULL);
 	} else {
 		/* update clusterid in case it was not set explicitly */
@@ -3377,6 +3566,7 @@ errors:
 		free(peerfilter_l);
 		free(groupfilter_l);
 
+		log_nolimit(0);
 		return (conf);
 	}
 }
@@ -4241,6 +4431,8 @@ neighbor_consistent(struct peer *p)
 		    ENFORCE_AS_ON : ENFORCE_AS_OFF;
 	if (p->conf.enforce_local_as == ENFORCE_AS_UNDEF)
 		p->conf.enforce_local_as = ENFORCE_AS_ON;
+	if (!(p->conf.flags & PEERFLAG_MRAI))
+		p->conf.mrai = p->conf.ebgp ? conf->mrai_ebgp : conf->mrai_ibgp;
 
 	if (p->conf.remote_as == 0 && !p->conf.template) {
 		yyerror("peer AS may not be zero");
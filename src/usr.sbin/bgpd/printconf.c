@@ -369,6 +369,7 @@ print_mainconf(struct bgpd_config *conf)
 {
 	struct in_addr		 ina;
 	struct listen_addr	*la;
+	struct rtr_config	*rtr;
 
 	printf("AS %s", log_as(conf->as));
 	if (conf->as > USHRT_MAX && conf->short_as != AS_TRANS)
@@ -385,6 +386,18 @@ print_mainconf(struct bgpd_config *conf)
 		printf("holdtime min %u\n", conf->min_holdtime);
 	if (conf->connectretry != INTERVAL_CONNECTRETRY)
 		printf("connect-retry %u\n", conf->connectretry);
+	if (conf->mrai_ebgp)
+		printf("advertisement-interval ebgp %u\n", conf->mrai_ebgp);
+	if (conf->mrai_ibgp)
+		printf("advertisement-interval ibgp %u\n", conf->mrai_ibgp);
+	if (conf->damp_halflife != DAMP_HALFLIFE)
+		printf("damping half-life %u\n", conf->damp_halflife);
+	if (conf->damp_reuse != DAMP_REUSE)
+		printf("damping reuse %u\n", conf->damp_reuse);
+	if (conf->damp_suppress != DAMP_SUPPRESS)
+		printf("damping suppress %u\n", conf->damp_suppress);
+	if (conf->damp_maxsuppress != DAMP_MAXSUPPRESS)
+		printf("damping max-suppress %u\n", conf->damp_maxsuppress);
 
 	if (conf->flags & BGPD_FLAG_DECISION_ROUTEAGE)
 		printf("rde route-age evaluate\n");
@@ -392,6 +405,12 @@ print_mainconf(struct bgpd_config *conf)
 	if (conf->flags & BGPD_FLAG_DECISION_MED_ALWAYS)
 		printf("rde med compare always\n");
 
+	if (conf->flags & BGPD_FLAG_MRT_SNAPSHOT)
+		printf("rde mrt-snapshot yes\n");
+
+	if (conf->flags & BGPD_FLAG_RIB_INDEX)
+		printf("rde rib-index yes\n");
+
 	if (conf->log & BGPD_LOG_UPDATES)
 		printf("log updates\n");
 
@@ -399,6 +418,15 @@ print_mainconf(struct bgpd_config *conf)
 		printf("listen on %s\n",
 		    log_sockaddr((struct sockaddr *)&la->sa, la->sa_len));
 
+	SIMPLEQ_FOREACH(rtr, &conf->rtrs, entry) {
+		printf("rtr %s", log_addr(&rtr->remote_addr));
+		if (rtr->remote_port != RTR_PORT)
+			printf(" port %u", rtr->remote_port);
+		if (rtr->descr[0])
+			printf(" descr \"%s\"", rtr->descr);
+		printf("\n");
+	}
+
 	if (conf->flags & BGPD_FLAG_NEXTHOP_BGP)
 		printf("nexthop qualify via bgp\n");
 	if (conf->flags & BGPD_FLAG_NEXTHOP_DEFAULT)
@@ -630,6 +658,10 @@ print_peer(struct peer_config *p, struct bgpd_config *conf, const char *c)
 		printf("%s\tholdtime %u\n", c, p->holdtime);
 	if (p->min_holdtime)
 		printf("%s\tholdtime min %u\n", c, p->min_holdtime);
+	if (p->flags & PEERFLAG_MRAI)
+		printf("%s\tadvertisement-interval %u\n", c, p->mrai);
+	if (p->flags & PEERFLAG_MRAI_WITHDRAW)
+		printf("%s\tadvertisement-interval withdraw yes\n", c);
 	if (p->announce_capa == 0)
 		printf("%s\tannounce capabilities no\n", c);
 	if (p->capabilities.refresh == 0)
@@ -668,6 +700,10 @@ print_peer(struct peer_config *p, struct bgpd_config *conf, const char *c)
 
 	if (p->flags & PEERFLAG_LOG_UPDATES)
 		printf("%s\tlog updates\n", c);
+	if (p->flags & PEERFLAG_DAMPING)
+		printf("%s\tdamping yes\n", c);
+	if (p->flags & PEERFLAG_NO_ADJRIBIN)
+		printf("%s\tsoftreconfig in no\n", c);
 
 	if (p->auth.method == AUTH_MD5SIG)
 		printf("%s\ttcp md5sig\n", c);
@@ -872,6 +908,9 @@ print_rule(struct bgpd_config *conf, struct filter_rule *r)
 		    "max-as-len" : "max-as-seq", r->match.aslen.aslen);
 	}
 
+	if (r->match.aspath.re[0] != '\0')
+		printf("as-path \"%s\" ", r->match.aspath.re);
+
 	for (i = 0; i < MAX_COMM_MATCH; i++) {
 		struct community *c = &r->match.community[i];
 		if (c->flags != 0) {
@@ -22,8 +22,10 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
 #include <poll.h>
 #include <signal.h>
@@ -31,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 #include <err.h>
 
@@ -44,7 +47,38 @@
 #define PFD_PIPE_SESSION_CTL	2
 #define PFD_PIPE_COUNT		3
 
+/*
+ * Incremental ROA update. Only the Adj-RIB-In prefixes covered by a ROA
+ * that was added, removed or changed are revalidated and only those
+ * with a new validation state are filtered again. More changed ROAs than
+ * ROA_INCREMENTAL_MAX result in a full Adj-RIB-In reload.
+ */
+#define ROA_INCREMENTAL_MAX	4096
+
+/*
+ * The same is done for prefix-sets and origin-sets on reload. If only the
+ * content of sets changed, RIBs and peers using them are filtered again
+ * just for the prefixes covered by the changed set entries.
+ */
+#define SOFTRECONF_RELOAD	0	/* RIBs with new filters */
+#define SOFTRECONF_ALL		1	/* all RIBs, e.g. vstate changed */
+#define SOFTRECONF_SETS		2	/* RIBs with changed sets only */
+
+/* minimal time between two ROA triggered route refreshes to a peer */
+#define RDE_REFRESH_INTERVAL	300
+
+struct roa_reval {
+	struct rib_subtree	*changes;
+	size_t			 len;
+	size_t			 size;
+	int			 overflow;
+	int			 running;	/* walks not done yet */
+	unsigned long long	 checked;
+	unsigned long long	 changed;
+};
+
 void		 rde_sighdlr(int);
+int		 rde_log_writer(int, const char *);
 void		 rde_dispatch_imsg_session(struct imsgbuf *);
 void		 rde_dispatch_imsg_parent(struct imsgbuf *);
 void		 rde_dispatch_imsg_peer(struct rde_peer *, void *);
@@ -53,6 +87,7 @@ int		 rde_update_update(struct rde_peer *, struct filterstate *,
 		     struct bgpd_addr *, u_int8_t);
 void		 rde_update_withdraw(struct rde_peer *, struct bgpd_addr *,
 		     u_int8_t);
+static int	 rde_max_prefix(struct rde_peer *);
 int		 rde_attr_parse(u_char *, u_int16_t, struct rde_peer *,
 		     struct filterstate *, struct mpattr *);
 int		 rde_attr_add(struct filterstate *, u_char *, u_int16_t);
@@ -64,12 +99,19 @@ void		 rde_reflector(struct rde_peer *, struct rde_aspath *);
 
 void		 rde_dump_ctx_new(struct ctl_show_rib_request *, pid_t,
 		     enum imsg_type);
+void		 rde_dump_stats(pid_t);
 void		 rde_dump_ctx_throttle(pid_t, int);
+void		 rde_trace_dump_new(pid_t);
+int		 rde_trace_dump_pending(void);
+void		 rde_trace_dump_runner(void);
 void		 rde_dump_ctx_terminate(pid_t);
 void		 rde_dump_mrt_new(struct mrt *, pid_t, int);
 
 int		 rde_l3vpn_import(struct rde_community *, struct l3vpn *);
 void		 rde_reload_done(void);
+static void	 rde_refresh_noadjin(int);
+static void	 rde_refresh_runner(void);
+static int	 rde_refresh_timeout(void);
 static void	 rde_softreconfig_in_done(void *, u_int8_t);
 static void	 rde_softreconfig_out_done(void *, u_int8_t);
 static void	 rde_softreconfig_done(void);
@@ -78,9 +120,30 @@ static void	 rde_softreconfig_in(struct rib_entry *, void *);
 static void	 rde_softreconfig_sync_reeval(struct rib_entry *, void *);
 static void	 rde_softreconfig_sync_fib(struct rib_entry *, void *);
 static void	 rde_softreconfig_sync_done(void *, u_int8_t);
+static void	 rde_roa_change(struct bgpd_addr *, u_int8_t, void *);
+static void	 rde_roa_reval_upcall(struct rib_entry *, void *);
+static void	 rde_roa_reval_done(void *, u_int8_t);
+static int	 rde_roa_reval_noadjin(struct roa_reval *,
+		     void (*)(void *, u_int8_t));
+static void	 rde_roa_reval_noadjin_upcall(struct rib_entry *, void *);
+static void	 rde_sets_diff(struct rde_prefixset_head *,
+		     struct rde_prefixset_head *, int);
+static void	 rde_sets_compact(struct roa_reval *);
+static void	 rde_softreconfig_in_sets(struct rib_entry *, void *);
+static void	 rde_softreconfig_in_sets_done(void *, u_int8_t);
+static void	 rde_softreconfig_out_sets(struct rib_entry *, void *);
+static void	 rde_softreconfig_sets_done(void);
+static void	 rde_roa_bulk_add(struct trie_bulk *, struct rde_prefixset *,
+		     struct roa *, struct set_table **);
+static void	 rde_rtr_roa(struct imsg *);
+static void	 rde_rtr_commit(void);
+static void	 rde_rtr_reval_part(struct roa_reval *);
+static void	 rde_rtr_reval_part_done(void *, u_int8_t);
+static void	 rde_rtr_reval_full(void);
+static void	 rde_rtr_reval_done(void *, u_int8_t);
 int		 rde_update_queue_pending(void);
+int		 rde_update_queue_timeout(void);
 void		 rde_update_queue_runner(void);
-void		 rde_update6_queue_runner(u_int8_t);
 struct rde_prefixset *rde_find_prefixset(char *, struct rde_prefixset_head *);
 void		 rde_mark_prefixsets_dirty(struct rde_prefixset_head *,
 		     struct rde_prefixset_head *);
@@ -89,16 +152,20 @@ u_int8_t	 rde_roa_validity(struct rde_prefixset *,
 
 static void	 rde_peer_recv_eor(struct rde_peer *, u_int8_t);
 static void	 rde_peer_send_eor(struct rde_peer *, u_int8_t);
+static void	 rde_peer_send_update(struct rde_peer *, void *, u_int16_t);
 
 void		 network_add(struct network_config *, struct filterstate *);
 void		 network_delete(struct network_config *);
 static void	 network_dump_upcall(struct rib_entry *, void *);
+static int	 rde_dump_mrt_fork(struct mrt *, u_int16_t);
+static void	 rde_mrt_reap(void);
 static void	 network_flush_upcall(struct rib_entry *, void *);
 
 void		 rde_shutdown(void);
 int		 ovs_match(struct prefix *, u_int32_t);
 
 volatile sig_atomic_t	 rde_quit = 0;
+volatile sig_atomic_t	 rde_sigchld = 0;
 struct bgpd_config	*conf, *nconf;
 struct filter_head	*out_rules, *out_rules_tmp;
 struct imsgbuf		*ibuf_se;
@@ -106,13 +173,56 @@ struct imsgbuf		*ibuf_se_ctl;
 struct imsgbuf		*ibuf_main;
 struct rde_memstats	 rdemem;
 int			 softreconfig;
+static int		 rde_pledge_proc = 1;	/* fork for mrt-snapshot */
+
+/*
+ * ROAs learned via RTR, kept apart from the roa-set of the config so
+ * that a reload does not touch them. rtr_reval collects the changes
+ * until the SE commits an update.
+ */
+static struct trie_head	 roa_rtr;
+static struct roa_reval	 rtr_reval;
+static struct roa_reval	 rtr_part;
+static struct roa_reval	 rtr_queue;
+static struct roa_reval	 rtr_full;
+static int		 rtr_part_running;
+static int		 rtr_full_running;
+static int		 rtr_full_again;
+
+/*
+ * Prefixes covered by ROAs and set entries changed by a reload. The
+ * covered subtrees are walked by async RIB dumps, the arrays are freed
+ * once these are done.
+ */
+static struct roa_reval	 roa_reval;
+static struct roa_reval	 sets_reval;
 
 extern struct rde_peer_head	 peerlist;
 extern struct rde_peer		*peerself;
 
+#define	RDE_INDEX_DUMP_MAX	(10 * CTL_MSG_HIGH_MARK)
+
+#define	RDE_BULK_SIZE	(MAX_IMSGSIZE - IMSG_HEADER_SIZE)
+#define	RDE_BULK_PEERS	64
+#define	RDE_BULK_ATTRS	256
+
+/* state of a batch of IMSG_CTL_SHOW_RIB_BULK */
+struct rde_bulk {
+	struct ibuf		*buf;
+	u_int32_t		 peers[RDE_BULK_PEERS];	/* peer id + 1 */
+	struct {
+		struct rde_aspath	*asp;
+		struct rde_community	*comm;
+		u_int16_t		 ref;
+	}			 attrs[RDE_BULK_ATTRS];
+	u_int16_t		 nattrs;
+};
+
 struct rde_dump_ctx {
 	LIST_ENTRY(rde_dump_ctx)	entry;
 	struct ctl_show_rib_request	req;
+	struct rde_bulk			*bulk;
+	struct trace_cursor		trace;	/* IMSG_CTL_TRACE_DUMP */
 	u_int32_t			peerid;
 	u_int8_t			throttled;
 };
@@ -135,9 +245,29 @@ rde_sighdlr(int sig)
 	case SIGTERM:
 		rde_quit = 1;
 		break;
+	case SIGCHLD:
+		rde_sigchld = 1;
+		break;
 	}
 }
 
+/* pass a queued log message to the parent which writes it out */
+int
+rde_log_writer(int pri, const char *msg)
+{
+	struct ibuf	*wbuf;
+	size_t		 len = strlen(msg) + 1;
+
+	if ((wbuf = imsg_create(ibuf_main, IMSG_LOG, 0, 0,
+	    sizeof(pri) + len)) == NULL)
+		return (-1);
+	if (imsg_add(wbuf, &pri, sizeof(pri)) == -1 ||
+	    imsg_add(wbuf, msg, len) == -1)
+		return (-1);
+	imsg_close(ibuf_main, wbuf);
+	return (0);
+}
+
 u_int32_t	peerhashsize = 1024;
 u_int32_t	pathhashsize = 128 * 1024;
 u_int32_t	attrhashsize = 16 * 1024;
@@ -151,8 +281,7 @@ rde_main(int debug, int verbose)
 	struct rde_mrt_ctx	*mctx, *xmctx;
 	void			*newp;
 	u_int			 pfd_elms = 0, i, j;
-	int			 timeout;
-	u_int8_t		 aid;
+	int			 timeout, t;
 
 	log_init(debug, LOG_DAEMON);
 	log_setverbose(verbose);
@@ -175,11 +304,16 @@ rde_main(int debug, int verbose)
 	    setresuid(pw->pw_uid, pw->pw_uid, pw->pw_uid))
 		fatal("can't drop privileges");
 
-	if (pledge("stdio recvfd", NULL) == -1)
+	/*
+	 * proc is only needed for mrt-snapshot, it is dropped with the
+	 * first config that does not enable it, before any session is up.
+	 */
+	if (pledge("stdio recvfd proc", NULL) == -1)
 		fatal("pledge");
 
 	signal(SIGTERM, rde_sighdlr);
 	signal(SIGINT, rde_sighdlr);
+	signal(SIGCHLD, rde_sighdlr);
 	signal(SIGPIPE, SIG_IGN);
 	signal(SIGHUP, SIG_IGN);
 	signal(SIGALRM, SIG_IGN);
@@ -188,6 +322,7 @@ rde_main(int debug, int verbose)
 	if ((ibuf_main = malloc(sizeof(struct imsgbuf))) == NULL)
 		fatal(NULL);
 	imsg_init(ibuf_main, 3);
+	log_queue_init(rde_log_writer);
 
 	/* initialize the RIB structures */
 	pt_init();
@@ -226,6 +361,12 @@ rde_main(int debug, int verbose)
 		timeout = -1;
 		bzero(pfd, sizeof(struct pollfd) * pfd_elms);
 
+		if (rde_sigchld) {
+			rde_sigchld = 0;
+			rde_mrt_reap();
+		}
+
+		log_flush();
 		set_pollfd(&pfd[PFD_PIPE_MAIN], ibuf_main);
 		set_pollfd(&pfd[PFD_PIPE_SESSION], ibuf_se);
 		set_pollfd(&pfd[PFD_PIPE_SESSION_CTL], ibuf_se_ctl);
@@ -249,8 +390,30 @@ rde_main(int debug, int verbose)
 		}
 
 		if (rib_dump_pending() || rde_update_queue_pending() ||
-		    nexthop_pending() || peer_imsg_pending())
+		    nexthop_pending() || peer_imsg_pending() ||
+		    rde_trace_dump_pending())
 			timeout = 0;
+		else {
+			timeout = rde_update_queue_timeout();
+			if ((t = damp_timeout()) != -1 &&
+			    (timeout == -1 || t < timeout))
+				timeout = t;
+			if ((t = rde_refresh_timeout()) != -1 &&
+			    (timeout == -1 || t < timeout))
+				timeout = t;
+		}
+
+		if (TRACE_ON(TRACE_IMSG)) {
+			trace_value(TRACE_EV_IMSG, 0, PFD_PIPE_MAIN,
+			    ibuf_main->w.queued);
+			if (ibuf_se != NULL)
+				trace_value(TRACE_EV_IMSG, 0, PFD_PIPE_SESSION,
+				    ibuf_se->w.queued);
+			if (ibuf_se_ctl != NULL)
+				trace_value(TRACE_EV_IMSG, 0,
+				    PFD_PIPE_SESSION_CTL,
+				    ibuf_se_ctl->w.queued);
+		}
 
 		if (poll(pfd, i, timeout) == -1) {
 			if (errno != EINTR)
@@ -290,14 +453,15 @@ rde_main(int debug, int verbose)
 
 		peer_foreach(rde_dispatch_imsg_peer, NULL);
 		rib_dump_runner();
+		rde_trace_dump_runner();
 		nexthop_runner();
-		if (ibuf_se && ibuf_se->w.queued < SESS_MSG_HIGH_MARK) {
-			rde_update_queue_runner();
-			for (aid = AID_INET6; aid < AID_MAX; aid++)
-				rde_update6_queue_runner(aid);
-		}
+		damp_runner();
+		rde_refresh_runner();
+		rde_update_queue_runner();
 	}
 
+	log_queue_done();
+
 	/* do not clean up on shutdown on production, it takes ages. */
 	if (debug)
 		rde_shutdown();
@@ -352,6 +516,7 @@ rde_dispatch_imsg_session(struct imsgbuf *ibuf)
 	ssize_t			 n;
 	size_t			 aslen;
 	int			 verbose;
+	u_int32_t		 credit, mask;
 	u_int16_t		 len;
 
 	while (ibuf) {
@@ -362,6 +527,7 @@ rde_dispatch_imsg_session(struct imsgbuf *ibuf)
 
 		switch (imsg.hdr.type) {
 		case IMSG_UPDATE:
+		case IMSG_UPDATE_SAMPLE:
 		case IMSG_SESSION_UP:
 		case IMSG_SESSION_DOWN:
 		case IMSG_SESSION_STALE:
@@ -546,6 +712,17 @@ badnetdel:
 				    peer->prefix_sent_withdraw;
 				p.stats.prefix_sent_eor =
 				    peer->prefix_sent_eor;
+				p.stats.pending_update = peer->up_nlricnt;
+				p.stats.pending_withdraw = peer->up_wcnt;
+				p.stats.pending_credit = peer->up_credit;
+				p.stats.drain_rate = peer->up_drain_rate;
+				p.stats.prefix_suppressed =
+				    peer->prefix_suppressed;
+				p.stats.prefix_damp_cnt = peer->prefix_damp_cnt;
+				p.stats.prefix_damp_absorbed =
+				    peer->prefix_damp_absorbed;
+				memcpy(p.stats.latency, peer->latency,
+				    sizeof(p.stats.latency));
 			}
 			imsg_compose(ibuf_se_ctl, IMSG_CTL_SHOW_NEIGHBOR, 0,
 			    imsg.hdr.pid, -1, &p, sizeof(struct peer));
@@ -568,11 +745,22 @@ badnetdel:
 			imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, imsg.hdr.pid,
 			    -1, NULL, 0);
 			break;
+		case IMSG_CTL_SHOW_RIB_STATS:
+			rde_dump_stats(imsg.hdr.pid);
+			break;
 		case IMSG_CTL_LOG_VERBOSE:
 			/* already checked by SE */
 			memcpy(&verbose, imsg.data, sizeof(verbose));
 			log_setverbose(verbose);
 			break;
+		case IMSG_CTL_TRACE:
+			/* already checked by SE */
+			memcpy(&mask, imsg.data, sizeof(mask));
+			trace_set(mask, PROC_RDE);
+			break;
+		case IMSG_CTL_TRACE_DUMP:
+			rde_trace_dump_new(imsg.hdr.pid);
+			break;
 		case IMSG_CTL_END:
 			imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, imsg.hdr.pid,
 			    -1, NULL, 0);
@@ -598,6 +786,28 @@ badnetdel:
 				rde_dump_ctx_throttle(imsg.hdr.pid, 1);
 			}
 			break;
+		case IMSG_UPDATE_CREDIT:
+			if (imsg.hdr.len - IMSG_HEADER_SIZE != sizeof(credit)) {
+				log_warnx("rde_dispatch: wrong imsg len");
+				break;
+			}
+			memcpy(&credit, imsg.data, sizeof(credit));
+			peer = peer_get(imsg.hdr.peerid);
+			if (peer == NULL)
+				break;
+			/* stale credits of a previous session are possible */
+			if (credit > peer->up_credit)
+				peer->up_credit = 0;
+			else
+				peer->up_credit -= credit;
+			break;
+		case IMSG_RTR_ROA_ADD:
+		case IMSG_RTR_ROA_DEL:
+			rde_rtr_roa(&imsg);
+			break;
+		case IMSG_RTR_ROA_COMMIT:
+			rde_rtr_commit();
+			break;
 		default:
 			break;
 		}
@@ -612,6 +822,10 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 	static struct as_set	*last_as_set;
 	static struct set_table	*last_set;
 	static struct l3vpn	*vpn;
+	static struct trie_bulk	 tbulk;
+	static struct roa	 last_roa;
+	static struct timespec	 set_time;
+	static size_t		 set_items;
 	struct imsg		 imsg;
 	struct mrt		 xmrt;
 	struct rde_rib		 rr;
@@ -623,10 +837,13 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 	struct rib		*rib;
 	struct rde_prefixset	*ps;
 	struct rde_aspath	*asp;
-	struct prefixset_item	 psi;
+	struct filter_prefix	 fp;
+	struct roa		 roa;
+	struct roa_set		 rs;
+	struct timespec		 ts, te;
 	char			*name;
-	size_t			 nmemb;
-	int			 n, fd, rv;
+	size_t			 nmemb, j;
+	int			 n, fd;
 	u_int16_t		 rid;
 
 	while (ibuf) {
@@ -706,6 +923,8 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 			TAILQ_INIT(out_rules_tmp);
 			nconf = new_config();
 			copy_config(nconf, imsg.data);
+			set_items = 0;
+			timespecclear(&set_time);
 
 			for (rid = 0; rid < rib_size; rid++) {
 				if ((rib = rib_byid(rid)) == NULL)
@@ -769,6 +988,17 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 					r->match.as.aset = aset;
 				}
 			}
+			if (r->match.aspath.re[0] != '\0') {
+				const char *errstr;
+
+				/* a rule without dfa never matches */
+				r->match.aspath.dfa = aspath_re_compile(
+				    r->match.aspath.re, &errstr);
+				if (r->match.aspath.dfa == NULL)
+					log_warnx("%s: as-path \"%s\": %s",
+					    __func__, r->match.aspath.re,
+					    errstr);
+			}
 			TAILQ_INIT(&r->set);
 			TAILQ_CONCAT(&r->set, &parent_set, entry);
 			if ((rib = rib_byid(rib_find(r->rib))) == NULL) {
@@ -810,45 +1040,83 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 			}
 			last_prefixset = ps;
 			last_set = NULL;
+			trie_bulk_init(&tbulk, &ps->th);
 			break;
 		case IMSG_RECONF_ROA_SET:
 			strlcpy(nconf->rde_roa.name, "RPKI ROA",
 			    sizeof(nconf->rde_roa.name));
 			last_prefixset = &nconf->rde_roa;
 			last_set = NULL;
+			trie_bulk_init(&tbulk, &nconf->rde_roa.th);
 			break;
-		case IMSG_RECONF_ROA_SET_ITEMS:
+		case IMSG_RECONF_PREFIX_SET_ITEMS:
 			nmemb = imsg.hdr.len - IMSG_HEADER_SIZE;
-			nmemb /= sizeof(struct roa_set);
-			if (last_set == NULL) {
-				last_set = set_new(1, sizeof(struct roa_set));
-				if (last_set == NULL)
-					fatal(NULL);
+			if (nmemb % sizeof(fp) != 0)
+				fatalx("IMSG_RECONF_PREFIX_SET_ITEMS bad len");
+			nmemb /= sizeof(fp);
+			if (last_prefixset == NULL)
+				fatalx("King Bula has no prefixset");
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			for (j = 0; j < nmemb; j++) {
+				memcpy(&fp, (struct filter_prefix *)imsg.data +
+				    j, sizeof(fp));
+				if (trie_bulk_add(&tbulk, &fp.addr, fp.len,
+				    fp.len_min, fp.len_max) == -1)
+					log_warnx("trie_add(%s) %s/%u failed",
+					    last_prefixset->name,
+					    log_addr(&fp.addr), fp.len);
 			}
-			if (set_add(last_set, imsg.data, nmemb) != 0)
-				fatal(NULL);
+			clock_gettime(CLOCK_MONOTONIC, &te);
+			timespecsub(&te, &ts, &te);
+			timespecadd(&set_time, &te, &set_time);
+			set_items += nmemb;
 			break;
-		case IMSG_RECONF_PREFIX_SET_ITEM:
-			if (imsg.hdr.len - IMSG_HEADER_SIZE !=
-			    sizeof(psi))
-				fatalx("IMSG_RECONF_PREFIX_SET_ITEM bad len");
-			memcpy(&psi, imsg.data, sizeof(psi));
+		case IMSG_RECONF_ROA_ITEMS:
+			nmemb = imsg.hdr.len - IMSG_HEADER_SIZE;
+			if (nmemb % sizeof(roa) != 0)
+				fatalx("IMSG_RECONF_ROA_ITEMS bad len");
+			nmemb /= sizeof(roa);
 			if (last_prefixset == NULL)
 				fatalx("King Bula has no prefixset");
-			if (last_set) {
-				set_prep(last_set);
-				rv = trie_roa_add(&last_prefixset->th,
-				    &psi.p.addr, psi.p.len, last_set);
-				last_set = NULL;
-			} else {
-				rv = trie_add(&last_prefixset->th,
-				    &psi.p.addr, psi.p.len,
-				    psi.p.len_min, psi.p.len_max);
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			for (j = 0; j < nmemb; j++) {
+				memcpy(&roa, (struct roa *)imsg.data + j,
+				    sizeof(roa));
+				/* items are sorted, one set per ROA prefix */
+				if (last_set != NULL &&
+				    (roa.prefixlen != last_roa.prefixlen ||
+				    prefix_compare(&roa.prefix, &last_roa.prefix,
+				    roa.prefixlen) != 0))
+					rde_roa_bulk_add(&tbulk, last_prefixset,
+					    &last_roa, &last_set);
+				if (last_set == NULL) {
+					last_set = set_new(1,
+					    sizeof(struct roa_set));
+					if (last_set == NULL)
+						fatal(NULL);
+				}
+				rs.as = roa.asnum;
+				rs.maxlen = roa.maxlen;
+				if (set_add(last_set, &rs, 1) != 0)
+					fatal(NULL);
+				last_roa = roa;
 			}
-			if (rv == -1)
-				log_warnx("trie_add(%s) %s/%u) failed",
-				    last_prefixset->name, log_addr(&psi.p.addr),
-				    psi.p.len);
+			clock_gettime(CLOCK_MONOTONIC, &te);
+			timespecsub(&te, &ts, &te);
+			timespecadd(&set_time, &te, &set_time);
+			set_items += nmemb;
+			break;
+		case IMSG_RECONF_PREFIX_SET_DONE:
+			if (last_prefixset == NULL)
+				fatalx("King Bula has no prefixset");
+			if (last_set != NULL)
+				rde_roa_bulk_add(&tbulk, last_prefixset,
+				    &last_roa, &last_set);
+			/* the set is complete, build the lookup tables */
+			if (trie_compile(&last_prefixset->th) == -1)
+				log_warn("prefix-set %s: compile",
+				    last_prefixset->name);
+			last_prefixset = NULL;
 			break;
 		case IMSG_RECONF_AS_SET:
 			if (imsg.hdr.len - IMSG_HEADER_SIZE !=
@@ -909,6 +1177,10 @@ rde_dispatch_imsg_parent(struct imsgbuf *ibuf)
 			if (nconf == NULL)
 				fatalx("got IMSG_RECONF_DONE but no config");
 			last_prefixset = NULL;
+			if (set_items > 0)
+				log_info("loaded %zu set items in %lld ms",
+				    set_items, (long long)set_time.tv_sec *
+				    1000 + set_time.tv_nsec / 1000000);
 
 			rde_reload_done();
 			break;
@@ -958,7 +1230,8 @@ void
 rde_dispatch_imsg_peer(struct rde_peer *peer, void *bula)
 {
 	struct session_up sup;
-	struct imsg imsg;
+	struct imsg imsg, uimsg;
+	struct timespec ts;
 	u_int8_t aid;
 
 	if (!peer_imsg_pop(peer, &imsg))
@@ -968,6 +1241,20 @@ rde_dispatch_imsg_peer(struct rde_peer *peer, void *bula)
 	case IMSG_UPDATE:
 		rde_update_dispatch(peer, &imsg);
 		break;
+	case IMSG_UPDATE_SAMPLE:
+		if (imsg.hdr.len - IMSG_HEADER_SIZE < sizeof(ts)) {
+			log_warnx("%s: wrong imsg len", __func__);
+			break;
+		}
+		/* strip the timestamp, the UPDATE follows it */
+		memcpy(&ts, imsg.data, sizeof(ts));
+		uimsg = imsg;
+		uimsg.data = (char *)imsg.data + sizeof(ts);
+		uimsg.hdr.len -= sizeof(ts);
+		latency_start(peer, &ts);
+		rde_update_dispatch(peer, &uimsg);
+		latency_done(peer);
+		break;
 	case IMSG_SESSION_UP:
 		if (imsg.hdr.len - IMSG_HEADER_SIZE != sizeof(sup))
 			fatalx("incorrect size of session request");
@@ -1038,6 +1325,9 @@ rde_update_dispatch(struct rde_peer *peer, struct imsg *imsg)
 
 	p = imsg->data;
 
+	TRACE_VALUE(TRACE_UPDATE, TRACE_EV_UPDATE, peer->conf.id, 0,
+	    imsg->hdr.len - IMSG_HEADER_SIZE);
+
 	if (imsg->hdr.len < IMSG_HEADER_SIZE + 2) {
 		rde_update_err(peer, ERR_UPDATE, ERR_UPD_ATTRLIST, NULL, 0);
 		return;
@@ -1396,27 +1686,29 @@ rde_update_update(struct rde_peer *peer, struct filterstate *in,
 	enum filter_actions	 action;
 	u_int8_t		 vstate;
 	u_int16_t		 i;
+	int			 damped = 0, before = 0, after = 0;
 	const char		*wmsg = "filtered, withdraw";
 
 	peer->prefix_rcvd_update++;
 	vstate = rde_roa_validity(&conf->rde_roa, prefix, prefixlen,
 	    aspath_origin(in->aspath.aspath));
 
+	if (peer->conf.flags & PEERFLAG_DAMPING && !peer->no_adjin)
+		damped = damp_update(peer, in, prefix, prefixlen);
+
 	/* add original path to the Adj-RIB-In */
-	if (prefix_update(rib_byid(RIB_ADJ_IN), peer, in, prefix, prefixlen,
-	    vstate) == 1)
+	if (!peer->no_adjin && prefix_update(rib_byid(RIB_ADJ_IN), peer, in,
+	    prefix, prefixlen, vstate) == 1)
 		peer->prefix_cnt++;
 
 	/* max prefix checker */
-	if (peer->conf.max_prefix && peer->prefix_cnt > peer->conf.max_prefix) {
-		log_peer_warnx(&peer->conf, "prefix limit reached (>%u/%u)",
-		    peer->prefix_cnt, peer->conf.max_prefix);
-		rde_update_err(peer, ERR_CEASE, ERR_CEASE_MAX_PREFIX, NULL, 0);
+	if (rde_max_prefix(peer) == -1)
 		return (-1);
-	}
 
 	if (in->aspath.flags & F_ATTR_PARSE_ERR)
 		wmsg = "path invalid, withdraw";
+	if (damped)
+		wmsg = "damped, withdraw";
 
 	for (i = RIB_LOC_START; i < rib_size; i++) {
 		struct rib *rib = rib_byid(i);
@@ -1427,22 +1719,50 @@ rde_update_update(struct rde_peer *peer, struct filterstate *in,
 		/* input filter */
 		action = rde_filter(rib->in_rules, peer, peer, prefix,
 		    prefixlen, vstate, &state);
+		if (TRACE_ON(TRACE_FILTER))
+			trace_prefix(TRACE_EV_FILTER, peer->conf.id, prefix,
+			    prefixlen, action);
 
-		if (action == ACTION_ALLOW) {
+		if (action == ACTION_ALLOW && !damped) {
 			rde_update_log("update", i, peer,
 			    &state.nexthop->exit_nexthop, prefix,
 			    prefixlen);
-			prefix_update(rib, peer, &state, prefix,
-			    prefixlen, vstate);
+			if (prefix_update(rib, peer, &state, prefix,
+			    prefixlen, vstate) == 0)
+				before = 1;
+			after = 1;
 		} else if (prefix_withdraw(rib, peer, prefix,
 		    prefixlen)) {
 			rde_update_log(wmsg, i, peer,
 			    NULL, prefix, prefixlen);
+			before = 1;
 		}
 
 		/* clear state */
 		rde_filterstate_clean(&state);
 	}
+
+	/* without Adj-RIB-In count what is in any Loc-RIB */
+	if (peer->no_adjin && before != after) {
+		if (after)
+			peer->prefix_cnt++;
+		else
+			peer->prefix_cnt--;
+		if (rde_max_prefix(peer) == -1)
+			return (-1);
+	}
+	return (0);
+}
+
+static int
+rde_max_prefix(struct rde_peer *peer)
+{
+	if (peer->conf.max_prefix && peer->prefix_cnt > peer->conf.max_prefix) {
+		log_peer_warnx(&peer->conf, "prefix limit reached (>%u/%u)",
+		    peer->prefix_cnt, peer->conf.max_prefix);
+		rde_update_err(peer, ERR_CEASE, ERR_CEASE_MAX_PREFIX, NULL, 0);
+		return (-1);
+	}
 	return (0);
 }
 
@@ -1451,18 +1771,28 @@ rde_update_withdraw(struct rde_peer *peer, struct bgpd_addr *prefix,
     u_int8_t prefixlen)
 {
 	u_int16_t i;
+	int found = 0;
+
+	if (peer->conf.flags & PEERFLAG_DAMPING && !peer->no_adjin)
+		damp_withdraw(peer, prefix, prefixlen);
 
 	for (i = RIB_LOC_START; i < rib_size; i++) {
 		struct rib *rib = rib_byid(i);
 		if (rib == NULL)
 			continue;
-		if (prefix_withdraw(rib, peer, prefix, prefixlen))
+		if (prefix_withdraw(rib, peer, prefix, prefixlen)) {
 			rde_update_log("withdraw", i, peer, NULL, prefix,
 			    prefixlen);
+			found = 1;
+		}
 	}
 
 	/* remove original path form the Adj-RIB-In */
-	if (prefix_withdraw(rib_byid(RIB_ADJ_IN), peer, prefix, prefixlen))
+	if (peer->no_adjin) {
+		if (found)
+			peer->prefix_cnt--;
+	} else if (prefix_withdraw(rib_byid(RIB_ADJ_IN), peer, prefix,
+	    prefixlen))
 		peer->prefix_cnt--;
 
 	peer->prefix_rcvd_withdraw++;
@@ -2028,6 +2358,8 @@ rde_update_log(const char *message, u_int16_t rid,
 	if (!((conf->log & BGPD_LOG_UPDATES) ||
 	    (peer->conf.flags & PEERFLAG_LOG_UPDATES)))
 		return;
+	if (log_limit(LOG_CLASS_UPDATE))
+		return;
 
 	if (next != NULL)
 		if (asprintf(&n, " via %s", log_addr(next)) == -1)
@@ -2035,7 +2367,7 @@ rde_update_log(const char *message, u_int16_t rid,
 	if (asprintf(&p, "%s/%u", log_addr(prefix), prefixlen) == -1)
 		p = NULL;
 	l = log_fmt_peer(&peer->conf);
-	log_info("Rib %s: %s AS%s: %s %s%s", rib_byid(rid)->name,
+	logit(LOG_INFO, "Rib %s: %s AS%s: %s %s%s", rib_byid(rid)->name,
 	    l, log_as(peer->conf.remote_as), message,
 	    p ? p : "out of memory", n ? n : "");
 
@@ -2179,59 +2511,69 @@ rde_reflector(struct rde_peer *peer, struct rde_aspath *asp)
  * control specific functions
  */
 static void
-rde_dump_rib_as(struct prefix *p, struct rde_aspath *asp, pid_t pid, int flags)
+rde_dump_rib_fill(struct prefix *p, struct rde_aspath *asp,
+    struct ctl_show_rib *rib)
 {
-	struct ctl_show_rib	 rib;
-	struct ibuf		*wbuf;
-	struct attr		*a;
 	struct nexthop		*nexthop;
-	void			*bp;
 	time_t			 staletime;
-	size_t			 aslen;
-	u_int8_t		 l;
 
 	nexthop = prefix_nexthop(p);
-	bzero(&rib, sizeof(rib));
-	rib.age = getmonotime() - p->lastchange;
-	rib.local_pref = asp->lpref;
-	rib.med = asp->med;
-	rib.weight = asp->weight;
-	strlcpy(rib.descr, prefix_peer(p)->conf.descr, sizeof(rib.descr));
-	memcpy(&rib.remote_addr, &prefix_peer(p)->remote_addr,
-	    sizeof(rib.remote_addr));
-	rib.remote_id = prefix_peer(p)->remote_bgpid;
+	bzero(rib, sizeof(*rib));
+	rib->age = getmonotime() - p->lastchange;
+	rib->local_pref = asp->lpref;
+	rib->med = asp->med;
+	rib->weight = asp->weight;
+	strlcpy(rib->descr, prefix_peer(p)->conf.descr, sizeof(rib->descr));
+	memcpy(&rib->remote_addr, &prefix_peer(p)->remote_addr,
+	    sizeof(rib->remote_addr));
+	rib->remote_id = prefix_peer(p)->remote_bgpid;
 	if (nexthop != NULL) {
-		memcpy(&rib.true_nexthop, &nexthop->true_nexthop,
-		    sizeof(rib.true_nexthop));
-		memcpy(&rib.exit_nexthop, &nexthop->exit_nexthop,
-		    sizeof(rib.exit_nexthop));
+		memcpy(&rib->true_nexthop, &nexthop->true_nexthop,
+		    sizeof(rib->true_nexthop));
+		memcpy(&rib->exit_nexthop, &nexthop->exit_nexthop,
+		    sizeof(rib->exit_nexthop));
 	} else {
 		/* announced network may have a NULL nexthop */
-		bzero(&rib.true_nexthop, sizeof(rib.true_nexthop));
-		bzero(&rib.exit_nexthop, sizeof(rib.exit_nexthop));
-		rib.true_nexthop.aid = p->pt->aid;
-		rib.exit_nexthop.aid = p->pt->aid;
-	}
-	pt_getaddr(p->pt, &rib.prefix);
-	rib.prefixlen = p->pt->prefixlen;
-	rib.origin = asp->origin;
-	rib.validation_state = p->validation_state;
-	rib.flags = 0;
+		bzero(&rib->true_nexthop, sizeof(rib->true_nexthop));
+		bzero(&rib->exit_nexthop, sizeof(rib->exit_nexthop));
+		rib->true_nexthop.aid = p->pt->aid;
+		rib->exit_nexthop.aid = p->pt->aid;
+	}
+	pt_getaddr(p->pt, &rib->prefix);
+	rib->prefixlen = p->pt->prefixlen;
+	rib->origin = asp->origin;
+	rib->validation_state = p->validation_state;
+	rib->flags = 0;
 	if (p->re != NULL && p->re->active == p)
-		rib.flags |= F_PREF_ACTIVE;
+		rib->flags |= F_PREF_ACTIVE;
 	if (!prefix_peer(p)->conf.ebgp)
-		rib.flags |= F_PREF_INTERNAL;
+		rib->flags |= F_PREF_INTERNAL;
 	if (asp->flags & F_PREFIX_ANNOUNCED)
-		rib.flags |= F_PREF_ANNOUNCE;
+		rib->flags |= F_PREF_ANNOUNCE;
 	if (nexthop == NULL || nexthop->state == NEXTHOP_REACH)
-		rib.flags |= F_PREF_ELIGIBLE;
+		rib->flags |= F_PREF_ELIGIBLE;
 	if (asp->flags & F_ATTR_LOOP)
-		rib.flags &= ~F_PREF_ELIGIBLE;
+		rib->flags &= ~F_PREF_ELIGIBLE;
 	if (asp->flags & F_ATTR_PARSE_ERR)
-		rib.flags |= F_PREF_INVALID;
+		rib->flags |= F_PREF_INVALID;
 	staletime = prefix_peer(p)->staletime[p->pt->aid];
 	if (staletime && p->lastchange <= staletime)
-		rib.flags |= F_PREF_STALE;
+		rib->flags |= F_PREF_STALE;
+	if (prefix_peer(p)->conf.flags & PEERFLAG_DAMPING)
+		damp_show(prefix_peer(p), p->pt, rib);
+}
+
+static void
+rde_dump_rib_as(struct prefix *p, struct rde_aspath *asp, pid_t pid, int flags)
+{
+	struct ctl_show_rib	 rib;
+	struct ibuf		*wbuf;
+	struct attr		*a;
+	void			*bp;
+	size_t			 aslen;
+	u_int8_t		 l;
+
+	rde_dump_rib_fill(p, asp, &rib);
 	aslen = aspath_length(asp->aspath);
 
 	if ((wbuf = imsg_create(ibuf_se_ctl, IMSG_CTL_SHOW_RIB, 0, pid,
@@ -2278,6 +2620,203 @@ rde_dump_rib_as(struct prefix *p, struct rde_aspath *asp, pid_t pid, int flags)
 	}
 }
 
+static int
+rde_bulk_u16(struct ibuf *buf, u_int16_t v)
+{
+	v = htons(v);
+	return (ibuf_add(buf, &v, sizeof(v)));
+}
+
+static int
+rde_bulk_u32(struct ibuf *buf, u_int32_t v)
+{
+	v = htonl(v);
+	return (ibuf_add(buf, &v, sizeof(v)));
+}
+
+static size_t
+rde_bulk_addrlen(struct bgpd_addr *addr)
+{
+	switch (addr->aid) {
+	case AID_UNSPEC:
+		return (1);
+	case AID_INET:
+		return (1 + sizeof(addr->v4));
+	case AID_INET6:
+		return (1 + sizeof(addr->v6));
+	default:
+		return (1 + sizeof(*addr));
+	}
+}
+
+static int
+rde_bulk_addr(struct ibuf *buf, struct bgpd_addr *addr)
+{
+	if (ibuf_add(buf, &addr->aid, sizeof(addr->aid)) == -1)
+		return (-1);
+	switch (addr->aid) {
+	case AID_UNSPEC:
+		return (0);
+	case AID_INET:
+		return (ibuf_add(buf, &addr->v4, sizeof(addr->v4)));
+	case AID_INET6:
+		return (ibuf_add(buf, &addr->v6, sizeof(addr->v6)));
+	default:
+		return (ibuf_add(buf, addr, sizeof(*addr)));
+	}
+}
+
+static void
+rde_bulk_reset(struct rde_bulk *b)
+{
+	u_int8_t	version = CTL_BULK_VERSION;
+
+	b->buf->wpos = 0;
+	bzero(b->peers, sizeof(b->peers));
+	bzero(b->attrs, sizeof(b->attrs));
+	b->nattrs = 0;
+	ibuf_add(b->buf, &version, sizeof(version));
+}
+
+static void
+rde_dump_bulk_flush(struct rde_dump_ctx *ctx)
+{
+	struct rde_bulk	*b = ctx->bulk;
+
+	if (b == NULL)
+		return;
+	if (ibuf_size(b->buf) > 1)
+		imsg_compose(ibuf_se_ctl, IMSG_CTL_SHOW_RIB_BULK, 0,
+		    ctx->req.pid, -1, b->buf->buf, ibuf_size(b->buf));
+	rde_bulk_reset(b);
+}
+
+/*
+ * Pack a RIB entry into the current batch. Peers and attribute sets are
+ * defined once per batch and referenced afterwards. Entries too large
+ * for a batch are sent the classic way, bgpctl fails a binary dump on
+ * them.
+ */
+static void
+rde_dump_bulk(struct rde_dump_ctx *ctx, struct prefix *p,
+    struct rde_aspath *asp)
+{
+	struct rde_bulk		*b = ctx->bulk;
+	struct rde_peer		*peer = prefix_peer(p);
+	struct rde_community	*comm = prefix_communities(p);
+	struct ctl_show_rib	 rib;
+	struct attr		*a;
+	size_t			 psize, asize, rsize, aslen, olen = 0;
+	u_int			 pslot, aslot;
+	int			 newpeer, newattr, i;
+	u_int8_t		 l, type;
+	u_int16_t		 ref;
+
+	rde_dump_rib_fill(p, asp, &rib);
+	aslen = aspath_length(asp->aspath);
+	for (l = 0; l < asp->others_len; l++) {
+		if ((a = asp->others[l]) == NULL)
+			break;
+		olen += attr_optlen(a);
+	}
+
+	psize = 1 + 2 * sizeof(u_int32_t) + rde_bulk_addrlen(&rib.remote_addr) +
+	    1 + strlen(rib.descr);
+	asize = 1 + sizeof(u_int16_t) + 1 + 3 * sizeof(u_int32_t) +
+	    sizeof(u_int16_t) + aslen + sizeof(u_int16_t) +
+	    comm->nentries * 4 * sizeof(u_int32_t) + sizeof(u_int16_t) + olen;
+	rsize = 1 + sizeof(u_int32_t) + sizeof(u_int16_t) + sizeof(u_int32_t) +
+	    1 + sizeof(u_int32_t) + rde_bulk_addrlen(&rib.prefix) + 1 +
+	    rde_bulk_addrlen(&rib.exit_nexthop) +
+	    rde_bulk_addrlen(&rib.true_nexthop);
+	if (rib.flags & F_PREF_DAMPED)
+		rsize += sizeof(u_int32_t) + sizeof(u_int16_t);
+
+	pslot = peer->conf.id % RDE_BULK_PEERS;
+	aslot = (((uintptr_t)asp ^ (uintptr_t)comm) >> 4) % RDE_BULK_ATTRS;
+	newpeer = b->peers[pslot] != peer->conf.id + 1;
+	newattr = b->attrs[aslot].asp != asp || b->attrs[aslot].comm != comm;
+
+	if (rsize + (newpeer ? psize : 0) + (newattr ? asize : 0) >
+	    ibuf_left(b->buf) || (newattr && b->nattrs == 0xffff)) {
+		rde_dump_bulk_flush(ctx);
+		newpeer = newattr = 1;
+		if (rsize + psize + asize > ibuf_left(b->buf) ||
+		    olen > 0xffff || comm->nentries > 0xffff) {
+			rde_dump_rib_as(p, asp, ctx->req.pid, ctx->req.flags);
+			return;
+		}
+	}
+
+	/* space was checked above so ibuf_add() can not fail */
+	if (newpeer) {
+		type = CTL_BULK_PEER;
+		ibuf_add(b->buf, &type, sizeof(type));
+		rde_bulk_u32(b->buf, peer->conf.id);
+		rde_bulk_u32(b->buf, rib.remote_id);
+		rde_bulk_addr(b->buf, &rib.remote_addr);
+		l = strlen(rib.descr);
+		ibuf_add(b->buf, &l, sizeof(l));
+		ibuf_add(b->buf, rib.descr, l);
+		b->peers[pslot] = peer->conf.id + 1;
+	}
+	if (newattr) {
+		type = CTL_BULK_ATTR;
+		ref = b->nattrs++;
+		ibuf_add(b->buf, &type, sizeof(type));
+		rde_bulk_u16(b->buf, ref);
+		ibuf_add(b->buf, &rib.origin, sizeof(rib.origin));
+		rde_bulk_u32(b->buf, rib.local_pref);
+		rde_bulk_u32(b->buf, rib.med);
+		rde_bulk_u32(b->buf, rib.weight);
+		rde_bulk_u16(b->buf, aslen);
+		ibuf_add(b->buf, aspath_dump(asp->aspath), aslen);
+		rde_bulk_u16(b->buf, comm->nentries);
+		for (i = 0; i < comm->nentries; i++) {
+			rde_bulk_u32(b->buf, comm->communities[i].flags);
+			rde_bulk_u32(b->buf, comm->communities[i].data1);
+			rde_bulk_u32(b->buf, comm->communities[i].data2);
+			rde_bulk_u32(b->buf, comm->communities[i].data3);
+		}
+		rde_bulk_u16(b->buf, olen);
+		for (l = 0; l < asp->others_len; l++) {
+			if ((a = asp->others[l]) == NULL)
+				break;
+			attr_writebuf(b->buf, a->flags, a->type, a->data,
+			    a->len);
+		}
+		b->attrs[aslot].asp = asp;
+		b->attrs[aslot].comm = comm;
+		b->attrs[aslot].ref = ref;
+	}
+
+	type = CTL_BULK_PREFIX;
+	ibuf_add(b->buf, &type, sizeof(type));
+	rde_bulk_u32(b->buf, peer->conf.id);
+	rde_bulk_u16(b->buf, b->attrs[aslot].ref);
+	rde_bulk_u32(b->buf, rib.flags);
+	ibuf_add(b->buf, &rib.validation_state, sizeof(rib.validation_state));
+	rde_bulk_u32(b->buf, rib.age);
+	rde_bulk_addr(b->buf, &rib.prefix);
+	ibuf_add(b->buf, &rib.prefixlen, sizeof(rib.prefixlen));
+	rde_bulk_addr(b->buf, &rib.exit_nexthop);
+	rde_bulk_addr(b->buf, &rib.true_nexthop);
+	if (rib.flags & F_PREF_DAMPED) {
+		rde_bulk_u32(b->buf, rib.damp_reuse);
+		rde_bulk_u16(b->buf, rib.damp_penalty);
+	}
+}
+
+static void
+rde_dump_ctx_free(struct rde_dump_ctx *ctx)
+{
+	if (ctx->bulk != NULL) {
+		ibuf_free(ctx->bulk->buf);
+		free(ctx->bulk);
+	}
+	free(ctx);
+}
+
 int
 rde_match_peer(struct rde_peer *p, struct ctl_neighbor *n)
 {
@@ -2295,33 +2834,50 @@ rde_match_peer(struct rde_peer *p, struct ctl_neighbor *n)
 	return 1;
 }
 
-static void
-rde_dump_filter(struct prefix *p, struct ctl_show_rib_request *req)
+static struct rde_aspath *
+rde_dump_match(struct prefix *p, struct ctl_show_rib_request *req)
 {
 	struct rde_aspath	*asp;
 
 	if (!rde_match_peer(prefix_peer(p), &req->neighbor))
-		return;
+		return (NULL);
 
 	asp = prefix_aspath(p);
 	if (asp == NULL)	/* skip pending withdraw in Adj-RIB-Out */
-		return;
+		return (NULL);
 	if ((req->flags & F_CTL_ACTIVE) && p->re->active != p)
-		return;
+		return (NULL);
 	if ((req->flags & F_CTL_INVALID) &&
 	    (asp->flags & F_ATTR_PARSE_ERR) == 0)
-		return;
+		return (NULL);
+	if ((req->flags & F_CTL_DAMPENED) &&
+	    !damp_suppressed(prefix_peer(p), p->pt))
+		return (NULL);
 	if (req->as.type != AS_UNDEF &&
 	    !aspath_match(asp->aspath, &req->as, 0))
-		return;
+		return (NULL);
 	if (req->community.flags != 0) {
 		if (!community_match(prefix_communities(p), &req->community,
 		    NULL))
-			return;
+			return (NULL);
 	}
 	if (!ovs_match(p, req->flags))
+		return (NULL);
+	return (asp);
+}
+
+static void
+rde_dump_filter(struct prefix *p, struct rde_dump_ctx *ctx)
+{
+	struct ctl_show_rib_request	*req = &ctx->req;
+	struct rde_aspath		*asp;
+
+	if ((asp = rde_dump_match(p, req)) == NULL)
 		return;
-	rde_dump_rib_as(p, asp, req->pid, req->flags);
+	if (ctx->bulk != NULL)
+		rde_dump_bulk(ctx, p, asp);
+	else
+		rde_dump_rib_as(p, asp, req->pid, req->flags);
 }
 
 static void
@@ -2331,7 +2887,7 @@ rde_dump_upcall(struct rib_entry *re, void *ptr)
 	struct prefix		*p;
 
 	LIST_FOREACH(p, &re->prefix_h, entry.list.rib)
-		rde_dump_filter(p, &ctx->req);
+		rde_dump_filter(p, ctx);
 }
 
 static void
@@ -2352,14 +2908,14 @@ rde_dump_prefix_upcall(struct rib_entry *re, void *ptr)
 		if (!prefix_compare(&ctx->req.prefix, &addr,
 		    ctx->req.prefixlen))
 			LIST_FOREACH(p, &re->prefix_h, entry.list.rib)
-				rde_dump_filter(p, &ctx->req);
+				rde_dump_filter(p, ctx);
 	} else {
 		if (ctx->req.prefixlen < pt->prefixlen)
 			return;
 		if (!prefix_compare(&addr, &ctx->req.prefix,
 		    pt->prefixlen))
 			LIST_FOREACH(p, &re->prefix_h, entry.list.rib)
-				rde_dump_filter(p, &ctx->req);
+				rde_dump_filter(p, ctx);
 	}
 }
 
@@ -2370,7 +2926,7 @@ rde_dump_adjout_upcall(struct prefix *p, void *ptr)
 
 	if (p->flags & (PREFIX_FLAG_WITHDRAW | PREFIX_FLAG_DEAD))
 		return;
-	rde_dump_filter(p, &ctx->req);
+	rde_dump_filter(p, ctx);
 }
 
 static void
@@ -2390,13 +2946,13 @@ rde_dump_adjout_prefix_upcall(struct prefix *p, void *ptr)
 			return;
 		if (!prefix_compare(&ctx->req.prefix, &addr,
 		    ctx->req.prefixlen))
-			rde_dump_filter(p, &ctx->req);
+			rde_dump_filter(p, ctx);
 	} else {
 		if (ctx->req.prefixlen < p->pt->prefixlen)
 			return;
 		if (!prefix_compare(&addr, &ctx->req.prefix,
 		    p->pt->prefixlen))
-			rde_dump_filter(p, &ctx->req);
+			rde_dump_filter(p, ctx);
 	}
 }
 
@@ -2440,9 +2996,10 @@ rde_dump_done(void *arg, u_int8_t aid)
 		return;
 	}
 done:
+	rde_dump_bulk_flush(ctx);
 	imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, ctx->req.pid, -1, NULL, 0);
 	LIST_REMOVE(ctx, entry);
-	free(ctx);
+	rde_dump_ctx_free(ctx);
 	return;
 
 nomem:
@@ -2453,6 +3010,133 @@ nomem:
 	return;
 }
 
+struct rde_index_ctx {
+	struct rde_dump_ctx	*ctx;
+	struct prefix		**list;
+	u_int			 count;
+	u_int			 n;
+};
+
+static void
+rde_dump_index_count(struct prefix *p, void *arg)
+{
+	struct rde_index_ctx	*di = arg;
+
+	if (rde_dump_match(p, &di->ctx->req) != NULL)
+		di->count++;
+}
+
+static void
+rde_dump_index_upcall(struct prefix *p, void *arg)
+{
+	struct rde_index_ctx	*di = arg;
+
+	if (di->n < di->count && rde_dump_match(p, &di->ctx->req) != NULL)
+		di->list[di->n++] = p;
+}
+
+/* sort like the RIB walk, by prefix and then in decision process order */
+static int
+rde_dump_index_cmp(const void *a, const void *b)
+{
+	struct prefix	*pa = *(struct prefix * const *)a;
+	struct prefix	*pb = *(struct prefix * const *)b;
+	struct prefix	*p;
+	int		 r;
+
+	if ((r = pt_prefix_cmp(pa->pt, pb->pt)) != 0)
+		return (r);
+	LIST_FOREACH(p, &pa->re->prefix_h, entry.list.rib) {
+		if (p == pa)
+			return (-1);
+		if (p == pb)
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Answer the request out of the RIB index if it is selective enough.
+ * The output is produced in one go so large results are left to the
+ * throttled RIB walk.
+ */
+static int
+rde_dump_index(struct rde_dump_ctx *ctx, u_int16_t rid)
+{
+	struct rde_index_ctx	di;
+	u_int			i;
+
+	memset(&di, 0, sizeof(di));
+	di.ctx = ctx;
+	if (index_walk(&ctx->req, rid, rde_dump_index_count, &di) == -1 ||
+	    di.count > RDE_INDEX_DUMP_MAX)
+		return (-1);
+	if (di.count > 0) {
+		if ((di.list = calloc(di.count, sizeof(*di.list))) == NULL)
+			return (-1);
+		index_walk(&ctx->req, rid, rde_dump_index_upcall, &di);
+		qsort(di.list, di.n, sizeof(*di.list), rde_dump_index_cmp);
+		for (i = 0; i < di.n; i++)
+			rde_dump_filter(di.list[i], ctx);
+		free(di.list);
+	}
+	rde_dump_bulk_flush(ctx);
+	imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, ctx->req.pid, -1, NULL, 0);
+	rde_dump_ctx_free(ctx);
+	return (0);
+}
+
+static void
+rde_dump_peerstats(struct rde_peer *peer, void *arg)
+{
+	struct ctl_show_rib_peerstats	 ps;
+	struct rib			*rib;
+	pid_t				*pid = arg;
+
+	if (peer->conf.id == 0)
+		return;
+	memset(&ps, 0, sizeof(ps));
+	ps.remote_addr = peer->remote_addr;
+	strlcpy(ps.descr, peer->conf.descr, sizeof(ps.descr));
+	if ((rib = rib_byid(peer->loc_rib_id)) != NULL)
+		strlcpy(ps.rib, rib->name, sizeof(ps.rib));
+	ps.prefix_cnt = peer->prefix_cnt;
+	ps.prefix_best_cnt = peer->prefix_best_cnt;
+	imsg_compose(ibuf_se_ctl, IMSG_CTL_SHOW_RIB_PEERSTATS, 0, *pid, -1,
+	    &ps, sizeof(ps));
+}
+
+/*
+ * The RIB counters are maintained while prefixes are linked, unlinked and
+ * evaluated so this does not need to walk any RIB.
+ */
+void
+rde_dump_stats(pid_t pid)
+{
+	struct ctl_show_rib_stats	 rs;
+	struct rib			*rib;
+	u_int16_t			 id;
+	u_int8_t			 aid;
+
+	for (id = 0; id < rib_size; id++) {
+		if ((rib = rib_byid(id)) == NULL)
+			continue;
+		for (aid = AID_MIN; aid < AID_MAX; aid++) {
+			if (rib->stats[aid].prefix_cnt == 0)
+				continue;
+			memset(&rs, 0, sizeof(rs));
+			strlcpy(rs.rib, rib->name, sizeof(rs.rib));
+			rs.stats = rib->stats[aid];
+			rs.flags = rib->flags;
+			rs.aid = aid;
+			imsg_compose(ibuf_se_ctl, IMSG_CTL_SHOW_RIB_STATS, 0,
+			    pid, -1, &rs, sizeof(rs));
+		}
+	}
+	peer_foreach(rde_dump_peerstats, &pid);
+	imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, pid, -1, NULL, 0);
+}
+
 void
 rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
     enum imsg_type type)
@@ -2476,8 +3160,16 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 	memcpy(&ctx->req, req, sizeof(struct ctl_show_rib_request));
 	ctx->req.pid = pid;
 	ctx->req.type = type;
+	if (req->flags & F_CTL_BULK) {
+		if ((ctx->bulk = calloc(1, sizeof(*ctx->bulk))) == NULL ||
+		    (ctx->bulk->buf = ibuf_open(RDE_BULK_SIZE)) == NULL) {
+			rde_dump_ctx_free(ctx);
+			goto nomem;
+		}
+		rde_bulk_reset(ctx->bulk);
+	}
 
-	if (req->flags & (F_CTL_ADJ_IN | F_CTL_INVALID)) {
+	if (req->flags & (F_CTL_ADJ_IN | F_CTL_INVALID | F_CTL_DAMPENED)) {
 		rid = RIB_ADJ_IN;
 	} else if (req->flags & F_CTL_ADJ_OUT) {
 		struct rde_peer *peer;
@@ -2489,7 +3181,7 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 			error = CTL_RES_NOSUCHPEER;
 			imsg_compose(ibuf_se_ctl, IMSG_CTL_RESULT, 0, pid, -1,
 			    &error, sizeof(error));
-			free(ctx);
+			rde_dump_ctx_free(ctx);
 			return;
 		}
 		ctx->peerid = peer->conf.id;
@@ -2533,9 +3225,10 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 			} while ((peer = peer_match(&req->neighbor,
 			    peer->conf.id)));
 
+			rde_dump_bulk_flush(ctx);
 			imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, ctx->req.pid,
 			    -1, NULL, 0);
-			free(ctx);
+			rde_dump_ctx_free(ctx);
 			return;
 		default:
 			fatalx("%s: unsupported imsg type", __func__);
@@ -2548,7 +3241,7 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 		error = CTL_RES_NOSUCHRIB;
 		imsg_compose(ibuf_se_ctl, IMSG_CTL_RESULT, 0, pid, -1, &error,
 		    sizeof(error));
-		free(ctx);
+		rde_dump_ctx_free(ctx);
 		return;
 	}
 
@@ -2560,6 +3253,8 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 			goto nomem;
 		break;
 	case IMSG_CTL_SHOW_RIB:
+		if (rde_dump_index(ctx, rid) == 0)
+			return;
 		if (rib_dump_new(rid, ctx->req.aid, CTL_MSG_HIGH_MARK, ctx,
 		    rde_dump_upcall, rde_dump_done, rde_dump_throttled) == -1)
 			goto nomem;
@@ -2591,9 +3286,10 @@ rde_dump_ctx_new(struct ctl_show_rib_request *req, pid_t pid,
 			    req->prefixlen);
 		if (re)
 			rde_dump_upcall(re, ctx);
+		rde_dump_bulk_flush(ctx);
 		imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, ctx->req.pid,
 		    -1, NULL, 0);
-		free(ctx);
+		rde_dump_ctx_free(ctx);
 		return;
 	default:
 		fatalx("%s: unsupported imsg type", __func__);
@@ -2621,18 +3317,72 @@ rde_dump_ctx_terminate(pid_t pid)
 
 	LIST_FOREACH(ctx, &rde_dump_h, entry) {
 		if (ctx->req.pid == pid) {
-			rib_dump_terminate(ctx);
+			if (ctx->req.type == IMSG_CTL_TRACE_DUMP) {
+				LIST_REMOVE(ctx, entry);
+				rde_dump_ctx_free(ctx);
+			} else
+				rib_dump_terminate(ctx);
 			return;
 		}
 	}
 }
 
-static int
-rde_mrt_throttled(void *arg)
+/*
+ * The trace ring is sent a few chunks per main loop run so a dump does
+ * not queue the whole ring at once and stops while the control
+ * connection is throttled.
+ */
+void
+rde_trace_dump_new(pid_t pid)
 {
-	struct mrt	*mrt = arg;
+	struct rde_dump_ctx	*ctx;
 
-	return (mrt->wbuf.queued > SESS_MSG_LOW_MARK);
+	if ((ctx = calloc(1, sizeof(*ctx))) == NULL) {
+		log_warn("%s", __func__);
+		imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, pid, -1, NULL, 0);
+		return;
+	}
+	ctx->req.pid = pid;
+	ctx->req.type = IMSG_CTL_TRACE_DUMP;
+	trace_dump_start(&ctx->trace);
+	LIST_INSERT_HEAD(&rde_dump_h, ctx, entry);
+}
+
+int
+rde_trace_dump_pending(void)
+{
+	struct rde_dump_ctx	*ctx;
+
+	LIST_FOREACH(ctx, &rde_dump_h, entry)
+		if (ctx->req.type == IMSG_CTL_TRACE_DUMP && !ctx->throttled)
+			return (1);
+	return (0);
+}
+
+void
+rde_trace_dump_runner(void)
+{
+	struct rde_dump_ctx	*ctx, *next;
+
+	LIST_FOREACH_SAFE(ctx, &rde_dump_h, entry, next) {
+		if (ctx->req.type != IMSG_CTL_TRACE_DUMP || ctx->throttled)
+			continue;
+		if (trace_dump(ibuf_se_ctl, ctx->req.pid, &ctx->trace,
+		    TRACE_DUMP_QUEUED))
+			continue;
+		imsg_compose(ibuf_se_ctl, IMSG_CTL_END, 0, ctx->req.pid,
+		    -1, NULL, 0);
+		LIST_REMOVE(ctx, entry);
+		rde_dump_ctx_free(ctx);
+	}
+}
+
+static int
+rde_mrt_throttled(void *arg)
+{
+	struct mrt	*mrt = arg;
+
+	return (mrt->wbuf.queued > SESS_MSG_LOW_MARK);
 }
 
 static void
@@ -2662,6 +3412,12 @@ rde_dump_mrt_new(struct mrt *mrt, pid_t pid, int fd)
 		return;
 	}
 
+	if (conf->flags & BGPD_FLAG_MRT_SNAPSHOT && rde_pledge_proc &&
+	    rde_dump_mrt_fork(&ctx->mrt, rid) == 0) {
+		free(ctx);
+		return;
+	}
+
 	if (ctx->mrt.type == MRT_TABLE_DUMP_V2)
 		mrt_dump_v2_hdr(&ctx->mrt, conf, &peerlist);
 
@@ -2673,6 +3429,98 @@ rde_dump_mrt_new(struct mrt *mrt, pid_t pid, int fd)
 	rde_mrt_cnt++;
 }
 
+static void
+rde_mrt_snapshot_flush(struct mrt *mrt)
+{
+	while (mrt->wbuf.queued) {
+		if (ibuf_write(&mrt->wbuf) == -1) {
+			log_warn("mrt snapshot dump aborted, mrt_write");
+			_exit(1);
+		}
+	}
+}
+
+static void
+rde_mrt_snapshot_upcall(struct rib_entry *re, void *ptr)
+{
+	struct mrt	*mrt = ptr;
+
+	mrt_dump_upcall(re, mrt);
+	if (mrt->wbuf.queued > SESS_MSG_HIGH_MARK)
+		rde_mrt_snapshot_flush(mrt);
+}
+
+/*
+ * Run a table dump in a forked child. The child walks a copy-on-write
+ * image of the RIB and so writes a consistent snapshot while the RDE
+ * continues to process updates. Returns -1 if the dump has to be done
+ * in-process instead.
+ */
+static int
+rde_dump_mrt_fork(struct mrt *mrt, u_int16_t rid)
+{
+	struct rde_mrt_ctx	*mctx;
+	int			 flags;
+
+	switch (fork()) {
+	case -1:
+		log_warn("%s: fork", __func__);
+		return (-1);
+	case 0:
+		break;
+	default:
+		close(mrt->wbuf.fd);
+		return (0);
+	}
+
+	/* child, drop everything not needed for the dump */
+	log_queue_drop();
+	if (pledge("stdio", NULL) == -1)
+		fatal("pledge");
+	setproctitle("route decision engine: mrt dump");
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+
+	close(ibuf_main->fd);
+	if (ibuf_se)
+		close(ibuf_se->fd);
+	if (ibuf_se_ctl)
+		close(ibuf_se_ctl->fd);
+	LIST_FOREACH(mctx, &rde_mrts, entry)
+		close(mctx->mrt.wbuf.fd);
+
+	if ((flags = fcntl(mrt->wbuf.fd, F_GETFL)) == -1 ||
+	    fcntl(mrt->wbuf.fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+		fatal("%s: fcntl", __func__);
+
+	if (mrt->type == MRT_TABLE_DUMP_V2)
+		mrt_dump_v2_hdr(mrt, conf, &peerlist);
+
+	/* a count of 0 requests a synchronous traversal */
+	if (rib_dump_new(rid, AID_UNSPEC, 0, mrt, rde_mrt_snapshot_upcall,
+	    NULL, NULL) == -1)
+		fatal("%s: rib_dump_new", __func__);
+	rde_mrt_snapshot_flush(mrt);
+
+	_exit(0);
+}
+
+static void
+rde_mrt_reap(void)
+{
+	pid_t	pid;
+	int	status;
+
+	while ((pid = waitpid(WAIT_ANY, &status, WNOHANG)) > 0) {
+		if (WIFSIGNALED(status))
+			log_warnx("mrt dump process %d terminated; signal %d",
+			    pid, WTERMSIG(status));
+		else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+			log_warnx("mrt dump process %d failed", pid);
+	}
+}
+
 /*
  * kroute specific functions
  */
@@ -2721,9 +3569,13 @@ rde_send_kroute(struct rib *rib, struct prefix *new, struct prefix *old)
 		type = IMSG_KROUTE_CHANGE;
 		p = new;
 	}
+	latency_mark(LAT_FIB);
 
 	asp = prefix_aspath(p);
 	pt_getaddr(p->pt, &addr);
+	if (TRACE_ON(TRACE_KROUTE))
+		trace_prefix(TRACE_EV_KROUTE, prefix_peer(p)->conf.id, &addr,
+		    p->pt->prefixlen, type);
 	bzero(&kr, sizeof(kr));
 	memcpy(&kr.prefix, &addr, sizeof(kr.prefix));
 	kr.prefixlen = p->pt->prefixlen;
@@ -2802,145 +3654,278 @@ rde_up_flush_upcall(struct prefix *p, void *ptr)
 	up_generate_updates(out_rules, prefix_peer(p), NULL, p);
 }
 
-u_char	queue_buf[4096];
+u_char		queue_buf[4096];
+u_int32_t	queue_cursor;	/* peer id the next DRR round starts at */
+time_t		queue_sample;
+
+static int
+rde_update_queue_ready(struct rde_peer *peer)
+{
+	if (peer->conf.id == 0)
+		return 0;
+	if (peer->state != PEER_UP)
+		return 0;
+	if (peer->throttled)
+		return 0;
+	if (peer->up_credit >= RDE_PEER_CREDIT)
+		return 0;
+	return 1;
+}
+
+static int
+rde_update_queue_empty(struct rde_peer *peer, int wdonly)
+{
+	u_int8_t aid;
+
+	for (aid = 0; aid < AID_MAX; aid++) {
+		if (!RB_EMPTY(&peer->withdraws[aid]))
+			return 0;
+		if (!wdonly && !RB_EMPTY(&peer->updates[aid]))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Minimum route advertisement interval. While the interval runs changes
+ * accumulate in the Adj-RIB-Out queues where intermediate states of
+ * flapping prefixes are coalesced. Once it expired the queues are flushed
+ * as a whole and the next interval starts. Returns 1 if at most withdraws
+ * may be sent right now.
+ */
+static int
+rde_update_queue_paced(struct rde_peer *peer, time_t now)
+{
+	if (peer->conf.mrai == 0 || peer->up_mrai_flush)
+		return 0;
+	if (now < peer->up_mrai_next)
+		return 1;
+	if (!rde_update_queue_empty(peer, 0))
+		peer->up_mrai_flush = 1;
+	return 0;
+}
 
 int
 rde_update_queue_pending(void)
 {
 	struct rde_peer *peer;
-	u_int8_t aid;
+	time_t now;
+	int paced;
 
 	if (ibuf_se && ibuf_se->w.queued >= SESS_MSG_HIGH_MARK)
 		return 0;
 
+	now = getmonotime();
 	LIST_FOREACH(peer, &peerlist, peer_l) {
-		if (peer->conf.id == 0)
+		if (!rde_update_queue_ready(peer))
 			continue;
-		if (peer->state != PEER_UP)
+		paced = rde_update_queue_paced(peer, now);
+		if (paced && peer->conf.flags & PEERFLAG_MRAI_WITHDRAW)
+			continue;
+		if (!rde_update_queue_empty(peer, paced))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Return the poll timeout in milliseconds until the first advertisement
+ * interval with pending changes expires or -1 if there is none.
+ */
+int
+rde_update_queue_timeout(void)
+{
+	struct rde_peer *peer;
+	time_t now, wait = -1;
+
+	now = getmonotime();
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		if (peer->conf.id == 0 || peer->state != PEER_UP)
 			continue;
-		if (peer->throttled)
+		if (peer->conf.mrai == 0 || peer->up_mrai_flush)
 			continue;
-		for (aid = 0; aid < AID_MAX; aid++) {
-			if (!RB_EMPTY(&peer->updates[aid]) ||
-			    !RB_EMPTY(&peer->withdraws[aid]))
-				return 1;
+		if (rde_update_queue_empty(peer, 0))
+			continue;
+		if (peer->up_mrai_next <= now)
+			return 0;
+		if (wait == -1 || peer->up_mrai_next - now < wait)
+			wait = peer->up_mrai_next - now;
+	}
+	return (wait == -1 ? -1 : wait * 1000);
+}
+
+/*
+ * Once per second update the exponentially weighted prefix drain rate
+ * of all peers. Used by bgpctl show neighbor to estimate the time it
+ * takes to flush the outbound queue.
+ */
+static void
+rde_update_queue_sample(void)
+{
+	struct rde_peer	*peer;
+	u_int64_t	 sent;
+	u_int32_t	 rate;
+	time_t		 now;
+
+	now = getmonotime();
+	if (now == queue_sample)
+		return;
+	queue_sample = now;
+
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		sent = peer->prefix_sent_update + peer->prefix_sent_withdraw;
+		if (peer->up_drain_time != 0 && now > peer->up_drain_time) {
+			rate = (sent - peer->up_drain_last) /
+			    (now - peer->up_drain_time);
+			peer->up_drain_rate = (3 * peer->up_drain_rate +
+			    rate) / 4;
 		}
+		peer->up_drain_last = sent;
+		peer->up_drain_time = now;
 	}
-	return 0;
 }
 
-void
-rde_update_queue_runner(void)
+/*
+ * Generate and send at most one UPDATE message for a peer.
+ * IPv4 goes first, then the multiprotocol withdraws and last the
+ * multiprotocol updates. If wdonly is set only withdraws are sent.
+ * Returns the number of bytes sent to the SE, 0 if nothing was pending.
+ */
+static int
+rde_update_queue_peer(struct rde_peer *peer, int wdonly)
 {
-	struct rde_peer		*peer;
-	int			 r, sent, max = RDE_RUNNER_ROUNDS, eor;
-	u_int16_t		 len, wpos;
+	int		 r;
+	u_int16_t	 len, wpos;
+	u_int8_t	 aid;
 
 	len = sizeof(queue_buf) - MSGSIZE_HEADER;
-	do {
-		sent = 0;
-		LIST_FOREACH(peer, &peerlist, peer_l) {
-			if (peer->conf.id == 0)
-				continue;
-			if (peer->state != PEER_UP)
-				continue;
-			if (peer->throttled)
-				continue;
-			eor = 0;
-			wpos = 0;
-			/* first withdraws, save 2 bytes for path attributes */
-			if ((r = up_dump_withdraws(queue_buf, len - 2, peer,
-			    AID_INET)) == -1)
-				continue;
-			wpos += r;
 
-			/* now bgp path attributes unless it is the EoR mark */
-			if (up_is_eor(peer, AID_INET)) {
-				eor = 1;
+	if (!RB_EMPTY(&peer->withdraws[AID_INET]) ||
+	    (!wdonly && !RB_EMPTY(&peer->updates[AID_INET]))) {
+		/* first withdraws, save 2 bytes for path attributes */
+		if ((r = up_dump_withdraws(queue_buf, len - 2, peer,
+		    AID_INET)) == -1)
+			fatalx("%s: buffer too small", __func__);
+		wpos = r;
+
+		/* now bgp path attributes unless it is the EoR mark */
+		if (wdonly) {
+			bzero(queue_buf + wpos, 2);
+			wpos += 2;
+		} else if (up_is_eor(peer, AID_INET)) {
+			if (wpos > 2) {
 				bzero(queue_buf + wpos, 2);
 				wpos += 2;
-			} else {
-				r = up_dump_attrnlri(queue_buf + wpos,
-				    len - wpos, peer);
-				wpos += r;
-			}
+				rde_peer_send_update(peer, queue_buf, wpos);
+			} else
+				wpos = 0;
+			rde_peer_send_eor(peer, AID_INET);
+			return (wpos + 4);
+		} else {
+			r = up_dump_attrnlri(queue_buf + wpos, len - wpos,
+			    peer);
+			wpos += r;
+		}
 
-			/* finally send message to SE */
-			if (wpos > 4) {
-				if (imsg_compose(ibuf_se, IMSG_UPDATE,
-				    peer->conf.id, 0, -1, queue_buf,
-				    wpos) == -1)
-					fatal("%s %d imsg_compose error",
-					    __func__, __LINE__);
-				sent++;
-			}
-			if (eor)
-				rde_peer_send_eor(peer, AID_INET);
+		/* finally send message to SE */
+		if (wpos > 4) {
+			rde_peer_send_update(peer, queue_buf, wpos);
+			return (wpos);
 		}
-		max -= sent;
-	} while (sent != 0 && max > 0);
+	}
+
+	/* first withdraws ... */
+	for (aid = AID_INET6; aid < AID_MAX; aid++) {
+		r = up_dump_mp_unreach(queue_buf, len, peer, aid);
+		if (r == -1)
+			continue;
+		rde_peer_send_update(peer, queue_buf, r);
+		return (r);
+	}
+
+	if (wdonly)
+		return (0);
+
+	/* ... then updates */
+	for (aid = AID_INET6; aid < AID_MAX; aid++) {
+		if (up_is_eor(peer, aid)) {
+			rde_peer_send_eor(peer, aid);
+			return (10);
+		}
+		r = up_dump_mp_reach(queue_buf, len, peer, aid);
+		if (r == 0)
+			continue;
+		rde_peer_send_update(peer, queue_buf, r);
+		return (r);
+	}
+
+	return (0);
 }
 
+/*
+ * Deficit round-robin over all peers with UPDATE credit left. Each round
+ * a peer may send up to RDE_UPDATE_QUANTUM bytes so a peer with a huge
+ * backlog can no longer starve the others. If the pipe to the SE fills up
+ * the round is interrupted and resumed at the same peer the next time.
+ */
 void
-rde_update6_queue_runner(u_int8_t aid)
+rde_update_queue_runner(void)
 {
-	struct rde_peer		*peer;
-	int			 r, sent, max = RDE_RUNNER_ROUNDS / 2;
-	u_int16_t		 len;
+	struct rde_peer	*peer, *start;
+	time_t		 now;
+	int		 r, sent, paced, max = RDE_RUNNER_ROUNDS;
 
-	/* first withdraws ... */
-	do {
-		sent = 0;
-		LIST_FOREACH(peer, &peerlist, peer_l) {
-			if (peer->conf.id == 0)
-				continue;
-			if (peer->state != PEER_UP)
-				continue;
-			if (peer->throttled)
-				continue;
-			len = sizeof(queue_buf) - MSGSIZE_HEADER;
-			r = up_dump_mp_unreach(queue_buf, len, peer, aid);
-			if (r == -1)
-				continue;
-			/* finally send message to SE */
-			if (imsg_compose(ibuf_se, IMSG_UPDATE, peer->conf.id,
-			    0, -1, queue_buf, r) == -1)
-				fatal("%s %d imsg_compose error", __func__,
-				    __LINE__);
-			sent++;
-		}
-		max -= sent;
-	} while (sent != 0 && max > 0);
+	rde_update_queue_sample();
+	now = getmonotime();
+
+	if (ibuf_se == NULL || LIST_EMPTY(&peerlist))
+		return;
+
+	if ((start = peer_get(queue_cursor)) == NULL)
+		start = LIST_FIRST(&peerlist);
 
-	/* ... then updates */
-	max = RDE_RUNNER_ROUNDS / 2;
 	do {
 		sent = 0;
-		LIST_FOREACH(peer, &peerlist, peer_l) {
-			if (peer->conf.id == 0)
-				continue;
-			if (peer->state != PEER_UP)
-				continue;
-			if (peer->throttled)
-				continue;
-			len = sizeof(queue_buf) - MSGSIZE_HEADER;
-			if (up_is_eor(peer, aid)) {
-				rde_peer_send_eor(peer, aid);
-				continue;
+		peer = start;
+		do {
+			if (!rde_update_queue_ready(peer))
+				goto next;
+			paced = rde_update_queue_paced(peer, now);
+			if (paced && peer->conf.flags & PEERFLAG_MRAI_WITHDRAW)
+				goto next;
+			peer->up_deficit += RDE_UPDATE_QUANTUM;
+			while (peer->up_deficit > 0 &&
+			    peer->up_credit < RDE_PEER_CREDIT) {
+				if (ibuf_se->w.queued >= SESS_MSG_HIGH_MARK) {
+					queue_cursor = peer->conf.id;
+					return;
+				}
+				if ((r = rde_update_queue_peer(peer,
+				    paced)) == 0) {
+					/* queue drained, restart interval */
+					if (peer->up_mrai_flush) {
+						peer->up_mrai_flush = 0;
+						peer->up_mrai_next = now +
+						    peer->conf.mrai;
+					}
+					/* idle peers do not bank deficit */
+					peer->up_deficit = 0;
+					break;
+				}
+				peer->up_deficit -= r;
+				sent++;
 			}
-			r = up_dump_mp_reach(queue_buf, len, peer, aid);
-			if (r == 0)
-				continue;
-
-			/* finally send message to SE */
-			if (imsg_compose(ibuf_se, IMSG_UPDATE, peer->conf.id,
-			    0, -1, queue_buf, r) == -1)
-				fatal("%s %d imsg_compose error", __func__,
-				    __LINE__);
-			sent++;
-		}
+next:
+			if ((peer = LIST_NEXT(peer, peer_l)) == NULL)
+				peer = LIST_FIRST(&peerlist);
+		} while (peer != start);
 		max -= sent;
 	} while (sent != 0 && max > 0);
+
+	/* completed rounds end at start, let the next peer go first */
+	if ((peer = LIST_NEXT(start, peer_l)) == NULL)
+		peer = LIST_FIRST(&peerlist);
+	queue_cursor = peer->conf.id;
 }
 
 /*
@@ -3020,8 +4005,9 @@ rde_reload_done(void)
 	struct rde_prefixset_head originsets_old;
 	struct rde_prefixset	 roa_old;
 	struct as_set_head	 as_sets_old;
+	enum filter_diff	 diff;
 	u_int16_t		 rid;
-	int			 reload = 0;
+	int			 reload = 0, sets = 0, partial;
 
 	softreconfig = 0;
 
@@ -3061,11 +4047,27 @@ rde_reload_done(void)
 	peerself->conf.remote_masklen = 32;
 	peerself->short_as = conf->short_as;
 
-	/* check if roa changed */
+	index_set(conf->flags & BGPD_FLAG_RIB_INDEX);
+
+	/* a pledge can not be widened again, a restart is needed for that */
+	if (rde_pledge_proc && !(conf->flags & BGPD_FLAG_MRT_SNAPSHOT)) {
+		if (pledge("stdio recvfd", NULL) == -1)
+			fatal("pledge");
+		rde_pledge_proc = 0;
+	} else if (!rde_pledge_proc && conf->flags & BGPD_FLAG_MRT_SNAPSHOT)
+		log_warnx("mrt-snapshot needs a restart, dumping in-process");
+
+	/* check if roa changed, small changes are handled incrementally */
+	free(roa_reval.changes);
+	memset(&roa_reval, 0, sizeof(roa_reval));
 	if (trie_equal(&conf->rde_roa.th, &roa_old.th) == 0) {
-		log_debug("roa change: reloading Adj-RIB-In");
-		conf->rde_roa.dirty = 1;
-		reload++;	/* run softreconf in */
+		trie_roa_diff(&roa_old.th, &conf->rde_roa.th, rde_roa_change,
+		    &roa_reval);
+		if (roa_reval.overflow) {
+			log_debug("roa change: reloading Adj-RIB-In");
+			conf->rde_roa.dirty = 1;
+			reload++;	/* run softreconf in */
+		}
 	}
 	trie_free(&roa_old.th);	/* old roa no longer needed */
 
@@ -3073,6 +4075,13 @@ rde_reload_done(void)
 	rde_mark_prefixsets_dirty(&originsets_old, &conf->rde_originsets);
 	as_sets_mark_dirty(&as_sets_old, &conf->as_sets);
 
+	/* collect the prefixes affected by changed set content */
+	free(sets_reval.changes);
+	memset(&sets_reval, 0, sizeof(sets_reval));
+	rde_sets_diff(&prefixsets_old, &conf->rde_prefixsets, 0);
+	rde_sets_diff(&originsets_old, &conf->rde_originsets, 1);
+	rde_sets_compact(&sets_reval);
+
 	/*
 	 * make the new filter rules the active one but keep the old for
 	 * softrconfig. This is needed so that changes happening are using
@@ -3090,6 +4099,7 @@ rde_reload_done(void)
 			continue;
 		peer->reconf_out = 0;
 		peer->reconf_rib = 0;
+		peer->reconf_sets = 0;
 		if (peer->loc_rib_id != rib_find(peer->conf.rib)) {
 			log_peer_info(&peer->conf, "rib change, reloading");
 			peer->loc_rib_id = rib_find(peer->conf.rib);
@@ -3105,7 +4115,16 @@ rde_reload_done(void)
 			softreconfig++;	/* account for the running flush */
 			continue;
 		}
-		if (!rde_filter_equal(out_rules, out_rules_tmp, peer)) {
+		diff = rde_filter_diff(out_rules, out_rules_tmp, peer);
+		if (diff == FILTER_DIFF_SETS && !sets_reval.overflow &&
+		    peer->conf.export_type != EXPORT_NONE &&
+		    peer->conf.export_type != EXPORT_DEFAULT_ROUTE) {
+			char *p = log_fmt_peer(&peer->conf);
+			log_debug("out filter set change: partial reload of "
+			    "peer %s", p);
+			free(p);
+			peer->reconf_sets = 1;
+		} else if (diff != FILTER_DIFF_NONE) {
 			char *p = log_fmt_peer(&peer->conf);
 			log_debug("out filter change: reloading peer %s", p);
 			free(p);
@@ -3123,6 +4142,7 @@ rde_reload_done(void)
 		fh = rib->in_rules;
 		rib->in_rules = rib->in_rules_tmp;
 		rib->in_rules_tmp = fh;
+		rib->reconf_sets = 0;
 
 		switch (rib->state) {
 		case RECONF_DELETE:
@@ -3133,10 +4153,18 @@ rde_reload_done(void)
 			rib->state = RECONF_KEEP;
 			/* FALLTHROUGH */
 		case RECONF_KEEP:
-			if (rde_filter_equal(rib->in_rules,
-			    rib->in_rules_tmp, NULL))
+			diff = rde_filter_diff(rib->in_rules,
+			    rib->in_rules_tmp, NULL);
+			if (diff == FILTER_DIFF_NONE)
 				/* rib is in sync */
 				break;
+			if (diff == FILTER_DIFF_SETS && !sets_reval.overflow) {
+				log_debug("in filter set change: partial "
+				    "reload of RIB %s", rib->name);
+				rib->reconf_sets = 1;
+				sets++;
+				break;
+			}
 			log_debug("in filter change: reloading RIB %s",
 			    rib->name);
 			rib->state = RECONF_RELOAD;
@@ -3166,6 +4194,44 @@ rde_reload_done(void)
 
 	log_info("RDE reconfigured");
 
+	/* peers without Adj-RIB-In need to send their table again */
+	if (reload > 0 || sets > 0)
+		rde_refresh_noadjin(0);
+	else if (roa_reval.len > 0)
+		rde_refresh_noadjin(1);
+
+	/*
+	 * The partial walks run like the full one and softreconfig in is
+	 * only done once all of them finished.
+	 */
+	partial = 0;
+	if (reload > 0 && roa_reval.len > 0) {
+		/* the full run revalidates everything anyway */
+		conf->rde_roa.dirty = 1;
+	} else if (roa_reval.len > 0 && !roa_reval.overflow) {
+		rde_sets_compact(&roa_reval);
+		softreconfig++;
+		partial++;
+		roa_reval.running = 1 +
+		    rde_roa_reval_noadjin(&roa_reval, rde_roa_reval_done);
+		if (rib_dump_subtree(RIB_ADJ_IN, roa_reval.changes,
+		    roa_reval.len, RDE_RUNNER_ROUNDS, &roa_reval,
+		    rde_roa_reval_upcall, rde_roa_reval_done, NULL) == -1)
+			fatal("%s: rib_dump_subtree", __func__);
+		log_info("running roa revalidation");
+	}
+
+	if (sets > 0 && sets_reval.len > 0) {
+		softreconfig++;
+		partial++;
+		if (rib_dump_subtree(RIB_ADJ_IN, sets_reval.changes,
+		    sets_reval.len, RDE_RUNNER_ROUNDS, &sets_reval,
+		    rde_softreconfig_in_sets, rde_softreconfig_in_sets_done,
+		    NULL) == -1)
+			fatal("%s: rib_dump_subtree", __func__);
+		log_info("running partial softreconfig in");
+	}
+
 	if (reload > 0) {
 		softreconfig++;
 		if (rib_dump_new(RIB_ADJ_IN, AID_UNSPEC, RDE_RUNNER_ROUNDS,
@@ -3173,36 +4239,118 @@ rde_reload_done(void)
 		    rde_softreconfig_in_done, NULL) == -1)
 			fatal("%s: rib_dump_new", __func__);
 		log_info("running softreconfig in");
-	} else {
+	} else if (partial == 0) {
 		rde_softreconfig_in_done(NULL, AID_UNSPEC);
 	}
 }
 
+/*
+ * There is nothing to run softreconfig in on for peers without Adj-RIB-In.
+ * Ask the SE to send a route refresh for every negotiated AID instead,
+ * the resent paths are filtered with the new rules as they arrive.
+ * A ROA change only matters for peers whose input rules use ovs. Since
+ * RTR caches may change often these requests are coalesced to at most
+ * one per RDE_REFRESH_INTERVAL, a config reload is sent right away.
+ */
 static void
-rde_softreconfig_in_done(void *arg, u_int8_t dummy)
+rde_refresh_noadjin(int roa)
 {
 	struct rde_peer	*peer;
 	u_int16_t	 i;
 
-	if (arg != NULL) {
-		softreconfig--;
-		/* one guy done but other dumps are still running */
-		if (softreconfig > 0)
-			return;
-
-		log_info("softreconfig in done");
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		if (!peer->no_adjin || peer->state != PEER_UP)
+			continue;
+		if (roa) {
+			for (i = RIB_LOC_START; i < rib_size; i++) {
+				struct rib *rib = rib_byid(i);
+				if (rib == NULL)
+					continue;
+				if (rde_filter_uses_ovs(rib->in_rules, peer))
+					break;
+			}
+			if (i == rib_size)
+				continue;
+		} else
+			peer->refresh_next = 0;
+		peer->refresh_pending = 1;
 	}
-	/* Changes may have been performed during softreconfig_in run */
-	rde_send_pftable_commit();
+	rde_refresh_runner();
+}
 
-	/* now do the Adj-RIB-Out sync and a possible FIB sync */
-	softreconfig = 0;
-	for (i = 0; i < rib_size; i++) {
-		struct rib *rib = rib_byid(i);
-		if (rib == NULL)
+static void
+rde_refresh_runner(void)
+{
+	struct rde_peer	*peer;
+	time_t		 now;
+	u_int8_t	 aid;
+
+	now = getmonotime();
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		if (!peer->refresh_pending || peer->refresh_next > now)
 			continue;
-		rib->state = RECONF_NONE;
-		if (rib->fibstate == RECONF_RELOAD) {
+		peer->refresh_pending = 0;
+		if (!peer->no_adjin || peer->state != PEER_UP)
+			continue;
+		for (aid = 0; aid < AID_MAX; aid++) {
+			if (!peer->capa.mp[aid])
+				continue;
+			if (imsg_compose(ibuf_se, IMSG_REFRESH, peer->conf.id,
+			    0, -1, &aid, sizeof(aid)) == -1)
+				fatal("%s %d imsg_compose error", __func__,
+				    __LINE__);
+		}
+		peer->refresh_next = now + RDE_REFRESH_INTERVAL;
+		log_peer_info(&peer->conf, "policy change, "
+		    "requesting route refresh");
+	}
+}
+
+static int
+rde_refresh_timeout(void)
+{
+	struct rde_peer	*peer;
+	time_t		 now, next = 0;
+
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		if (!peer->refresh_pending)
+			continue;
+		if (next == 0 || peer->refresh_next < next)
+			next = peer->refresh_next;
+	}
+	if (next == 0)
+		return (-1);
+	now = getmonotime();
+	if (next <= now)
+		return (0);
+	return ((next - now) * 1000);
+}
+
+static void
+rde_softreconfig_in_done(void *arg, u_int8_t dummy)
+{
+	struct rde_peer	*peer;
+	u_int16_t	 i;
+
+	if (arg != NULL) {
+		softreconfig--;
+		/* one guy done but other dumps are still running */
+		if (softreconfig > 0)
+			return;
+
+		log_info("softreconfig in done");
+	}
+	/* Changes may have been performed during softreconfig_in run */
+	rde_send_pftable_commit();
+
+	/* now do the Adj-RIB-Out sync and a possible FIB sync */
+	softreconfig = 0;
+	for (i = 0; i < rib_size; i++) {
+		struct rib *rib = rib_byid(i);
+		if (rib == NULL)
+			continue;
+		rib->state = RECONF_NONE;
+		if (rib->fibstate == RECONF_RELOAD) {
 			if (rib_dump_new(i, AID_UNSPEC, RDE_RUNNER_ROUNDS,
 			    rib, rde_softreconfig_sync_fib,
 			    rde_softreconfig_sync_done, NULL) == -1)
@@ -3249,6 +4397,8 @@ rde_softreconfig_in_done(void *arg, u_int8_t dummy)
 		}
 	}
 
+	rde_softreconfig_sets_done();
+
 	for (i = 0; i < rib_size; i++) {
 		struct rib *rib = rib_byid(i);
 		if (rib == NULL)
@@ -3285,7 +4435,8 @@ rde_softreconfig_out_done(void *arg, u_int8_t aid)
 static void
 rde_softreconfig_done(void)
 {
-	u_int16_t	i;
+	struct rde_peer	*peer;
+	u_int16_t	 i;
 
 	for (i = 0; i < rib_size; i++) {
 		struct rib *rib = rib_byid(i);
@@ -3294,72 +4445,537 @@ rde_softreconfig_done(void)
 		rib->state = RECONF_NONE;
 	}
 
+	LIST_FOREACH(peer, &peerlist, peer_l)
+		peer->reconf_sets = 0;
+	free(roa_reval.changes);
+	memset(&roa_reval, 0, sizeof(roa_reval));
+	free(sets_reval.changes);
+	memset(&sets_reval, 0, sizeof(sets_reval));
+
 	log_info("RDE soft reconfiguration done");
 	imsg_compose(ibuf_main, IMSG_RECONF_DONE, 0, 0,
 	    -1, NULL, 0);
 }
 
+/*
+ * Run the input filters of the RIBs selected by mode for an Adj-RIB-In
+ * prefix.
+ */
 static void
-rde_softreconfig_in(struct rib_entry *re, void *bula)
+rde_softreconfig_in_prefix(struct prefix *p, struct bgpd_addr *prefix,
+    int mode)
 {
 	struct filterstate	 state;
 	struct rib		*rib;
-	struct prefix		*p;
-	struct pt_entry		*pt;
-	struct rde_peer		*peer;
-	struct rde_aspath	*asp;
+	struct pt_entry		*pt = p->pt;
+	struct rde_peer		*peer = prefix_peer(p);
+	struct rde_aspath	*asp = prefix_aspath(p);
 	enum filter_actions	 action;
+	u_int16_t		 i;
+
+	/* skip announced networks, they are never filtered */
+	if (asp->flags & F_PREFIX_ANNOUNCED)
+		return;
+
+	/* suppressed prefixes stay out until they are reused */
+	if (damp_suppressed(peer, pt))
+		return;
+
+	for (i = RIB_LOC_START; i < rib_size; i++) {
+		rib = rib_byid(i);
+		if (rib == NULL)
+			continue;
+
+		if (mode == SOFTRECONF_SETS) {
+			if (!rib->reconf_sets)
+				continue;
+		} else if (mode != SOFTRECONF_ALL &&
+		    rib->state != RECONF_RELOAD)
+			continue;
+
+		rde_filterstate_prep(&state, asp, prefix_communities(p),
+		    prefix_nexthop(p), prefix_nhflags(p));
+		action = rde_filter(rib->in_rules, peer, peer, prefix,
+		    pt->prefixlen, p->validation_state, &state);
+
+		if (action == ACTION_ALLOW) {
+			/* update Local-RIB */
+			prefix_update(rib, peer, &state, prefix,
+			    pt->prefixlen, p->validation_state);
+		} else if (action == ACTION_DENY) {
+			/* remove from Local-RIB */
+			prefix_withdraw(rib, peer, prefix, pt->prefixlen);
+		}
+
+		rde_filterstate_clean(&state);
+	}
+}
+
+/* recalculate the ROA validation state, returns 1 if it changed */
+static int
+rde_roa_revalidate_prefix(struct prefix *p, struct bgpd_addr *prefix)
+{
+	u_int8_t	 vstate;
+
+	vstate = rde_roa_validity(&conf->rde_roa, prefix, p->pt->prefixlen,
+	    aspath_origin(prefix_aspath(p)->aspath));
+	if (vstate == p->validation_state)
+		return (0);
+	prefix_set_vstate(p, vstate);
+	return (1);
+}
+
+static void
+rde_softreconfig_in(struct rib_entry *re, void *bula)
+{
+	struct prefix		*p;
 	struct bgpd_addr	 prefix;
 	int			 force_eval;
-	u_int8_t		 vstate;
-	u_int16_t		 i;
 
-	pt = re->prefix;
-	pt_getaddr(pt, &prefix);
+	pt_getaddr(re->prefix, &prefix);
 	LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
-		asp = prefix_aspath(p);
-		peer = prefix_peer(p);
 		force_eval = 0;
+		/* ROA validation state update */
+		if (conf->rde_roa.dirty)
+			force_eval = rde_roa_revalidate_prefix(p, &prefix);
+		rde_softreconfig_in_prefix(p, &prefix,
+		    force_eval ? SOFTRECONF_ALL : SOFTRECONF_RELOAD);
+	}
+}
 
-		if (conf->rde_roa.dirty) {
-			/* ROA validation state update */
-			vstate = rde_roa_validity(&conf->rde_roa,
-			    &prefix, pt->prefixlen, aspath_origin(asp->aspath));
-			if (vstate != p->validation_state) {
-				force_eval = 1;
-				p->validation_state = vstate;
-			}
+static void
+rde_roa_change(struct bgpd_addr *prefix, u_int8_t prefixlen, void *arg)
+{
+	struct roa_reval	*rr = arg;
+	struct rib_subtree	*c;
+	size_t			 n;
+
+	if (rr->overflow)
+		return;
+	/* a change of a default route entry covers everything */
+	if (prefixlen == 0 || rr->len >= ROA_INCREMENTAL_MAX) {
+		rr->overflow = 1;
+		return;
+	}
+	if (rr->len == rr->size) {
+		n = rr->size == 0 ? 64 : rr->size * 2;
+		if ((c = reallocarray(rr->changes, n, sizeof(*c))) == NULL) {
+			rr->overflow = 1;
+			return;
 		}
+		rr->changes = c;
+		rr->size = n;
+	}
+	rr->changes[rr->len].prefix = *prefix;
+	rr->changes[rr->len].prefixlen = prefixlen;
+	rr->len++;
+}
 
-		/* skip announced networks, they are never filtered */
-		if (asp->flags & F_PREFIX_ANNOUNCED)
+static void
+rde_roa_reval_upcall(struct rib_entry *re, void *arg)
+{
+	struct roa_reval	*rr = arg;
+	struct prefix		*p;
+	struct bgpd_addr	 prefix;
+
+	pt_getaddr(re->prefix, &prefix);
+	LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
+		rr->checked++;
+		if (rde_roa_revalidate_prefix(p, &prefix)) {
+			rr->changed++;
+			rde_softreconfig_in_prefix(p, &prefix, SOFTRECONF_ALL);
+		}
+	}
+}
+
+/*
+ * Peers without Adj-RIB-In only have their paths in the Loc-RIBs. Their
+ * input filters are not affected unless they use ovs, which is handled
+ * by a route refresh, but the validation state stored in the Loc-RIBs
+ * has to follow the change. Returns the number of walks started.
+ */
+static int
+rde_roa_reval_noadjin(struct roa_reval *rr, void (*done)(void *, u_int8_t))
+{
+	struct rde_peer	*peer;
+	u_int16_t	 i;
+	int		 n = 0;
+
+	LIST_FOREACH(peer, &peerlist, peer_l)
+		if (peer->no_adjin)
+			break;
+	if (peer == NULL)
+		return (0);
+
+	for (i = RIB_LOC_START; i < rib_size; i++) {
+		if (rib_byid(i) == NULL)
 			continue;
+		if (rr->overflow) {
+			if (rib_dump_new(i, AID_UNSPEC, RDE_RUNNER_ROUNDS, rr,
+			    rde_roa_reval_noadjin_upcall, done, NULL) == -1)
+				fatal("%s: rib_dump_new", __func__);
+		} else {
+			if (rib_dump_subtree(i, rr->changes, rr->len,
+			    RDE_RUNNER_ROUNDS, rr, rde_roa_reval_noadjin_upcall,
+			    done, NULL) == -1)
+				fatal("%s: rib_dump_subtree", __func__);
+		}
+		n++;
+	}
+	return (n);
+}
 
-		for (i = RIB_LOC_START; i < rib_size; i++) {
-			rib = rib_byid(i);
-			if (rib == NULL)
-				continue;
+static void
+rde_roa_reval_noadjin_upcall(struct rib_entry *re, void *arg)
+{
+	struct roa_reval	*rr = arg;
+	struct prefix		*p;
+	struct bgpd_addr	 prefix;
 
-			if (rib->state != RECONF_RELOAD && !force_eval)
-				continue;
+	pt_getaddr(re->prefix, &prefix);
+	LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
+		if (!prefix_peer(p)->no_adjin)
+			continue;
+		rr->checked++;
+		if (rde_roa_revalidate_prefix(p, &prefix))
+			rr->changed++;
+	}
+}
 
-			rde_filterstate_prep(&state, asp, prefix_communities(p),
-			    prefix_nexthop(p), prefix_nhflags(p));
-			action = rde_filter(rib->in_rules, peer, peer, &prefix,
-			    pt->prefixlen, p->validation_state, &state);
-
-			if (action == ACTION_ALLOW) {
-				/* update Local-RIB */
-				prefix_update(rib, peer, &state, &prefix,
-				    pt->prefixlen, p->validation_state);
-			} else if (action == ACTION_DENY) {
-				/* remove from Local-RIB */
-				prefix_withdraw(rib, peer, &prefix,
-				    pt->prefixlen);
-			}
+static void
+rde_roa_reval_done(void *arg, u_int8_t dummy)
+{
+	struct roa_reval	*rr = arg;
 
-			rde_filterstate_clean(&state);
+	if (--rr->running > 0)
+		return;
+	log_info("roa change: %zu ROAs changed, %llu prefixes revalidated, "
+	    "%llu changed state", rr->len, rr->checked, rr->changed);
+	rde_softreconfig_in_done(rib_byid(RIB_ADJ_IN), AID_UNSPEC);
+}
+
+/*
+ * Collect the prefixes covered by entries that differ between the old and
+ * new version of the dirty sets. A set without old version can't be
+ * diffed and forces a full reload.
+ */
+static void
+rde_sets_diff(struct rde_prefixset_head *psold,
+    struct rde_prefixset_head *psnew, int roa)
+{
+	struct rde_prefixset	*new, *old;
+
+	SIMPLEQ_FOREACH(new, psnew, entry) {
+		if (!new->dirty)
+			continue;
+		if ((old = rde_find_prefixset(new->name, psold)) == NULL) {
+			sets_reval.overflow = 1;
+			return;
 		}
+		if (roa)
+			trie_roa_diff(&old->th, &new->th, rde_roa_change,
+			    &sets_reval);
+		else
+			trie_diff(&old->th, &new->th, rde_roa_change,
+			    &sets_reval);
+	}
+}
+
+static int
+rde_sets_cmp(const void *a, const void *b)
+{
+	const struct rib_subtree *ca = a, *cb = b;
+	int			 r;
+
+	if (ca->prefix.aid != cb->prefix.aid)
+		return (ca->prefix.aid < cb->prefix.aid ? -1 : 1);
+	if (ca->prefix.aid == AID_INET)
+		r = memcmp(&ca->prefix.v4, &cb->prefix.v4,
+		    sizeof(ca->prefix.v4));
+	else
+		r = memcmp(&ca->prefix.v6, &cb->prefix.v6,
+		    sizeof(ca->prefix.v6));
+	if (r != 0)
+		return (r);
+	return (ca->prefixlen - cb->prefixlen);
+}
+
+/* sort the changes and drop the ones covered by a less specific change */
+static void
+rde_sets_compact(struct roa_reval *rr)
+{
+	struct rib_subtree	*k = NULL, *c;
+	size_t			 i, n = 0;
+
+	if (rr->overflow || rr->len == 0)
+		return;
+	qsort(rr->changes, rr->len, sizeof(*rr->changes), rde_sets_cmp);
+	for (i = 0; i < rr->len; i++) {
+		c = &rr->changes[i];
+		if (k != NULL && k->prefixlen <= c->prefixlen &&
+		    prefix_compare(&k->prefix, &c->prefix, k->prefixlen) == 0)
+			continue;
+		rr->changes[n] = *c;
+		k = &rr->changes[n++];
+	}
+	rr->len = n;
+}
+
+static void
+rde_softreconfig_in_sets(struct rib_entry *re, void *arg)
+{
+	struct roa_reval	*rr = arg;
+	struct prefix		*p;
+	struct bgpd_addr	 prefix;
+
+	pt_getaddr(re->prefix, &prefix);
+	LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
+		rr->checked++;
+		rde_softreconfig_in_prefix(p, &prefix, SOFTRECONF_SETS);
+	}
+}
+
+static void
+rde_softreconfig_in_sets_done(void *arg, u_int8_t dummy)
+{
+	struct roa_reval	*rr = arg;
+
+	log_info("softreconfig in: %zu changed set prefixes, "
+	    "%llu prefixes filtered", rr->len, rr->checked);
+	rde_softreconfig_in_done(rib_byid(RIB_ADJ_IN), AID_UNSPEC);
+}
+
+static void
+rde_softreconfig_out_sets(struct rib_entry *re, void *bula)
+{
+	struct prefix		*p = re->active;
+	struct rde_peer		*peer;
+
+	if (p == NULL)
+		/* no valid path for prefix */
+		return;
+
+	LIST_FOREACH(peer, &peerlist, peer_l) {
+		if (peer->loc_rib_id == re->rib_id && peer->reconf_sets)
+			up_generate_updates(out_rules, peer, p, p);
+	}
+}
+
+/*
+ * Regenerate the updates of the covered prefixes for peers where only
+ * sets changed. The Loc-RIBs are up to date at this point. The dumps
+ * are accounted like the softreconfig out ones.
+ */
+static void
+rde_softreconfig_sets_done(void)
+{
+	struct rde_peer	*peer;
+	struct rib	*rib;
+	u_int16_t	 rid;
+
+	if (sets_reval.len == 0)
+		return;
+	for (rid = RIB_LOC_START; rid < rib_size; rid++) {
+		if ((rib = rib_byid(rid)) == NULL)
+			continue;
+		LIST_FOREACH(peer, &peerlist, peer_l)
+			if (peer->loc_rib_id == rid && peer->reconf_sets)
+				break;
+		if (peer == NULL)
+			continue;
+		if (rib_dump_subtree(rid, sets_reval.changes, sets_reval.len,
+		    RDE_RUNNER_ROUNDS, rib, rde_softreconfig_out_sets,
+		    rde_softreconfig_out_done, NULL) == -1)
+			fatal("%s: rib_dump_subtree", __func__);
+		softreconfig++;
+		log_info("starting partial softreconfig out for rib %s: "
+		    "%zu changed set prefixes", rib->name, sets_reval.len);
+	}
+}
+
+/* add a ROA prefix with all its collected source-as entries */
+static void
+rde_roa_bulk_add(struct trie_bulk *tb, struct rde_prefixset *ps,
+    struct roa *roa, struct set_table **set)
+{
+	set_prep(*set);
+	if (trie_bulk_roa_add(tb, &roa->prefix, roa->prefixlen, *set) == -1) {
+		log_warnx("trie_roa_add(%s) %s/%u failed", ps->name,
+		    log_addr(&roa->prefix), roa->prefixlen);
+		set_free(*set);
+	}
+	*set = NULL;
+}
+
+static void
+rde_rtr_roa(struct imsg *imsg)
+{
+	struct roa	 roa;
+	struct roa_set	 rs;
+	int		 rv;
+
+	if (imsg->hdr.len - IMSG_HEADER_SIZE != sizeof(roa)) {
+		log_warnx("rde_dispatch: wrong imsg len");
+		return;
+	}
+	memcpy(&roa, imsg->data, sizeof(roa));
+
+	if (imsg->hdr.type == IMSG_RTR_ROA_ADD) {
+		rs.as = roa.asnum;
+		rs.maxlen = roa.maxlen;
+		rv = trie_roa_update(&roa_rtr, &roa.prefix, roa.prefixlen,
+		    &rs);
+	} else
+		rv = trie_roa_delete(&roa_rtr, &roa.prefix, roa.prefixlen,
+		    roa.asnum);
+	if (rv == -1) {
+		log_warnx("rtr roa %s %s/%u source-as %u failed",
+		    imsg->hdr.type == IMSG_RTR_ROA_ADD ? "add" : "delete",
+		    log_addr(&roa.prefix), roa.prefixlen, roa.asnum);
+		return;
+	}
+	rde_roa_change(&roa.prefix, roa.prefixlen, &rtr_reval);
+}
+
+/* the SE finished an RTR update, revalidate the affected prefixes */
+static void
+rde_rtr_commit(void)
+{
+	size_t	i;
+
+	if (trie_compile(&roa_rtr) == -1)
+		log_warn("rtr roa: compile");
+	if (rtr_reval.overflow || rtr_reval.len > 0)
+		rde_refresh_noadjin(1);
+
+	/* queue the changes until the running partial walk is done */
+	if (rtr_part_running && !rtr_reval.overflow) {
+		for (i = 0; i < rtr_reval.len; i++)
+			rde_roa_change(&rtr_reval.changes[i].prefix,
+			    rtr_reval.changes[i].prefixlen, &rtr_queue);
+		if (rtr_queue.overflow)
+			rtr_reval.overflow = 1;
+	}
+
+	if (rtr_reval.overflow) {
+		/* the full run covers the queued changes as well */
+		free(rtr_queue.changes);
+		memset(&rtr_queue, 0, sizeof(rtr_queue));
+		if (rtr_full_running)
+			rtr_full_again = 1;
+		else
+			rde_rtr_reval_full();
+	} else if (rtr_reval.len > 0 && !rtr_part_running)
+		rde_rtr_reval_part(&rtr_reval);
+	free(rtr_reval.changes);
+	memset(&rtr_reval, 0, sizeof(rtr_reval));
+}
+
+/* revalidate the prefixes covered by the changes, takes over rr */
+static void
+rde_rtr_reval_part(struct roa_reval *rr)
+{
+	rtr_part = *rr;
+	memset(rr, 0, sizeof(*rr));
+	rde_sets_compact(&rtr_part);
+	rtr_part_running = 1;
+	rtr_part.running = 1 +
+	    rde_roa_reval_noadjin(&rtr_part, rde_rtr_reval_part_done);
+	if (rib_dump_subtree(RIB_ADJ_IN, rtr_part.changes, rtr_part.len,
+	    RDE_RUNNER_ROUNDS, &rtr_part, rde_roa_reval_upcall,
+	    rde_rtr_reval_part_done, NULL) == -1)
+		fatal("%s: rib_dump_subtree", __func__);
+}
+
+static void
+rde_rtr_reval_part_done(void *arg, u_int8_t dummy)
+{
+	struct roa_reval	*rr = arg;
+
+	if (--rr->running > 0)
+		return;
+	rde_send_pftable_commit();
+	log_info("roa change: %zu ROAs changed, %llu prefixes revalidated, "
+	    "%llu changed state", rr->len, rr->checked, rr->changed);
+	free(rr->changes);
+	memset(rr, 0, sizeof(*rr));
+	rtr_part_running = 0;
+	if (rtr_queue.len > 0)
+		rde_rtr_reval_part(&rtr_queue);
+}
+
+static void
+rde_rtr_reval_full(void)
+{
+	memset(&rtr_full, 0, sizeof(rtr_full));
+	rtr_full.overflow = 1;	/* walk the Loc-RIBs completely */
+	rtr_full_running = 1;
+	rtr_full.running = 1 +
+	    rde_roa_reval_noadjin(&rtr_full, rde_rtr_reval_done);
+	if (rib_dump_new(RIB_ADJ_IN, AID_UNSPEC, RDE_RUNNER_ROUNDS, &rtr_full,
+	    rde_roa_reval_upcall, rde_rtr_reval_done, NULL) == -1)
+		fatal("%s: rib_dump_new", __func__);
+	log_info("roa change: revalidating Adj-RIB-In");
+}
+
+static void
+rde_rtr_reval_done(void *arg, u_int8_t dummy)
+{
+	struct roa_reval	*rr = arg;
+
+	if (--rr->running > 0)
+		return;
+	rde_send_pftable_commit();
+	log_info("roa change: %llu prefixes revalidated, %llu changed state",
+	    rr->checked, rr->changed);
+	rtr_full_running = 0;
+	/* more changes arrived while the dump was running */
+	if (rtr_full_again) {
+		rtr_full_again = 0;
+		rde_rtr_reval_full();
+	}
+}
+
+/*
+ * A prefix is no longer suppressed by route flap damping, feed the
+ * current Adj-RIB-In path into the Loc-RIBs again.
+ */
+void
+rde_damp_reuse(struct rde_peer *peer, struct pt_entry *pt)
+{
+	struct filterstate	 state;
+	struct bgpd_addr	 prefix;
+	struct prefix		*p;
+	struct rde_aspath	*asp;
+	struct rib		*rib;
+	enum filter_actions	 action;
+	u_int16_t		 i;
+
+	pt_getaddr(pt, &prefix);
+	p = prefix_get(rib_byid(RIB_ADJ_IN), peer, &prefix, pt->prefixlen);
+	if (p == NULL)
+		return;
+	asp = prefix_aspath(p);
+
+	for (i = RIB_LOC_START; i < rib_size; i++) {
+		rib = rib_byid(i);
+		if (rib == NULL)
+			continue;
+
+		rde_filterstate_prep(&state, asp, prefix_communities(p),
+		    prefix_nexthop(p), prefix_nhflags(p));
+		action = rde_filter(rib->in_rules, peer, peer, &prefix,
+		    pt->prefixlen, p->validation_state, &state);
+
+		if (action == ACTION_ALLOW) {
+			rde_update_log("reuse", i, peer,
+			    &state.nexthop->exit_nexthop, &prefix,
+			    pt->prefixlen);
+			prefix_update(rib, peer, &state, &prefix,
+			    pt->prefixlen, p->validation_state);
+		}
+
+		rde_filterstate_clean(&state);
 	}
 }
 
@@ -3396,16 +5012,17 @@ rde_softreconfig_sync_reeval(struct rib_entry *re, void *arg)
 		LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
 			if (p->flags & PREFIX_NEXTHOP_LINKED)
 				nexthop_unlink(p);
+			prefix_stats_eligible(p);
 		}
 		if (re->active) {
 			rde_generate_updates(rib, NULL, re->active);
-			re->active = NULL;
+			prefix_set_active(re, NULL);
 		}
 		return;
 	}
 
 	/* evaluation process is turned on, so evaluate all prefixes again */
-	re->active = NULL;
+	prefix_set_active(re, NULL);
 	prefixes = re->prefix_h;
 	LIST_INIT(&re->prefix_h);
 
@@ -3413,6 +5030,7 @@ rde_softreconfig_sync_reeval(struct rib_entry *re, void *arg)
 		/* need to re-link the nexthop if not already linked */
 		if ((p->flags & PREFIX_NEXTHOP_LINKED) == 0)
 			nexthop_link(p);
+		prefix_stats_eligible(p);
 		LIST_REMOVE(p, entry.list.rib);
 		prefix_evaluate(p, re);
 	}
@@ -3485,6 +5103,17 @@ rde_peer_recv_eor(struct rde_peer *peer, u_int8_t aid)
 	    aid2str(aid));
 }
 
+static void
+rde_peer_send_update(struct rde_peer *peer, void *buf, u_int16_t len)
+{
+	if (imsg_compose(ibuf_se, IMSG_UPDATE, peer->conf.id, 0, -1,
+	    buf, len) == -1)
+		fatal("%s %d imsg_compose error", __func__, __LINE__);
+	/* credit is returned by the SE with IMSG_UPDATE_CREDIT */
+	peer->up_credit++;
+	latency_sent(peer);
+}
+
 static void
 rde_peer_send_eor(struct rde_peer *peer, u_int8_t aid)
 {
@@ -3497,9 +5126,7 @@ rde_peer_send_eor(struct rde_peer *peer, u_int8_t aid)
 		u_char null[4];
 
 		bzero(&null, 4);
-		if (imsg_compose(ibuf_se, IMSG_UPDATE, peer->conf.id,
-		    0, -1, &null, 4) == -1)
-			fatal("imsg_compose error while sending EoR");
+		rde_peer_send_update(peer, &null, 4);
 	} else {
 		u_int16_t	i;
 		u_char		buf[10];
@@ -3518,10 +5145,7 @@ rde_peer_send_eor(struct rde_peer *peer, u_int8_t aid)
 		bcopy(&i, &buf[7], sizeof(i));
 		buf[9] = safi;
 
-		if (imsg_compose(ibuf_se, IMSG_UPDATE, peer->conf.id,
-		    0, -1, &buf, 10) == -1)
-			fatal("%s %d imsg_compose error in peer_send_eor",
-			    __func__, __LINE__);
+		rde_peer_send_update(peer, &buf, 10);
 	}
 
 	log_peer_info(&peer->conf, "sending %s EOR marker",
@@ -3772,6 +5396,7 @@ rde_shutdown(void)
 
 	/* kill the VPN configs */
 	free_l3vpns(&conf->l3vpns);
+	trie_free(&roa_rtr);
 
 	/* now check everything */
 	rib_shutdown();
@@ -3816,9 +5441,13 @@ u_int8_t
 rde_roa_validity(struct rde_prefixset *ps, struct bgpd_addr *prefix,
     u_int8_t plen, u_int32_t as)
 {
-	int r;
+	int r, rtr;
 
 	r = trie_roa_check(&ps->th, prefix, plen, as);
+	/* combine with the RTR ROAs, valid beats invalid beats not-found */
+	rtr = trie_roa_check(&roa_rtr, prefix, plen, as);
+	if (rtr > r)
+		r = rtr;
 	return (r & ROA_MASK);
 }
 
@@ -38,6 +38,7 @@ enum peer_state {
 };
 
 LIST_HEAD(prefix_list, prefix);
+LIST_HEAD(prefix_idx_list, prefix_idx);
 RB_HEAD(rib_tree, rib_entry);
 
 struct rib_entry {
@@ -60,6 +61,14 @@ struct rib {
 	u_int16_t		flags_tmp;
 	u_int16_t		id;
 	enum reconf_action	state, fibstate;
+	u_int8_t		reconf_sets;	/* only sets changed */
+	struct rib_stats	stats[AID_MAX];
+};
+
+/* a prefix and all more specifics of it */
+struct rib_subtree {
+	struct bgpd_addr	prefix;
+	u_int8_t		prefixlen;
 };
 
 #define RIB_ADJ_IN	0
@@ -88,6 +97,7 @@ struct rde_peer {
 	struct bgpd_addr		 local_v6_addr;
 	struct capabilities		 capa;
 	struct prefix_index		 adj_rib_out;
+	struct prefix_idx_list		 index_h;	/* RIB index */
 	struct prefix_tree		 updates[AID_MAX];
 	struct prefix_tree		 withdraws[AID_MAX];
 	time_t				 staletime[AID_MAX];
@@ -97,8 +107,18 @@ struct rde_peer {
 	u_int64_t			 prefix_sent_update;
 	u_int64_t			 prefix_sent_withdraw;
 	u_int64_t			 prefix_sent_eor;
+	u_int64_t			 prefix_suppressed;
+	u_int64_t			 prefix_damp_absorbed;
+	u_int64_t			 up_drain_last;	/* sent at last sample */
+	time_t				 up_drain_time;
+	time_t				 up_mrai_next;	/* next flush allowed */
+	u_int32_t			 up_drain_rate;	/* prefixes per second */
+	u_int32_t			 up_credit;	/* credits used */
+	int32_t				 up_deficit;	/* DRR deficit in bytes */
 	u_int32_t			 prefix_cnt;
+	u_int32_t			 prefix_best_cnt;
 	u_int32_t			 prefix_out_cnt;
+	u_int32_t			 prefix_damp_cnt;
 	u_int32_t			 remote_bgpid; /* host byte order! */
 	u_int32_t			 up_nlricnt;
 	u_int32_t			 up_wcnt;
@@ -108,7 +128,14 @@ struct rde_peer {
 	u_int16_t			 mrt_idx;
 	u_int8_t			 reconf_out;	/* out filter changed */
 	u_int8_t			 reconf_rib;	/* rib changed */
+	u_int8_t			 reconf_sets;	/* only sets changed */
 	u_int8_t			 throttled;
+	u_int8_t			 up_mrai_flush;	/* flushing queues */
+	u_int8_t			 no_adjin;	/* no Adj-RIB-In kept */
+	u_int8_t			 refresh_pending;
+	time_t				 refresh_next;	/* no refresh before */
+	u_int64_t			 lat_wire;	/* unsent sample */
+	struct latency_hist		 latency[LAT_MAX];
 };
 
 #define AS_SET			1
@@ -119,10 +146,14 @@ struct rde_peer {
 
 struct aspath {
 	LIST_ENTRY(aspath)	entry;
+	u_int64_t		id;		/* unique, used for caching */
+	u_int64_t		as_bloom;	/* bloom filter of all ASes */
 	u_int32_t		source_as;	/* cached source_as */
+	u_int32_t		neighbor_as;	/* cached leftmost AS */
 	int			refcnt;	/* reference count */
 	u_int16_t		len;	/* total length of aspath in octets */
 	u_int16_t		ascnt;	/* number of AS hops in data */
+	u_int16_t		maxrun;	/* longest run of the same AS */
 	u_char			data[1]; /* placeholder for actual data */
 };
 
@@ -178,10 +209,13 @@ struct mpattr {
 
 struct rde_community {
 	LIST_ENTRY(rde_community)	entry;
+	LIST_ENTRY(rde_community)	index_l;
+	struct prefix_idx_list		prefix_h;	/* RIB index */
 	size_t				size;
 	size_t				nentries;
 	int				flags;
 	int				refcnt;
+	int				wellknown;	/* set when linked */
 	struct community		*communities;
 };
 
@@ -189,6 +223,10 @@ struct rde_community {
 #define	PARTIAL_LARGE_COMMUNITIES	0x02
 #define	PARTIAL_EXT_COMMUNITIES		0x04
 
+#define	WELLKNOWN_NO_EXPORT		0x01
+#define	WELLKNOWN_NO_ADVERTISE		0x02
+#define	WELLKNOWN_NO_EXPSUBCONFED	0x04
+
 #define	F_ATTR_ORIGIN		0x00001
 #define	F_ATTR_ASPATH		0x00002
 #define	F_ATTR_NEXTHOP		0x00004
@@ -213,6 +251,8 @@ struct rde_community {
 
 struct rde_aspath {
 	LIST_ENTRY(rde_aspath)		 path_l;
+	LIST_ENTRY(rde_aspath)		 origin_l;
+	struct prefix_idx_list		 prefix_h;	/* RIB index */
 	struct attr			**others;
 	struct aspath			*aspath;
 	u_int64_t			 hash;
@@ -318,13 +358,14 @@ struct prefix {
 			RB_ENTRY(prefix)	 index, update;
 		} tree;
 	}				 entry;
+	struct prefix_idx		*index;		/* may be NULL */
 	struct pt_entry			*pt;
 	struct rib_entry		*re;
 	struct rde_aspath		*aspath;
 	struct rde_community		*communities;
 	struct rde_peer			*peer;
 	struct nexthop			*nexthop;	/* may be NULL */
-	time_t				 lastchange;
+	u_int32_t			 lastchange;	/* getmonotime() */
 	u_int8_t			 validation_state;
 	u_int8_t			 nhflags;
 	u_int8_t			 eor;
@@ -334,10 +375,17 @@ struct prefix {
 #define	PREFIX_FLAG_DEAD	0x04	/* locked but removed */
 #define	PREFIX_FLAG_STALE	0x08	/* stale entry (graceful reload) */
 #define	PREFIX_FLAG_MASK	0x0f	/* mask for the prefix types */
+#define	PREFIX_ELIGIBLE		0x10	/* counted as eligible in stats */
 #define	PREFIX_NEXTHOP_LINKED	0x40	/* prefix is linked onto nexthop list */
 #define	PREFIX_FLAG_LOCKED	0x80	/* locked by rib walker */
 };
 
+/* RIB index linkage, only allocated while the index is enabled */
+struct prefix_idx {
+	LIST_ENTRY(prefix_idx)		 path, comm, peer;
+	struct prefix			*prefix;
+};
+
 /* possible states for nhflags */
 #define	NEXTHOP_SELF		0x01
 #define	NEXTHOP_REJECT		0x02
@@ -351,6 +399,12 @@ struct filterstate {
 	u_int8_t		 nhflags;
 };
 
+enum filter_diff {
+	FILTER_DIFF_NONE,
+	FILTER_DIFF_SETS,	/* only prefix- or origin-set content */
+	FILTER_DIFF_RULES
+};
+
 extern struct rde_memstats rdemem;
 
 /* prototypes */
@@ -378,6 +432,27 @@ u_int32_t	rde_local_as(void);
 int		rde_decisionflags(void);
 int		rde_as4byte(struct rde_peer *);
 int		rde_match_peer(struct rde_peer *, struct ctl_neighbor *);
+void		rde_damp_reuse(struct rde_peer *, struct pt_entry *);
+
+/* rde_damp.c */
+int		 damp_update(struct rde_peer *, struct filterstate *,
+		    struct bgpd_addr *, u_int8_t);
+void		 damp_withdraw(struct rde_peer *, struct bgpd_addr *,
+		    u_int8_t);
+int		 damp_suppressed(struct rde_peer *, struct pt_entry *);
+void		 damp_show(struct rde_peer *, struct pt_entry *,
+		    struct ctl_show_rib *);
+void		 damp_peer_flush(struct rde_peer *);
+void		 damp_peer_release(struct rde_peer *);
+int		 damp_timeout(void);
+void		 damp_runner(void);
+
+/* rde_index.c */
+void		 index_set(int);
+void		 index_link(struct prefix *);
+void		 index_unlink(struct prefix *);
+int		 index_walk(struct ctl_show_rib_request *, u_int16_t,
+		    void (*)(struct prefix *, void *), void *);
 
 /* rde_peer.c */
 void		 peer_init(u_int32_t);
@@ -398,6 +473,12 @@ int		 peer_imsg_pop(struct rde_peer *, struct imsg *);
 int		 peer_imsg_pending(void);
 void		 peer_imsg_flush(struct rde_peer *);
 
+void		 latency_start(struct rde_peer *, struct timespec *);
+void		 latency_mark(enum latency_stage);
+void		 latency_enqueue(struct rde_peer *);
+void		 latency_sent(struct rde_peer *);
+void		 latency_done(struct rde_peer *);
+
 /* rde_attr.c */
 int		 attr_write(void *, u_int16_t, u_int8_t, u_int8_t, void *,
 		     u_int16_t);
@@ -487,6 +568,8 @@ communities_unref(struct rde_community *comm)
 int	 community_to_rd(struct community *, u_int64_t *);
 
 /* rde_decide.c */
+int		 prefix_eligible(struct prefix *);
+void		 prefix_set_active(struct rib_entry *, struct prefix *);
 void		 prefix_evaluate(struct prefix *, struct rib_entry *);
 
 /* rde_filter.c */
@@ -495,8 +578,9 @@ void	rde_apply_set(struct filter_set_head *, struct rde_peer *,
 void	rde_filterstate_prep(struct filterstate *, struct rde_aspath *,
 	    struct rde_community *, struct nexthop *, u_int8_t);
 void	rde_filterstate_clean(struct filterstate *);
-int	rde_filter_equal(struct filter_head *, struct filter_head *,
+enum filter_diff rde_filter_diff(struct filter_head *, struct filter_head *,
 	    struct rde_peer *);
+int	rde_filter_uses_ovs(struct filter_head *, struct rde_peer *);
 void	rde_filter_calc_skip_steps(struct filter_head *);
 enum filter_actions rde_filter(struct filter_head *, struct rde_peer *,
 	    struct rde_peer *, struct bgpd_addr *, u_int8_t, u_int8_t,
@@ -531,6 +615,9 @@ pt_unref(struct pt_entry *pt)
 		pt_remove(pt);
 }
 
+/* rde_regex.c */
+int		 aspath_re_match(const struct aspath_re *, struct aspath *);
+
 /* rde_rib.c */
 extern u_int16_t	rib_size;
 
@@ -548,6 +635,11 @@ int		 rib_dump_new(u_int16_t, u_int8_t, unsigned int, void *,
 		    void (*)(struct rib_entry *, void *),
 		    void (*)(void *, u_int8_t),
 		    int (*)(void *));
+int		 rib_dump_subtree(u_int16_t, struct rib_subtree *, size_t,
+		    unsigned int, void *,
+		    void (*)(struct rib_entry *, void *),
+		    void (*)(void *, u_int8_t),
+		    int (*)(void *));
 void		 rib_dump_terminate(void *);
 
 static inline struct rib *
@@ -591,6 +683,8 @@ int		 prefix_write(u_char *, int, struct bgpd_addr *, u_int8_t, int);
 int		 prefix_writebuf(struct ibuf *, struct bgpd_addr *, u_int8_t);
 struct prefix	*prefix_bypeer(struct rib_entry *, struct rde_peer *);
 void		 prefix_destroy(struct prefix *);
+void		 prefix_set_vstate(struct prefix *, u_int8_t);
+void		 prefix_stats_eligible(struct prefix *);
 void		 prefix_relink(struct prefix *, struct rde_aspath *, int);
 
 RB_PROTOTYPE(prefix_tree, prefix, entry, prefix_cmp)
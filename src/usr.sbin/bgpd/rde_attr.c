@@ -443,6 +443,7 @@ attr_put(struct attr *a)
 
 static u_int16_t aspath_count(const void *, u_int16_t);
 static u_int32_t aspath_extract_origin(const void *, u_int16_t);
+static void	 aspath_fingerprint(struct aspath *);
 static u_int16_t aspath_countlength(struct aspath *, u_int16_t, int);
 static void	 aspath_countcopy(struct aspath *, u_int16_t, u_int8_t *,
 		     u_int16_t, int);
@@ -454,6 +455,7 @@ struct aspath_table {
 } astable;
 
 SIPHASH_KEY astablekey;
+static u_int64_t aspath_nextid;
 
 #define ASPATH_HASH(x)				\
 	&astable.hashtbl[(x) & astable.hashmask]
@@ -529,11 +531,13 @@ aspath_get(void *data, u_int16_t len)
 		rdemem.aspath_cnt++;
 		rdemem.aspath_size += ASPATH_HEADER_SIZE + len;
 
+		aspath->id = ++aspath_nextid;
 		aspath->refcnt = 0;
 		aspath->len = len;
 		aspath->ascnt = aspath_count(data, len);
 		aspath->source_as = aspath_extract_origin(data, len);
 		memcpy(aspath->data, data, len);
+		aspath_fingerprint(aspath);
 
 		/* link */
 		head = ASPATH_HASH(SipHash24(&astablekey, aspath->data,
@@ -676,7 +680,7 @@ aspath_neighbor(struct aspath *aspath)
 	/* Empty aspath is OK -- internal AS route. */
 	if (aspath->len == 0)
 		return (rde_local_as());
-	return (aspath_extract(aspath->data, 0));
+	return (aspath->neighbor_as);
 }
 
 u_int32_t
@@ -745,6 +749,57 @@ aspath_extract_origin(const void *data, u_int16_t len)
 	return (as);
 }
 
+static inline u_int64_t
+aspath_bloom(u_int32_t as)
+{
+	u_int32_t h = as * 0x9e3779b1;
+
+	return (1ULL << (h >> 26) | 1ULL << ((h >> 20) & 0x3f));
+}
+
+/*
+ * Precompute the facts used by the filters and the decision process so
+ * that they don't need to walk the path on every use. maxrun follows the
+ * rules of max-as-seq: AS path 3 { 4 3 7 } 3 has a run of 3.
+ */
+static void
+aspath_fingerprint(struct aspath *aspath)
+{
+	const u_int8_t	*seg;
+	u_int32_t	 as, lastas = 0;
+	u_int16_t	 len, seg_size, count = 0;
+	u_int8_t	 i, seg_len, seg_type;
+
+	aspath->as_bloom = 0;
+	aspath->neighbor_as = 0;
+	aspath->maxrun = 0;
+	if (aspath->len != 0)
+		aspath->neighbor_as = aspath_extract(aspath->data, 0);
+
+	seg = aspath->data;
+	for (len = aspath->len; len > 0; len -= seg_size, seg += seg_size) {
+		seg_type = seg[0];
+		seg_len = seg[1];
+		seg_size = 2 + sizeof(u_int32_t) * seg_len;
+
+		if (seg_size > len)
+			fatalx("%s: would overflow", __func__);
+
+		for (i = 0; i < seg_len; i++) {
+			as = aspath_extract(seg, i);
+			aspath->as_bloom |= aspath_bloom(as);
+			if (as == lastas) {
+				if (++count > aspath->maxrun)
+					aspath->maxrun = count;
+			} else if (seg_type == AS_SET) {
+				continue;
+			} else
+				count = 1;
+			lastas = as;
+		}
+	}
+}
+
 static u_int16_t
 aspath_countlength(struct aspath *aspath, u_int16_t cnt, int headcnt)
 {
@@ -945,6 +1000,16 @@ aspath_match(struct aspath *aspath, struct filter_as *f, u_int32_t neighas)
 			return (0);
 	}
 
+	/* an exact match on an AS not in the bloom filter can't succeed */
+	if ((f->flags & (AS_FLAG_AS_SET | AS_FLAG_AS_SET_NAME)) == 0 &&
+	    (f->op == OP_NONE || f->op == OP_EQ)) {
+		as = f->flags & AS_FLAG_NEIGHBORAS ? neighas : f->as_min;
+		/* AS_NONE is used for a source without AS_SEQUENCE */
+		if (as != AS_NONE &&
+		    (aspath->as_bloom & aspath_bloom(as)) != aspath_bloom(as))
+			return (0);
+	}
+
 	seg = aspath->data;
 	len = aspath->len;
 	for (; len >= 6; len -= seg_size, seg += seg_size) {
@@ -1109,41 +1174,9 @@ aspath_override(struct aspath *asp, u_int32_t neighbor_as, u_int32_t local_as,
 int
 aspath_lenmatch(struct aspath *a, enum aslen_spec type, u_int aslen)
 {
-	u_int8_t	*seg;
-	u_int32_t	 as, lastas = 0;
-	u_int		 count = 0;
-	u_int16_t	 len, seg_size;
-	u_int8_t	 i, seg_len, seg_type;
-
-	if (type == ASLEN_MAX) {
-		if (aslen < aspath_count(a->data, a->len))
-			return (1);
-		else
-			return (0);
-	}
-
-	/* type == ASLEN_SEQ */
-	seg = a->data;
-	for (len = a->len; len > 0; len -= seg_size, seg += seg_size) {
-		seg_type = seg[0];
-		seg_len = seg[1];
-		seg_size = 2 + sizeof(u_int32_t) * seg_len;
-
-		for (i = 0; i < seg_len; i++) {
-			as = aspath_extract(seg, i);
-			if (as == lastas) {
-				if (aslen < ++count)
-					return (1);
-			} else if (seg_type == AS_SET) {
-				/* AS path 3 { 4 3 7 } 3 will have count = 3 */
-				continue;
-			} else
-				count = 1;
-			lastas = as;
-		}
+	if (type == ASLEN_MAX)
+		return (aslen < a->ascnt);
 
-		if (seg_size > len)
-			fatalx("%s: would overflow", __func__);
-	}
-	return (0);
+	/* type == ASLEN_SEQ, see aspath_fingerprint() */
+	return (aslen < a->maxrun);
 }
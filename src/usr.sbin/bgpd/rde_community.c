@@ -202,6 +202,85 @@ mask_match(struct community *a, struct community *b, struct community *m)
 	return 0;
 }
 
+/*
+ * The array is sorted by type, data1, data2 and data3 so all communities
+ * that agree in the type and the first depth data fields form a range.
+ * Compare only that prefix of the key.
+ */
+static int
+community_prefix(const struct community *a, const struct community *b,
+    int depth)
+{
+	if ((u_int8_t)a->flags != (u_int8_t)b->flags)
+		return (u_int8_t)a->flags > (u_int8_t)b->flags ? 1 : -1;
+	if (depth < 1)
+		return 0;
+	if (a->data1 != b->data1)
+		return a->data1 > b->data1 ? 1 : -1;
+	if (depth < 2)
+		return 0;
+	if (a->data2 != b->data2)
+		return a->data2 > b->data2 ? 1 : -1;
+	if (depth < 3)
+		return 0;
+	if (a->data3 != b->data3)
+		return a->data3 > b->data3 ? 1 : -1;
+	return 0;
+}
+
+/* index of the first community not smaller than c in the key prefix */
+static size_t
+lower_community(struct rde_community *comm, struct community *c, int depth)
+{
+	size_t lo = 0, hi = comm->nentries, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (community_prefix(&comm->communities[mid], c, depth) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Number of leading data fields compared in full by the mask. A wildcard
+ * match only needs to look at the range sharing this key prefix.
+ */
+static int
+mask_depth(struct community *m)
+{
+	if (m->data1 != UINT32_MAX)
+		return 0;
+	if (m->data2 != UINT32_MAX)
+		return 1;
+	if (m->data3 != UINT32_MAX)
+		return 2;
+	return 3;
+}
+
+/*
+ * Make room for at least n more communities.
+ */
+static void
+reserve_community(struct rde_community *comm, size_t n)
+{
+	struct community *new;
+	size_t newsize;
+
+	if (comm->nentries + n <= comm->size)
+		return;
+	newsize = comm->size + (n > 8 ? n : 8);
+	if ((new = reallocarray(comm->communities, newsize,
+	    sizeof(struct community))) == NULL)
+		fatal(__func__);
+	memset(new + comm->size, 0,
+	    (newsize - comm->size) * sizeof(struct community));
+	comm->communities = new;
+	comm->size = newsize;
+}
+
 /*
  * Insert a community keeping the list sorted. Don't add if already present.
  */
@@ -209,40 +288,44 @@ static void
 insert_community(struct rde_community *comm, struct community *c)
 {
 	size_t l;
-	int r;
-
-	if (comm->nentries + 1 > comm->size) {
-		struct community *new;
-		size_t newsize = comm->size + 8;
-
-		if ((new = reallocarray(comm->communities, newsize,
-		    sizeof(struct community))) == NULL)
-			fatal(__func__);
-		memset(new + comm->size, 0, 8 * sizeof(struct community));
-		comm->communities = new;
-		comm->size = newsize;
-	}
 
-	/* XXX can be made faster by binary search */
-	for (l = 0; l < comm->nentries; l++) {
-		r = fast_match(comm->communities + l, c);
-		if (r == 0) {
-			/* already present, nothing to do */
-			return;
-		} else if (r > 0) {
-			/* shift reminder by one slot */
-			memmove(comm->communities + l + 1,
-			    comm->communities + l,
-			    (comm->nentries - l) * sizeof(*c));
-			break;
-		}
-	}
+	reserve_community(comm, 1);
 
-	/* insert community at slot l */
+	l = lower_community(comm, c, 3);
+	if (l < comm->nentries && fast_match(comm->communities + l, c) == 0)
+		/* already present, nothing to do */
+		return;
+
+	/* shift reminder by one slot and insert community at slot l */
+	memmove(comm->communities + l + 1, comm->communities + l,
+	    (comm->nentries - l) * sizeof(*c));
 	comm->communities[l] = *c;
 	comm->nentries++;
 }
 
+/*
+ * Sort the list and drop duplicates. Used after appending a whole
+ * attribute instead of inserting the communities one by one.
+ */
+static void
+sort_communities(struct rde_community *comm)
+{
+	size_t l, n;
+
+	qsort(comm->communities, comm->nentries, sizeof(struct community),
+	    fast_match);
+	for (l = 1, n = 1; l < comm->nentries; l++) {
+		if (fast_match(comm->communities + l,
+		    comm->communities + n - 1) != 0)
+			comm->communities[n++] = comm->communities[l];
+	}
+	if (comm->nentries > n)
+		memset(comm->communities + n, 0,
+		    (comm->nentries - n) * sizeof(struct community));
+	if (comm->nentries > 0)
+		comm->nentries = n;
+}
+
 static int
 non_transitive_community(struct community *c)
 {
@@ -262,18 +345,23 @@ struct rde_peer *peer)
 {
 	struct community test, mask;
 	size_t l;
+	int depth;
 
 	if (fc->flags >> 8 == 0) {
 		/* fast path */
 		return (bsearch(fc, comm->communities, comm->nentries,
 		    sizeof(*fc), fast_match) != NULL);
 	} else {
-		/* slow path */
-
+		/* slow path, only scan the range with the same key prefix */
 		if (fc2c(fc, peer, &test, &mask) == -1)
 			return 0;
 
-		for (l = 0; l < comm->nentries; l++) {
+		depth = mask_depth(&mask);
+		for (l = lower_community(comm, &test, depth);
+		    l < comm->nentries; l++) {
+			if (community_prefix(&comm->communities[l], &test,
+			    depth) != 0)
+				break;
 			if (mask_match(&comm->communities[l], &test,
 			    &mask) == 0)
 				return 1;
@@ -312,7 +400,8 @@ struct rde_peer *peer)
 {
 	struct community test, mask;
 	struct community *match;
-	size_t l = 0;
+	size_t l, n, end;
+	int depth;
 
 	if (fc->flags >> 8 == 0) {
 		/* fast path */
@@ -330,17 +419,24 @@ struct rde_peer *peer)
 		if (fc2c(fc, peer, &test, &mask) == -1)
 			return;
 
-		while (l < comm->nentries) {
-			if (mask_match(&comm->communities[l], &test,
-			    &mask) == 0) {
-				memmove(comm->communities + l,
-				    comm->communities + l + 1,
-				    (comm->nentries - l - 1) * sizeof(test));
-				comm->nentries--;
-				continue;
-			}
-			l++;
+		/* compact the matching range, then close the gap once */
+		depth = mask_depth(&mask);
+		l = n = lower_community(comm, &test, depth);
+		for (end = l; end < comm->nentries; end++) {
+			if (community_prefix(&comm->communities[end], &test,
+			    depth) != 0)
+				break;
+			if (mask_match(&comm->communities[end], &test,
+			    &mask) != 0)
+				comm->communities[n++] = comm->communities[end];
 		}
+		if (n == end)
+			return;
+		memmove(comm->communities + n, comm->communities + end,
+		    (comm->nentries - end) * sizeof(test));
+		comm->nentries -= end - n;
+		memset(comm->communities + comm->nentries, 0,
+		    (end - n) * sizeof(test));
 	}
 }
 
@@ -365,13 +461,15 @@ community_add(struct rde_community *comm, int flags, void *buf, size_t len)
 	if (flags & ATTR_PARTIAL)
 		comm->flags |= PARTIAL_COMMUNITIES;
 
+	reserve_community(comm, len / 4);
 	for (l = 0; l < len; l += 4, b += 4) {
 		memcpy(&c, b, sizeof(c));
 		set.data1 = ntohs(c);
 		memcpy(&c, b + 2, sizeof(c));
 		set.data2 = ntohs(c);
-		insert_community(comm, &set);
+		comm->communities[comm->nentries++] = set;
 	}
+	sort_communities(comm);
 
 	return 0;
 }
@@ -390,6 +488,7 @@ community_large_add(struct rde_community *comm, int flags, void *buf,
 	if (flags & ATTR_PARTIAL)
 		comm->flags |= PARTIAL_LARGE_COMMUNITIES;
 
+	reserve_community(comm, len / 12);
 	for (l = 0; l < len; l += 12, b += 12) {
 		memcpy(&set.data1, b, sizeof(set.data1));
 		memcpy(&set.data2, b + 4, sizeof(set.data2));
@@ -397,8 +496,9 @@ community_large_add(struct rde_community *comm, int flags, void *buf,
 		set.data1 = ntohl(set.data1);
 		set.data2 = ntohl(set.data2);
 		set.data3 = ntohl(set.data3);
-		insert_community(comm, &set);
+		comm->communities[comm->nentries++] = set;
 	}
+	sort_communities(comm);
 
 	return 0;
 }
@@ -417,6 +517,7 @@ community_ext_add(struct rde_community *comm, int flags, void *buf, size_t len)
 	if (flags & ATTR_PARTIAL)
 		comm->flags |= PARTIAL_EXT_COMMUNITIES;
 
+	reserve_community(comm, len / 8);
 	for (l = 0; l < len; l += 8, b += 8) {
 		memcpy(&c, b, 8);
 
@@ -438,8 +539,9 @@ community_ext_add(struct rde_community *comm, int flags, void *buf, size_t len)
 		}
 		set.data3 = c >> 48;
 
-		insert_community(comm, &set);
+		comm->communities[comm->nentries++] = set;
 	}
+	sort_communities(comm);
 
 	return 0;
 }
@@ -721,6 +823,38 @@ community_writebuf(struct ibuf *buf, struct rde_community *comm)
 	return 0;
 }
 
+/*
+ * Summarize the well-known communities of a collection so that the
+ * update code does not need to search for them on every prefix.
+ */
+static int
+communities_wellknown(struct rde_community *comm)
+{
+	struct community *c;
+	size_t l;
+	int wk = 0;
+
+	for (l = 0; l < comm->nentries; l++) {
+		c = &comm->communities[l];
+		if ((u_int8_t)c->flags != COMMUNITY_TYPE_BASIC)
+			break;
+		if (c->data1 != COMMUNITY_WELLKNOWN)
+			continue;
+		switch (c->data2) {
+		case COMMUNITY_NO_EXPORT:
+			wk |= WELLKNOWN_NO_EXPORT;
+			break;
+		case COMMUNITY_NO_ADVERTISE:
+			wk |= WELLKNOWN_NO_ADVERTISE;
+			break;
+		case COMMUNITY_NO_EXPSUBCONFED:
+			wk |= WELLKNOWN_NO_EXPSUBCONFED;
+			break;
+		}
+	}
+	return wk;
+}
+
 /*
  * Global RIB cache for communities
  */
@@ -828,6 +962,7 @@ communities_link(struct rde_community *comm)
 		fatal(__func__);
 
 	communities_copy(n, comm);
+	n->wellknown = communities_wellknown(n);
 
 	head = communities_hash(n);
 	LIST_INSERT_HEAD(head, n, entry);
@@ -0,0 +1,432 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/tree.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bgpd.h"
+#include "rde.h"
+#include "log.h"
+
+/*
+ * Route flap damping (RFC 2439, RFC 7196) between Adj-RIB-In and Loc-RIB.
+ *
+ * A damp_entry is kept per peer and prefix as long as the prefix carries
+ * a penalty. The penalty decays exponentially but is only brought up to
+ * date when the entry is accessed. Every entry sits on a timer wheel at
+ * the time it is either reusable again or can be forgotten, so no
+ * periodic scan over all entries is needed.
+ */
+
+#define	DAMP_PENALTY_WITHDRAW	1000
+#define	DAMP_PENALTY_ATTR	500
+
+#define	DAMP_DECAY_STEPS	32	/* resolution of one half-life */
+#define	DAMP_WHEEL_SLOTS	256
+#define	DAMP_WHEEL_TICK		15	/* seconds per wheel slot */
+
+struct damp_entry {
+	RB_ENTRY(damp_entry)	 entry;
+	LIST_ENTRY(damp_entry)	 wheel;
+	struct pt_entry		*pt;
+	time_t			 updated;	/* penalty decayed up to */
+	u_int32_t		 peerid;
+	u_int16_t		 penalty;
+	u_int8_t		 suppressed;
+};
+
+LIST_HEAD(damp_list, damp_entry);
+RB_HEAD(damp_tree, damp_entry);
+
+static inline int damp_cmp(struct damp_entry *, struct damp_entry *);
+RB_PROTOTYPE_STATIC(damp_tree, damp_entry, entry, damp_cmp);
+RB_GENERATE_STATIC(damp_tree, damp_entry, entry, damp_cmp);
+
+/* 2^(-i/32) as 16.16 fixed point */
+static const u_int32_t damp_decay_tab[DAMP_DECAY_STEPS] = {
+	65536, 64132, 62757, 61413, 60097, 58809, 57549, 56316,
+	55109, 53928, 52773, 51642, 50535, 49452, 48393, 47356,
+	46341, 45348, 44376, 43425, 42495, 41584, 40693, 39821,
+	38968, 38133, 37316, 36516, 35734, 34968, 34219, 33486
+};
+
+static struct damp_tree	damp_entries = RB_INITIALIZER(&damp_entries);
+static struct damp_list	damp_wheel[DAMP_WHEEL_SLOTS];
+static time_t		damp_wheel_now;	/* start of the current slot */
+static u_int		damp_wheel_cur;
+
+extern struct bgpd_config	*conf;
+
+static inline int
+damp_cmp(struct damp_entry *a, struct damp_entry *b)
+{
+	if (a->peerid < b->peerid)
+		return (-1);
+	if (a->peerid > b->peerid)
+		return (1);
+	if (a->pt < b->pt)
+		return (-1);
+	if (a->pt > b->pt)
+		return (1);
+	return (0);
+}
+
+static struct damp_entry *
+damp_get(struct rde_peer *peer, struct pt_entry *pt)
+{
+	struct damp_entry	needle;
+
+	needle.peerid = peer->conf.id;
+	needle.pt = pt;
+	return (RB_FIND(damp_tree, &damp_entries, &needle));
+}
+
+/*
+ * Bring the penalty up to date. The elapsed time is accounted in
+ * 1/DAMP_DECAY_STEPS half-lives, the remainder is carried over to the
+ * next access so frequent lookups do not stop the decay.
+ */
+static void
+damp_decay(struct damp_entry *de, time_t now)
+{
+	u_int64_t	steps;
+	u_int32_t	penalty;
+
+	if (now <= de->updated)
+		return;
+	steps = (u_int64_t)(now - de->updated) * DAMP_DECAY_STEPS /
+	    conf->damp_halflife;
+	if (steps == 0)
+		return;
+	de->updated += steps * conf->damp_halflife / DAMP_DECAY_STEPS;
+
+	if (steps / DAMP_DECAY_STEPS >= 16) {
+		de->penalty = 0;
+		return;
+	}
+	penalty = de->penalty >> (steps / DAMP_DECAY_STEPS);
+	de->penalty = (penalty * damp_decay_tab[steps % DAMP_DECAY_STEPS]) >>
+	    16;
+}
+
+/* Number of seconds until penalty decayed below limit. */
+static time_t
+damp_decay_time(u_int32_t penalty, u_int32_t limit)
+{
+	u_int32_t	steps = 0, i;
+
+	if (limit == 0)
+		limit = 1;
+	if (penalty < limit)
+		return (0);
+	while (penalty >= 2 * limit) {
+		penalty >>= 1;
+		steps += DAMP_DECAY_STEPS;
+	}
+	for (i = 0; i < DAMP_DECAY_STEPS; i++)
+		if ((penalty * damp_decay_tab[i]) >> 16 < limit)
+			break;
+	steps += i;
+
+	return (((time_t)steps * conf->damp_halflife + DAMP_DECAY_STEPS - 1) /
+	    DAMP_DECAY_STEPS);
+}
+
+static u_int32_t
+damp_ceiling(void)
+{
+	u_int32_t	ceiling;
+
+	ceiling = (u_int32_t)conf->damp_reuse <<
+	    (conf->damp_maxsuppress / conf->damp_halflife);
+	if (ceiling > DAMP_PENALTY_MAX)
+		ceiling = DAMP_PENALTY_MAX;
+	return (ceiling);
+}
+
+/*
+ * Put the entry on the wheel slot for the time it becomes reusable or,
+ * if not suppressed, the time it can be forgotten. Entries further out
+ * than the wheel covers are parked on the last slot and rescheduled.
+ */
+static void
+damp_schedule(struct damp_entry *de)
+{
+	time_t		when;
+	u_int		slot;
+
+	when = de->updated + damp_decay_time(de->penalty,
+	    de->suppressed ? conf->damp_reuse : conf->damp_reuse / 2);
+
+	slot = 0;
+	if (when > damp_wheel_now) {
+		if ((when - damp_wheel_now) / DAMP_WHEEL_TICK >=
+		    DAMP_WHEEL_SLOTS)
+			slot = DAMP_WHEEL_SLOTS - 1;
+		else
+			slot = (when - damp_wheel_now) / DAMP_WHEEL_TICK;
+	}
+	slot = (damp_wheel_cur + slot) % DAMP_WHEEL_SLOTS;
+	LIST_INSERT_HEAD(&damp_wheel[slot], de, wheel);
+}
+
+static void
+damp_free(struct damp_entry *de)
+{
+	RB_REMOVE(damp_tree, &damp_entries, de);
+	LIST_REMOVE(de, wheel);
+	pt_unref(de->pt);
+	rdemem.damp_cnt--;
+	rdemem.damp_size -= sizeof(*de);
+	free(de);
+}
+
+/* Add penalty to a prefix of peer, returns 1 if it is now suppressed. */
+static int
+damp_charge(struct rde_peer *peer, struct pt_entry *pt, u_int32_t penalty)
+{
+	struct damp_entry	*de;
+	time_t			 now;
+
+	now = getmonotime();
+	if (RB_EMPTY(&damp_entries))
+		damp_wheel_now = now;
+
+	if ((de = damp_get(peer, pt)) == NULL) {
+		if ((de = calloc(1, sizeof(*de))) == NULL)
+			fatal("%s", __func__);
+		de->peerid = peer->conf.id;
+		de->pt = pt_ref(pt);
+		de->updated = now;
+		if (RB_INSERT(damp_tree, &damp_entries, de) != NULL)
+			fatalx("%s: RB tree invariant violated", __func__);
+		rdemem.damp_cnt++;
+		rdemem.damp_size += sizeof(*de);
+	} else {
+		LIST_REMOVE(de, wheel);
+		damp_decay(de, now);
+	}
+
+	penalty += de->penalty;
+	if (penalty > damp_ceiling())
+		penalty = damp_ceiling();
+	de->penalty = penalty;
+
+	if (!de->suppressed && de->penalty >= conf->damp_suppress) {
+		de->suppressed = 1;
+		peer->prefix_damp_cnt++;
+	}
+	damp_schedule(de);
+
+	return (de->suppressed);
+}
+
+/*
+ * Called before a new path is added to the Adj-RIB-In. A changed path of
+ * a known prefix is charged, returns 1 if the prefix is suppressed and
+ * must be kept out of the Loc-RIB.
+ */
+int
+damp_update(struct rde_peer *peer, struct filterstate *in,
+    struct bgpd_addr *prefix, u_int8_t prefixlen)
+{
+	struct prefix		*p;
+	struct pt_entry		*pt;
+	struct damp_entry	*de;
+
+	p = prefix_get(rib_byid(RIB_ADJ_IN), peer, prefix, prefixlen);
+	if (p != NULL) {
+		if (prefix_nexthop(p) == in->nexthop &&
+		    prefix_nhflags(p) == in->nhflags &&
+		    communities_equal(&in->communities,
+		    prefix_communities(p)) &&
+		    path_compare(&in->aspath, prefix_aspath(p)) == 0)
+			pt = p->pt;
+		else if (damp_charge(peer, p->pt, DAMP_PENALTY_ATTR))
+			goto absorbed;
+		else
+			return (0);
+	} else if ((pt = pt_get(prefix, prefixlen)) == NULL)
+		return (0);
+
+	/* re-announcement or duplicate, no extra penalty */
+	if ((de = damp_get(peer, pt)) == NULL || !de->suppressed)
+		return (0);
+
+absorbed:
+	peer->prefix_damp_absorbed++;
+	return (1);
+}
+
+/* Called before a prefix is withdrawn from the Adj-RIB-In. */
+void
+damp_withdraw(struct rde_peer *peer, struct bgpd_addr *prefix,
+    u_int8_t prefixlen)
+{
+	struct prefix		*p;
+
+	p = prefix_get(rib_byid(RIB_ADJ_IN), peer, prefix, prefixlen);
+	if (p == NULL)
+		return;
+	if (damp_suppressed(peer, p->pt))
+		peer->prefix_damp_absorbed++;
+	damp_charge(peer, p->pt, DAMP_PENALTY_WITHDRAW);
+}
+
+int
+damp_suppressed(struct rde_peer *peer, struct pt_entry *pt)
+{
+	struct damp_entry	*de;
+
+	if (!(peer->conf.flags & PEERFLAG_DAMPING))
+		return (0);
+	if ((de = damp_get(peer, pt)) == NULL)
+		return (0);
+	return (de->suppressed);
+}
+
+void
+damp_show(struct rde_peer *peer, struct pt_entry *pt,
+    struct ctl_show_rib *rib)
+{
+	struct damp_entry	*de, cur;
+	time_t			 now;
+
+	if ((de = damp_get(peer, pt)) == NULL)
+		return;
+
+	/* decay a copy, showing must not move the entry on the wheel */
+	now = getmonotime();
+	cur = *de;
+	damp_decay(&cur, now);
+
+	rib->damp_penalty = cur.penalty;
+	if (cur.suppressed) {
+		rib->flags |= F_PREF_DAMPED;
+		rib->damp_reuse = cur.updated +
+		    damp_decay_time(cur.penalty, conf->damp_reuse) - now;
+	}
+}
+
+/* Drop all damping state of a peer, used when the session goes down. */
+void
+damp_peer_flush(struct rde_peer *peer)
+{
+	struct damp_entry	*de, *next, needle;
+
+	needle.peerid = peer->conf.id;
+	needle.pt = NULL;
+	for (de = RB_NFIND(damp_tree, &damp_entries, &needle);
+	    de != NULL && de->peerid == peer->conf.id; de = next) {
+		next = RB_NEXT(damp_tree, &damp_entries, de);
+		damp_free(de);
+	}
+	peer->prefix_damp_cnt = 0;
+}
+
+/*
+ * Damping got disabled for peer by a reload. Feed the suppressed prefixes
+ * into the Loc-RIBs again instead of waiting for them to be reused.
+ */
+void
+damp_peer_release(struct rde_peer *peer)
+{
+	struct damp_entry	*de, needle;
+
+	needle.peerid = peer->conf.id;
+	needle.pt = NULL;
+	for (de = RB_NFIND(damp_tree, &damp_entries, &needle);
+	    de != NULL && de->peerid == peer->conf.id;
+	    de = RB_NEXT(damp_tree, &damp_entries, de)) {
+		if (!de->suppressed)
+			continue;
+		de->suppressed = 0;
+		rde_damp_reuse(peer, de->pt);
+	}
+	damp_peer_flush(peer);
+}
+
+static void
+damp_expire(struct damp_entry *de, time_t now)
+{
+	struct rde_peer		*peer;
+
+	if ((peer = peer_get(de->peerid)) == NULL) {
+		damp_free(de);
+		return;
+	}
+
+	damp_decay(de, now);
+	if (de->suppressed && de->penalty < conf->damp_reuse) {
+		de->suppressed = 0;
+		peer->prefix_damp_cnt--;
+		rde_damp_reuse(peer, de->pt);
+	}
+	if (!de->suppressed && de->penalty < conf->damp_reuse / 2)
+		damp_free(de);
+	else {
+		LIST_REMOVE(de, wheel);
+		damp_schedule(de);
+	}
+}
+
+/*
+ * Return the poll timeout in milliseconds until the current wheel slot
+ * expires or -1 if no prefix is tracked.
+ */
+int
+damp_timeout(void)
+{
+	time_t	now;
+
+	if (RB_EMPTY(&damp_entries))
+		return (-1);
+	now = getmonotime();
+	if (damp_wheel_now + DAMP_WHEEL_TICK <= now)
+		return (0);
+	return ((damp_wheel_now + DAMP_WHEEL_TICK - now) * 1000);
+}
+
+void
+damp_runner(void)
+{
+	struct damp_list	 expired;
+	struct damp_entry	*de;
+	time_t			 now;
+
+	now = getmonotime();
+	while (damp_wheel_now + DAMP_WHEEL_TICK <= now) {
+		if (RB_EMPTY(&damp_entries)) {
+			damp_wheel_now = now;
+			break;
+		}
+
+		/* detach the slot first, entries may end up there again */
+		LIST_INIT(&expired);
+		while ((de = LIST_FIRST(&damp_wheel[damp_wheel_cur])) != NULL) {
+			LIST_REMOVE(de, wheel);
+			LIST_INSERT_HEAD(&expired, de, wheel);
+		}
+		damp_wheel_cur = (damp_wheel_cur + 1) % DAMP_WHEEL_SLOTS;
+		damp_wheel_now += DAMP_WHEEL_TICK;
+
+		while ((de = LIST_FIRST(&expired)) != NULL)
+			damp_expire(de, now);
+	}
+}
@@ -197,8 +197,8 @@ prefix_cmp(struct prefix *p1, struct prefix *p2)
 	 * evaluation is enabled.
 	 */
 	if (rde_decisionflags() & BGPD_FLAG_DECISION_ROUTEAGE)
-		if ((p2->lastchange - p1->lastchange) != 0)
-			return (p2->lastchange - p1->lastchange);
+		if (p1->lastchange != p2->lastchange)
+			return (p1->lastchange < p2->lastchange ? 1 : -1);
 
 	/* 10. lowest BGP Id wins, use ORIGINATOR_ID if present */
 	if ((a = attr_optget(asp1, ATTR_ORIGINATOR_ID)) != NULL) {
@@ -232,6 +232,49 @@ prefix_cmp(struct prefix *p1, struct prefix *p2)
 	fatalx("Uh, oh a politician in the decision process");
 }
 
+/*
+ * Returns 1 if the prefix may be selected by the decision process.
+ * Invalid paths and paths with a loop are never eligible. A NULL nexthop
+ * is used by locally announced networks and is always reachable.
+ */
+int
+prefix_eligible(struct prefix *p)
+{
+	struct rde_aspath	*asp = prefix_aspath(p);
+	struct nexthop		*nh = prefix_nexthop(p);
+
+	if (asp == NULL || asp->flags & (F_ATTR_LOOP|F_ATTR_PARSE_ERR))
+		return (0);
+	if (nh != NULL && nh->state != NEXTHOP_REACH)
+		return (0);
+	return (1);
+}
+
+/* switch the active prefix of re and keep the RIB and peer stats */
+void
+prefix_set_active(struct rib_entry *re, struct prefix *xp)
+{
+	struct rib_stats	*rs = &re_rib(re)->stats[re->prefix->aid];
+	struct bgpd_addr	 addr;
+
+	if (TRACE_ON(TRACE_DECISION) && re->active != xp) {
+		pt_getaddr(re->prefix, &addr);
+		trace_prefix(TRACE_EV_BEST,
+		    xp != NULL ? prefix_peer(xp)->conf.id : 0, &addr,
+		    re->prefix->prefixlen, 0);
+	}
+
+	if (re->active != NULL) {
+		rs->active_cnt--;
+		prefix_peer(re->active)->prefix_best_cnt--;
+	}
+	if (xp != NULL) {
+		rs->active_cnt++;
+		prefix_peer(xp)->prefix_best_cnt++;
+	}
+	re->active = xp;
+}
+
 /*
  * Find the correct place to insert the prefix in the prefix list.
  * If the active prefix has changed we need to send an update.
@@ -254,7 +297,7 @@ prefix_evaluate(struct prefix *p, struct rib_entry *re)
 			 * is consistant.
 			 */
 			rde_generate_updates(re_rib(re), NULL, re->active);
-			re->active = NULL;
+			prefix_set_active(re, NULL);
 		}
 		return;
 	}
@@ -280,15 +323,8 @@ prefix_evaluate(struct prefix *p, struct rib_entry *re)
 	}
 
 	xp = LIST_FIRST(&re->prefix_h);
-	if (xp != NULL) {
-		struct rde_aspath *xasp = prefix_aspath(xp);
-		if (xasp == NULL ||
-		    xasp->flags & (F_ATTR_LOOP|F_ATTR_PARSE_ERR) ||
-		    (prefix_nexthop(xp) != NULL && prefix_nexthop(xp)->state !=
-		    NEXTHOP_REACH))
-			/* xp is ineligible */
-			xp = NULL;
-	}
+	if (xp != NULL && !prefix_eligible(xp))
+		xp = NULL;
 
 	if (re->active != xp) {
 		/* need to generate an update */
@@ -302,6 +338,7 @@ prefix_evaluate(struct prefix *p, struct rib_entry *re)
 		if ((re_rib(re)->flags & F_RIB_NOFIB) == 0)
 			rde_send_kroute(re_rib(re), xp, re->active);
 
-		re->active = xp;
+		prefix_set_active(re, xp);
 	}
+	latency_mark(LAT_DECISION);
 }
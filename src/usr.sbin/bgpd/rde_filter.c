@@ -22,6 +22,7 @@
 #include <sys/queue.h>
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -207,6 +208,64 @@ rde_prefix_match(struct filter_prefix *fp, struct bgpd_addr *prefix,
 	}
 }
 
+/*
+ * The AS path is interned and shared by many prefixes so the verdict of
+ * the AS path part of a rule is cached, keyed by rule and path id. This
+ * only pays off for the matches that need to walk the path: as-sets and
+ * as-path expressions. Freeing filter rules bumps the epoch which
+ * invalidates all entries since rule pointers may be reused.
+ */
+#define FILTER_CACHE_BITS	12
+
+static struct filter_cache {
+	const struct filter_rule	*rule;
+	u_int64_t			 aspath_id;
+	u_int32_t			 neighas;
+	u_int32_t			 epoch;
+	int				 verdict;
+} filter_cache[1 << FILTER_CACHE_BITS];
+static u_int32_t	filter_cache_epoch = 1;
+
+static int
+rde_filter_match_aspath(struct filter_rule *f, struct rde_peer *peer,
+    struct aspath *aspath)
+{
+	struct filter_cache	*fc = NULL;
+	u_int64_t		 h;
+	u_int32_t		 neighas = 0;
+	int			 verdict = 1;
+
+	if (f->match.as.flags & AS_FLAG_NEIGHBORAS)
+		neighas = peer->conf.remote_as;
+
+	if (f->match.aspath.re[0] != '\0' ||
+	    (f->match.as.flags & AS_FLAG_AS_SET)) {
+		h = (aspath->id ^ (u_int64_t)(uintptr_t)f << 20) *
+		    0x9e3779b97f4a7c15ULL;
+		fc = &filter_cache[h >> (64 - FILTER_CACHE_BITS)];
+		if (fc->epoch == filter_cache_epoch && fc->rule == f &&
+		    fc->aspath_id == aspath->id && fc->neighas == neighas)
+			return (fc->verdict);
+	}
+
+	if (f->match.as.type != AS_UNDEF &&
+	    aspath_match(aspath, &f->match.as, peer->conf.remote_as) == 0)
+		verdict = 0;
+	else if (f->match.aspath.re[0] != '\0' &&
+	    (f->match.aspath.dfa == NULL ||
+	    aspath_re_match(f->match.aspath.dfa, aspath) == 0))
+		verdict = 0;
+
+	if (fc != NULL) {
+		fc->rule = f;
+		fc->aspath_id = aspath->id;
+		fc->neighas = neighas;
+		fc->epoch = filter_cache_epoch;
+		fc->verdict = verdict;
+	}
+	return (verdict);
+}
+
 static int
 rde_filter_match(struct filter_rule *f, struct rde_peer *peer,
     struct rde_peer *from, struct filterstate *state,
@@ -225,9 +284,9 @@ rde_filter_match(struct filter_rule *f, struct rde_peer *peer,
 			return (0);
 	}
 
-	if (asp != NULL && f->match.as.type != AS_UNDEF) {
-		if (aspath_match(asp->aspath, &f->match.as,
-		    peer->conf.remote_as) == 0)
+	if (asp != NULL && (f->match.as.type != AS_UNDEF ||
+	    f->match.aspath.re[0] != '\0')) {
+		if (rde_filter_match_aspath(f, peer, asp->aspath) == 0)
 			return (0);
 	}
 
@@ -326,13 +385,40 @@ rde_filter_skip_rule(struct rde_peer *peer, struct filter_rule *f)
 	return (0);
 }
 
+/*
+ * Returns 1 if a rule applying to peer depends on the ROA validation state.
+ */
 int
-rde_filter_equal(struct filter_head *a, struct filter_head *b,
+rde_filter_uses_ovs(struct filter_head *rules, struct rde_peer *peer)
+{
+	struct filter_rule	*f;
+
+	if (rules == NULL)
+		return (0);
+	TAILQ_FOREACH(f, rules, entry) {
+		if (rde_filter_skip_rule(peer, f))
+			continue;
+		if (f->match.ovs.is_set)
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Compare two filter lists. FILTER_DIFF_SETS is returned if the rules are
+ * the same but some of the referenced prefix-sets or origin-sets changed.
+ * In that case only prefixes covered by the changed set entries need to
+ * be filtered again.
+ */
+enum filter_diff
+rde_filter_diff(struct filter_head *a, struct filter_head *b,
     struct rde_peer *peer)
 {
 	struct filter_rule	*fa, *fb;
 	struct rde_prefixset	*psa, *psb, *osa, *osb;
 	struct as_set		*asa, *asb;
+	struct aspath_re	*rea, *reb;
+	enum filter_diff	 diff = FILTER_DIFF_NONE;
 	int			 r;
 
 	fa = a ? TAILQ_FIRST(a) : NULL;
@@ -352,23 +438,26 @@ rde_filter_equal(struct filter_head *a, struct filter_head *b,
 		/* compare the two rules */
 		if ((fa == NULL && fb != NULL) || (fa != NULL && fb == NULL))
 			/* new rule added or removed */
-			return (0);
+			return (FILTER_DIFF_RULES);
 
 		if (fa->action != fb->action || fa->quick != fb->quick)
-			return (0);
+			return (FILTER_DIFF_RULES);
 		if (memcmp(&fa->peer, &fb->peer, sizeof(fa->peer)))
-			return (0);
+			return (FILTER_DIFF_RULES);
 
-		/* compare filter_rule.match without the prefixset pointer */
+		/* compare filter_rule.match without the set and dfa pointers */
 		psa = fa->match.prefixset.ps;
 		psb = fb->match.prefixset.ps;
 		osa = fa->match.originset.ps;
 		osb = fb->match.originset.ps;
 		asa = fa->match.as.aset;
 		asb = fb->match.as.aset;
+		rea = fa->match.aspath.dfa;
+		reb = fb->match.aspath.dfa;
 		fa->match.prefixset.ps = fb->match.prefixset.ps = NULL;
 		fa->match.originset.ps = fb->match.originset.ps = NULL;
 		fa->match.as.aset = fb->match.as.aset = NULL;
+		fa->match.aspath.dfa = fb->match.aspath.dfa = NULL;
 		r = memcmp(&fa->match, &fb->match, sizeof(fa->match));
 		/* fixup the struct again */
 		fa->match.prefixset.ps = psa;
@@ -377,34 +466,36 @@ rde_filter_equal(struct filter_head *a, struct filter_head *b,
 		fb->match.originset.ps = osb;
 		fa->match.as.aset = asa;
 		fb->match.as.aset = asb;
+		fa->match.aspath.dfa = rea;
+		fb->match.aspath.dfa = reb;
 		if (r != 0)
-			return (0);
+			return (FILTER_DIFF_RULES);
 		if (fa->match.prefixset.ps != NULL &&
 		    fa->match.prefixset.ps->dirty) {
 			log_debug("%s: prefixset %s has changed",
 			    __func__, fa->match.prefixset.name);
-			return (0);
+			diff = FILTER_DIFF_SETS;
 		}
 		if (fa->match.originset.ps != NULL &&
 		    fa->match.originset.ps->dirty) {
 			log_debug("%s: originset %s has changed",
 			    __func__, fa->match.originset.name);
-			return (0);
+			diff = FILTER_DIFF_SETS;
 		}
 		if ((fa->match.as.flags & AS_FLAG_AS_SET) &&
 		    fa->match.as.aset->dirty) {
 			log_debug("%s: as-set %s has changed",
 			    __func__, fa->match.as.name);
-			return (0);
+			return (FILTER_DIFF_RULES);
 		}
 
 		if (!filterset_equal(&fa->set, &fb->set))
-			return (0);
+			return (FILTER_DIFF_RULES);
 
 		fa = TAILQ_NEXT(fa, entry);
 		fb = TAILQ_NEXT(fb, entry);
 	}
-	return (1);
+	return (diff);
 }
 
 void
@@ -439,9 +530,13 @@ filterlist_free(struct filter_head *fh)
 	if (fh == NULL)
 		return;
 
+	/* the rules may be reused, flush the aspath verdict cache */
+	if (++filter_cache_epoch == 0)
+		filter_cache_epoch = 1;
 	while ((r = TAILQ_FIRST(fh)) != NULL) {
 		TAILQ_REMOVE(fh, r, entry);
 		filterset_free(&r->set);
+		aspath_re_free(r->match.aspath.dfa);
 		free(r);
 	}
 	free(fh);
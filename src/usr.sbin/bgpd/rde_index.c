@@ -0,0 +1,255 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bgpd.h"
+#include "rde.h"
+#include "log.h"
+
+/*
+ * Secondary indexes over the prefixes in the RIBs (Adj-RIB-In and the
+ * Loc-RIBs, not the Adj-RIB-Out).
+ *
+ * Every indexed prefix has a prefix_idx that is linked onto the lists of
+ * its peer, its rde_aspath and its rde_community. The prefix_idx is only
+ * allocated while the index is enabled so that struct prefix stays small
+ * for the common case. Paths with indexed prefixes are in
+ * a hash table by origin AS and community sets with indexed prefixes on
+ * one list. A query first selects the matching paths or community sets
+ * and then only looks at their prefixes.
+ */
+
+#define	INDEX_ORIGIN_SIZE	1024
+
+LIST_HEAD(index_paths, rde_aspath);
+LIST_HEAD(index_comms, rde_community);
+
+static struct index_paths	index_origin_tbl[INDEX_ORIGIN_SIZE];
+static struct index_comms	index_comms;
+static int			index_enabled;
+
+/* same AS as used by aspath_match() for AS_SOURCE */
+static u_int32_t
+index_origin(struct aspath *aspath)
+{
+	const u_int8_t	*seg;
+	u_int32_t	 as = AS_NONE;
+	u_int16_t	 len, seg_size;
+	u_int8_t	 seg_len;
+
+	seg = aspath->data;
+	len = aspath->len;
+	for (; len >= 6; len -= seg_size, seg += seg_size) {
+		seg_len = seg[1];
+		seg_size = 2 + sizeof(u_int32_t) * seg_len;
+		if (seg[0] == AS_SEQUENCE)
+			as = aspath_extract(seg, seg_len - 1);
+		if (seg_size > len)
+			break;
+	}
+	return (as);
+}
+
+static struct index_paths *
+index_origin_head(u_int32_t as)
+{
+	return (&index_origin_tbl[(as * 2654435761U) >> 22 &
+	    (INDEX_ORIGIN_SIZE - 1)]);
+}
+
+void
+index_link(struct prefix *p)
+{
+	struct rde_aspath	*asp = p->aspath;
+	struct rde_community	*comm = p->communities;
+	struct prefix_idx	*pi;
+
+	if (!index_enabled || p->index != NULL)
+		return;
+
+	if ((pi = malloc(sizeof(*pi))) == NULL)
+		fatal("%s", __func__);
+	pi->prefix = p;
+	p->index = pi;
+
+	if (LIST_EMPTY(&asp->prefix_h))
+		LIST_INSERT_HEAD(index_origin_head(index_origin(asp->aspath)),
+		    asp, origin_l);
+	LIST_INSERT_HEAD(&asp->prefix_h, pi, path);
+
+	if (LIST_EMPTY(&comm->prefix_h))
+		LIST_INSERT_HEAD(&index_comms, comm, index_l);
+	LIST_INSERT_HEAD(&comm->prefix_h, pi, comm);
+
+	LIST_INSERT_HEAD(&p->peer->index_h, pi, peer);
+
+	rdemem.index_cnt++;
+	rdemem.index_size += sizeof(*pi);
+}
+
+void
+index_unlink(struct prefix *p)
+{
+	struct prefix_idx	*pi = p->index;
+
+	if (pi == NULL)
+		return;
+
+	LIST_REMOVE(pi, path);
+	if (LIST_EMPTY(&p->aspath->prefix_h))
+		LIST_REMOVE(p->aspath, origin_l);
+	LIST_REMOVE(pi, comm);
+	if (LIST_EMPTY(&p->communities->prefix_h))
+		LIST_REMOVE(p->communities, index_l);
+	LIST_REMOVE(pi, peer);
+
+	free(pi);
+	p->index = NULL;
+	rdemem.index_cnt--;
+	rdemem.index_size -= sizeof(*pi);
+}
+
+static void
+index_rib_upcall(struct rib_entry *re, void *arg)
+{
+	struct prefix	*p;
+
+	LIST_FOREACH(p, &re->prefix_h, entry.list.rib) {
+		if (index_enabled)
+			index_link(p);
+		else
+			index_unlink(p);
+	}
+}
+
+/*
+ * Turn the index on or off, the RIBs are walked to add or remove all
+ * prefixes.
+ */
+void
+index_set(int on)
+{
+	u_int16_t	id;
+
+	on = on != 0;
+	if (on == index_enabled)
+		return;
+	index_enabled = on;
+	for (id = 0; id < rib_size; id++) {
+		if (rib_byid(id) == NULL)
+			continue;
+		if (rib_dump_new(id, AID_UNSPEC, 0, NULL, index_rib_upcall,
+		    NULL, NULL) == -1)
+			fatal("%s: rib_dump_new", __func__);
+	}
+	log_info("RIB index %s", on ? "enabled" : "disabled");
+}
+
+struct index_walk_ctx {
+	void				(*upcall)(struct prefix *, void *);
+	void				*arg;
+	struct ctl_show_rib_request	*req;
+	u_int16_t			 rid;
+};
+
+static void
+index_visit(struct prefix *p, struct index_walk_ctx *ctx)
+{
+	if (p->re->rib_id != ctx->rid)
+		return;
+	if (ctx->req->aid != AID_UNSPEC && p->pt->aid != ctx->req->aid)
+		return;
+	ctx->upcall(p, ctx->arg);
+}
+
+static void
+index_walk_paths(struct index_paths *head, struct index_walk_ctx *ctx)
+{
+	struct rde_aspath	*asp;
+	struct prefix_idx	*pi;
+
+	LIST_FOREACH(asp, head, origin_l) {
+		if (!aspath_match(asp->aspath, &ctx->req->as, 0))
+			continue;
+		LIST_FOREACH(pi, &asp->prefix_h, path)
+			index_visit(pi->prefix, ctx);
+	}
+}
+
+static void
+index_walk_peer(struct rde_peer *peer, void *arg)
+{
+	struct index_walk_ctx	*ctx = arg;
+	struct prefix_idx	*pi;
+
+	if (!rde_match_peer(peer, &ctx->req->neighbor))
+		return;
+	LIST_FOREACH(pi, &peer->index_h, peer)
+		index_visit(pi->prefix, ctx);
+}
+
+/*
+ * Call upcall for a superset of the prefixes in RIB rid matching the
+ * request, the caller still needs to apply the full filter.
+ * Returns -1 if no index is usable for this request.
+ */
+int
+index_walk(struct ctl_show_rib_request *req, u_int16_t rid,
+    void (*upcall)(struct prefix *, void *), void *arg)
+{
+	struct index_walk_ctx	 ctx;
+	struct rde_community	*comm;
+	struct prefix_idx	*pi;
+	int			 i;
+
+	if (!index_enabled)
+		return (-1);
+
+	ctx.upcall = upcall;
+	ctx.arg = arg;
+	ctx.req = req;
+	ctx.rid = rid;
+
+	if (req->community.flags != 0) {
+		LIST_FOREACH(comm, &index_comms, index_l) {
+			if (!community_match(comm, &req->community, NULL))
+				continue;
+			LIST_FOREACH(pi, &comm->prefix_h, comm)
+				index_visit(pi->prefix, &ctx);
+		}
+		return (0);
+	}
+	if (req->as.type == AS_SOURCE && req->as.flags == 0 &&
+	    (req->as.op == OP_NONE || req->as.op == OP_EQ)) {
+		index_walk_paths(index_origin_head(req->as.as_min), &ctx);
+		return (0);
+	}
+	if (req->as.type != AS_UNDEF) {
+		for (i = 0; i < INDEX_ORIGIN_SIZE; i++)
+			index_walk_paths(&index_origin_tbl[i], &ctx);
+		return (0);
+	}
+	if (req->neighbor.addr.aid != AID_UNSPEC ||
+	    req->neighbor.descr[0] != '\0') {
+		peer_foreach(index_walk_peer, &ctx);
+		return (0);
+	}
+	return (-1);
+}
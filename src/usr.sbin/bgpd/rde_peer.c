@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "bgpd.h"
@@ -154,9 +155,13 @@ peer_add(u_int32_t id, struct peer_config *p_conf)
 {
 	struct rde_peer_head	*head;
 	struct rde_peer		*peer;
+	u_int8_t		 damping;
 
 	if ((peer = peer_get(id))) {
+		damping = peer->conf.flags & PEERFLAG_DAMPING;
 		memcpy(&peer->conf, p_conf, sizeof(struct peer_config));
+		if (damping && !(peer->conf.flags & PEERFLAG_DAMPING))
+			damp_peer_release(peer);
 		return (NULL);
 	}
 
@@ -252,6 +257,49 @@ peer_flush_upcall(struct rib_entry *re, void *arg)
 	}
 }
 
+/*
+ * Same as peer_flush_upcall() but for peers without Adj-RIB-In, here
+ * every Loc-RIB is walked. The prefix count only drops once the prefix
+ * is gone from all Loc-RIBs.
+ */
+static void
+peer_flush_locrib_upcall(struct rib_entry *re, void *arg)
+{
+	struct rde_peer *peer = ((struct peer_flush *)arg)->peer;
+	struct rde_aspath *asp;
+	struct bgpd_addr addr;
+	struct prefix *p, *np;
+	time_t staletime = ((struct peer_flush *)arg)->staletime;
+	u_int32_t i;
+	u_int8_t prefixlen;
+
+	pt_getaddr(re->prefix, &addr);
+	prefixlen = re->prefix->prefixlen;
+	LIST_FOREACH_SAFE(p, &re->prefix_h, entry.list.rib, np) {
+		if (peer != prefix_peer(p))
+			continue;
+		if (staletime && p->lastchange > staletime)
+			continue;
+
+		asp = prefix_aspath(p);
+		if (asp->pftableid)
+			rde_send_pftable(asp->pftableid, &addr, prefixlen, 1);
+		rde_update_log("flush", re->rib_id, peer, NULL, &addr,
+		    prefixlen);
+		prefix_destroy(p);
+
+		for (i = RIB_LOC_START; i < rib_size; i++) {
+			struct rib *rib = rib_byid(i);
+			if (rib == NULL)
+				continue;
+			if (prefix_get(rib, peer, &addr, prefixlen) != NULL)
+				return;
+		}
+		peer->prefix_cnt--;
+		break;	/* optimization, only one match per peer possible */
+	}
+}
+
 static void
 rde_up_adjout_force_upcall(struct prefix *p, void *ptr)
 {
@@ -310,7 +358,7 @@ rde_up_dump_done(void *ptr, u_int8_t aid)
 int
 peer_up(struct rde_peer *peer, struct session_up *sup)
 {
-	u_int8_t	 i;
+	u_int8_t	 i, no_adjin;
 
 	if (peer->state == PEER_ERR) {
 		/*
@@ -331,6 +379,40 @@ peer_up(struct rde_peer *peer, struct session_up *sup)
 	peer->local_v4_addr = sup->local_v4_addr;
 	peer->local_v6_addr = sup->local_v6_addr;
 	memcpy(&peer->capa, &sup->capa, sizeof(peer->capa));
+	peer->up_credit = 0;
+	peer->up_deficit = 0;
+	peer->up_mrai_next = 0;
+	peer->up_mrai_flush = 0;
+	peer->lat_wire = 0;
+	peer->refresh_pending = 0;	/* the new session sends all */
+
+	/*
+	 * Without Adj-RIB-In a policy change is handled by asking the peer
+	 * for its table again. This needs route refresh and damping needs
+	 * the original paths, else keep the Adj-RIB-In.
+	 */
+	no_adjin = 0;
+	if (peer->conf.flags & PEERFLAG_NO_ADJRIBIN) {
+		if (!peer->capa.refresh)
+			log_peer_warnx(&peer->conf, "route refresh not "
+			    "negotiated, keeping Adj-RIB-In");
+		else if (peer->conf.flags & PEERFLAG_DAMPING)
+			log_peer_warnx(&peer->conf, "damping enabled, "
+			    "keeping Adj-RIB-In");
+		else
+			no_adjin = 1;
+	}
+	if (peer->no_adjin != no_adjin) {
+		/* stale routes from graceful restart are in the other RIBs */
+		for (i = 0; i < AID_MAX; i++)
+			if (peer->staletime[i])
+				break;
+		if (i < AID_MAX) {
+			peer_flush(peer, AID_UNSPEC, 0);
+			peer->prefix_cnt = 0;
+		}
+		peer->no_adjin = no_adjin;
+	}
 
 	peer->state = PEER_UP;
 
@@ -363,6 +445,7 @@ peer_down(struct rde_peer *peer, void *bula)
 	peer_flush(peer, AID_UNSPEC, 0);
 	peer->prefix_cnt = 0;
 	peer->prefix_out_cnt = 0;
+	damp_peer_flush(peer);
 
 	peer_imsg_flush(peer);
 
@@ -379,11 +462,22 @@ void
 peer_flush(struct rde_peer *peer, u_int8_t aid, time_t staletime)
 {
 	struct peer_flush pf = { peer, staletime };
+	u_int16_t i;
 
 	/* this dump must run synchronous, too much depends on that right now */
-	if (rib_dump_new(RIB_ADJ_IN, aid, 0, &pf, peer_flush_upcall,
-	    NULL, NULL) == -1)
-		fatal("%s: rib_dump_new", __func__);
+	if (!peer->no_adjin) {
+		if (rib_dump_new(RIB_ADJ_IN, aid, 0, &pf, peer_flush_upcall,
+		    NULL, NULL) == -1)
+			fatal("%s: rib_dump_new", __func__);
+	} else {
+		for (i = RIB_LOC_START; i < rib_size; i++) {
+			if (rib_byid(i) == NULL)
+				continue;
+			if (rib_dump_new(i, aid, 0, &pf,
+			    peer_flush_locrib_upcall, NULL, NULL) == -1)
+				fatal("%s: rib_dump_new", __func__);
+		}
+	}
 
 	/* Deletions may have been performed in peer_flush_upcall */
 	rde_send_pftable_commit();
@@ -528,3 +622,85 @@ peer_imsg_flush(struct rde_peer *peer)
 		free(iq);
 	}
 }
+
+/*
+ * Convergence latency of sampled UPDATEs. While a sampled UPDATE is
+ * processed the time each stage was last reached is recorded and added
+ * to the histograms of the sending peer in latency_done(). The Adj-RIB-Out
+ * of other peers remembers the oldest sample not yet sent and accounts
+ * it once the next UPDATE for that peer is built.
+ */
+static u_int64_t	lat_wire;
+static u_int64_t	lat_stage[LAT_MAX];
+static int		lat_active;
+
+static u_int64_t
+latency_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void
+latency_add(struct latency_hist *h, u_int64_t start, u_int64_t end)
+{
+	u_int64_t	us = end > start ? end - start : 0;
+	int		i;
+
+	for (i = 0; i < LATENCY_BUCKETS - 1 && us > (8ULL << i); i++)
+		;
+	h->bucket[i]++;
+	h->count++;
+	h->sum += us;
+}
+
+void
+latency_start(struct rde_peer *peer, struct timespec *ts)
+{
+	lat_wire = (u_int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+	memset(lat_stage, 0, sizeof(lat_stage));
+	lat_active = 1;
+	latency_add(&peer->latency[LAT_QUEUE], lat_wire, latency_now());
+}
+
+void
+latency_mark(enum latency_stage stage)
+{
+	if (!lat_active)
+		return;
+	lat_stage[stage] = latency_now();
+}
+
+/* the sampled UPDATE caused a change in the Adj-RIB-Out of peer */
+void
+latency_enqueue(struct rde_peer *peer)
+{
+	if (!lat_active)
+		return;
+	lat_stage[LAT_ADJOUT] = latency_now();
+	if (peer->lat_wire == 0)
+		peer->lat_wire = lat_wire;
+}
+
+/* an UPDATE was built for peer */
+void
+latency_sent(struct rde_peer *peer)
+{
+	if (peer->lat_wire == 0)
+		return;
+	latency_add(&peer->latency[LAT_SEND], peer->lat_wire, latency_now());
+	peer->lat_wire = 0;
+}
+
+void
+latency_done(struct rde_peer *peer)
+{
+	enum latency_stage	s;
+
+	for (s = LAT_DECISION; s < LAT_SEND; s++)
+		if (lat_stage[s] != 0)
+			latency_add(&peer->latency[s], lat_wire, lat_stage[s]);
+	lat_active = 0;
+}
@@ -0,0 +1,529 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bgpd.h"
+#include "rde.h"
+
+/*
+ * AS path regular expressions. The alphabet are AS numbers, an AS_SET or
+ * AS_CONFED_SET counts as one hop that only '.' matches. The expression
+ * is parsed into a Thompson NFA which is then converted into a DFA.
+ * The AS numbers used in the expression split the AS number space into
+ * classes, the DFA has one transition per state and class. A match
+ * therefore does one class lookup and one table lookup per hop.
+ */
+
+#define RE_MAXNODES	1024	/* NFA nodes */
+#define RE_MAXSTATES	512	/* DFA states */
+#define RE_MAXDEPTH	32	/* nested parentheses */
+
+enum re_type {
+	RE_EPS,
+	RE_SYM,
+	RE_ANY,
+};
+
+struct re_node {
+	enum re_type	type;
+	u_int32_t	lo, hi;
+	int		out[2];		/* -1 if unused */
+};
+
+struct re_frag {
+	int		start, end;
+};
+
+struct re_parse {
+	const char	*s;
+	const char	*errstr;
+	struct re_node	*nodes;
+	int		 nnodes;
+	int		 depth;
+};
+
+struct aspath_re {
+	u_int32_t	*bounds;	/* lower bound of each class */
+	u_int16_t	*trans;		/* nstates * nclass */
+	u_int8_t	*accept;
+	u_int		 nbounds;
+	u_int		 nclass;	/* nbounds + 1 for AS_SET */
+	u_int		 nstates;
+	int		 anchor_end;
+};
+
+#define RE_DEAD		0	/* no match possible anymore */
+#define RE_START	1
+
+static int	re_alt(struct re_parse *, struct re_frag *);
+
+static int
+re_node(struct re_parse *p, enum re_type type, u_int32_t lo, u_int32_t hi)
+{
+	struct re_node *n;
+
+	if (p->nnodes >= RE_MAXNODES) {
+		p->errstr = "expression too long";
+		return -1;
+	}
+	n = &p->nodes[p->nnodes];
+	n->type = type;
+	n->lo = lo;
+	n->hi = hi;
+	n->out[0] = n->out[1] = -1;
+	return p->nnodes++;
+}
+
+static void
+re_skipws(struct re_parse *p)
+{
+	while (isspace((unsigned char)*p->s))
+		p->s++;
+}
+
+static int
+re_number(struct re_parse *p, u_int32_t *as)
+{
+	unsigned long long v = 0;
+
+	if (!isdigit((unsigned char)*p->s)) {
+		p->errstr = "AS number expected";
+		return -1;
+	}
+	while (isdigit((unsigned char)*p->s)) {
+		v = v * 10 + (*p->s++ - '0');
+		if (v > UINT_MAX) {
+			p->errstr = "AS number too big";
+			return -1;
+		}
+	}
+	*as = v;
+	return 0;
+}
+
+/* atom: as | as-as | '.' | '(' alt ')' */
+static int
+re_atom(struct re_parse *p, struct re_frag *f)
+{
+	u_int32_t lo, hi;
+	enum re_type type = RE_SYM;
+
+	re_skipws(p);
+	if (*p->s == '(') {
+		p->s++;
+		if (++p->depth > RE_MAXDEPTH) {
+			p->errstr = "too many nested parentheses";
+			return -1;
+		}
+		if (re_alt(p, f) == -1)
+			return -1;
+		re_skipws(p);
+		if (*p->s != ')') {
+			p->errstr = "missing ')'";
+			return -1;
+		}
+		p->s++;
+		p->depth--;
+		return 0;
+	}
+
+	if (*p->s == '.') {
+		p->s++;
+		type = RE_ANY;
+		lo = 0;
+		hi = UINT_MAX;
+	} else {
+		if (re_number(p, &lo) == -1)
+			return -1;
+		hi = lo;
+		re_skipws(p);
+		if (*p->s == '-') {
+			p->s++;
+			re_skipws(p);
+			if (re_number(p, &hi) == -1)
+				return -1;
+			if (lo > hi) {
+				p->errstr = "bad AS range";
+				return -1;
+			}
+		}
+	}
+
+	if ((f->start = re_node(p, type, lo, hi)) == -1 ||
+	    (f->end = re_node(p, RE_EPS, 0, 0)) == -1)
+		return -1;
+	p->nodes[f->start].out[0] = f->end;
+	return 0;
+}
+
+/* repeat: atom ['*' | '+' | '?']... */
+static int
+re_repeat(struct re_parse *p, struct re_frag *f)
+{
+	int s, e;
+
+	if (re_atom(p, f) == -1)
+		return -1;
+	for (;;) {
+		re_skipws(p);
+		switch (*p->s) {
+		case '*':
+		case '?':
+			if ((s = re_node(p, RE_EPS, 0, 0)) == -1 ||
+			    (e = re_node(p, RE_EPS, 0, 0)) == -1)
+				return -1;
+			p->nodes[s].out[0] = f->start;
+			p->nodes[s].out[1] = e;
+			p->nodes[f->end].out[0] = *p->s == '*' ? s : e;
+			f->start = s;
+			f->end = e;
+			break;
+		case '+':
+			if ((e = re_node(p, RE_EPS, 0, 0)) == -1)
+				return -1;
+			p->nodes[f->end].out[0] = f->start;
+			p->nodes[f->end].out[1] = e;
+			f->end = e;
+			break;
+		default:
+			return 0;
+		}
+		p->s++;
+	}
+}
+
+/* concat: repeat... or nothing */
+static int
+re_concat(struct re_parse *p, struct re_frag *f)
+{
+	struct re_frag n;
+
+	if ((f->start = f->end = re_node(p, RE_EPS, 0, 0)) == -1)
+		return -1;
+	for (;;) {
+		re_skipws(p);
+		if (*p->s == '\0' || *p->s == '|' || *p->s == ')' ||
+		    *p->s == '$')
+			return 0;
+		if (re_repeat(p, &n) == -1)
+			return -1;
+		p->nodes[f->end].out[0] = n.start;
+		f->end = n.end;
+	}
+}
+
+/* alt: concat ['|' concat]... */
+static int
+re_alt(struct re_parse *p, struct re_frag *f)
+{
+	struct re_frag n;
+	int s, e;
+
+	if (re_concat(p, f) == -1)
+		return -1;
+	while (*p->s == '|') {
+		p->s++;
+		if (re_concat(p, &n) == -1)
+			return -1;
+		if ((s = re_node(p, RE_EPS, 0, 0)) == -1 ||
+		    (e = re_node(p, RE_EPS, 0, 0)) == -1)
+			return -1;
+		p->nodes[s].out[0] = f->start;
+		p->nodes[s].out[1] = n.start;
+		p->nodes[f->end].out[0] = e;
+		p->nodes[n.end].out[0] = e;
+		f->start = s;
+		f->end = e;
+	}
+	return 0;
+}
+
+static void
+re_closure(struct re_node *nodes, int n, u_int32_t *set, int *stack)
+{
+	int sp = 0, i, o;
+
+	if (set[n / 32] & (1U << (n % 32)))
+		return;
+	set[n / 32] |= 1U << (n % 32);
+	stack[sp++] = n;
+	while (sp > 0) {
+		n = stack[--sp];
+		if (nodes[n].type != RE_EPS)
+			continue;
+		for (i = 0; i < 2; i++) {
+			o = nodes[n].out[i];
+			if (o == -1 || set[o / 32] & (1U << (o % 32)))
+				continue;
+			set[o / 32] |= 1U << (o % 32);
+			stack[sp++] = o;
+		}
+	}
+}
+
+static int
+re_bound_cmp(const void *a, const void *b)
+{
+	u_int32_t x = *(const u_int32_t *)a, y = *(const u_int32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* return the class of an AS number, the last bound <= as */
+static inline u_int
+re_class(const struct aspath_re *re, u_int32_t as)
+{
+	u_int lo = 0, hi = re->nbounds, mid;
+
+	/* bounds[0] is always 0 */
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (re->bounds[mid] <= as)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* make room for at least one more state plus the scratch set */
+static int
+re_dfa_grow(struct aspath_re *re, struct re_parse *p, u_int32_t **sets,
+    size_t words, size_t *maxstates)
+{
+	u_int32_t *ns;
+	u_int16_t *nt;
+	size_t newmax;
+
+	if (re->nstates + 2 <= *maxstates)
+		return 0;
+	if (*maxstates >= RE_MAXSTATES) {
+		p->errstr = "expression too complex";
+		return -1;
+	}
+	newmax = *maxstates == 0 ? 16 : *maxstates * 2;
+	if ((ns = recallocarray(*sets, *maxstates, newmax,
+	    words * sizeof(**sets))) == NULL)
+		return -1;
+	*sets = ns;
+	if ((nt = reallocarray(re->trans, newmax,
+	    re->nclass * sizeof(*nt))) == NULL)
+		return -1;
+	re->trans = nt;
+	*maxstates = newmax;
+	return 0;
+}
+
+/*
+ * Subset construction, each DFA state is the set of NFA nodes that are
+ * reachable. Unless the expression is anchored with '^' the start node is
+ * added to every state so that a match can start at any hop.
+ */
+static int
+re_dfa(struct aspath_re *re, struct re_parse *p, struct re_frag *f,
+    int anchor_start)
+{
+	u_int32_t *sets = NULL, *cur;
+	int *stack = NULL;
+	size_t words, maxstates = 0;
+	u_int i, s, c, k, n;
+	u_int32_t lo = 0, hi = 0;
+
+	words = (p->nnodes + 31) / 32;
+	if ((stack = calloc(p->nnodes, sizeof(*stack))) == NULL)
+		goto fail;
+
+	/* class bounds from all AS numbers used in the expression */
+	if ((re->bounds = calloc(2 * p->nnodes + 1,
+	    sizeof(*re->bounds))) == NULL)
+		goto fail;
+	re->bounds[re->nbounds++] = 0;
+	for (i = 0; i < (u_int)p->nnodes; i++) {
+		if (p->nodes[i].type != RE_SYM)
+			continue;
+		re->bounds[re->nbounds++] = p->nodes[i].lo;
+		if (p->nodes[i].hi != UINT_MAX)
+			re->bounds[re->nbounds++] = p->nodes[i].hi + 1;
+	}
+	qsort(re->bounds, re->nbounds, sizeof(*re->bounds), re_bound_cmp);
+	for (i = 1, k = 1; i < re->nbounds; i++)
+		if (re->bounds[i] != re->bounds[k - 1])
+			re->bounds[k++] = re->bounds[i];
+	re->nbounds = k;
+	re->nclass = re->nbounds + 1;
+
+	/* state 0 is the dead state, state 1 the start state */
+	re->nstates = 2;
+	if (re_dfa_grow(re, p, &sets, words, &maxstates) == -1)
+		goto fail;
+	re_closure(p->nodes, f->start, sets + words, stack);
+
+	for (s = 0; s < re->nstates; s++) {
+		for (c = 0; c < re->nclass; c++) {
+			if (re_dfa_grow(re, p, &sets, words, &maxstates) == -1)
+				goto fail;
+			cur = sets + re->nstates * words;
+			memset(cur, 0, words * sizeof(*cur));
+			if (c < re->nbounds) {
+				lo = re->bounds[c];
+				hi = c + 1 < re->nbounds ?
+				    re->bounds[c + 1] - 1 : UINT_MAX;
+			}
+			for (n = 0; n < (u_int)p->nnodes; n++) {
+				if ((sets[s * words + n / 32] &
+				    (1U << (n % 32))) == 0)
+					continue;
+				if (p->nodes[n].type == RE_EPS)
+					continue;
+				if (p->nodes[n].type == RE_SYM &&
+				    (c >= re->nbounds || lo < p->nodes[n].lo ||
+				    hi > p->nodes[n].hi))
+					continue;
+				re_closure(p->nodes, p->nodes[n].out[0],
+				    cur, stack);
+			}
+			if (s != RE_DEAD && !anchor_start)
+				re_closure(p->nodes, f->start, cur, stack);
+
+			for (k = 0; k < re->nstates; k++)
+				if (memcmp(sets + k * words, cur,
+				    words * sizeof(*cur)) == 0)
+					break;
+			if (k == re->nstates)
+				re->nstates++;
+			re->trans[s * re->nclass + c] = k;
+		}
+	}
+
+	if ((re->accept = calloc(re->nstates, sizeof(*re->accept))) == NULL)
+		goto fail;
+	for (s = 0; s < re->nstates; s++)
+		re->accept[s] = (sets[s * words + f->end / 32] &
+		    (1U << (f->end % 32))) != 0;
+
+	free(sets);
+	free(stack);
+	return 0;
+
+fail:
+	if (p->errstr == NULL)
+		p->errstr = "out of memory";
+	free(sets);
+	free(stack);
+	return -1;
+}
+
+/*
+ * Compile the expression, on error NULL is returned and errstr is set.
+ */
+struct aspath_re *
+aspath_re_compile(const char *str, const char **errstr)
+{
+	struct re_parse p;
+	struct re_frag f;
+	struct aspath_re *re;
+	int anchor_start = 0;
+
+	memset(&p, 0, sizeof(p));
+	if ((re = calloc(1, sizeof(*re))) == NULL ||
+	    (p.nodes = calloc(RE_MAXNODES, sizeof(*p.nodes))) == NULL) {
+		*errstr = "out of memory";
+		free(re);
+		return NULL;
+	}
+
+	p.s = str;
+	re_skipws(&p);
+	if (*p.s == '^') {
+		p.s++;
+		anchor_start = 1;
+	}
+	if (re_alt(&p, &f) == -1)
+		goto fail;
+	re_skipws(&p);
+	if (*p.s == '$') {
+		p.s++;
+		re->anchor_end = 1;
+		re_skipws(&p);
+	}
+	if (*p.s != '\0') {
+		p.errstr = *p.s == ')' ? "unbalanced ')'" :
+		    "unexpected character";
+		goto fail;
+	}
+	if (re_dfa(re, &p, &f, anchor_start) == -1)
+		goto fail;
+
+	free(p.nodes);
+	return re;
+
+fail:
+	*errstr = p.errstr;
+	free(p.nodes);
+	aspath_re_free(re);
+	return NULL;
+}
+
+void
+aspath_re_free(struct aspath_re *re)
+{
+	if (re == NULL)
+		return;
+	free(re->bounds);
+	free(re->trans);
+	free(re->accept);
+	free(re);
+}
+
+int
+aspath_re_match(const struct aspath_re *re, struct aspath *aspath)
+{
+	const u_int8_t	*seg;
+	u_int16_t	 len, seg_size;
+	u_int8_t	 i, seg_len;
+	u_int		 s = RE_START;
+
+	seg = aspath->data;
+	for (len = aspath->len; len > 0; len -= seg_size, seg += seg_size) {
+		seg_len = seg[1];
+		seg_size = 2 + sizeof(u_int32_t) * seg_len;
+
+		if (seg_size > len)
+			fatalx("%s: would overflow", __func__);
+
+		for (i = 0; i < seg_len; i++) {
+			if (!re->anchor_end && re->accept[s])
+				return 1;
+			if (seg[0] == AS_SET || seg[0] == AS_CONFED_SET) {
+				s = re->trans[s * re->nclass + re->nbounds];
+				break;
+			}
+			s = re->trans[s * re->nclass +
+			    re_class(re, aspath_extract(seg, i))];
+			if (s == RE_DEAD)
+				return 0;
+		}
+		if (s == RE_DEAD)
+			return 0;
+	}
+	return re->accept[s];
+}
@@ -59,6 +59,9 @@ struct rib_context {
 	void		(*ctx_done)(void *, u_int8_t);
 	int		(*ctx_throttle)(void *);
 	void				*ctx_arg;
+	struct rib_subtree		*ctx_subtree;
+	size_t				 ctx_nsubtree;
+	size_t				 ctx_cursubtree;
 	unsigned int			 ctx_count;
 	u_int8_t			 ctx_aid;
 };
@@ -418,27 +421,74 @@ rib_restart(struct rib_context *ctx)
 	return (re);
 }
 
+static int
+rib_in_subtree(struct rib_entry *re, struct rib_subtree *st)
+{
+	struct bgpd_addr	addr;
+
+	if (re->prefix->aid != st->prefix.aid)
+		return 0;
+	pt_getaddr(re->prefix, &addr);
+	return prefix_compare(&addr, &st->prefix, st->prefixlen) == 0;
+}
+
+/*
+ * Find the first entry of the current or a following subtree. The tree
+ * is sorted by address first so the entries of a subtree are adjacent.
+ */
+static struct rib_entry *
+rib_subtree_first(struct rib_context *ctx, struct rib *rib)
+{
+	struct rib_entry	 xre, *re;
+	struct rib_subtree	*st;
+
+	for (; ctx->ctx_cursubtree < ctx->ctx_nsubtree;
+	    ctx->ctx_cursubtree++) {
+		st = &ctx->ctx_subtree[ctx->ctx_cursubtree];
+		memset(&xre, 0, sizeof(xre));
+		xre.prefix = pt_fill(&st->prefix, st->prefixlen);
+		re = RB_NFIND(rib_tree, rib_tree(rib), &xre);
+		if (re != NULL && rib_in_subtree(re, st))
+			return re;
+	}
+	return NULL;
+}
+
 static void
 rib_dump_r(struct rib_context *ctx)
 {
 	struct rib_entry	*re, *next;
 	struct rib		*rib;
+	struct rib_subtree	*st;
 	unsigned int		 i;
 
 	rib = rib_byid(ctx->ctx_id);
 	if (rib == NULL)
 		fatalx("%s: rib id %u gone", __func__, ctx->ctx_id);
 
-	if (ctx->ctx_re == NULL)
-		re = RB_MIN(rib_tree, rib_tree(rib));
-	else
+	if (ctx->ctx_re != NULL)
 		re = rib_restart(ctx);
+	else if (ctx->ctx_subtree != NULL)
+		re = rib_subtree_first(ctx, rib);
+	else
+		re = RB_MIN(rib_tree, rib_tree(rib));
 
 	for (i = 0; re != NULL; re = next) {
 		next = RB_NEXT(rib_tree, unused, re);
 		if (re->rib_id != ctx->ctx_id)
 			fatalx("%s: Unexpected RIB %u != %u.", __func__,
 			    re->rib_id, ctx->ctx_id);
+		if (ctx->ctx_subtree != NULL) {
+			st = &ctx->ctx_subtree[ctx->ctx_cursubtree];
+			if (!rib_in_subtree(re, st)) {
+				/* continue with the next subtree */
+				ctx->ctx_cursubtree++;
+				next = rib_subtree_first(ctx, rib);
+				continue;
+			}
+			if (re->prefix->prefixlen < st->prefixlen)
+				continue;
+		}
 		if (ctx->ctx_aid != AID_UNSPEC &&
 		    ctx->ctx_aid != re->prefix->aid)
 			continue;
@@ -550,6 +600,39 @@ rib_dump_new(u_int16_t id, u_int8_t aid, unsigned int count, void *arg,
 	return 0;
 }
 
+/*
+ * Like rib_dump_new() but only call upcall for the entries covered by
+ * one of the nsubtree subtrees. nsubtree must not be 0 and the subtree
+ * array must stay valid until done is called.
+ */
+int
+rib_dump_subtree(u_int16_t id, struct rib_subtree *subtree, size_t nsubtree,
+    unsigned int count, void *arg, void (*upcall)(struct rib_entry *, void *),
+    void (*done)(void *, u_int8_t), int (*throttle)(void *))
+{
+	struct rib_context *ctx;
+
+	if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+		return -1;
+	ctx->ctx_id = id;
+	ctx->ctx_aid = AID_UNSPEC;
+	ctx->ctx_count = count;
+	ctx->ctx_arg = arg;
+	ctx->ctx_rib_call = upcall;
+	ctx->ctx_done = done;
+	ctx->ctx_throttle = throttle;
+	ctx->ctx_subtree = subtree;
+	ctx->ctx_nsubtree = nsubtree;
+
+	LIST_INSERT_HEAD(&rib_dumps, ctx, entry);
+
+	/* requested a sync traversal */
+	if (count == 0)
+		rib_dump_r(ctx);
+
+	return 0;
+}
+
 /* path specific functions */
 
 static struct rde_aspath *path_lookup(struct rde_aspath *);
@@ -860,6 +943,8 @@ static void	prefix_link(struct prefix *, struct rib_entry *,
 		     struct rde_community *, struct nexthop *,
 		     u_int8_t, u_int8_t);
 static void	prefix_unlink(struct prefix *);
+static void	prefix_stats_link(struct prefix *);
+static void	prefix_stats_unlink(struct prefix *);
 
 static struct prefix	*prefix_alloc(void);
 static void		 prefix_free(struct prefix *);
@@ -980,7 +1065,7 @@ prefix_update(struct rib *rib, struct rde_peer *peer, struct filterstate *state,
 		    path_compare(nasp, prefix_aspath(p)) == 0) {
 			/* no change, update last change */
 			p->lastchange = getmonotime();
-			p->validation_state = vstate;
+			prefix_set_vstate(p, vstate);
 			return (0);
 		}
 	}
@@ -1054,6 +1139,8 @@ prefix_move(struct prefix *p, struct rde_peer *peer,
 	np->nhflags = nhflags;
 	np->nexthop = nexthop_ref(nexthop);
 	nexthop_link(np);
+	index_link(np);
+	prefix_stats_link(np);
 	np->lastchange = getmonotime();
 
 	/*
@@ -1076,6 +1163,8 @@ prefix_move(struct prefix *p, struct rde_peer *peer,
 	/* as before peer count needs no update because of move */
 
 	/* destroy all references to other objects and free the old prefix */
+	prefix_stats_unlink(p);
+	index_unlink(p);
 	nexthop_unlink(p);
 	nexthop_unref(p->nexthop);
 	communities_unref(p->communities);
@@ -1150,6 +1239,7 @@ prefix_adjout_update(struct rde_peer *peer, struct filterstate *state,
 		/* prefix is already in the Adj-RIB-Out */
 		if (p->flags & PREFIX_FLAG_WITHDRAW) {
 			created = 1;	/* consider this a new entry */
+			peer->prefix_suppressed++;
 			peer->up_wcnt--;
 			prefix_head = &peer->withdraws[prefix->aid];
 			RB_REMOVE(prefix_tree, prefix_head, p);
@@ -1171,6 +1261,7 @@ prefix_adjout_update(struct rde_peer *peer, struct filterstate *state,
 
 			if (p->flags & PREFIX_FLAG_UPDATE) {
 				/* created = 0 so up_nlricnt is not increased */
+				peer->prefix_suppressed++;
 				prefix_head = &peer->updates[prefix->aid];
 				RB_REMOVE(prefix_tree, prefix_head, p);
 			}
@@ -1220,6 +1311,7 @@ prefix_adjout_update(struct rde_peer *peer, struct filterstate *state,
 	p->flags |= PREFIX_FLAG_UPDATE;
 	if (RB_INSERT(prefix_tree, &peer->updates[prefix->aid], p) != NULL)
 		fatalx("%s: RB tree invariant violated", __func__);
+	latency_enqueue(peer);
 
 	return created;
 }
@@ -1245,8 +1337,10 @@ prefix_adjout_withdraw(struct rde_peer *peer, struct bgpd_addr *prefix,
 		return (0);
 	}
 	/* pending update just got withdrawn */
-	if (p->flags & PREFIX_FLAG_UPDATE)
+	if (p->flags & PREFIX_FLAG_UPDATE) {
 		RB_REMOVE(prefix_tree, &peer->updates[p->pt->aid], p);
+		peer->prefix_suppressed++;
+	}
 	/* nothing needs to be done for PREFIX_FLAG_DEAD and STALE */
 	p->flags &= ~PREFIX_FLAG_MASK;
 
@@ -1272,6 +1366,7 @@ prefix_adjout_withdraw(struct rde_peer *peer, struct bgpd_addr *prefix,
 	p->flags |= PREFIX_FLAG_WITHDRAW;
 	if (RB_INSERT(prefix_tree, &peer->withdraws[prefix->aid], p) != NULL)
 		fatalx("%s: RB tree invariant violated", __func__);
+	latency_enqueue(peer);
 	return (1);
 }
 
@@ -1551,6 +1646,8 @@ prefix_evaluate_all(struct prefix *p, enum nexthop_state state,
 		return;
 	}
 
+	prefix_stats_eligible(p);
+
 	/* redo the route decision */
 	LIST_REMOVE(p, entry.list.rib);
 	/*
@@ -1566,6 +1663,74 @@ prefix_evaluate_all(struct prefix *p, enum nexthop_state state,
 	prefix_evaluate(p, p->re);
 }
 
+/*
+ * Per RIB and AID counters, kept up to date as prefixes are linked and
+ * unlinked. Eligibility is only tracked in RIBs with a decision process,
+ * PREFIX_ELIGIBLE remembers if the prefix is currently counted.
+ */
+static void
+prefix_stats_link(struct prefix *p)
+{
+	struct rib		*rib = re_rib(p->re);
+	struct rib_stats	*rs = &rib->stats[p->pt->aid];
+
+	rs->prefix_cnt++;
+	rs->ovs_cnt[p->validation_state & ROA_MASK]++;
+	p->flags &= ~PREFIX_ELIGIBLE;
+	if ((rib->flags & F_RIB_NOEVALUATE) == 0 && prefix_eligible(p)) {
+		p->flags |= PREFIX_ELIGIBLE;
+		rs->eligible_cnt++;
+	}
+}
+
+static void
+prefix_stats_unlink(struct prefix *p)
+{
+	struct rib_stats	*rs;
+
+	if (p->re == NULL)
+		return;
+	rs = &re_rib(p->re)->stats[p->pt->aid];
+	rs->prefix_cnt--;
+	rs->ovs_cnt[p->validation_state & ROA_MASK]--;
+	if (p->flags & PREFIX_ELIGIBLE) {
+		p->flags &= ~PREFIX_ELIGIBLE;
+		rs->eligible_cnt--;
+	}
+}
+
+/*
+ * Recount the prefix after the state of its nexthop or the decision
+ * process of its RIB changed.
+ */
+void
+prefix_stats_eligible(struct prefix *p)
+{
+	struct rib		*rib = re_rib(p->re);
+	struct rib_stats	*rs = &rib->stats[p->pt->aid];
+
+	if ((rib->flags & F_RIB_NOEVALUATE) == 0 && prefix_eligible(p)) {
+		if ((p->flags & PREFIX_ELIGIBLE) == 0) {
+			p->flags |= PREFIX_ELIGIBLE;
+			rs->eligible_cnt++;
+		}
+	} else if (p->flags & PREFIX_ELIGIBLE) {
+		p->flags &= ~PREFIX_ELIGIBLE;
+		rs->eligible_cnt--;
+	}
+}
+
+/* change the origin validation state of a prefix in a RIB */
+void
+prefix_set_vstate(struct prefix *p, u_int8_t vstate)
+{
+	struct rib_stats	*rs = &re_rib(p->re)->stats[p->pt->aid];
+
+	rs->ovs_cnt[p->validation_state & ROA_MASK]--;
+	rs->ovs_cnt[vstate & ROA_MASK]++;
+	p->validation_state = vstate;
+}
+
 /* kill a prefix. */
 void
 prefix_destroy(struct prefix *p)
@@ -1595,6 +1760,8 @@ prefix_link(struct prefix *p, struct rib_entry *re, struct rde_peer *peer,
 	p->nhflags = nhflags;
 	p->nexthop = nexthop_ref(nexthop);
 	nexthop_link(p);
+	index_link(p);
+	prefix_stats_link(p);
 	p->lastchange = getmonotime();
 
 	/* make route decision */
@@ -1610,6 +1777,8 @@ prefix_unlink(struct prefix *p)
 	struct rib_entry	*re = p->re;
 
 	/* destroy all references to other objects */
+	prefix_stats_unlink(p);
+	index_unlink(p);
 	nexthop_unlink(p);
 	nexthop_unref(p->nexthop);
 	communities_unref(p->communities);
@@ -24,16 +24,34 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #include "rde.h"
 
+/*
+ * The elements are kept sorted by their first u_int32_t. For membership
+ * tests of larger sets set_prep() additionally builds a read-only index:
+ * the 16-bit keys go into a bitmap if that is dense enough and all other
+ * keys are stored in Eytzinger (BFS) order which allows a branch-free
+ * search that touches only the first few cache lines for the top levels.
+ * Any modification of the set drops the index until the next set_prep().
+ */
+#define SET_INDEX_MIN	16		/* smaller sets use bsearch() */
+#define SET_BITMAP_MAX	0xffff		/* highest key in the bitmap */
+
 struct set_table {
 	void			*set;
 	size_t			 nmemb;
 	size_t			 size;
 	size_t			 max;
+	u_int32_t		*eytz;		/* 1-based, eytz[0] unused */
+	size_t			 neytz;
+	u_int32_t		*bitmap;
+	size_t			 nbitmap;	/* in words */
 };
 
+static void	set_index_free(struct set_table *);
+
 struct as_set *
 as_sets_new(struct as_set_head *as_sets, const char *name, size_t nmemb,
     size_t size)
@@ -98,10 +116,31 @@ as_sets_mark_dirty(struct as_set_head *old, struct as_set_head *new)
 	}
 }
 
+static int
+set_member(const struct set_table *a, u_int32_t asnum)
+{
+	u_int32_t k;
+
+	if (a == NULL)
+		return 0;
+	if (a->eytz == NULL && a->bitmap == NULL)
+		return set_match(a, asnum) != NULL;
+
+	if (a->bitmap != NULL && asnum <= SET_BITMAP_MAX)
+		return asnum / 32 < a->nbitmap &&
+		    (a->bitmap[asnum / 32] & (1U << (asnum % 32)));
+
+	/* descend to the leaf, then back to the last step to the right */
+	for (k = 1; k <= a->neytz; )
+		k = 2 * k + (a->eytz[k] < asnum);
+	k >>= ffs(~k);
+	return k != 0 && a->eytz[k] == asnum;
+}
+
 int
 as_set_match(const struct as_set *aset, u_int32_t asnum)
 {
-	return set_match(aset->set, asnum) != NULL;
+	return set_member(aset->set, asnum);
 }
 
 struct set_table *
@@ -139,6 +178,7 @@ set_free(struct set_table *set)
 	rdemem.aset_size -= sizeof(*set);
 	rdemem.aset_size -= set->size * set->max;
 	rdemem.aset_nmemb -= set->nmemb;
+	set_index_free(set);
 	free(set->set);
 	free(set);
 }
@@ -146,6 +186,7 @@ set_free(struct set_table *set)
 int
 set_add(struct set_table *set, void *elms, size_t nelms)
 {
+	set_index_free(set);
 	if (set->max < nelms || set->max - nelms < set->nmemb) {
 		u_int32_t *s;
 		size_t new_size;
@@ -173,6 +214,23 @@ set_add(struct set_table *set, void *elms, size_t nelms)
 	return 0;
 }
 
+/* remove the element with key asnum, the set needs to be prepped */
+int
+set_del(struct set_table *set, u_int32_t asnum)
+{
+	u_int8_t	*e, *end;
+
+	if ((e = set_match(set, asnum)) == NULL)
+		return -1;
+	set_index_free(set);
+	end = (u_int8_t *)set->set + set->nmemb * set->size;
+	memmove(e, e + set->size, end - e - set->size);
+	set->nmemb--;
+	rdemem.aset_nmemb--;
+
+	return 0;
+}
+
 void *
 set_get(struct set_table *set, size_t *nelms)
 {
@@ -193,19 +251,115 @@ set_cmp(const void *ap, const void *bp)
 	return 0;
 }
 
+static void
+set_index_free(struct set_table *set)
+{
+	if (set->eytz != NULL)
+		rdemem.aset_size -= (set->neytz + 1) * sizeof(*set->eytz);
+	rdemem.aset_size -= set->nbitmap * sizeof(*set->bitmap);
+	free(set->eytz);
+	free(set->bitmap);
+	set->eytz = NULL;
+	set->bitmap = NULL;
+	set->neytz = 0;
+	set->nbitmap = 0;
+}
+
+static inline u_int32_t
+set_key(const struct set_table *set, size_t i)
+{
+	u_int32_t key;
+
+	memcpy(&key, (u_int8_t *)set->set + i * set->size, sizeof(key));
+	return key;
+}
+
+/* fill the Eytzinger array with an in-order walk over the sorted keys */
+static size_t
+set_eytz_fill(struct set_table *set, size_t i, size_t k, size_t off)
+{
+	if (k <= set->neytz) {
+		i = set_eytz_fill(set, i, 2 * k, off);
+		set->eytz[k] = set_key(set, off + i++);
+		i = set_eytz_fill(set, i, 2 * k + 1, off);
+	}
+	return i;
+}
+
+static void
+set_index(struct set_table *set)
+{
+	size_t i, nlow;
+	u_int32_t key;
+
+	if (set->nmemb < SET_INDEX_MIN || set->nmemb > UINT32_MAX / 4)
+		return;
+
+	for (nlow = 0; nlow < set->nmemb; nlow++)
+		if (set_key(set, nlow) > SET_BITMAP_MAX)
+			break;
+
+	/* use the bitmap only if it is smaller than the keys it replaces */
+	if (nlow > 0) {
+		key = set_key(set, nlow - 1);
+		set->nbitmap = key / 32 + 1;
+		if (set->nbitmap > nlow)
+			set->nbitmap = 0;
+	}
+	if (set->nbitmap != 0) {
+		set->bitmap = calloc(set->nbitmap, sizeof(*set->bitmap));
+		if (set->bitmap == NULL)
+			goto fail;
+		for (i = 0; i < nlow; i++) {
+			key = set_key(set, i);
+			set->bitmap[key / 32] |= 1U << (key % 32);
+		}
+		rdemem.aset_size += set->nbitmap * sizeof(*set->bitmap);
+	} else
+		nlow = 0;
+
+	set->neytz = set->nmemb - nlow;
+	if (set->neytz == 0)
+		return;
+	set->eytz = reallocarray(NULL, set->neytz + 1, sizeof(*set->eytz));
+	if (set->eytz == NULL)
+		goto fail;
+	rdemem.aset_size += (set->neytz + 1) * sizeof(*set->eytz);
+	set->eytz[0] = 0;
+	set_eytz_fill(set, 0, 1, nlow);
+	return;
+
+fail:
+	/* fall back to bsearch() */
+	set_index_free(set);
+}
+
 void
 set_prep(struct set_table *set)
 {
 	if (set == NULL)
 		return;
+	set_index_free(set);
 	qsort(set->set, set->nmemb, set->size, set_cmp);
+	set_index(set);
 }
 
 void *
 set_match(const struct set_table *a, u_int32_t asnum)
 {
+	size_t i;
+
 	if (a == NULL)
 		return NULL;
+	/* the source-as sets of roas are tiny, a scan is quicker */
+	if (a->nmemb < SET_INDEX_MIN) {
+		for (i = 0; i < a->nmemb; i++)
+			if (set_key(a, i) >= asnum)
+				break;
+		if (i < a->nmemb && set_key(a, i) == asnum)
+			return (u_int8_t *)a->set + i * a->size;
+		return NULL;
+	}
 	return bsearch(&asnum, a->set, a->nmemb, a->size, set_cmp);
 }
 
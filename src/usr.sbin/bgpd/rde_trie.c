@@ -73,6 +73,44 @@ struct tentry_v6 {
 	u_int8_t		 node;
 };
 
+/*
+ * Compiled read-only multibit trie, built by trie_compile() from the
+ * binary trie once a set is loaded. Each level consumes TRIE_STRIDE bits
+ * of the address. A real node with prefixlen plen is expanded into all
+ * slots of the level containing bit plen - 1 it covers, a slot keeps the
+ * most specific one. Every entry links to the next less specific real
+ * node covering it so a lookup walks the levels and then follows parent
+ * links until the prefixlen fits. Nodes and entries are kept in two
+ * arrays and reference each other by index.
+ * Any change to the binary trie drops the compiled copy again.
+ */
+#define TRIE_STRIDE	4
+#define TRIE_SLOTS	(1 << TRIE_STRIDE)
+
+struct tmulti_node {
+	struct {
+		u_int32_t	 child;		/* node index, 0 none */
+		u_int32_t	 entry;		/* entry index + 1 */
+	}			 slot[TRIE_SLOTS];
+};
+
+struct tmulti_entry {
+	struct set_table	*set;
+	struct in6_addr		 plenmask;
+	u_int32_t		 parent;		/* entry index + 1 */
+	u_int8_t		 plen;
+};
+
+struct trie_multi {
+	struct tmulti_node	*nodes;
+	struct tmulti_entry	*entries;
+	size_t			 nnodes, maxnodes;
+	size_t			 nentries, maxentries;
+	u_int32_t		 root_entry;		/* prefixlen 0 */
+};
+
+static void	trie_uncompile(struct trie_head *);
+
 /*
  * Find first different bit between a & b starting from the MSB,
  * a & b have to be different.
@@ -142,7 +180,7 @@ inet6setbit(struct in6_addr *addr, u_int8_t bit)
 }
 
 static struct tentry_v4 *
-trie_add_v4(struct trie_head *th, struct in_addr *prefix, u_int8_t plen)
+trie_add_v4(struct tentry_v4 **root, struct in_addr *prefix, u_int8_t plen)
 {
 	struct tentry_v4 *n, *new, *b, **prev;
 	struct in_addr p;
@@ -150,15 +188,17 @@ trie_add_v4(struct trie_head *th, struct in_addr *prefix, u_int8_t plen)
 	inet4applymask(&p, prefix, plen);
 
 	/* walk tree finding spot to insert */
-	prev = &th->root_v4;
+	prev = root;
 	n = *prev;
 	while (n) {
-		struct in_addr mp;
+		struct in_addr mp, np;
 		u_int8_t minlen;
 
+		/* n may be more specific, compare only the common part */
 		minlen = n->plen > plen ? plen : n->plen;
 		inet4applymask(&mp, &p, minlen);
-		if (n->addr.s_addr !=  mp.s_addr) {
+		inet4applymask(&np, &n->addr, minlen);
+		if (np.s_addr != mp.s_addr) {
 			/*
 			 * out of path, insert intermediary node between
 			 * np and n, then insert n and new node there
@@ -222,7 +262,7 @@ trie_add_v4(struct trie_head *th, struct in_addr *prefix, u_int8_t plen)
 }
 
 static struct tentry_v6 *
-trie_add_v6(struct trie_head *th, struct in6_addr *prefix, u_int8_t plen)
+trie_add_v6(struct tentry_v6 **root, struct in6_addr *prefix, u_int8_t plen)
 {
 	struct tentry_v6 *n, *new, *b, **prev;
 	struct in6_addr p;
@@ -230,15 +270,17 @@ trie_add_v6(struct trie_head *th, struct in6_addr *prefix, u_int8_t plen)
 	inet6applymask(&p, prefix, plen);
 
 	/* walk tree finding spot to insert */
-	prev = &th->root_v6;
+	prev = root;
 	n = *prev;
 	while (n) {
-		struct in6_addr mp;
+		struct in6_addr mp, np;
 		u_int8_t minlen;
 
+		/* n may be more specific, compare only the common part */
 		minlen = n->plen > plen ? plen : n->plen;
 		inet6applymask(&mp, &p, minlen);
-		if (memcmp(&n->addr, &mp, sizeof(mp)) != 0) {
+		inet6applymask(&np, &n->addr, minlen);
+		if (memcmp(&np, &mp, sizeof(mp)) != 0) {
 			/*
 			 * out of path, insert intermediary node between
 			 * np and n, then insert n and new node there
@@ -301,15 +343,115 @@ trie_add_v6(struct trie_head *th, struct in6_addr *prefix, u_int8_t plen)
 	return new;
 }
 
+/*
+ * Bulk insert for large sets. The path from the root to the last inserted
+ * node is kept and the next insert starts from the deepest node on that
+ * path covering the new prefix. For sorted input, as sent by the parent,
+ * this is the direct parent most of the time so the trie is built bottom-up
+ * without walking down from the root. Unsorted input still works.
+ */
+static struct tentry_v4 *
+trie_bulk_v4(struct trie_bulk *tb, struct in_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v4 *t, *n, **prev;
+	struct in_addr p, mp;
+
+	inet4applymask(&p, prefix, plen);
+
+	/* unwind the path until a node covers the prefix */
+	while (tb->depth_v4 > 0) {
+		t = tb->path_v4[tb->depth_v4 - 1];
+		if (t->plen <= plen) {
+			inet4applymask(&mp, &p, t->plen);
+			if (t->addr.s_addr == mp.s_addr)
+				break;
+		}
+		tb->depth_v4--;
+	}
+
+	if (tb->depth_v4 == 0)
+		prev = &tb->th->root_v4;
+	else {
+		t = tb->path_v4[tb->depth_v4 - 1];
+		if (t->plen == plen) {
+			t->node = 1;
+			return t;
+		}
+		prev = &t->trie[inet4isset(&p, t->plen) ? 1 : 0];
+	}
+	if ((n = trie_add_v4(prev, &p, plen)) == NULL)
+		return NULL;
+
+	/* extend the path down to the new node */
+	t = *prev;
+	while (t != NULL) {
+		tb->path_v4[tb->depth_v4++] = t;
+		if (t == n)
+			break;
+		t = t->trie[inet4isset(&p, t->plen) ? 1 : 0];
+	}
+	return n;
+}
+
+static struct tentry_v6 *
+trie_bulk_v6(struct trie_bulk *tb, struct in6_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v6 *t, *n, **prev;
+	struct in6_addr p, mp;
+
+	inet6applymask(&p, prefix, plen);
+
+	/* unwind the path until a node covers the prefix */
+	while (tb->depth_v6 > 0) {
+		t = tb->path_v6[tb->depth_v6 - 1];
+		if (t->plen <= plen) {
+			inet6applymask(&mp, &p, t->plen);
+			if (memcmp(&t->addr, &mp, sizeof(mp)) == 0)
+				break;
+		}
+		tb->depth_v6--;
+	}
+
+	if (tb->depth_v6 == 0)
+		prev = &tb->th->root_v6;
+	else {
+		t = tb->path_v6[tb->depth_v6 - 1];
+		if (t->plen == plen) {
+			t->node = 1;
+			return t;
+		}
+		prev = &t->trie[inet6isset(&p, t->plen) ? 1 : 0];
+	}
+	if ((n = trie_add_v6(prev, &p, plen)) == NULL)
+		return NULL;
+
+	/* extend the path down to the new node */
+	t = *prev;
+	while (t != NULL) {
+		tb->path_v6[tb->depth_v6++] = t;
+		if (t == n)
+			break;
+		t = t->trie[inet6isset(&p, t->plen) ? 1 : 0];
+	}
+	return n;
+}
+
+void
+trie_bulk_init(struct trie_bulk *tb, struct trie_head *th)
+{
+	memset(tb, 0, sizeof(*tb));
+	tb->th = th;
+}
+
 /*
  * Insert prefix/plen into the trie with a prefixlen mask covering min - max.
  * If plen == min == max then only the prefix/plen will match and no longer
  * match is possible. Else all prefixes under prefix/plen with a prefixlen
  * between min and max will match.
  */
-int
-trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
-    u_int8_t min, u_int8_t max)
+static int
+trie_insert(struct trie_head *th, struct trie_bulk *tb,
+    struct bgpd_addr *prefix, u_int8_t plen, u_int8_t min, u_int8_t max)
 {
 	struct tentry_v4 *n4;
 	struct tentry_v6 *n6;
@@ -321,6 +463,8 @@ trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 	if (prefix->aid != AID_INET && prefix->aid != AID_INET6)
 		return -1;
 
+	trie_uncompile(th);
+
 	/*
 	 * Check for default route, this is special cased since prefixlen 0
 	 * can't be checked in the prefixlen mask plenmask.  Also there is
@@ -342,7 +486,10 @@ trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 		if (max > 32)
 			return -1;
 
-		n4 = trie_add_v4(th, &prefix->v4, plen);
+		if (tb != NULL)
+			n4 = trie_bulk_v4(tb, &prefix->v4, plen);
+		else
+			n4 = trie_add_v4(&th->root_v4, &prefix->v4, plen);
 		if (n4 == NULL)
 			return -1;
 		/*
@@ -357,7 +504,10 @@ trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 		if (max > 128)
 			return -1;
 
-		n6 = trie_add_v6(th, &prefix->v6, plen);
+		if (tb != NULL)
+			n6 = trie_bulk_v6(tb, &prefix->v6, plen);
+		else
+			n6 = trie_add_v6(&th->root_v6, &prefix->v6, plen);
 		if (n6 == NULL)
 			return -1;
 
@@ -369,6 +519,20 @@ trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 	return 0;
 }
 
+int
+trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
+    u_int8_t min, u_int8_t max)
+{
+	return trie_insert(th, NULL, prefix, plen, min, max);
+}
+
+int
+trie_bulk_add(struct trie_bulk *tb, struct bgpd_addr *prefix, u_int8_t plen,
+    u_int8_t min, u_int8_t max)
+{
+	return trie_insert(tb->th, tb, prefix, plen, min, max);
+}
+
 /*
  * Insert a ROA entry for prefix/plen. The prefix will insert a set with
  * source_as and the maxlen as data. This makes it possible to validate if a
@@ -377,9 +541,9 @@ trie_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
  * be used to cover a large prefix as ROA_INVALID unless a more specific route
  * is a match.
  */
-int
-trie_roa_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
-    struct set_table *set)
+static int
+trie_roa_insert(struct trie_head *th, struct trie_bulk *tb,
+    struct bgpd_addr *prefix, u_int8_t plen, struct set_table *set)
 {
 	struct tentry_v4 *n4;
 	struct tentry_v6 *n6;
@@ -387,12 +551,17 @@ trie_roa_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 
 	/* ignore possible default route since it does not make sense */
 
+	trie_uncompile(th);
+
 	switch (prefix->aid) {
 	case AID_INET:
 		if (plen > 32)
 			return -1;
 
-		n4 = trie_add_v4(th, &prefix->v4, plen);
+		if (tb != NULL)
+			n4 = trie_bulk_v4(tb, &prefix->v4, plen);
+		else
+			n4 = trie_add_v4(&th->root_v4, &prefix->v4, plen);
 		if (n4 == NULL)
 			return -1;
 		stp = &n4->set;
@@ -401,7 +570,10 @@ trie_roa_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 		if (plen > 128)
 			return -1;
 
-		n6 = trie_add_v6(th, &prefix->v6, plen);
+		if (tb != NULL)
+			n6 = trie_bulk_v6(tb, &prefix->v6, plen);
+		else
+			n6 = trie_add_v6(&th->root_v6, &prefix->v6, plen);
 		if (n6 == NULL)
 			return -1;
 		stp = &n6->set;
@@ -419,6 +591,20 @@ trie_roa_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 	return 0;
 }
 
+int
+trie_roa_add(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
+    struct set_table *set)
+{
+	return trie_roa_insert(th, NULL, prefix, plen, set);
+}
+
+int
+trie_bulk_roa_add(struct trie_bulk *tb, struct bgpd_addr *prefix,
+    u_int8_t plen, struct set_table *set)
+{
+	return trie_roa_insert(tb->th, tb, prefix, plen, set);
+}
+
 static void
 trie_free_v4(struct tentry_v4 *n)
 {
@@ -445,13 +631,288 @@ trie_free_v6(struct tentry_v6 *n)
 	rdemem.pset_size -= sizeof(*n);
 }
 
+static void
+trie_multi_free(struct trie_multi *tm)
+{
+	if (tm == NULL)
+		return;
+	rdemem.pset_size -= tm->maxnodes * sizeof(*tm->nodes) +
+	    tm->maxentries * sizeof(*tm->entries) + sizeof(*tm);
+	free(tm->nodes);
+	free(tm->entries);
+	free(tm);
+}
+
+/* drop the compiled copy, called before any change of the trie */
+static void
+trie_uncompile(struct trie_head *th)
+{
+	trie_multi_free(th->multi_v4);
+	trie_multi_free(th->multi_v6);
+	th->multi_v4 = NULL;
+	th->multi_v6 = NULL;
+}
+
 void
 trie_free(struct trie_head *th)
 {
+	trie_uncompile(th);
 	trie_free_v4(th->root_v4);
 	trie_free_v6(th->root_v6);
 }
 
+/* bits level * TRIE_STRIDE to level * TRIE_STRIDE + TRIE_STRIDE - 1 */
+static inline u_int
+trie_multi_slot(const u_int8_t *addr, u_int level)
+{
+	return (addr[level / 2] >> (level % 2 ? 0 : 4)) & (TRIE_SLOTS - 1);
+}
+
+static u_int32_t
+trie_multi_node(struct trie_multi *tm)
+{
+	struct tmulti_node *n;
+	size_t newmax;
+
+	if (tm->nnodes == tm->maxnodes) {
+		newmax = tm->maxnodes == 0 ? 64 : tm->maxnodes * 2;
+		if (newmax > UINT32_MAX)
+			return 0;
+		n = reallocarray(tm->nodes, newmax, sizeof(*n));
+		if (n == NULL)
+			return 0;
+		rdemem.pset_size += (newmax - tm->maxnodes) * sizeof(*n);
+		tm->nodes = n;
+		tm->maxnodes = newmax;
+	}
+	memset(&tm->nodes[tm->nnodes], 0, sizeof(*tm->nodes));
+	return tm->nnodes++;
+}
+
+/* add a real node as entry and expand it into the slots it covers */
+static u_int32_t
+trie_multi_add(struct trie_multi *tm, const void *addr, u_int8_t plen,
+    const void *plenmask, size_t masklen, struct set_table *set,
+    u_int32_t parent)
+{
+	struct tmulti_entry *e;
+	const u_int8_t *a = addr;
+	size_t newmax;
+	u_int32_t idx, n, c, s, first, last;
+	u_int level, depth;
+
+	if (tm->nentries == tm->maxentries) {
+		newmax = tm->maxentries == 0 ? 64 : tm->maxentries * 2;
+		if (newmax >= UINT32_MAX)
+			return 0;
+		e = reallocarray(tm->entries, newmax, sizeof(*e));
+		if (e == NULL)
+			return 0;
+		rdemem.pset_size += (newmax - tm->maxentries) * sizeof(*e);
+		tm->entries = e;
+		tm->maxentries = newmax;
+	}
+	e = &tm->entries[tm->nentries];
+	memset(e, 0, sizeof(*e));
+	memcpy(&e->plenmask, plenmask, masklen);
+	e->set = set;
+	e->parent = parent;
+	e->plen = plen;
+	idx = ++tm->nentries;
+
+	if (plen == 0) {
+		tm->root_entry = idx;
+		return idx;
+	}
+
+	/* walk down to the level holding bit plen - 1 */
+	depth = (plen - 1) / TRIE_STRIDE;
+	n = 0;
+	for (level = 0; level < depth; level++) {
+		s = trie_multi_slot(a, level);
+		if ((c = tm->nodes[n].slot[s].child) == 0) {
+			if ((c = trie_multi_node(tm)) == 0)
+				return 0;
+			tm->nodes[n].slot[s].child = c;
+		}
+		n = c;
+	}
+
+	/* expand, the free bits of the slot index are covered by plen */
+	s = (level + 1) * TRIE_STRIDE - plen;
+	first = trie_multi_slot(a, level) & ~((1U << s) - 1);
+	last = first + (1U << s);
+	for (s = first; s < last; s++) {
+		c = tm->nodes[n].slot[s].entry;
+		if (c == 0 || tm->entries[c - 1].plen < plen)
+			tm->nodes[n].slot[s].entry = idx;
+	}
+	return idx;
+}
+
+static int
+trie_compile_v4(struct trie_multi *tm, struct tentry_v4 *n, u_int32_t parent)
+{
+	if (n == NULL)
+		return 0;
+	if (n->node) {
+		parent = trie_multi_add(tm, &n->addr, n->plen, &n->plenmask,
+		    sizeof(n->plenmask), n->set, parent);
+		if (parent == 0)
+			return -1;
+	}
+	if (trie_compile_v4(tm, n->trie[0], parent) == -1 ||
+	    trie_compile_v4(tm, n->trie[1], parent) == -1)
+		return -1;
+	return 0;
+}
+
+static int
+trie_compile_v6(struct trie_multi *tm, struct tentry_v6 *n, u_int32_t parent)
+{
+	if (n == NULL)
+		return 0;
+	if (n->node) {
+		parent = trie_multi_add(tm, &n->addr, n->plen, &n->plenmask,
+		    sizeof(n->plenmask), n->set, parent);
+		if (parent == 0)
+			return -1;
+	}
+	if (trie_compile_v6(tm, n->trie[0], parent) == -1 ||
+	    trie_compile_v6(tm, n->trie[1], parent) == -1)
+		return -1;
+	return 0;
+}
+
+/* release the unused space of the growable arrays */
+static void
+trie_multi_shrink(struct trie_multi *tm)
+{
+	struct tmulti_node *n;
+	struct tmulti_entry *e;
+
+	if ((n = reallocarray(tm->nodes, tm->nnodes, sizeof(*n))) != NULL) {
+		rdemem.pset_size -= (tm->maxnodes - tm->nnodes) * sizeof(*n);
+		tm->nodes = n;
+		tm->maxnodes = tm->nnodes;
+	}
+	if (tm->nentries == 0)
+		return;
+	if ((e = reallocarray(tm->entries, tm->nentries, sizeof(*e))) != NULL) {
+		rdemem.pset_size -= (tm->maxentries - tm->nentries) *
+		    sizeof(*e);
+		tm->entries = e;
+		tm->maxentries = tm->nentries;
+	}
+}
+
+static struct trie_multi *
+trie_multi_new(void)
+{
+	struct trie_multi *tm;
+
+	if ((tm = calloc(1, sizeof(*tm))) == NULL)
+		return NULL;
+	rdemem.pset_size += sizeof(*tm);
+	/* node 0 is the root */
+	if (trie_multi_node(tm) != 0) {
+		trie_multi_free(tm);
+		return NULL;
+	}
+	return tm;
+}
+
+/*
+ * Build the compiled lookup tables for a trie. On failure the binary
+ * trie is used for lookups.
+ */
+int
+trie_compile(struct trie_head *th)
+{
+	trie_uncompile(th);
+
+	if (th->root_v4 != NULL) {
+		if ((th->multi_v4 = trie_multi_new()) == NULL ||
+		    trie_compile_v4(th->multi_v4, th->root_v4, 0) == -1)
+			goto fail;
+		trie_multi_shrink(th->multi_v4);
+	}
+	if (th->root_v6 != NULL) {
+		if ((th->multi_v6 = trie_multi_new()) == NULL ||
+		    trie_compile_v6(th->multi_v6, th->root_v6, 0) == -1)
+			goto fail;
+		trie_multi_shrink(th->multi_v6);
+	}
+	return 0;
+
+fail:
+	trie_uncompile(th);
+	return -1;
+}
+
+/*
+ * Return the most specific entry covering addr/plen with a prefixlen
+ * of at most plen, the others follow via the parent links.
+ */
+static u_int32_t
+trie_multi_lookup(struct trie_multi *tm, const void *addr, u_int8_t plen)
+{
+	struct tmulti_node *n = &tm->nodes[0];
+	u_int32_t best = tm->root_entry, e;
+	u_int level, s;
+
+	for (level = 0; ; level++) {
+		s = trie_multi_slot(addr, level);
+		if ((e = n->slot[s].entry) != 0)
+			best = e;
+		if (plen <= (level + 1) * TRIE_STRIDE || n->slot[s].child == 0)
+			break;
+		n = &tm->nodes[n->slot[s].child];
+	}
+	while (best != 0 && tm->entries[best - 1].plen > plen)
+		best = tm->entries[best - 1].parent;
+	return best;
+}
+
+static int
+trie_multi_match(struct trie_multi *tm, const void *addr, u_int8_t plen,
+    int orlonger)
+{
+	struct tmulti_entry *te;
+	u_int32_t e;
+
+	for (e = trie_multi_lookup(tm, addr, plen); e != 0; e = te->parent) {
+		te = &tm->entries[e - 1];
+		/* the match covers all larger prefixlens */
+		if (orlonger)
+			return 1;
+		/* plen is from 1 - 128 but the bitmask starts with 0 */
+		if (inet6isset(&te->plenmask, plen - 1))
+			return 1;
+	}
+	return 0;
+}
+
+static int
+trie_multi_roa_check(struct trie_multi *tm, const void *addr, u_int8_t plen,
+    u_int32_t as)
+{
+	struct tmulti_entry *te;
+	struct roa_set *rs;
+	u_int32_t e;
+	int validity = ROA_NOTFOUND;
+
+	for (e = trie_multi_lookup(tm, addr, plen); e != 0; e = te->parent) {
+		te = &tm->entries[e - 1];
+		/* covered by this roa, invalid unless roa_set matches */
+		validity = ROA_INVALID;
+		if (as != AS_NONE && (rs = set_match(te->set, as)) != NULL &&
+		    (plen == te->plen || plen <= rs->maxlen))
+			return ROA_VALID;
+	}
+	return validity;
+}
+
 static int
 trie_match_v4(struct trie_head *th, struct in_addr *prefix, u_int8_t plen,
     int orlonger)
@@ -540,8 +1001,14 @@ trie_match(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 {
 	switch (prefix->aid) {
 	case AID_INET:
+		if (th->multi_v4 != NULL && plen != 0)
+			return trie_multi_match(th->multi_v4, &prefix->v4,
+			    plen, orlonger);
 		return trie_match_v4(th, &prefix->v4, plen, orlonger);
 	case AID_INET6:
+		if (th->multi_v6 != NULL && plen != 0)
+			return trie_multi_match(th->multi_v6, &prefix->v6,
+			    plen, orlonger);
 		return trie_match_v6(th, &prefix->v6, plen, orlonger);
 	default:
 		/* anything else is no match */
@@ -658,8 +1125,14 @@ trie_roa_check(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
 	/* valid, invalid, unknown */
 	switch (prefix->aid) {
 	case AID_INET:
+		if (th->multi_v4 != NULL)
+			return trie_multi_roa_check(th->multi_v4, &prefix->v4,
+			    plen, as);
 		return trie_roa_check_v4(th, &prefix->v4, plen, as);
 	case AID_INET6:
+		if (th->multi_v6 != NULL)
+			return trie_multi_roa_check(th->multi_v6, &prefix->v6,
+			    plen, as);
 		return trie_roa_check_v6(th, &prefix->v6, plen, as);
 	default:
 		/* anything else is not-found */
@@ -729,6 +1202,311 @@ trie_equal(struct trie_head *a, struct trie_head *b)
 	return 1;
 }
 
+static struct tentry_v4 *
+trie_find_v4(struct trie_head *th, struct in_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v4 *n;
+	struct in_addr mp;
+
+	n = th->root_v4;
+	while (n) {
+		if (n->plen > plen)
+			break;
+		inet4applymask(&mp, prefix, n->plen);
+		if (n->addr.s_addr != mp.s_addr)
+			break;
+		if (n->plen == plen)
+			return n->node ? n : NULL;
+		if (inet4isset(prefix, n->plen))
+			n = n->trie[1];
+		else
+			n = n->trie[0];
+	}
+	return NULL;
+}
+
+static struct tentry_v6 *
+trie_find_v6(struct trie_head *th, struct in6_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v6 *n;
+	struct in6_addr mp;
+
+	n = th->root_v6;
+	while (n) {
+		if (n->plen > plen)
+			break;
+		inet6applymask(&mp, prefix, n->plen);
+		if (memcmp(&n->addr, &mp, sizeof(mp)) != 0)
+			break;
+		if (n->plen == plen)
+			return n->node ? n : NULL;
+		if (inet6isset(prefix, n->plen))
+			n = n->trie[1];
+		else
+			n = n->trie[0];
+	}
+	return NULL;
+}
+
+/*
+ * Add or update a single source-as entry of the ROA prefix/plen. Used for
+ * ROAs learned via RTR which change one entry at a time. An entry with the
+ * same source-as gets the new maxlen.
+ */
+int
+trie_roa_update(struct trie_head *th, struct bgpd_addr *prefix, u_int8_t plen,
+    struct roa_set *rs)
+{
+	struct tentry_v4 *n4;
+	struct tentry_v6 *n6;
+	struct set_table **stp;
+	struct roa_set *r;
+
+	trie_uncompile(th);
+
+	switch (prefix->aid) {
+	case AID_INET:
+		if (plen > 32)
+			return -1;
+		if ((n4 = trie_add_v4(&th->root_v4, &prefix->v4, plen)) ==
+		    NULL)
+			return -1;
+		stp = &n4->set;
+		break;
+	case AID_INET6:
+		if (plen > 128)
+			return -1;
+		if ((n6 = trie_add_v6(&th->root_v6, &prefix->v6, plen)) ==
+		    NULL)
+			return -1;
+		stp = &n6->set;
+		break;
+	default:
+		return -1;
+	}
+
+	if (*stp == NULL)
+		if ((*stp = set_new(1, sizeof(*rs))) == NULL)
+			return -1;
+	if ((r = set_match(*stp, rs->as)) != NULL) {
+		r->maxlen = rs->maxlen;
+		return 0;
+	}
+	if (set_add(*stp, rs, 1) == -1)
+		return -1;
+	set_prep(*stp);
+	return 0;
+}
+
+/*
+ * Unlink the node prefix/plen which is no longer a real node. If it
+ * still branches it stays as internal node, else it is replaced by its
+ * only child. An internal parent left with a single child goes as well.
+ */
+static void
+trie_prune_v4(struct tentry_v4 **root, struct in_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v4 *n, *p = NULL, *c, **prev, **pprev = NULL;
+
+	prev = root;
+	while ((n = *prev) != NULL && n->plen < plen) {
+		pprev = prev;
+		p = n;
+		prev = &n->trie[inet4isset(prefix, n->plen) ? 1 : 0];
+	}
+	if (n == NULL || n->plen != plen || n->node)
+		return;
+	if (n->trie[0] != NULL && n->trie[1] != NULL)
+		return;
+
+	c = n->trie[0] != NULL ? n->trie[0] : n->trie[1];
+	*prev = c;
+	free(n);
+	rdemem.pset_cnt--;
+	rdemem.pset_size -= sizeof(*n);
+
+	if (c == NULL && p != NULL && !p->node) {
+		*pprev = p->trie[0] != NULL ? p->trie[0] : p->trie[1];
+		free(p);
+		rdemem.pset_cnt--;
+		rdemem.pset_size -= sizeof(*p);
+	}
+}
+
+static void
+trie_prune_v6(struct tentry_v6 **root, struct in6_addr *prefix, u_int8_t plen)
+{
+	struct tentry_v6 *n, *p = NULL, *c, **prev, **pprev = NULL;
+
+	prev = root;
+	while ((n = *prev) != NULL && n->plen < plen) {
+		pprev = prev;
+		p = n;
+		prev = &n->trie[inet6isset(prefix, n->plen) ? 1 : 0];
+	}
+	if (n == NULL || n->plen != plen || n->node)
+		return;
+	if (n->trie[0] != NULL && n->trie[1] != NULL)
+		return;
+
+	c = n->trie[0] != NULL ? n->trie[0] : n->trie[1];
+	*prev = c;
+	free(n);
+	rdemem.pset_cnt--;
+	rdemem.pset_size -= sizeof(*n);
+
+	if (c == NULL && p != NULL && !p->node) {
+		*pprev = p->trie[0] != NULL ? p->trie[0] : p->trie[1];
+		free(p);
+		rdemem.pset_cnt--;
+		rdemem.pset_size -= sizeof(*p);
+	}
+}
+
+/*
+ * Remove the source-as entry from the ROA prefix/plen. The node is no
+ * longer a ROA once the last entry is gone and is pruned from the trie.
+ */
+int
+trie_roa_delete(struct trie_head *th, struct bgpd_addr *prefix,
+    u_int8_t plen, u_int32_t as)
+{
+	struct tentry_v4 *n4;
+	struct tentry_v6 *n6;
+	struct set_table **stp;
+	u_int8_t *node;
+	size_t nmemb;
+
+	trie_uncompile(th);
+
+	switch (prefix->aid) {
+	case AID_INET:
+		if ((n4 = trie_find_v4(th, &prefix->v4, plen)) == NULL)
+			return -1;
+		stp = &n4->set;
+		node = &n4->node;
+		break;
+	case AID_INET6:
+		if ((n6 = trie_find_v6(th, &prefix->v6, plen)) == NULL)
+			return -1;
+		stp = &n6->set;
+		node = &n6->node;
+		break;
+	default:
+		return -1;
+	}
+
+	if (*stp == NULL || set_del(*stp, as) == -1)
+		return -1;
+	set_get(*stp, &nmemb);
+	if (nmemb != 0)
+		return 0;
+
+	set_free(*stp);
+	*stp = NULL;
+	*node = 0;
+	if (prefix->aid == AID_INET)
+		trie_prune_v4(&th->root_v4, &prefix->v4, plen);
+	else
+		trie_prune_v6(&th->root_v6, &prefix->v6, plen);
+	return 0;
+}
+
+#define TRIE_DIFF_SET	0x01	/* compare the source-as sets */
+#define TRIE_DIFF_MASK	0x02	/* compare the prefixlen masks */
+
+static void
+trie_diff_v4(struct tentry_v4 *n, struct trie_head *other, int cmp,
+    void (*cb)(struct bgpd_addr *, u_int8_t, void *), void *arg)
+{
+	struct tentry_v4 *o;
+	struct bgpd_addr addr;
+
+	if (n == NULL)
+		return;
+	if (n->node) {
+		o = trie_find_v4(other, &n->addr, n->plen);
+		if (o == NULL ||
+		    ((cmp & TRIE_DIFF_SET) && set_equal(n->set, o->set) == 0) ||
+		    ((cmp & TRIE_DIFF_MASK) &&
+		    n->plenmask.s_addr != o->plenmask.s_addr)) {
+			memset(&addr, 0, sizeof(addr));
+			addr.aid = AID_INET;
+			addr.v4 = n->addr;
+			cb(&addr, n->plen, arg);
+		}
+	}
+	trie_diff_v4(n->trie[0], other, cmp, cb, arg);
+	trie_diff_v4(n->trie[1], other, cmp, cb, arg);
+}
+
+static void
+trie_diff_v6(struct tentry_v6 *n, struct trie_head *other, int cmp,
+    void (*cb)(struct bgpd_addr *, u_int8_t, void *), void *arg)
+{
+	struct tentry_v6 *o;
+	struct bgpd_addr addr;
+
+	if (n == NULL)
+		return;
+	if (n->node) {
+		o = trie_find_v6(other, &n->addr, n->plen);
+		if (o == NULL ||
+		    ((cmp & TRIE_DIFF_SET) && set_equal(n->set, o->set) == 0) ||
+		    ((cmp & TRIE_DIFF_MASK) && memcmp(&n->plenmask,
+		    &o->plenmask, sizeof(n->plenmask)) != 0)) {
+			memset(&addr, 0, sizeof(addr));
+			addr.aid = AID_INET6;
+			addr.v6 = n->addr;
+			cb(&addr, n->plen, arg);
+		}
+	}
+	trie_diff_v6(n->trie[0], other, cmp, cb, arg);
+	trie_diff_v6(n->trie[1], other, cmp, cb, arg);
+}
+
+/*
+ * Compare two prefix-set tries and call cb for every prefix that was added,
+ * removed or has a different prefixlen range. Only prefixes covered by a
+ * reported prefix can match differently. A change of the default route
+ * match is reported as prefixlen 0.
+ */
+void
+trie_diff(struct trie_head *a, struct trie_head *b,
+    void (*cb)(struct bgpd_addr *, u_int8_t, void *), void *arg)
+{
+	struct bgpd_addr addr;
+
+	memset(&addr, 0, sizeof(addr));
+	if (a->match_default_v4 != b->match_default_v4) {
+		addr.aid = AID_INET;
+		cb(&addr, 0, arg);
+	}
+	if (a->match_default_v6 != b->match_default_v6) {
+		addr.aid = AID_INET6;
+		cb(&addr, 0, arg);
+	}
+	trie_diff_v4(a->root_v4, b, TRIE_DIFF_MASK, cb, arg);
+	trie_diff_v4(b->root_v4, a, 0, cb, arg);
+	trie_diff_v6(a->root_v6, b, TRIE_DIFF_MASK, cb, arg);
+	trie_diff_v6(b->root_v6, a, 0, cb, arg);
+}
+
+/*
+ * Compare two ROA tries and call cb for every ROA prefix that was added,
+ * removed or has a different source-as set. Changed prefixes are reported
+ * once, removed and added ones once from the tree they are in.
+ */
+void
+trie_roa_diff(struct trie_head *a, struct trie_head *b,
+    void (*cb)(struct bgpd_addr *, u_int8_t, void *), void *arg)
+{
+	trie_diff_v4(a->root_v4, b, TRIE_DIFF_SET, cb, arg);
+	trie_diff_v4(b->root_v4, a, 0, cb, arg);
+	trie_diff_v6(a->root_v6, b, TRIE_DIFF_SET, cb, arg);
+	trie_diff_v6(b->root_v6, a, 0, cb, arg);
+}
+
 /* debugging functions for printing the trie */
 static void
 trie_dump_v4(struct tentry_v4 *n)
@@ -28,22 +28,6 @@
 #include "rde.h"
 #include "log.h"
 
-static struct community	comm_no_advertise = {
-	.flags = COMMUNITY_TYPE_BASIC,
-	.data1 = COMMUNITY_WELLKNOWN,
-	.data2 = COMMUNITY_NO_ADVERTISE
-};
-static struct community	comm_no_export = {
-	.flags = COMMUNITY_TYPE_BASIC,
-	.data1 = COMMUNITY_WELLKNOWN,
-	.data2 = COMMUNITY_NO_EXPORT
-};
-static struct community	comm_no_expsubconfed = {
-	.flags = COMMUNITY_TYPE_BASIC,
-	.data1 = COMMUNITY_WELLKNOWN,
-	.data2 = COMMUNITY_NO_EXPSUBCONFED
-};
-
 static int
 up_test_update(struct rde_peer *peer, struct prefix *p)
 {
@@ -100,15 +84,12 @@ up_test_update(struct rde_peer *peer, struct prefix *p)
 		return (-1);
 	}
 
-	/* well known communities */
-	if (community_match(comm, &comm_no_advertise, NULL))
+	/* well known communities, summarized when the communities got linked */
+	if (comm->wellknown & WELLKNOWN_NO_ADVERTISE)
+		return (0);
+	if (peer->conf.ebgp && comm->wellknown &
+	    (WELLKNOWN_NO_EXPORT | WELLKNOWN_NO_EXPSUBCONFED))
 		return (0);
-	if (peer->conf.ebgp) {
-		if (community_match(comm, &comm_no_export, NULL))
-			return (0);
-		if (community_match(comm, &comm_no_expsubconfed, NULL))
-			return (0);
-	}
 
 	/*
 	 * Don't send messages back to originator
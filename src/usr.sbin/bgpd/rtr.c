@@ -0,0 +1,1098 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/tree.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bgpd.h"
+#include "session.h"
+#include "log.h"
+
+/*
+ * RPKI to Router protocol client (RFC 8210, falls back to RFC 6810).
+ * Every configured cache has its own session and VRP table. The tables
+ * are merged into one table with a reference count per VRP and only the
+ * changes of the merged table are passed on to the RDE. Changes are
+ * collected until the End of Data PDU so that the RDE never sees a
+ * partial update.
+ */
+
+#define	RTR_MAX_VERSION		1
+#define	RTR_MAX_PDU_SIZE	65535
+#define	RTR_DEFAULT_REFRESH	3600
+#define	RTR_DEFAULT_RETRY	600
+#define	RTR_DEFAULT_EXPIRE	7200
+
+enum rtr_pdu_type {
+	SERIAL_NOTIFY = 0,
+	SERIAL_QUERY = 1,
+	RESET_QUERY = 2,
+	CACHE_RESPONSE = 3,
+	IPV4_PREFIX = 4,
+	IPV6_PREFIX = 6,
+	END_OF_DATA = 7,
+	CACHE_RESET = 8,
+	ROUTER_KEY = 9,
+	ERROR_REPORT = 10,
+};
+
+enum rtr_error {
+	NO_ERROR = -1,
+	CORRUPT_DATA = 0,
+	INTERNAL_ERROR,
+	NO_DATA_AVAILABLE,
+	INVALID_REQUEST,
+	UNSUPP_PROTOCOL_VERS,
+	UNSUPP_PDU_TYPE,
+	UNK_REC_WDRAWL,
+	DUP_REC_RECV,
+	UNEXP_PROTOCOL_VERS,
+	RTR_ERROR_MAX
+};
+
+static const char * const rtr_errnames[] = {
+	"corrupt data",
+	"internal error",
+	"no data available",
+	"invalid request",
+	"unsupported protocol version",
+	"unsupported PDU type",
+	"withdrawal of unknown record",
+	"duplicate announcement",
+	"unexpected protocol version",
+};
+
+struct rtr_header {
+	u_int8_t	version;
+	u_int8_t	type;
+	u_int16_t	session_id;	/* or error code */
+	u_int32_t	length;
+};
+
+#define	RTR_FLAG_ANNOUNCE	0x1
+
+struct rtr_ipv4 {
+	struct rtr_header	hdr;
+	u_int8_t		flags;
+	u_int8_t		prefixlen;
+	u_int8_t		maxlen;
+	u_int8_t		zero;
+	u_int32_t		prefix;
+	u_int32_t		asnum;
+};
+
+struct rtr_ipv6 {
+	struct rtr_header	hdr;
+	u_int8_t		flags;
+	u_int8_t		prefixlen;
+	u_int8_t		maxlen;
+	u_int8_t		zero;
+	u_int32_t		prefix[4];
+	u_int32_t		asnum;
+};
+
+struct rtr_endofdata {
+	struct rtr_header	hdr;
+	u_int32_t		serial;
+	u_int32_t		refresh;	/* version 1 only */
+	u_int32_t		retry;
+	u_int32_t		expire;
+};
+
+#define	RTR_EOD_V0_LEN		(sizeof(struct rtr_header) + sizeof(u_int32_t))
+#define	RTR_NOTIFY_LEN	(sizeof(struct rtr_header) + sizeof(u_int32_t))
+
+enum rtr_state {
+	RTR_STATE_CLOSED,
+	RTR_STATE_CONNECT,
+	RTR_STATE_IDLE,
+	RTR_STATE_ACTIVE,
+};
+
+static const char * const rtr_statenames[] = {
+	"closed",
+	"connect",
+	"idle",
+	"active",
+};
+
+struct vrp {
+	RB_ENTRY(vrp)		 entry;
+	struct bgpd_addr	 addr;
+	u_int32_t		 asnum;
+	u_int32_t		 refcnt;	/* merged table only */
+	u_int8_t		 prefixlen;
+	u_int8_t		 maxlen;
+};
+
+RB_HEAD(vrp_tree, vrp);
+
+struct rtr_session {
+	TAILQ_ENTRY(rtr_session)	 entry;
+	struct rtr_config		 conf;
+	struct vrp_tree			 vrps;
+	struct vrp_tree			 pend_add;
+	struct vrp_tree			 pend_del;
+	struct msgbuf			 wbuf;
+	struct timespec			 update_start;
+	struct pollfd			*pfd;
+	time_t				 next;		/* next state timeout */
+	time_t				 expire_at;
+	time_t				 last_update;
+	enum rtr_state			 state;
+	enum reconf_action		 reconf;
+	size_t				 rpos;
+	u_int32_t			 serial;
+	u_int32_t			 refresh;
+	u_int32_t			 retry;
+	u_int32_t			 expire;
+	u_int32_t			 vrp_v4;
+	u_int32_t			 vrp_v6;
+	u_int32_t			 updates;
+	u_int32_t			 update_ms;
+	u_int16_t			 session_id;
+	u_int8_t			 version;
+	u_int8_t			 version_ok;
+	u_int8_t			 have_serial;
+	u_int8_t			 in_response;
+	u_int8_t			 discard;	/* until end of data */
+	u_int8_t			 reset;
+	u_int8_t			 rbuf[RTR_MAX_PDU_SIZE];
+};
+
+static int	vrp_cmp(struct vrp *, struct vrp *);
+static void	rtr_close(struct rtr_session *);
+static void	rtr_send_query(struct rtr_session *);
+
+RB_GENERATE_STATIC(vrp_tree, vrp, entry, vrp_cmp);
+
+static TAILQ_HEAD(, rtr_session) rtrs = TAILQ_HEAD_INITIALIZER(rtrs);
+static struct vrp_tree	vrp_merged = RB_INITIALIZER(&vrp_merged);
+static u_int		rtr_cnt;
+static int		vrp_changed;
+
+/* compare everything but maxlen */
+static int
+vrp_cmp_prefix(struct vrp *a, struct vrp *b)
+{
+	int	r;
+
+	if (a->addr.aid != b->addr.aid)
+		return (a->addr.aid < b->addr.aid ? -1 : 1);
+	switch (a->addr.aid) {
+	case AID_INET:
+		r = memcmp(&a->addr.v4, &b->addr.v4, sizeof(a->addr.v4));
+		break;
+	case AID_INET6:
+		r = memcmp(&a->addr.v6, &b->addr.v6, sizeof(a->addr.v6));
+		break;
+	default:
+		r = 0;
+		break;
+	}
+	if (r != 0)
+		return (r < 0 ? -1 : 1);
+	if (a->prefixlen != b->prefixlen)
+		return (a->prefixlen < b->prefixlen ? -1 : 1);
+	if (a->asnum != b->asnum)
+		return (a->asnum < b->asnum ? -1 : 1);
+	return (0);
+}
+
+static int
+vrp_cmp(struct vrp *a, struct vrp *b)
+{
+	int	r;
+
+	if ((r = vrp_cmp_prefix(a, b)) != 0)
+		return (r);
+	if (a->maxlen != b->maxlen)
+		return (a->maxlen < b->maxlen ? -1 : 1);
+	return (0);
+}
+
+static void
+vrp_tree_free(struct vrp_tree *tree)
+{
+	struct vrp	*v, *next;
+
+	RB_FOREACH_SAFE(v, vrp_tree, tree, next) {
+		RB_REMOVE(vrp_tree, tree, v);
+		free(v);
+	}
+}
+
+/*
+ * Pass the ROA for prefix/prefixlen/asnum to the RDE. Multiple VRPs may
+ * only differ in maxlen, the RDE gets the longest one.
+ */
+static void
+vrp_notify(struct vrp *v)
+{
+	struct vrp	 needle, *n, *last = NULL;
+	struct roa	 roa;
+
+	needle = *v;
+	needle.maxlen = 0;
+	for (n = RB_NFIND(vrp_tree, &vrp_merged, &needle); n != NULL;
+	    n = RB_NEXT(vrp_tree, &vrp_merged, n)) {
+		if (vrp_cmp_prefix(n, v) != 0)
+			break;
+		last = n;
+	}
+
+	memset(&roa, 0, sizeof(roa));
+	roa.prefix = v->addr;
+	roa.prefixlen = v->prefixlen;
+	roa.asnum = v->asnum;
+	if (last != NULL) {
+		roa.maxlen = last->maxlen;
+		imsg_rde(IMSG_RTR_ROA_ADD, 0, &roa, sizeof(roa));
+	} else
+		imsg_rde(IMSG_RTR_ROA_DEL, 0, &roa, sizeof(roa));
+	vrp_changed = 1;
+}
+
+static void
+vrp_merged_add(struct vrp *v)
+{
+	struct vrp	*n;
+
+	if ((n = RB_FIND(vrp_tree, &vrp_merged, v)) != NULL) {
+		n->refcnt++;
+		return;
+	}
+	if ((n = malloc(sizeof(*n))) == NULL)
+		fatal(NULL);
+	*n = *v;
+	n->refcnt = 1;
+	RB_INSERT(vrp_tree, &vrp_merged, n);
+	vrp_notify(n);
+}
+
+static void
+vrp_merged_del(struct vrp *v)
+{
+	struct vrp	*n;
+
+	if ((n = RB_FIND(vrp_tree, &vrp_merged, v)) == NULL)
+		fatalx("%s: unknown vrp", __func__);
+	if (--n->refcnt > 0)
+		return;
+	RB_REMOVE(vrp_tree, &vrp_merged, n);
+	vrp_notify(n);
+	free(n);
+}
+
+static void
+vrp_commit(void)
+{
+	if (!vrp_changed)
+		return;
+	imsg_rde(IMSG_RTR_ROA_COMMIT, 0, NULL, 0);
+	vrp_changed = 0;
+}
+
+static const char *
+log_rtr(struct rtr_session *rs)
+{
+	if (rs->conf.descr[0] != '\0')
+		return (rs->conf.descr);
+	return (log_addr(&rs->conf.remote_addr));
+}
+
+static void
+rtr_vrp_count(struct rtr_session *rs, struct vrp *v, int add)
+{
+	u_int32_t	*cnt;
+
+	cnt = v->addr.aid == AID_INET ? &rs->vrp_v4 : &rs->vrp_v6;
+	if (add)
+		(*cnt)++;
+	else
+		(*cnt)--;
+}
+
+/* add an announced or withdrawn VRP to the pending changes */
+static enum rtr_error
+rtr_vrp(struct rtr_session *rs, struct vrp *v, int announce)
+{
+	struct vrp	*n;
+
+	if (announce) {
+		if ((n = RB_FIND(vrp_tree, &rs->pend_del, v)) != NULL) {
+			RB_REMOVE(vrp_tree, &rs->pend_del, n);
+			free(n);
+			return (NO_ERROR);
+		}
+		if (RB_FIND(vrp_tree, &rs->pend_add, v) != NULL ||
+		    (!rs->reset && RB_FIND(vrp_tree, &rs->vrps, v) != NULL))
+			return (DUP_REC_RECV);
+		if ((n = malloc(sizeof(*n))) == NULL)
+			fatal(NULL);
+		*n = *v;
+		RB_INSERT(vrp_tree, &rs->pend_add, n);
+	} else {
+		if ((n = RB_FIND(vrp_tree, &rs->pend_add, v)) != NULL) {
+			RB_REMOVE(vrp_tree, &rs->pend_add, n);
+			free(n);
+			return (NO_ERROR);
+		}
+		if (rs->reset || RB_FIND(vrp_tree, &rs->vrps, v) == NULL ||
+		    RB_FIND(vrp_tree, &rs->pend_del, v) != NULL)
+			return (UNK_REC_WDRAWL);
+		if ((n = malloc(sizeof(*n))) == NULL)
+			fatal(NULL);
+		*n = *v;
+		RB_INSERT(vrp_tree, &rs->pend_del, n);
+	}
+	return (NO_ERROR);
+}
+
+/* apply the pending changes, a reset response replaces all data */
+static void
+rtr_apply(struct rtr_session *rs)
+{
+	struct vrp	*v, *n, *next;
+
+	if (rs->reset) {
+		RB_FOREACH_SAFE(v, vrp_tree, &rs->vrps, next) {
+			if (RB_FIND(vrp_tree, &rs->pend_add, v) != NULL)
+				continue;
+			RB_REMOVE(vrp_tree, &rs->vrps, v);
+			vrp_merged_del(v);
+			rtr_vrp_count(rs, v, 0);
+			free(v);
+		}
+	}
+	RB_FOREACH_SAFE(v, vrp_tree, &rs->pend_del, next) {
+		RB_REMOVE(vrp_tree, &rs->pend_del, v);
+		if ((n = RB_FIND(vrp_tree, &rs->vrps, v)) != NULL) {
+			RB_REMOVE(vrp_tree, &rs->vrps, n);
+			vrp_merged_del(n);
+			rtr_vrp_count(rs, n, 0);
+			free(n);
+		}
+		free(v);
+	}
+	RB_FOREACH_SAFE(v, vrp_tree, &rs->pend_add, next) {
+		RB_REMOVE(vrp_tree, &rs->pend_add, v);
+		if (RB_INSERT(vrp_tree, &rs->vrps, v) != NULL) {
+			free(v);
+			continue;
+		}
+		vrp_merged_add(v);
+		rtr_vrp_count(rs, v, 1);
+	}
+	vrp_commit();
+}
+
+/* remove all VRPs of this cache */
+static void
+rtr_flush(struct rtr_session *rs)
+{
+	struct vrp	*v, *next;
+
+	RB_FOREACH_SAFE(v, vrp_tree, &rs->vrps, next) {
+		RB_REMOVE(vrp_tree, &rs->vrps, v);
+		vrp_merged_del(v);
+		free(v);
+	}
+	rs->vrp_v4 = rs->vrp_v6 = 0;
+	vrp_commit();
+}
+
+static void
+rtr_send(struct rtr_session *rs, struct ibuf *buf)
+{
+	if (rs->wbuf.fd == -1) {
+		ibuf_free(buf);
+		return;
+	}
+	ibuf_close(&rs->wbuf, buf);
+}
+
+static void
+rtr_send_error(struct rtr_session *rs, enum rtr_error err, const char *msg,
+    void *pdu, size_t pdulen)
+{
+	struct rtr_header	 rh;
+	struct ibuf		*buf;
+	size_t			 msglen;
+	u_int32_t		 len;
+
+	if (msg == NULL)
+		msg = "";
+	msglen = strlen(msg);
+	log_warnx("rtr %s: sending error: %s%s%s", log_rtr(rs),
+	    rtr_errnames[err], msglen ? ": " : "", msg);
+
+	memset(&rh, 0, sizeof(rh));
+	rh.version = rs->version;
+	rh.type = ERROR_REPORT;
+	rh.session_id = htons(err);
+	rh.length = htonl(sizeof(rh) + 2 * sizeof(len) + pdulen + msglen);
+
+	if ((buf = ibuf_open(ntohl(rh.length))) == NULL)
+		fatal(NULL);
+	if (ibuf_add(buf, &rh, sizeof(rh)) == -1)
+		fatal(NULL);
+	len = htonl(pdulen);
+	if (ibuf_add(buf, &len, sizeof(len)) == -1 ||
+	    ibuf_add(buf, pdu, pdulen) == -1)
+		fatal(NULL);
+	len = htonl(msglen);
+	if (ibuf_add(buf, &len, sizeof(len)) == -1 ||
+	    ibuf_add(buf, msg, msglen) == -1)
+		fatal(NULL);
+	rtr_send(rs, buf);
+
+	/* best effort, the session is closed right away */
+	msgbuf_write(&rs->wbuf);
+	rtr_close(rs);
+}
+
+static void
+rtr_send_query(struct rtr_session *rs)
+{
+	struct rtr_header	 rh;
+	struct ibuf		*buf;
+	u_int32_t		 serial;
+
+	memset(&rh, 0, sizeof(rh));
+	rh.version = rs->version;
+	if (rs->have_serial) {
+		rh.type = SERIAL_QUERY;
+		rh.session_id = htons(rs->session_id);
+		rh.length = htonl(sizeof(rh) + sizeof(serial));
+	} else {
+		rh.type = RESET_QUERY;
+		rh.length = htonl(sizeof(rh));
+	}
+
+	if ((buf = ibuf_open(ntohl(rh.length))) == NULL)
+		fatal(NULL);
+	if (ibuf_add(buf, &rh, sizeof(rh)) == -1)
+		fatal(NULL);
+	if (rs->have_serial) {
+		serial = htonl(rs->serial);
+		if (ibuf_add(buf, &serial, sizeof(serial)) == -1)
+			fatal(NULL);
+	}
+	rtr_send(rs, buf);
+
+	rs->reset = !rs->have_serial;
+	rs->state = RTR_STATE_ACTIVE;
+	rs->next = getmonotime() + rs->retry;
+	clock_gettime(CLOCK_MONOTONIC, &rs->update_start);
+}
+
+static void
+rtr_connect(struct rtr_session *rs, time_t now)
+{
+	struct sockaddr	*sa;
+	socklen_t	 len;
+	int		 fd;
+
+	rs->next = now + rs->retry;
+	if ((sa = addr2sa(&rs->conf.remote_addr, rs->conf.remote_port,
+	    &len)) == NULL) {
+		log_warnx("rtr %s: bad address", log_rtr(rs));
+		return;
+	}
+	if ((fd = socket(sa->sa_family,
+	    SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_TCP)) == -1) {
+		log_warn("rtr %s: socket", log_rtr(rs));
+		return;
+	}
+	if (connect(fd, sa, len) == -1 && errno != EINPROGRESS) {
+		log_warn("rtr %s: connect", log_rtr(rs));
+		close(fd);
+		return;
+	}
+	rs->wbuf.fd = fd;
+	rs->state = RTR_STATE_CONNECT;
+}
+
+static void
+rtr_close(struct rtr_session *rs)
+{
+	if (rs->wbuf.fd != -1) {
+		msgbuf_clear(&rs->wbuf);
+		close(rs->wbuf.fd);
+		rs->wbuf.fd = -1;
+	}
+	vrp_tree_free(&rs->pend_add);
+	vrp_tree_free(&rs->pend_del);
+	rs->rpos = 0;
+	rs->in_response = 0;
+	rs->discard = 0;
+	rs->state = RTR_STATE_CLOSED;
+	rs->next = getmonotime() + rs->retry;
+}
+
+static int
+rtr_parse_prefix(struct rtr_session *rs, u_int8_t *buf, size_t len)
+{
+	struct rtr_ipv4	 ip4;
+	struct rtr_ipv6	 ip6;
+	struct vrp	 v;
+	enum rtr_error	 err;
+	u_int8_t	 flags, max;
+
+	memset(&v, 0, sizeof(v));
+	if (buf[1] == IPV4_PREFIX) {
+		if (len != sizeof(ip4))
+			goto bad;
+		memcpy(&ip4, buf, sizeof(ip4));
+		v.addr.aid = AID_INET;
+		memcpy(&v.addr.v4, &ip4.prefix, sizeof(v.addr.v4));
+		v.asnum = ntohl(ip4.asnum);
+		v.prefixlen = ip4.prefixlen;
+		v.maxlen = ip4.maxlen;
+		flags = ip4.flags;
+		max = 32;
+	} else {
+		if (len != sizeof(ip6))
+			goto bad;
+		memcpy(&ip6, buf, sizeof(ip6));
+		v.addr.aid = AID_INET6;
+		memcpy(&v.addr.v6, &ip6.prefix, sizeof(v.addr.v6));
+		v.asnum = ntohl(ip6.asnum);
+		v.prefixlen = ip6.prefixlen;
+		v.maxlen = ip6.maxlen;
+		flags = ip6.flags;
+		max = 128;
+	}
+	if (v.prefixlen > v.maxlen || v.maxlen > max)
+		goto bad;
+	/* the RDE stores masked prefixes, do the same for the VRP tree */
+	if (v.addr.aid == AID_INET)
+		inet4applymask(&v.addr.v4, &v.addr.v4, v.prefixlen);
+	else
+		inet6applymask(&v.addr.v6, &v.addr.v6, v.prefixlen);
+	if (!rs->in_response) {
+		rtr_send_error(rs, CORRUPT_DATA, "prefix outside of response",
+		    buf, len);
+		return (-1);
+	}
+	if (rs->discard)
+		return (0);
+
+	if ((err = rtr_vrp(rs, &v, flags & RTR_FLAG_ANNOUNCE)) != NO_ERROR) {
+		rtr_send_error(rs, err, NULL, buf, len);
+		return (-1);
+	}
+	return (0);
+
+bad:
+	rtr_send_error(rs, CORRUPT_DATA, "bad prefix PDU", buf, len);
+	return (-1);
+}
+
+static int
+rtr_parse_end_of_data(struct rtr_session *rs, u_int8_t *buf, size_t len)
+{
+	struct rtr_endofdata	 eod;
+	struct timespec		 ts;
+	u_int32_t		 refresh, retry, expire;
+
+	if ((rs->version == 0 && len != RTR_EOD_V0_LEN) ||
+	    (rs->version > 0 && len != sizeof(eod))) {
+		rtr_send_error(rs, CORRUPT_DATA, "bad end of data PDU",
+		    buf, len);
+		return (-1);
+	}
+	if (!rs->in_response) {
+		rtr_send_error(rs, CORRUPT_DATA, "end of data outside of "
+		    "response", buf, len);
+		return (-1);
+	}
+
+	if (rs->discard) {
+		/* end of the response of the old session */
+		rs->discard = 0;
+		rs->in_response = 0;
+		return (0);
+	}
+
+	memset(&eod, 0, sizeof(eod));
+	memcpy(&eod, buf, len);
+	if (ntohs(eod.hdr.session_id) != rs->session_id) {
+		rtr_send_error(rs, CORRUPT_DATA, "session id mismatch",
+		    buf, len);
+		return (-1);
+	}
+	if (rs->version > 0) {
+		/* only take over the timers when in the RFC 8210 range */
+		refresh = ntohl(eod.refresh);
+		retry = ntohl(eod.retry);
+		expire = ntohl(eod.expire);
+		if (refresh >= 1 && refresh <= 86400)
+			rs->refresh = refresh;
+		if (retry >= 1 && retry <= 7200)
+			rs->retry = retry;
+		if (expire >= 600 && expire <= 172800)
+			rs->expire = expire;
+	}
+
+	rtr_apply(rs);
+
+	rs->serial = ntohl(eod.serial);
+	rs->have_serial = 1;
+	rs->in_response = 0;
+	rs->reset = 0;
+	rs->state = RTR_STATE_IDLE;
+	rs->last_update = getmonotime();
+	rs->next = rs->last_update + rs->refresh;
+	rs->expire_at = rs->last_update + rs->expire;
+	rs->updates++;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	timespecsub(&ts, &rs->update_start, &ts);
+	rs->update_ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+	log_debug("rtr %s: serial %u, %u IPv4 and %u IPv6 VRPs", log_rtr(rs),
+	    rs->serial, rs->vrp_v4, rs->vrp_v6);
+	return (0);
+}
+
+static int
+rtr_parse_error(struct rtr_session *rs, u_int8_t *buf, size_t len)
+{
+	struct rtr_header	 rh;
+	char			*str = NULL;
+	u_int32_t		 pdulen, msglen;
+	u_int16_t		 code;
+
+	memcpy(&rh, buf, sizeof(rh));
+	code = ntohs(rh.session_id);
+	buf += sizeof(rh);
+	len -= sizeof(rh);
+
+	if (len < sizeof(pdulen))
+		goto done;
+	memcpy(&pdulen, buf, sizeof(pdulen));
+	pdulen = ntohl(pdulen);
+	if (len - sizeof(pdulen) < pdulen)
+		goto done;
+	buf += sizeof(pdulen) + pdulen;
+	len -= sizeof(pdulen) + pdulen;
+
+	if (len < sizeof(msglen))
+		goto done;
+	memcpy(&msglen, buf, sizeof(msglen));
+	msglen = ntohl(msglen);
+	if (len - sizeof(msglen) < msglen || msglen == 0)
+		goto done;
+	if ((str = strndup((char *)buf + sizeof(msglen), msglen)) == NULL)
+		fatal(NULL);
+
+done:
+	log_warnx("rtr %s: received error: %s%s%s", log_rtr(rs),
+	    code < RTR_ERROR_MAX ? rtr_errnames[code] : "unknown error",
+	    str ? ": " : "", str ? str : "");
+	free(str);
+
+	if (code == NO_DATA_AVAILABLE) {
+		/* cache is not ready yet, keep the session and try later */
+		vrp_tree_free(&rs->pend_add);
+		vrp_tree_free(&rs->pend_del);
+		rs->in_response = 0;
+		rs->state = RTR_STATE_IDLE;
+		rs->next = getmonotime() + rs->retry;
+		return (0);
+	}
+
+	rtr_close(rs);
+	if (code == UNSUPP_PROTOCOL_VERS && !rs->version_ok &&
+	    rs->version > 0) {
+		/* RFC 6810 cache, reconnect right away with version 0 */
+		rs->version = 0;
+		rs->next = getmonotime();
+	}
+	return (-1);
+}
+
+/* returns -1 if the session was closed */
+static int
+rtr_parse_pdu(struct rtr_session *rs, u_int8_t *buf, size_t len)
+{
+	struct rtr_header	 rh;
+
+	memcpy(&rh, buf, sizeof(rh));
+
+	if (rh.type == ERROR_REPORT)
+		return (rtr_parse_error(rs, buf, len));
+
+	if (rh.version != rs->version) {
+		if (!rs->version_ok && rh.version < rs->version) {
+			log_info("rtr %s: downgrading to version %u",
+			    log_rtr(rs), rh.version);
+			rs->version = rh.version;
+		} else {
+			rtr_send_error(rs, UNEXP_PROTOCOL_VERS, NULL,
+			    buf, len);
+			return (-1);
+		}
+	}
+
+	switch (rh.type) {
+	case SERIAL_NOTIFY:
+		if (len != RTR_NOTIFY_LEN) {
+			rtr_send_error(rs, CORRUPT_DATA, "bad serial notify PDU",
+			    buf, len);
+			return (-1);
+		}
+		/* new data available, query now unless busy */
+		if (rs->state == RTR_STATE_IDLE)
+			rtr_send_query(rs);
+		break;
+	case CACHE_RESPONSE:
+		if (len != sizeof(rh) || rs->state != RTR_STATE_ACTIVE ||
+		    rs->in_response) {
+			rtr_send_error(rs, CORRUPT_DATA, "unexpected cache "
+			    "response", buf, len);
+			return (-1);
+		}
+		if (!rs->reset && ntohs(rh.session_id) != rs->session_id) {
+			/*
+			 * Cache was restarted, skip the rest of this response
+			 * and ask for the full table right away.
+			 */
+			log_warnx("rtr %s: session id changed, resetting",
+			    log_rtr(rs));
+			rs->have_serial = 0;
+			rtr_send_query(rs);
+			rs->in_response = 1;
+			rs->discard = 1;
+			break;
+		}
+		rs->session_id = ntohs(rh.session_id);
+		rs->version_ok = 1;
+		rs->in_response = 1;
+		break;
+	case IPV4_PREFIX:
+	case IPV6_PREFIX:
+		return (rtr_parse_prefix(rs, buf, len));
+	case END_OF_DATA:
+		return (rtr_parse_end_of_data(rs, buf, len));
+	case CACHE_RESET:
+		if (len != sizeof(rh)) {
+			rtr_send_error(rs, CORRUPT_DATA, "bad cache reset PDU",
+			    buf, len);
+			return (-1);
+		}
+		/* cache has no incremental data for us */
+		rs->have_serial = 0;
+		vrp_tree_free(&rs->pend_add);
+		vrp_tree_free(&rs->pend_del);
+		rs->in_response = 0;
+		rs->discard = 0;
+		rtr_send_query(rs);
+		break;
+	case ROUTER_KEY:
+		/* BGPsec router keys are not used */
+		break;
+	default:
+		rtr_send_error(rs, UNSUPP_PDU_TYPE, NULL, buf, len);
+		return (-1);
+	}
+	return (0);
+}
+
+static void
+rtr_read(struct rtr_session *rs)
+{
+	struct rtr_header	 rh;
+	ssize_t			 n;
+	size_t			 off, len;
+
+	if ((n = read(rs->wbuf.fd, rs->rbuf + rs->rpos,
+	    sizeof(rs->rbuf) - rs->rpos)) == -1) {
+		if (errno != EINTR && errno != EAGAIN) {
+			log_warn("rtr %s: read error", log_rtr(rs));
+			rtr_close(rs);
+		}
+		return;
+	}
+	if (n == 0) {
+		log_warnx("rtr %s: connection closed", log_rtr(rs));
+		rtr_close(rs);
+		return;
+	}
+	rs->rpos += n;
+
+	for (off = 0; rs->rpos - off >= sizeof(rh); off += len) {
+		memcpy(&rh, rs->rbuf + off, sizeof(rh));
+		len = ntohl(rh.length);
+		if (len < sizeof(rh) || len > RTR_MAX_PDU_SIZE) {
+			rtr_send_error(rs, CORRUPT_DATA, "bad length",
+			    rs->rbuf + off, sizeof(rh));
+			return;
+		}
+		if (rs->rpos - off < len)
+			break;
+		if (rtr_parse_pdu(rs, rs->rbuf + off, len) == -1)
+			return;
+	}
+
+	rs->rpos -= off;
+	memmove(rs->rbuf, rs->rbuf + off, rs->rpos);
+}
+
+static void
+rtr_dispatch(struct rtr_session *rs, short revents)
+{
+	socklen_t	len;
+	int		error, n;
+
+	if (rs->state == RTR_STATE_CONNECT) {
+		if (!(revents & (POLLOUT|POLLHUP|POLLERR)))
+			return;
+		len = sizeof(error);
+		if (getsockopt(rs->wbuf.fd, SOL_SOCKET, SO_ERROR, &error,
+		    &len) == -1 || error != 0 || revents & POLLHUP) {
+			if (error != 0)
+				errno = error;
+			log_warn("rtr %s: connect", log_rtr(rs));
+			rtr_close(rs);
+			return;
+		}
+		log_info("rtr %s: connected", log_rtr(rs));
+		rtr_send_query(rs);
+		return;
+	}
+
+	if (revents & (POLLERR|POLLNVAL)) {
+		log_warnx("rtr %s: socket error", log_rtr(rs));
+		rtr_close(rs);
+		return;
+	}
+	if (revents & POLLOUT && rs->wbuf.queued) {
+		if ((n = msgbuf_write(&rs->wbuf)) == -1 && errno != EAGAIN) {
+			log_warn("rtr %s: write error", log_rtr(rs));
+			rtr_close(rs);
+			return;
+		}
+		if (n == 0) {
+			log_warnx("rtr %s: connection closed", log_rtr(rs));
+			rtr_close(rs);
+			return;
+		}
+	}
+	if (revents & (POLLIN|POLLHUP))
+		rtr_read(rs);
+}
+
+static void
+rtr_free(struct rtr_session *rs)
+{
+	log_info("rtr %s: removed", log_rtr(rs));
+	rtr_close(rs);
+	rtr_flush(rs);
+	TAILQ_REMOVE(&rtrs, rs, entry);
+	rtr_cnt--;
+	free(rs);
+}
+
+static void
+rtr_new(struct rtr_config *rc)
+{
+	struct rtr_session	*rs;
+
+	if ((rs = calloc(1, sizeof(*rs))) == NULL)
+		fatal(NULL);
+	rs->conf = *rc;
+	RB_INIT(&rs->vrps);
+	RB_INIT(&rs->pend_add);
+	RB_INIT(&rs->pend_del);
+	msgbuf_init(&rs->wbuf);
+	rs->wbuf.fd = -1;
+	rs->version = RTR_MAX_VERSION;
+	rs->refresh = RTR_DEFAULT_REFRESH;
+	rs->retry = RTR_DEFAULT_RETRY;
+	rs->expire = RTR_DEFAULT_EXPIRE;
+	rs->state = RTR_STATE_CLOSED;
+	rs->reconf = RECONF_KEEP;
+	TAILQ_INSERT_TAIL(&rtrs, rs, entry);
+	rtr_cnt++;
+	log_info("rtr %s: added", log_rtr(rs));
+}
+
+/*
+ * Take over the new RTR config. Removed caches are only flagged here and
+ * freed by the next rtr_poll_events() call since their pollfd may still
+ * be referenced in this poll round.
+ */
+void
+rtr_config_merge(struct rtr_config_head *rh)
+{
+	struct rtr_config	*rc;
+	struct rtr_session	*rs;
+
+	TAILQ_FOREACH(rs, &rtrs, entry)
+		rs->reconf = RECONF_DELETE;
+
+	while ((rc = SIMPLEQ_FIRST(rh)) != NULL) {
+		SIMPLEQ_REMOVE_HEAD(rh, entry);
+		TAILQ_FOREACH(rs, &rtrs, entry)
+			if (memcmp(&rs->conf.remote_addr, &rc->remote_addr,
+			    sizeof(rc->remote_addr)) == 0 &&
+			    rs->conf.remote_port == rc->remote_port)
+				break;
+		if (rs == NULL)
+			rtr_new(rc);
+		else {
+			strlcpy(rs->conf.descr, rc->descr,
+			    sizeof(rs->conf.descr));
+			rs->reconf = RECONF_KEEP;
+		}
+		free(rc);
+	}
+}
+
+u_int
+rtr_count(void)
+{
+	return (rtr_cnt);
+}
+
+/*
+ * Run the timers and fill in the pollfds, returns the number of pollfds
+ * used. timeout is lowered to the next timer.
+ */
+u_int
+rtr_poll_events(struct pollfd *pfds, u_int npfds, int *timeout)
+{
+	struct rtr_session	*rs, *next;
+	time_t			 now;
+	u_int			 i = 0;
+
+	now = getmonotime();
+	TAILQ_FOREACH_SAFE(rs, &rtrs, entry, next) {
+		rs->pfd = NULL;
+		if (rs->reconf == RECONF_DELETE) {
+			rtr_free(rs);
+			continue;
+		}
+
+		if (rs->expire_at != 0 && rs->expire_at <= now) {
+			log_warnx("rtr %s: data expired", log_rtr(rs));
+			rtr_flush(rs);
+			rs->have_serial = 0;
+			rs->expire_at = 0;
+		}
+		if (rs->next <= now) {
+			switch (rs->state) {
+			case RTR_STATE_CLOSED:
+				rtr_connect(rs, now);
+				break;
+			case RTR_STATE_CONNECT:
+			case RTR_STATE_ACTIVE:
+				log_warnx("rtr %s: timeout", log_rtr(rs));
+				rtr_close(rs);
+				break;
+			case RTR_STATE_IDLE:
+				rtr_send_query(rs);
+				break;
+			}
+		}
+
+		if (rs->next - now < *timeout)
+			*timeout = rs->next - now;
+		if (rs->expire_at != 0 && rs->expire_at - now < *timeout)
+			*timeout = rs->expire_at - now;
+
+		if (rs->wbuf.fd == -1 || i >= npfds)
+			continue;
+		pfds[i].fd = rs->wbuf.fd;
+		pfds[i].events = POLLIN;
+		if (rs->state == RTR_STATE_CONNECT || rs->wbuf.queued > 0)
+			pfds[i].events |= POLLOUT;
+		rs->pfd = &pfds[i++];
+	}
+	return (i);
+}
+
+void
+rtr_check_events(void)
+{
+	struct rtr_session	*rs;
+
+	TAILQ_FOREACH(rs, &rtrs, entry) {
+		if (rs->pfd == NULL || rs->pfd->revents == 0)
+			continue;
+		rtr_dispatch(rs, rs->pfd->revents);
+	}
+}
+
+void
+rtr_show(struct imsgbuf *ibuf, pid_t pid)
+{
+	struct rtr_session	*rs;
+	struct ctl_show_rtr	 msg;
+	time_t			 now;
+
+	now = getmonotime();
+	TAILQ_FOREACH(rs, &rtrs, entry) {
+		memset(&msg, 0, sizeof(msg));
+		strlcpy(msg.descr, rs->conf.descr, sizeof(msg.descr));
+		strlcpy(msg.state, rtr_statenames[rs->state],
+		    sizeof(msg.state));
+		msg.remote_addr = rs->conf.remote_addr;
+		msg.remote_port = rs->conf.remote_port;
+		msg.last_update = rs->last_update ? now - rs->last_update : -1;
+		msg.serial = rs->serial;
+		msg.refresh = rs->refresh;
+		msg.retry = rs->retry;
+		msg.expire = rs->expire;
+		msg.vrp_v4 = rs->vrp_v4;
+		msg.vrp_v6 = rs->vrp_v6;
+		msg.updates = rs->updates;
+		msg.update_ms = rs->update_ms;
+		msg.session_id = rs->session_id;
+		msg.version = rs->version;
+		msg.have_serial = rs->have_serial;
+		imsg_compose(ibuf, IMSG_CTL_SHOW_RTR, 0, pid, -1,
+		    &msg, sizeof(msg));
+	}
+}
+
+void
+rtr_shutdown(void)
+{
+	struct rtr_session	*rs;
+
+	while ((rs = TAILQ_FIRST(&rtrs)) != NULL) {
+		TAILQ_REMOVE(&rtrs, rs, entry);
+		rtr_close(rs);
+		vrp_tree_free(&rs->vrps);
+		free(rs);
+	}
+	vrp_tree_free(&vrp_merged);
+	rtr_cnt = 0;
+}
@@ -55,6 +55,7 @@
 #define PFD_LISTENERS_START	5
 
 void	session_sighdlr(int);
+int	session_log_writer(int, const char *);
 int	setup_listeners(u_int *);
 void	init_peer(struct peer *);
 void	start_timer_holdtime(struct peer *);
@@ -91,7 +92,6 @@ int	capa_neg_calc(struct peer *);
 void	session_dispatch_imsg(struct imsgbuf *, int, u_int *);
 void	session_up(struct peer *);
 void	session_down(struct peer *);
-int	imsg_rde(int, u_int32_t, void *, u_int16_t);
 void	session_demote(struct peer *, int);
 void	merge_peers(struct bgpd_config *, struct bgpd_config *);
 
@@ -132,6 +132,23 @@ session_sighdlr(int sig)
 	}
 }
 
+/* pass a queued log message to the parent which writes it out */
+int
+session_log_writer(int pri, const char *msg)
+{
+	struct ibuf	*wbuf;
+	size_t		 len = strlen(msg) + 1;
+
+	if ((wbuf = imsg_create(ibuf_main, IMSG_LOG, 0, 0,
+	    sizeof(pri) + len)) == NULL)
+		return (-1);
+	if (imsg_add(wbuf, &pri, sizeof(pri)) == -1 ||
+	    imsg_add(wbuf, msg, len) == -1)
+		return (-1);
+	imsg_close(ibuf_main, wbuf);
+	return (0);
+}
+
 int
 setup_listeners(u_int *la_cnt)
 {
@@ -189,8 +206,9 @@ session_main(int debug, int verbose)
 {
 	int			 timeout;
 	unsigned int		 i, j, idx_peers, idx_listeners, idx_mrts;
+	unsigned int		 idx_rtrs;
 	u_int			 pfd_elms = 0, peer_l_elms = 0, mrt_l_elms = 0;
-	u_int			 listener_cnt, ctl_cnt, mrt_cnt;
+	u_int			 listener_cnt, ctl_cnt, mrt_cnt, rtr_cnt;
 	u_int			 new_cnt;
 	struct passwd		*pw;
 	struct peer		*p, **peer_l = NULL, *next;
@@ -236,6 +254,7 @@ session_main(int debug, int verbose)
 	if ((ibuf_main = malloc(sizeof(struct imsgbuf))) == NULL)
 		fatal(NULL);
 	imsg_init(ibuf_main, 3);
+	log_queue_init(session_log_writer);
 
 	TAILQ_INIT(&ctl_conns);
 	LIST_INIT(&mrthead);
@@ -323,8 +342,9 @@ session_main(int debug, int verbose)
 			mrt_l_elms = mrt_cnt;
 		}
 
+		rtr_cnt = rtr_count();
 		new_cnt = PFD_LISTENERS_START + listener_cnt + peer_cnt +
-		    ctl_cnt + mrt_cnt;
+		    ctl_cnt + mrt_cnt + rtr_cnt;
 		if (new_cnt > pfd_elms) {
 			if ((newp = reallocarray(pfd, new_cnt,
 			    sizeof(struct pollfd))) == NULL) {
@@ -339,6 +359,7 @@ session_main(int debug, int verbose)
 
 		bzero(pfd, sizeof(struct pollfd) * pfd_elms);
 
+		log_flush();
 		set_pollfd(&pfd[PFD_PIPE_MAIN], ibuf_main);
 		set_pollfd(&pfd[PFD_PIPE_ROUTE], ibuf_rde);
 		set_pollfd(&pfd[PFD_PIPE_ROUTE_CTL], ibuf_rde_ctl);
@@ -438,6 +459,10 @@ session_main(int debug, int verbose)
 
 		idx_mrts = i;
 
+		i += rtr_poll_events(&pfd[i], rtr_cnt, &timeout);
+
+		idx_rtrs = i;
+
 		TAILQ_FOREACH(ctl_conn, &ctl_conns, entry) {
 			pfd[i].fd = ctl_conn->ibuf.fd;
 			pfd[i].events = POLLIN;
@@ -446,6 +471,14 @@ session_main(int debug, int verbose)
 			i++;
 		}
 
+		if (TRACE_ON(TRACE_IMSG)) {
+			trace_value(TRACE_EV_IMSG, 0, PFD_PIPE_MAIN,
+			    ibuf_main->w.queued);
+			if (ibuf_rde != NULL)
+				trace_value(TRACE_EV_IMSG, 0, PFD_PIPE_ROUTE,
+				    ibuf_rde->w.queued);
+		}
+
 		if (pauseaccept && timeout > 1)
 			timeout = 1;
 		if (timeout < 0)
@@ -510,10 +543,16 @@ session_main(int debug, int verbose)
 			if (pfd[j].revents & POLLOUT)
 				mrt_write(mrt_l[j - idx_peers]);
 
+		rtr_check_events();
+		j = idx_rtrs;
+
 		for (; j < i; j++)
 			control_dispatch_msg(&pfd[j], &ctl_cnt, &conf->peers);
 	}
 
+	log_queue_done();
+	rtr_shutdown();
+
 	RB_FOREACH_SAFE(p, peer_head, &conf->peers, next) {
 		RB_REMOVE(peer_head, &conf->peers, p);
 		strlcpy(p->conf.reason,
@@ -1552,6 +1591,15 @@ session_update(u_int32_t peerid, void *data, size_t datalen)
 		return;
 	}
 
+	/* the message left the RDE pipe, return the credit in batches */
+	if (++p->credit_ret >= RDE_PEER_CREDIT_BATCH) {
+		if (imsg_rde(IMSG_UPDATE_CREDIT, p->conf.id, &p->credit_ret,
+		    sizeof(p->credit_ret)) == -1)
+			log_peer_warn(&p->conf, "imsg_compose UPDATE_CREDIT");
+		else
+			p->credit_ret = 0;
+	}
+
 	if (p->state != STATE_ESTABLISHED)
 		return;
 
@@ -2190,6 +2238,25 @@ parse_update(struct peer *peer)
 	p += MSGSIZE_HEADER;	/* header is already checked */
 	datalen -= MSGSIZE_HEADER;
 
+	TRACE_VALUE(TRACE_UPDATE, TRACE_EV_UPDATE, peer->conf.id, 0, datalen);
+
+	/* timestamp some UPDATEs so the RDE can measure its latency */
+	if (peer->stats.msg_rcvd_update % LATENCY_SAMPLE == 0 &&
+	    ibuf_rde != NULL) {
+		struct ibuf	*wbuf;
+		struct timespec	 ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if ((wbuf = imsg_create(ibuf_rde, IMSG_UPDATE_SAMPLE,
+		    peer->conf.id, 0, sizeof(ts) + datalen)) == NULL)
+			return (-1);
+		if (imsg_add(wbuf, &ts, sizeof(ts)) == -1 ||
+		    imsg_add(wbuf, p, datalen) == -1)
+			return (-1);
+		imsg_close(ibuf_rde, wbuf);
+		return (0);
+	}
+
 	if (imsg_rde(IMSG_UPDATE, peer->conf.id, p, datalen) == -1)
 		return (-1);
 
@@ -2582,6 +2649,7 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 	struct imsgbuf		*i;
 	struct peer		*p;
 	struct listen_addr	*la, *nla;
+	struct rtr_config	*rtr;
 	struct kif		*kif;
 	u_char			*data;
 	int			 n, fd, depend_ok, restricted;
@@ -2681,6 +2749,19 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 				la->reconf = RECONF_KEEP;
 			}
 
+			break;
+		case IMSG_RECONF_RTR_CONFIG:
+			if (idx != PFD_PIPE_MAIN)
+				fatalx("reconf request not from parent");
+			if (nconf == NULL)
+				fatalx("IMSG_RECONF_RTR_CONFIG but no config");
+			if (imsg.hdr.len - IMSG_HEADER_SIZE !=
+			    sizeof(struct rtr_config))
+				fatalx("IMSG_RECONF_RTR_CONFIG bad len");
+			if ((rtr = malloc(sizeof(*rtr))) == NULL)
+				fatal(NULL);
+			memcpy(rtr, imsg.data, sizeof(*rtr));
+			SIMPLEQ_INSERT_TAIL(&nconf->rtrs, rtr, entry);
 			break;
 		case IMSG_RECONF_CTRL:
 			if (idx != PFD_PIPE_MAIN)
@@ -2736,6 +2817,7 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 			    entry);
 
 			setup_listeners(listener_cnt);
+			rtr_config_merge(&nconf->rtrs);
 			free_config(nconf);
 			nconf = NULL;
 			pending_reconf = 0;
@@ -2788,6 +2870,7 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 				LIST_INSERT_HEAD(&mrthead, mrt, entry);
 			} else {
 				/* old dump reopened */
+				mrt_dropped(mrt);
 				close(mrt->wbuf.fd);
 				mrt->wbuf.fd = xmrt.wbuf.fd;
 			}
@@ -2817,8 +2900,12 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 		case IMSG_CTL_SHOW_RIB_PREFIX:
 		case IMSG_CTL_SHOW_RIB_COMMUNITIES:
 		case IMSG_CTL_SHOW_RIB_ATTR:
+		case IMSG_CTL_SHOW_RIB_BULK:
 		case IMSG_CTL_SHOW_RIB_MEM:
 		case IMSG_CTL_SHOW_RIB_HASH:
+		case IMSG_CTL_SHOW_RIB_STATS:
+		case IMSG_CTL_SHOW_RIB_PEERSTATS:
+		case IMSG_CTL_TRACE_DUMP:
 		case IMSG_CTL_SHOW_NETWORK:
 		case IMSG_CTL_SHOW_NEIGHBOR:
 			if (idx != PFD_PIPE_ROUTE_CTL)
@@ -2927,6 +3014,25 @@ session_dispatch_imsg(struct imsgbuf *ibuf, int idx, u_int *listener_cnt)
 			}
 			session_stop(p, ERR_CEASE_ADMIN_DOWN);
 			break;
+		case IMSG_REFRESH:
+			if (idx != PFD_PIPE_ROUTE)
+				fatalx("route refresh request not from RDE");
+			if (imsg.hdr.len < IMSG_HEADER_SIZE + sizeof(aid)) {
+				log_warnx("RDE sent invalid refresh msg");
+				break;
+			}
+			if ((p = getpeerbyid(conf, imsg.hdr.peerid)) == NULL) {
+				log_warnx("no such peer: id=%u",
+				    imsg.hdr.peerid);
+				break;
+			}
+			memcpy(&aid, imsg.data, sizeof(aid));
+			if (aid >= AID_MAX)
+				fatalx("IMSG_REFRESH: bad AID");
+			if (p->state == STATE_ESTABLISHED &&
+			    p->capa.neg.refresh && p->capa.neg.mp[aid])
+				session_rrefresh(p, aid);
+			break;
 		default:
 			break;
 		}
@@ -3146,6 +3252,7 @@ session_up(struct peer *p)
 {
 	struct session_up	 sup;
 
+	p->credit_ret = 0;
 	if (imsg_rde(IMSG_SESSION_ADD, p->conf.id,
 	    &p->conf, sizeof(p->conf)) == -1)
 		fatalx("imsg_compose error");
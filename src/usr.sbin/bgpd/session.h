@@ -141,9 +141,11 @@ struct bgpd_sysdep {
 struct ctl_conn {
 	TAILQ_ENTRY(ctl_conn)	entry;
 	struct imsgbuf		ibuf;
+	struct trace_cursor	trace;
 	int			restricted;
 	int			throttled;
 	int			terminate;
+	int			tracing;
 };
 
 TAILQ_HEAD(ctl_conns, ctl_conn)	ctl_conns;
@@ -165,16 +167,24 @@ struct peer_stats {
 	unsigned long long	 prefix_sent_update;
 	unsigned long long	 prefix_sent_withdraw;
 	unsigned long long	 prefix_sent_eor;
+	unsigned long long	 prefix_suppressed;
+	unsigned long long	 prefix_damp_absorbed;
 	time_t			 last_updown;
 	time_t			 last_read;
 	time_t			 last_write;
 	u_int32_t		 prefix_cnt;
 	u_int32_t		 prefix_out_cnt;
+	u_int32_t		 pending_update;
+	u_int32_t		 pending_withdraw;
+	u_int32_t		 pending_credit;
+	u_int32_t		 drain_rate;	/* prefixes per second */
+	u_int32_t		 prefix_damp_cnt;
 	u_int8_t		 last_sent_errcode;
 	u_int8_t		 last_sent_suberr;
 	u_int8_t		 last_rcvd_errcode;
 	u_int8_t		 last_rcvd_suberr;
 	char			 last_reason[REASON_LEN];
+	struct latency_hist	 latency[LAT_MAX];
 };
 
 enum Timer {
@@ -225,6 +235,7 @@ struct peer {
 	u_int			 errcnt;
 	u_int			 IdleHoldTime;
 	u_int32_t		 remote_bgpid;
+	u_int32_t		 credit_ret;	/* UPDATE credit owed to RDE */
 	enum session_state	 state;
 	enum session_state	 prev_state;
 	enum reconf_action	 reconf_action;
@@ -300,6 +311,14 @@ void	print_config(struct bgpd_config *, struct rib_names *);
 /* rde.c */
 void	 rde_main(int, int);
 
+/* rtr.c */
+void	 rtr_config_merge(struct rtr_config_head *);
+u_int	 rtr_count(void);
+u_int	 rtr_poll_events(struct pollfd *, u_int, int *);
+void	 rtr_check_events(void);
+void	 rtr_show(struct imsgbuf *, pid_t);
+void	 rtr_shutdown(void);
+
 /* session.c */
 RB_PROTOTYPE(peer_head, peer, entry, peer_compare);
 
@@ -312,6 +331,7 @@ struct peer	*getpeerbyid(struct bgpd_config *, u_int32_t);
 int		 peer_matched(struct peer *, struct ctl_neighbor *);
 int		 imsg_ctl_parent(int, u_int32_t, pid_t, void *, u_int16_t);
 int		 imsg_ctl_rde(int, pid_t, void *, u_int16_t);
+int		 imsg_rde(int, u_int32_t, void *, u_int16_t);
 void		 session_stop(struct peer *, u_int8_t);
 
 /* timer.c */
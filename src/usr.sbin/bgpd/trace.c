@@ -0,0 +1,152 @@
+/*	$OpenBSD$ */
+
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bgpd.h"
+#include "log.h"
+
+/*
+ * Per process trace ring. The tracepoints check trace_mask inline so a
+ * disabled class costs one load and branch. The ring is allocated the
+ * first time tracing is enabled and kept afterwards so that it can still
+ * be dumped after tracing was turned off again.
+ */
+
+u_int32_t			 trace_mask;
+static struct trace_event	*trace_ring;
+static u_int32_t		 trace_next;
+static int			 trace_wrapped;
+static u_int8_t			 trace_proc;
+
+void
+trace_set(u_int32_t mask, enum bgpd_process proc)
+{
+	mask &= TRACE_ALL;
+	if (mask != 0 && trace_ring == NULL) {
+		trace_ring = calloc(TRACE_RING_SIZE, sizeof(*trace_ring));
+		if (trace_ring == NULL) {
+			log_warn("%s", __func__);
+			mask = 0;
+		}
+	}
+	trace_proc = proc;
+	trace_mask = mask;
+}
+
+static struct trace_event *
+trace_get(enum trace_type type, u_int32_t peerid)
+{
+	struct trace_event	*ev;
+	struct timespec		 ts;
+
+	ev = &trace_ring[trace_next];
+	if (++trace_next == TRACE_RING_SIZE) {
+		trace_next = 0;
+		trace_wrapped = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	memset(ev, 0, sizeof(*ev));
+	ev->time = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	ev->peerid = peerid;
+	ev->type = type;
+	ev->proc = trace_proc;
+	return (ev);
+}
+
+void
+trace_value(enum trace_type type, u_int32_t peerid, u_int64_t data,
+    u_int32_t value)
+{
+	struct trace_event	*ev;
+
+	ev = trace_get(type, peerid);
+	ev->data = data;
+	ev->value = value;
+}
+
+void
+trace_prefix(enum trace_type type, u_int32_t peerid, struct bgpd_addr *addr,
+    u_int8_t prefixlen, u_int32_t value)
+{
+	struct trace_event	*ev;
+
+	ev = trace_get(type, peerid);
+	ev->aid = addr->aid;
+	ev->prefixlen = prefixlen;
+	ev->value = value;
+
+	switch (addr->aid) {
+	case AID_INET:
+		memcpy(&ev->data, &addr->v4, sizeof(addr->v4));
+		break;
+	case AID_INET6:
+		memcpy(&ev->data, &addr->v6, sizeof(ev->data));
+		break;
+	case AID_VPN_IPv4:
+		memcpy(&ev->data, &addr->vpn4.addr, sizeof(addr->vpn4.addr));
+		break;
+	case AID_VPN_IPv6:
+		memcpy(&ev->data, &addr->vpn6.addr, sizeof(ev->data));
+		break;
+	}
+}
+
+void
+trace_dump_start(struct trace_cursor *tc)
+{
+	if (trace_ring == NULL) {
+		tc->start = 0;
+		tc->cnt = 0;
+	} else if (trace_wrapped) {
+		tc->start = trace_next;
+		tc->cnt = TRACE_RING_SIZE;
+	} else {
+		tc->start = 0;
+		tc->cnt = trace_next;
+	}
+}
+
+/*
+ * Send up to max chunks of the ring oldest event first as
+ * IMSG_CTL_TRACE_DUMP messages. Returns 1 if events are left, else the
+ * caller needs to terminate the reply. Events recorded while the dump
+ * runs may replace older ones not sent yet.
+ */
+int
+trace_dump(struct imsgbuf *ibuf, pid_t pid, struct trace_cursor *tc,
+    u_int max)
+{
+	u_int32_t	n;
+
+	for (; tc->cnt > 0 && max > 0; max--) {
+		n = tc->cnt < TRACE_DUMP_CHUNK ? tc->cnt : TRACE_DUMP_CHUNK;
+		if (tc->start + n > TRACE_RING_SIZE)
+			n = TRACE_RING_SIZE - tc->start;
+		if (imsg_compose(ibuf, IMSG_CTL_TRACE_DUMP, 0, pid, -1,
+		    &trace_ring[tc->start], n * sizeof(*trace_ring)) == -1) {
+			tc->cnt = 0;
+			break;
+		}
+		tc->start = (tc->start + n) % TRACE_RING_SIZE;
+		tc->cnt -= n;
+	}
+	return (tc->cnt > 0);
+}
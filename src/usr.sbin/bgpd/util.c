@@ -32,8 +32,6 @@
 #include "rde.h"
 #include "log.h"
 
-const char	*aspath_delim(u_int8_t, int);
-
 const char *
 log_addr(const struct bgpd_addr *addr)
 {